@@ -0,0 +1,70 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Turn on/off aggregation of samples into windows that are reported only when something has changed
+#define AGGREGATION             true
+
+// The reasons for which a report is due, as returned by aggregateAdd().  The first two are immediate, and
+// are raised by the sample that caused them without waiting for the window to close.
+#define AGGREGATE_THRESHOLD     0x01    // The value moved into a different band of the thresholds
+#define AGGREGATE_RATE          0x02    // The value changed faster than the configured rate
+#define AGGREGATE_WINDOW        0x04    // The window closed with a mean outside the deadband
+#define AGGREGATE_HEARTBEAT     0x08    // The window closed and nothing has been reported for too long
+#define AGGREGATE_IMMEDIATE     (AGGREGATE_THRESHOLD|AGGREGATE_RATE)
+
+// How a signal is to be aggregated.  Any trigger whose value is zero is disabled.
+typedef struct {
+    uint32_t windowMs;          // How long each window accumulates samples
+    uint32_t heartbeatMs;       // The longest to go without reporting, checked as each window closes
+    float deadband;             // How far a window's mean must move from the last reported mean
+    float ratePerSec;           // How fast the value must change between successive samples
+    bool thresholds;            // Whether low and high are to be used
+    float low;                  // Crossing below this, or back above it, is reported immediately
+    float high;                 // Crossing above this, or back below it, is reported immediately
+} aggregateConfig;
+
+// The statistics of a window
+typedef struct {
+    uint32_t count;
+    float min;
+    float max;
+    float mean;
+    float variance;             // Sample variance, or zero if there are fewer than two samples
+    uint32_t startMs;
+    uint32_t endMs;
+} aggregateSummary;
+
+// The state of a signal being aggregated
+typedef struct {
+    aggregateConfig config;
+    // The current window, whose mean and sum of squared deviations are maintained by Welford's method
+    uint32_t count;
+    float min;
+    float max;
+    float mean;
+    float m2;
+    uint32_t startMs;
+    uint32_t lastMs;
+    bool closed;
+    // The previous sample, for the rate of change
+    bool havePrevious;
+    float previous;
+    uint32_t previousMs;
+    // The band of the thresholds that the value was last in (-1 below, 0 between, 1 above)
+    int8_t band;
+    // The last report
+    bool reported;
+    float reportedMean;
+    uint32_t reportedMs;
+} aggregator;
+
+// Public
+void aggregateInit(aggregator *agg, const aggregateConfig *config, uint32_t nowMs);
+int aggregateAdd(aggregator *agg, float value, uint32_t nowMs);
+bool aggregateFlush(aggregator *agg, aggregateSummary *summary, uint32_t nowMs);
@@ -0,0 +1,31 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "note.h"
+
+// Turn on/off keeping state in the TAMP backup registers, which survive a system reset and every low
+// power mode, and are cleared only when the backup domain loses power.
+#define BACKUP_REGISTERS        true
+
+// Allocation of the five 32-bit backup registers.  A register that reads as zero holds nothing.
+#define BACKUP_TEMPLATE_FIRST   0       // Two template registrations, of two registers each
+#define BACKUP_TEMPLATE_ENTRIES 2
+#define BACKUP_CONFIG           4       // The fingerprint of the configuration last applied to the Notecard
+#define BACKUP_REGISTER_COUNT   5
+
+// When the fingerprint of the configuration matches the one saved, whether to confirm with a single hub.get
+// that the Notecard still has it, which catches a Notecard that was reconfigured or swapped while we kept
+// power, or to trust the fingerprint and skip the transaction altogether.
+#ifndef BACKUP_CONFIG_VERIFY
+#define BACKUP_CONFIG_VERIFY    false
+#endif
+
+// Public
+void backupTemplateSave(const NoteTemplateEntry *entries, int count);
+int backupTemplateRestore(NoteTemplateEntry *entries, int maxEntries);
+bool backupConfigure(J *req);
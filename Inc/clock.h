@@ -0,0 +1,41 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Turn on/off scaling of the system clock to suit what the Notecard library is doing
+#define CLOCK_SCALING           true
+
+// Clock modes.  The normal mode is SYSCLK at 16MHz directly from HSI16.  Boost runs SYSCLK at 64MHz from
+// the PLL, which needs two flash wait states, and low power divides HSI16 by 8 to run SYSCLK at 2MHz with
+// the regulator in Low-power Run mode.  The USART and I2C kernel clocks are taken from HSI16 itself, which
+// is not divided, so their timing is the same in every mode.
+#define CLOCK_LOWPOWER          0
+#define CLOCK_NORMAL            1
+#define CLOCK_BOOST             2
+#define CLOCK_MODES             3
+
+// Typical supply current in each mode when running from flash, from the STM32G031 datasheet, used only
+// to estimate the energy spent, at a nominal supply voltage.
+#define CLOCK_LOWPOWER_UA       230
+#define CLOCK_NORMAL_UA         1900
+#define CLOCK_BOOST_UA          6100
+#define CLOCK_SUPPLY_MV         3300
+
+// Time spent in each mode, in time base ticks, and the number of switches into it
+typedef struct {
+    uint64_t ticks[CLOCK_MODES];
+    uint32_t switches[CLOCK_MODES];
+} clockResidency;
+
+// Public
+void clockSet(int mode);
+int clockMode(void);
+void clockPhase(int phase);
+void clockGetResidency(clockResidency *residency);
+void clockResetResidency(void);
+uint32_t clockEnergyUJ(const clockResidency *residency);
@@ -13,6 +13,23 @@
 
 #define EVENT_TIMER         0x00000001
 #define EVENT_BUTTON        0x00000002
+#define EVENT_ATTN          0x00000004
+
+// Number of event records that can be queued by ISRs awaiting the app (a power of 2)
+#define EVENT_QUEUE_DEPTH   16
+#if (EVENT_QUEUE_DEPTH & (EVENT_QUEUE_DEPTH - 1)) != 0
+#error "EVENT_QUEUE_DEPTH must be a power of two, so that the free-running counts index the queue across their wrap"
+#endif
+
+// Number of bytes of the Notecard debug log written out at a time while idle, when NOTE_LOG is defined
+#define EVENT_LOG_DRAIN_BYTES   64
+
+// A record of an event posted by an ISR
+typedef struct {
+    uint32_t ms;            // When it happened, per MY_TimerMs()
+    uint32_t event;         // Which event it was
+    uint32_t data;          // Source-specific data, such as the GPIO pin
+} eventRecord;
 
 // Public
 void eventPollTimer(void);
@@ -20,6 +37,9 @@ bool eventWait(uint32_t events, uint32_t timeoutMs);
 uint32_t eventOccurred(void);
 void event(uint32_t event);
 void eventClear(uint32_t event);
+bool eventPost(uint32_t event, uint32_t data);
+bool eventGet(eventRecord *rec);
+uint32_t eventDropped(void);
 
 #endif  // EVENTS
 
@@ -31,6 +51,15 @@ void eventClear(uint32_t event);
 #define GPIO_BUTTON_IRQ             EXTI4_15_IRQn
 #endif
 
+// If we wait for the Notecard's ATTN pin to tell us that an inbound note has arrived, this defines the GPIO
+// to which it's wired.  Arming the Notecard drives ATTN low, and it rises when a note arrives.
+#ifdef EVENT_ATTN
+#define GPIO_ATTN_CLOCK_ENABLE      __HAL_RCC_GPIOB_CLK_ENABLE
+#define GPIO_ATTN_PORT              GPIOB
+#define GPIO_ATTN_PIN               GPIO_PIN_5
+#define GPIO_ATTN_IRQ               EXTI4_15_IRQn
+#endif
+
 #if EVENT_SLEEP_LED
 #define GPIO_LED_ENABLE             __HAL_RCC_GPIOC_CLK_ENABLE
 #define GPIO_LED_PORT               GPIOC
@@ -44,8 +44,32 @@ bool MY_Debug(void);
 void MY_Sleep_DeInit(void);
 
 #include "event.h"
+#include "clock.h"
+#if CLOCK_SCALING
+void MY_ClockSwitch(int from, int to);
+#endif
+#include "backup.h"
+#if BACKUP_REGISTERS
+uint32_t MY_BackupRead(int index);
+void MY_BackupWrite(int index, uint32_t value);
+#endif
+#include "sensor.h"
+#if SENSORS
+void MY_SensorStart(uint16_t *ring, uint32_t count, uint32_t scanHz);
+void MY_SensorStop(void);
+void MY_SensorIdle(void);
+void MY_SensorCalibration(sensorCalibration *cal);
+void MY_SensorIRQHandler(void);
+#endif
+#include "power.h"
+#if POWER_MANAGEMENT
+void MY_PowerStandby(uint32_t ms);
+bool MY_PowerWokeFromStandby(void);
+#endif
 #ifdef EVENT_TIMER
 uint32_t MY_TimerMs(void);
+uint16_t MY_TimerCounter(bool *overflowPending);
+void MY_TimerSetCompare(uint16_t ticks);
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,80 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Turn on/off choosing the depth of each sleep, rather than always using STOP1
+#define POWER_MANAGEMENT        true
+
+// Turn on/off letting the Notecard cut the power to the host for long sleeps.  This needs the Notecarrier
+// to be wired so that the Notecard's ATTN pin switches the host's power, in which case ATTN can't also be
+// wired to a GPIO, and EVENT_ATTN must not be defined in event.h.
+#define POWER_NOTECARD_OFF      false
+
+// Sleep modes, from the shallowest to the deepest.  Sleep and LP Sleep stop only the CPU, the latter after
+// dropping SYSCLK to 2MHz in Low-power Run mode.  STOP0 and STOP1 stop every clock but the LSI, with the main
+// and low-power regulator respectively.  Standby powers down the core, keeping SRAM but restarting from reset,
+// and is woken by the RTC.  Off has the Notecard cut the host's power entirely, waking it by restoring it.
+#define POWER_SLEEP             0
+#define POWER_LPSLEEP           1
+#define POWER_STOP0             2
+#define POWER_STOP1             3
+#define POWER_STANDBY           4
+#define POWER_OFF               5
+#define POWER_MODES             6
+
+// What a sleep needs of the mode that is chosen for it
+#define POWER_NEEDS_EXTI        0x01    // To be woken by a GPIO, which rules out Standby and Off
+#define POWER_NEEDS_CLOCKS      0x02    // Peripheral clocks kept running, which rules out every STOP mode
+
+// A sleep with no deadline, which only an event can end
+#define POWER_FOREVER           0xFFFFFFFFUL
+
+// The nominal supply voltage, for turning current into energy
+#define POWER_SUPPLY_MV         3300
+
+// The app state that is kept across a mode that restarts from reset is registered as regions of a Notecard
+// library snapshot, with NoteSnapshotRegister.  The version of the app's schema of that state is recorded in
+// each snapshot, and the power module registers a region of its own under an identifier that the app must
+// not use.  For Standby the snapshot is kept in SRAM, in a buffer of this many characters, and for Off it is
+// sent to the Notecard as the payload of card.attn.
+#define POWER_STATE_VERSION     1
+#define POWER_SNAPSHOT_ID       255
+#define POWER_SNAPSHOT_LEN      384
+
+// How long to wait for the Notecard to cut the power before concluding that it isn't wired to do so
+#define POWER_OFF_TIMEOUT_MS    5000
+
+// The cost of each mode.  Currents are typical at 25C, from the STM32G031 datasheet, including the LSI and
+// LPTIM1 or RTC where the mode needs them.  The transition is the energy spent going into and out of the
+// mode beyond that of the sleep itself, which for the STOP modes is reinitializing the Notecard's bus, for
+// Standby is booting and running setup(), and for Off is also the card.attn transactions to go to sleep and
+// to recover the state.  A mode can't be used for a sleep shorter than its minimum.
+typedef struct {
+    uint32_t currentNA;
+    uint32_t wakeUs;
+    uint32_t transitionUJ;
+    uint32_t minMs;
+    bool retainsState;          // Whether execution resumes where it left off
+} powerModel;
+
+// Time spent in each mode, and the number of times that it was entered
+typedef struct {
+    uint64_t ms[POWER_MODES];
+    uint32_t entries[POWER_MODES];
+} powerResidency;
+
+// Public
+const powerModel *powerModelOf(int mode);
+uint32_t powerCostUJ(int mode, uint32_t sleepMs);
+bool powerAllowed(int mode, uint32_t sleepMs, uint32_t needs);
+int powerSelect(uint32_t sleepMs, uint32_t needs);
+bool powerRestore(void);
+bool powerSuspend(int mode, uint32_t sleepMs);
+void powerAccount(int mode, uint32_t ms);
+void powerGetResidency(powerResidency *residency);
+uint32_t powerEnergyUJ(const powerResidency *residency);
@@ -0,0 +1,59 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Turn on/off sampling of the MCU's own ADC, in place of asking the Notecard for its temperature and voltage
+#define SENSORS                 true
+
+// The channels converted in each scan.  The ADC always converts the selected channels in ascending order of
+// channel number, which is therefore the order in which they appear within each scan in the ring.
+#define SENSOR_INPUT            0       // ADC_IN0, the external input on PA0 (A0 on the Nucleo header)
+#define SENSOR_TEMP             1       // ADC_IN12, the internal temperature sensor
+#define SENSOR_VREFINT          2       // ADC_IN13, the internal voltage reference
+#define SENSOR_CHANNELS         3
+
+// The number of scans held in the ring, and the rate at which the trigger timer starts each scan
+#define SENSOR_SCANS            8
+#define SENSOR_SCAN_HZ          1000
+
+// Each conversion is the sum of this many samples, accumulated by the ADC's hardware oversampler without
+// shifting, so that every value in the ring has 16 bits of which the low 4 are extra resolution.
+#define SENSOR_OVERSAMPLE       16
+#define SENSOR_FULL_SCALE       (4095*SENSOR_OVERSAMPLE)
+
+// How long to wait for the ring to be filled before concluding that the ADC isn't being triggered
+#define SENSOR_TIMEOUT_MS       100
+
+// The factory calibration values were measured with VDDA at 3.0V, and TS_CAL1 at 30C.  The G0 series has
+// no second temperature calibration point, so the sensor's typical slope from the datasheet is used.
+#define SENSOR_CAL_MV           3000
+#define SENSOR_TS_CAL1_C        30
+#define SENSOR_TS_SLOPE_UV      2500
+
+// Factory calibration values, as raw 12-bit conversions
+typedef struct {
+    uint16_t tsCal1;            // Temperature sensor at SENSOR_TS_CAL1_C
+    uint16_t vrefintCal;        // Internal voltage reference
+} sensorCalibration;
+
+// A calibrated reading
+typedef struct {
+    uint32_t raw[SENSOR_CHANNELS];  // Filtered value of each channel, in oversampled counts
+    int32_t vddaMv;                 // Analog supply voltage, in millivolts
+    int32_t tempCentiC;             // Die temperature, in hundredths of a degree C
+    int32_t inputMv;                // External input, in millivolts
+} sensorReading;
+
+// Public
+void sensorStart(void);
+void sensorStop(void);
+bool sensorRead(sensorReading *reading);
+bool sensorSample(sensorReading *reading);
+void sensorComplete(void);
+uint32_t sensorFilter(const uint16_t *ring, int scans, int channel);
+void sensorCalibrate(const sensorCalibration *cal, sensorReading *reading);
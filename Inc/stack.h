@@ -0,0 +1,21 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Turn on/off painting of the stack so that its high-water mark can be measured
+#define STACK_MONITOR           true
+
+// The word with which free memory is painted at boot, and how much of the stack below the current
+// frame is left unpainted so as not to overwrite the painter's own frame.
+#define STACK_PAINT             0xC5C5C5C5
+#define STACK_PAINT_MARGIN      64
+
+// Public
+void stackPaint(void);
+uint32_t stackUsed(void);
+uint32_t stackHeadroom(void);
@@ -0,0 +1,29 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The time base is LPTIM1 counting LSI ticks through its full 16-bit range, extended in software by
+// counting the number of times that the counter has wrapped.  The LSI runs at a nominal 32kHz, so a
+// tick is 31.25uS and there are exactly 32 ticks per millisecond.
+#define TIMEBASE_HZ                 32000
+#define TIMEBASE_COUNTER_BITS       16
+#define TIMEBASE_COUNTER_MAX        0xFFFF
+#define TIMEBASE_TICKS_PER_MS_SHIFT 5
+
+// Writes to the LPTIM1 compare register take effect a couple of ticks after they are made, so a
+// deadline that is closer than this to the current count may be passed before the compare is armed.
+#define TIMEBASE_COMPARE_MARGIN     3
+
+// Public
+uint64_t timebaseTicks(void);
+uint32_t timebaseMs(void);
+uint64_t timebaseUs(void);
+void timebaseResume(uint32_t ms);
+bool timebaseSetDeadline(uint32_t ms);
+void timebaseCancelDeadline(void);
+bool timebaseOverflow(void);
@@ -0,0 +1,124 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// This module sits between taking samples and adding notes, so that a note is sent only when there is
+// something to say.  Samples of a signal are accumulated into windows of a fixed duration, keeping only their
+// count, min, max, mean and variance, which are updated as each sample arrives so that no samples are kept.
+// When a window closes it is reported only if its mean has moved outside a deadband around the mean that
+// was last reported, or if nothing has been reported for longer than a heartbeat interval; otherwise it is
+// discarded, and a stable signal costs nothing but the occasional heartbeat.  Changes that shouldn't wait
+// for the window to close, which are the value crossing one of its thresholds or changing faster than a
+// given rate, make a report due immediately.
+// Several signals can be aggregated together, with a note for all of them sent when any one of them is due,
+// because a window that closes without being due isn't discarded until the next sample is added to it.
+// This is pure C, without access to any hardware, so that it can be exercised and benchmarked on a host.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "aggregate.h"
+
+#if AGGREGATION
+
+// Begin a new window
+static void aggregateOpen(aggregator *agg, uint32_t nowMs) {
+    agg->count = 0;
+    agg->min = agg->max = agg->mean = agg->m2 = 0;
+    agg->startMs = agg->lastMs = nowMs;
+    agg->closed = false;
+}
+
+// The band of the thresholds in which a value lies
+static int8_t aggregateBand(const aggregator *agg, float value) {
+    if (!agg->config.thresholds)
+        return 0;
+    if (value < agg->config.low)
+        return -1;
+    if (value > agg->config.high)
+        return 1;
+    return 0;
+}
+
+// Begin aggregating a signal
+void aggregateInit(aggregator *agg, const aggregateConfig *config, uint32_t nowMs) {
+    memset(agg, 0, sizeof(aggregator));
+    agg->config = *config;
+    aggregateOpen(agg, nowMs);
+}
+
+// Add a sample to the current window, returning the AGGREGATE_ reasons for which a report is due, if any.
+// When a report is due the caller should call aggregateFlush(); otherwise, if the window has closed, it is
+// discarded when the next sample is added.
+int aggregateAdd(aggregator *agg, float value, uint32_t nowMs) {
+    int reasons = 0;
+
+    // Discard a window that closed without anything to report
+    if (agg->closed)
+        aggregateOpen(agg, nowMs);
+
+    // Check the immediate triggers against the previous sample
+    int8_t band = aggregateBand(agg, value);
+    if (band != agg->band) {
+        agg->band = band;
+        reasons |= AGGREGATE_THRESHOLD;
+    }
+    if (agg->config.ratePerSec != 0 && agg->havePrevious) {
+        uint32_t elapsedMs = nowMs - agg->previousMs;
+        float change = value - agg->previous;
+        if (change < 0)
+            change = -change;
+        if (change * 1000 > agg->config.ratePerSec * (float) elapsedMs)
+            reasons |= AGGREGATE_RATE;
+    }
+    agg->havePrevious = true;
+    agg->previous = value;
+    agg->previousMs = nowMs;
+
+    // Accumulate the sample
+    agg->count++;
+    if (agg->count == 1 || value < agg->min)
+        agg->min = value;
+    if (agg->count == 1 || value > agg->max)
+        agg->max = value;
+    float delta = value - agg->mean;
+    agg->mean += delta / (float) agg->count;
+    agg->m2 += delta * (value - agg->mean);
+    agg->lastMs = nowMs;
+    if (reasons != 0)
+        return reasons;
+
+    // If the window has closed, see whether it should be reported
+    if ((uint32_t) (nowMs - agg->startMs) < agg->config.windowMs)
+        return 0;
+    agg->closed = true;
+    float moved = agg->mean - agg->reportedMean;
+    if (moved < 0)
+        moved = -moved;
+    if (!agg->reported || moved > agg->config.deadband)
+        return AGGREGATE_WINDOW;
+    if (agg->config.heartbeatMs != 0 && (uint32_t) (nowMs - agg->reportedMs) >= agg->config.heartbeatMs)
+        return AGGREGATE_HEARTBEAT;
+    return 0;
+}
+
+// Get the statistics of the current window and begin a new one, recording them as reported.  This returns
+// false, and leaves the summary untouched, if the window holds no samples.
+bool aggregateFlush(aggregator *agg, aggregateSummary *summary, uint32_t nowMs) {
+    if (agg->count == 0)
+        return false;
+    summary->count = agg->count;
+    summary->min = agg->min;
+    summary->max = agg->max;
+    summary->mean = agg->mean;
+    summary->variance = agg->count > 1 ? agg->m2 / (float) (agg->count - 1) : 0;
+    summary->startMs = agg->startMs;
+    summary->endMs = agg->lastMs;
+    agg->reported = true;
+    agg->reportedMean = agg->mean;
+    agg->reportedMs = nowMs;
+    aggregateOpen(agg, nowMs);
+    return true;
+}
+
+#endif // AGGREGATION
@@ -0,0 +1,113 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// This module keeps small amounts of state in the TAMP backup registers, so that it survives a reset without
+// wearing the flash.  There are only five registers, so each use of them is given a fixed allocation in
+// backup.h.  The hardware is accessed only through MY_BackupRead() and MY_BackupWrite().
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "main.h"
+#include "note.h"
+#include "backup.h"
+
+#if BACKUP_REGISTERS
+
+// Save the table of template registrations that the Notecard library keeps, as it changes
+void backupTemplateSave(const NoteTemplateEntry *entries, int count) {
+    for (int i=0; i<BACKUP_TEMPLATE_ENTRIES; i++) {
+        NoteTemplateEntry entry = {0};
+        if (i < count)
+            entry = entries[i];
+        int reg = BACKUP_TEMPLATE_FIRST + i*2;
+        if (MY_BackupRead(reg) != entry.fileHash)
+            MY_BackupWrite(reg, entry.fileHash);
+        if (MY_BackupRead(reg+1) != entry.templateHash)
+            MY_BackupWrite(reg+1, entry.templateHash);
+    }
+}
+
+// Read back the table of template registrations, returning the number of entries
+int backupTemplateRestore(NoteTemplateEntry *entries, int maxEntries) {
+    int count = 0;
+    for (int i=0; i<BACKUP_TEMPLATE_ENTRIES && i<maxEntries; i++) {
+        int reg = BACKUP_TEMPLATE_FIRST + i*2;
+        entries[i].fileHash = MY_BackupRead(reg);
+        entries[i].templateHash = MY_BackupRead(reg+1);
+        count++;
+    }
+    return count;
+}
+
+// Fingerprint a request with a 32-bit FNV-1a hash of its text, which is never zero so that zero can mean
+// that nothing has been saved
+static uint32_t backupHash(J *req) {
+    char *text = JPrintUnformatted(req);
+    if (text == NULL)
+        return 0;
+    uint32_t hash = 2166136261UL;
+    for (const char *p = text; *p != '\0'; p++) {
+        hash ^= (uint8_t) *p;
+        hash *= 16777619UL;
+    }
+    JFree(text);
+    return (hash == 0 ? 1 : hash);
+}
+
+// Whether the Notecard's hub configuration has the value of each argument of a hub.set request
+#if BACKUP_CONFIG_VERIFY
+static bool backupConfigVerify(J *req) {
+    J *rsp = NoteRequestResponse(NoteNewRequest("hub.get"));
+    if (rsp == NULL)
+        return false;
+    bool matches = !NoteResponseError(rsp);
+    for (J *arg = req->child; matches && arg != NULL; arg = arg->next) {
+        if (strcmp(arg->string, "req") == 0)
+            continue;
+        J *value = JGetObjectItem(rsp, arg->string);
+        if (value == NULL)
+            matches = false;
+        else if (JIsString(arg))
+            matches = JIsString(value) && strcmp(JStringValue(arg), JStringValue(value)) == 0;
+        else if (JIsNumber(arg))
+            matches = JIsNumber(value) && JNumberValue(arg) == JNumberValue(value);
+        else if (JIsBool(arg))
+            matches = JIsBool(value) && JIsTrue(arg) == JIsTrue(value);
+        else
+            matches = false;
+    }
+    NoteDeleteResponse(rsp);
+    return matches;
+}
+#endif
+
+// Apply a hub.set request, unless its fingerprint shows that it was already applied before a reset, in which
+// case it is freed without being sent.  A brown-out or watchdog reset leaves the backup domain, and so the
+// fingerprint, intact, while a power cycle clears it, so that a cold boot always configures the Notecard.
+// The fingerprint is saved only once the request has succeeded.  Returns false if the request failed.
+bool backupConfigure(J *req) {
+    if (req == NULL)
+        return false;
+    uint32_t hash = backupHash(req);
+    if (hash != 0 && MY_BackupRead(BACKUP_CONFIG) == hash) {
+#if BACKUP_CONFIG_VERIFY
+        if (backupConfigVerify(req)) {
+            JDelete(req);
+            return true;
+        }
+#else
+        JDelete(req);
+        return true;
+#endif
+    }
+    MY_BackupWrite(BACKUP_CONFIG, 0);
+    if (!NoteRequest(req))
+        return false;
+    if (hash != 0)
+        MY_BackupWrite(BACKUP_CONFIG, hash);
+    return true;
+}
+
+#endif // BACKUP_REGISTERS
@@ -0,0 +1,103 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// This module scales the system clock to suit what the Notecard library is doing.  Serializing requests,
+// parsing responses and base64 coding are bound by the CPU, so for those we boost SYSCLK to 64MHz and get
+// them over with quickly, and while we are waiting on the bus for the Notecard, when the CPU has nothing to
+// do but poll, we drop to 2MHz in Low-power Run mode.  The library tells us what it is doing through its
+// phase hook, which is called as each phase of a transaction begins and ends.
+// The low-power timer that is our time base is clocked by the LSI, and the USART and I2C kernel clocks by
+// HSI16, none of which are touched here, so neither time nor bus timing is affected by a switch.  The HAL
+// tick is derived from SYSCLK, and is re-derived after each switch.
+// The hardware is accessed only through MY_ClockSwitch(), and switches are always made to or from the normal
+// mode, so that the sequencing of flash wait states, PLL and regulator is kept simple.  Like the time base,
+// everything here can be exercised on a host against a simulated clock, which is how the residency that
+// we keep in each mode can be turned into an estimate of the energy spent on a transaction.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "main.h"
+#include "note.h"
+#include "clock.h"
+#include "timebase.h"
+
+#if CLOCK_SCALING
+
+// The mode that we're in, and when we entered it
+static int clockCurrent = CLOCK_NORMAL;
+#ifdef EVENT_TIMER
+static uint64_t clockEnteredTicks = 0;
+#endif
+
+// Time spent in each mode
+static clockResidency clockStats = {0};
+
+// The mode for each phase of a transaction, indexed by NOTE_PHASE_ value
+static const uint8_t clockPolicy[NOTE_PHASES] = {
+    [NOTE_PHASE_APP] = CLOCK_NORMAL,
+    [NOTE_PHASE_PRINT] = CLOCK_BOOST,
+    [NOTE_PHASE_IO] = CLOCK_LOWPOWER,
+    [NOTE_PHASE_PARSE] = CLOCK_BOOST,
+};
+
+// Account for the time spent in the current mode, up until now
+static void clockAccount() {
+#ifdef EVENT_TIMER
+    uint64_t now = timebaseTicks();
+    clockStats.ticks[clockCurrent] += now - clockEnteredTicks;
+    clockEnteredTicks = now;
+#endif
+}
+
+// Switch to a mode, by way of the normal mode if need be
+void clockSet(int mode) {
+    if (mode < 0 || mode >= CLOCK_MODES || mode == clockCurrent)
+        return;
+    clockAccount();
+    if (clockCurrent != CLOCK_NORMAL)
+        MY_ClockSwitch(clockCurrent, CLOCK_NORMAL);
+    if (mode != CLOCK_NORMAL)
+        MY_ClockSwitch(CLOCK_NORMAL, mode);
+    clockCurrent = mode;
+    clockStats.switches[mode]++;
+}
+
+// Get the current mode
+int clockMode() {
+    return clockCurrent;
+}
+
+// The Notecard library's phase hook, which applies the policy
+void clockPhase(int phase) {
+    if (phase >= 0 && phase < NOTE_PHASES)
+        clockSet(clockPolicy[phase]);
+}
+
+// Get the time spent in each mode, including the time spent so far in the current one
+void clockGetResidency(clockResidency *residency) {
+    clockAccount();
+    *residency = clockStats;
+}
+
+// Start measuring residency afresh
+void clockResetResidency() {
+    clockAccount();
+    memset(&clockStats, 0, sizeof(clockStats));
+}
+
+// Estimate the energy spent, in microjoules, over some residency
+uint32_t clockEnergyUJ(const clockResidency *residency) {
+    static const uint16_t modeUA[CLOCK_MODES] = {
+        [CLOCK_LOWPOWER] = CLOCK_LOWPOWER_UA,
+        [CLOCK_NORMAL] = CLOCK_NORMAL_UA,
+        [CLOCK_BOOST] = CLOCK_BOOST_UA,
+    };
+    uint64_t nanojoules = 0;
+    for (int mode=0; mode<CLOCK_MODES; mode++)
+        nanojoules += (residency->ticks[mode] * modeUA[mode] * CLOCK_SUPPLY_MV) / TIMEBASE_HZ;
+    return (uint32_t) (nanojoules / 1000);
+}
+
+#endif // CLOCK_SCALING
@@ -5,11 +5,17 @@
 // This module implements an event handler that enables the STM32 to enter STOP2 during periods when it is waiting
 // for interrupts or a timeout.  If this capability is not needed, just set EVENTS to false in the Inc/event.h
 // header file.  For this capability to work, the MCU must have one timer configured (generally LPTIM1) that can be
-// active while in STOP2 mode.  We configure this timer with an extremely long period (2 seconds) so that we can
-// process a coarse-grained timeout while also waiting for up to 31 other interrupt-generated events.
+// active while in STOP2 mode.  That timer is the tickless time base in timebase.c, which interrupts us only when
+// the timeout is due, so that we can process a millisecond-accurate timeout while also waiting for up to 31 other
+// interrupt-generated events.
 // For demonstration purposes, in event.h we have defined a single GPIO pin that can be used to simulate
 // a button press.  In this demonstration, using a jumper to briefly pull that pin to GND will result in a wake
 // from STOP2 mode and an early timeout on the delay.
+// Event flags are updated atomically, because they are written both by ISRs and by the app.  Beyond the flags,
+// an ISR may post an event record carrying a timestamp and a data word into a small queue, so that a burst of
+// interrupts can be processed one by one rather than being coalesced into a single flag.
+// How deeply to sleep is chosen each time by power.c, from the time left until the deadline and from whether a
+// GPIO event must be able to wake us.
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -24,17 +30,30 @@
 #include "stm32g0xx_ll_rcc.h"
 #include "main.h"
 #include "event.h"
+#include "timebase.h"
+#include "power.h"
+#include "note.h"
 
 #if EVENTS
 
 // Current event state
-static uint32_t eventsThatHappened = 0;
+static volatile uint32_t eventsThatHappened = 0;
 static uint32_t eventTimerExpiresMs = 0;
 
+// Queue of event records, written by ISRs and read by the app.  The indices are free-running, and
+// the number of records queued is their difference.
+static eventRecord eventQueue[EVENT_QUEUE_DEPTH];
+static volatile uint32_t eventQueueIn = 0;
+static volatile uint32_t eventQueueOut = 0;
+static volatile uint32_t eventQueueDropped = 0;
+#ifdef EVENT_TIMER
+static volatile bool eventTimerArmed = false;
+#endif
+
 // Forwards
 void eventSleep(uint32_t wakeEvents);
 
-// Wait for any of these events to happen, with a high-granularity timeout (granularity defined by LPTIM1)
+// Wait for any of these events to happen, with a millisecond-granularity timeout
 bool eventWait(uint32_t events, uint32_t timeoutMs) {
 
     if (timeoutMs != 0) {
@@ -42,6 +61,9 @@ bool eventWait(uint32_t events, uint32_t timeoutMs) {
         eventClear(EVENT_TIMER);
         events |= EVENT_TIMER;
         eventTimerExpiresMs = MY_TimerMs() + timeoutMs;
+        eventTimerArmed = true;
+        if (timebaseSetDeadline(eventTimerExpiresMs))
+            eventPollTimer();
 #else
         eventTimerExpiresMs = HAL_Ticks() + timeoutMs;
 #endif
@@ -64,16 +86,21 @@ bool eventWait(uint32_t events, uint32_t timeoutMs) {
 // Poll to see if any timer events transpired
 #ifdef EVENT_TIMER
 void eventPollTimer() {
-    if (eventTimerExpiresMs != 0 && MY_TimerMs() >= eventTimerExpiresMs) {
-        eventTimerExpiresMs = 0;
+    if (eventTimerArmed && (int32_t) (MY_TimerMs() - eventTimerExpiresMs) >= 0) {
+        eventTimerArmed = false;
+        timebaseCancelDeadline();
         event(EVENT_TIMER);
     }
 }
 #endif
 
-// Mark that an event has transpired.  Note that this is safe to call from an ISR
+// Mark that an event has transpired.  Note that this is safe to call from an ISR.  The M0+ has no
+// exclusive load/store, so we mask interrupts for just the duration of the read-modify-write.
 void event(uint32_t event) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
     eventsThatHappened |= event;
+    __set_PRIMASK(primask);
 }
 
 // Get the mask of events that have occurred
@@ -83,7 +110,53 @@ uint32_t eventOccurred() {
 
 // Mark that we're no longer interested in an event
 void eventClear(uint32_t event) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
     eventsThatHappened &= ~event;
+    __set_PRIMASK(primask);
+}
+
+// Post a timestamped record of an event into the queue, and mark that the event has transpired.  This is
+// safe to call from any ISR, at any priority.  Returns false if the queue was full and the record was
+// dropped, although the event flag is set regardless.
+bool eventPost(uint32_t event, uint32_t data) {
+#ifdef EVENT_TIMER
+    uint32_t ms = MY_TimerMs();
+#else
+    uint32_t ms = HAL_GetTick();
+#endif
+    bool queued = false;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if ((eventQueueIn - eventQueueOut) < EVENT_QUEUE_DEPTH) {
+        eventRecord *rec = &eventQueue[eventQueueIn % EVENT_QUEUE_DEPTH];
+        rec->ms = ms;
+        rec->event = event;
+        rec->data = data;
+        eventQueueIn++;
+        queued = true;
+    } else {
+        eventQueueDropped++;
+    }
+    eventsThatHappened |= event;
+    __set_PRIMASK(primask);
+    return queued;
+}
+
+// Take the oldest record from the queue, returning false if it is empty.  This must only be called
+// from the app, never from an ISR, because as the only consumer it needs no lock.
+bool eventGet(eventRecord *rec) {
+    uint32_t out = eventQueueOut;
+    if (out == eventQueueIn)
+        return false;
+    *rec = eventQueue[out % EVENT_QUEUE_DEPTH];
+    eventQueueOut = out + 1;
+    return true;
+}
+
+// Get the number of records that have been dropped since boot because the queue was full
+uint32_t eventDropped() {
+    return eventQueueDropped;
 }
 
 // Go into a sleep state if it's appropriate to do so, else simply return
@@ -93,6 +166,14 @@ void eventSleep(uint32_t wakeEvents) {
     if ((eventsThatHappened & wakeEvents) != 0)
         return;
 
+    // Use the time that we would otherwise spend asleep to write out the debug log, a piece at a time so
+    // that an event that arrives in the meantime isn't kept waiting
+#ifdef NOTE_LOG
+    while (NoteLogDrain(EVENT_LOG_DRAIN_BYTES))
+        if ((eventsThatHappened & wakeEvents) != 0)
+            return;
+#endif
+
     // We can only sleep if we've got a timer that can be active during sleep
 #ifndef EVENT_TIMER
 
@@ -112,6 +193,11 @@ void eventSleep(uint32_t wakeEvents) {
     if (MY_Debug())
         highPowerEventWait = true;
 
+    // The clock to return to once the wait is over
+#if CLOCK_SCALING
+    int clockWas = clockMode();
+#endif
+
     // Loop in here until an event happens
     while ((eventsThatHappened & wakeEvents) == 0) {
 
@@ -122,14 +208,40 @@ void eventSleep(uint32_t wakeEvents) {
 
         } else {
 
+            // Choose the cheapest mode that will wake us in time for the deadline, and that can be woken by
+            // the events that we are waiting for.  If it is one that restarts us from reset this doesn't
+            // return, unless it couldn't be entered, in which case we fall back to STOP1.
+#if POWER_MANAGEMENT
+            uint32_t sleepMs = POWER_FOREVER;
+            if (eventTimerArmed) {
+                int32_t remainingMs = (int32_t) (eventTimerExpiresMs - MY_TimerMs());
+                sleepMs = (remainingMs > 0 ? (uint32_t) remainingMs : 0);
+            }
+            int mode = powerSelect(sleepMs, (wakeEvents & ~EVENT_TIMER) != 0 ? POWER_NEEDS_EXTI : 0);
+            if (!powerModelOf(mode)->retainsState && !powerSuspend(mode, sleepMs))
+                mode = POWER_STOP1;
+            uint32_t sleptAtMs = MY_TimerMs();
+#else
+            int mode = POWER_STOP1;
+#endif
+
+            // In Sleep and LP Sleep only the CPU stops, and peripherals carry on as they were.  LP Sleep
+            // needs the low-power clock, which we keep for as long as we wait in it, rather than switching
+            // back and forth on every wake.
+            bool deepSleep = (mode >= POWER_STOP0);
+#if CLOCK_SCALING
+            clockSet(mode == POWER_LPSLEEP ? CLOCK_LOWPOWER : clockWas);
+#endif
+
             // Deinitialize all perpherals
-            MY_Sleep_DeInit();
+            if (deepSleep)
+                MY_Sleep_DeInit();
 
             // Specify that we want flash to be powered down in STOP mode (huge savings)
             LL_PWR_EnableFlashPowerDownInStop();
 
-            // Set Stop mode 2
-            LL_PWR_SetPowerMode(LL_PWR_MODE_STOP1);
+            // Set Stop mode 0 or 1
+            LL_PWR_SetPowerMode(mode == POWER_STOP0 ? LL_PWR_MODE_STOP0 : LL_PWR_MODE_STOP1);
 
             // Enabled events and all interrupts, including disabled interrupts,
             // can wake up the processor
@@ -141,19 +253,30 @@ void eventSleep(uint32_t wakeEvents) {
             // Enable content retention
             LL_PWR_EnableSRAMRetention();
 
-            // Set SLEEPDEEP bit of Cortex System Control Register
-            LL_LPM_EnableDeepSleep();
+            // Set SLEEPDEEP bit of Cortex System Control Register, for the STOP modes
+            if (deepSleep)
+                LL_LPM_EnableDeepSleep();
+            else
+                LL_LPM_EnableSleep();
 
             // Give visibility to scheduler because otherwise it's difficult to debug
 #if EVENT_SLEEP_LED
             HAL_GPIO_WritePin(GPIO_LED_PORT, GPIO_LED_PIN, GPIO_PIN_RESET);
 #endif
 
+            // In Sleep and LP Sleep the SysTick would wake us every millisecond, so it is stopped while we
+            // wait.  Our time is kept by the low-power timer, which carries on.
+            if (!deepSleep)
+                HAL_SuspendTick();
+
             // Wait for interrupt
             __DSB();
             __WFI();
             __ISB();
 
+            if (!deepSleep)
+                HAL_ResumeTick();
+
             // Give visibility to scheduler because otherwise it's difficult to debug
 #if EVENT_SLEEP_LED
             HAL_GPIO_WritePin(GPIO_LED_PORT, GPIO_LED_PIN, GPIO_PIN_SET);
@@ -166,12 +289,22 @@ void eventSleep(uint32_t wakeEvents) {
             // Reset clocks (BEFORE GetHCLKFreq() is called)
             SystemCoreClockUpdate();
 
+            // Account for the time spent asleep
+#if POWER_MANAGEMENT
+            powerAccount(mode, MY_TimerMs() - sleptAtMs);
+#endif
+
         }
 
 #endif  // EVENT_TIMER
 
     }   // loop until an event happens
 
+    // Go back to the clock that we were using before the wait
+#if defined(EVENT_TIMER) && CLOCK_SCALING
+    clockSet(clockWas);
+#endif
+
 }
 
 #endif // EVENTS
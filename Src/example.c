@@ -12,8 +12,13 @@
 // a Microcontroller's I2C ports (SDA and SCL) rather than using Serial, in case there is no
 // unused serial port available to use for the Notecard.
 
+#include <stdio.h>
 #include "main.h"
 #include "event.h"
+#include "stack.h"
+#include "sensor.h"
+#include "aggregate.h"
+#include "power.h"
 #include "note.h"
 
 // This is the unique Product Identifier for your device.  This Product ID tells the Notecard what
@@ -38,14 +43,93 @@
 
 // Events to wait for within our loop that could trigger an update
 #ifdef EVENT_BUTTON
-#define EVENTS_TO_WAIT_FOR  EVENT_BUTTON
+#define EVENTS_TO_WAIT_FOR  (EVENT_BUTTON|EVENT_ATTN)
+#elif defined(EVENT_ATTN)
+#define EVENTS_TO_WAIT_FOR  EVENT_ATTN
 #else
 #define EVENTS_TO_WAIT_FOR  0
 #endif
 
+// Inbound notes sent to this Notefile from the service are delivered when the Notecard raises ATTN, and a
+// note whose body contains "report":true makes us send a note at once, as though the button were pressed.
+#ifdef EVENT_ATTN
+#define INBOUND_FILE    "commands.qi"
+static bool reportRequested = false;
+static void commandReceived(const char *file, J *note, void *context) {
+	(void) file;
+	(void) context;
+	if (JGetBool(JGetObject(note, "body"), "report"))
+		reportRequested = true;
+}
+#endif
+
+// The name of the supply voltage in each note.  The MCU's own ADC measures its analog supply, VDDA, which is
+// named as such so that it isn't mistaken for the voltage on the Notecard's V+ pin that is reported otherwise.
+#if SENSORS
+#define VOLTAGE_FIELD   "vdda"
+#else
+#define VOLTAGE_FIELD   "voltage"
+#endif
+
+// Samples are aggregated into windows, and a note is sent only when a window's mean has moved by more than
+// a deadband since the last note, when a threshold is crossed or the value changes quickly, or at least once
+// per heartbeat so that it can be seen that the device is alive.
+#if AGGREGATION
+#if myLiveDemo
+#define AGGREGATE_WINDOW_MS     (60*1000)           // 1 minute
+#define AGGREGATE_HEARTBEAT_MS  (10*60*1000)        // 10 minutes
+#else
+#define AGGREGATE_WINDOW_MS     (60*60*1000)        // 1 hour
+#define AGGREGATE_HEARTBEAT_MS  (12*60*60*1000)     // 12 hours
+#endif
+static const aggregateConfig temperatureConfig = {
+    .windowMs = AGGREGATE_WINDOW_MS, .heartbeatMs = AGGREGATE_HEARTBEAT_MS,
+    .deadband = 0.5, .ratePerSec = 0.05, .thresholds = true, .low = 0, .high = 40,
+};
+static const aggregateConfig voltageConfig = {
+    .windowMs = AGGREGATE_WINDOW_MS, .heartbeatMs = AGGREGATE_HEARTBEAT_MS,
+    .deadband = 0.05, .ratePerSec = 0.01, .thresholds = true, .low = 2.0, .high = 3.6,
+};
+static aggregator temperatureAggregator;
+static aggregator voltageAggregator;
+
+// Add a window's statistics to the body of a note, as fields whose names begin with the given name.  The
+// body is kept flat, rather than holding an object for each signal, so that it can be described by the
+// template that is registered for the Notefile.
+static void addSummary(J *body, const char *name, aggregator *agg, uint32_t nowMs) {
+    aggregateSummary summary;
+    if (!aggregateFlush(agg, &summary, nowMs))
+        return;
+    char field[24];
+    JAddNumberToObject(body, name, summary.mean);
+    snprintf(field, sizeof(field), "%s_min", name);
+    JAddNumberToObject(body, field, summary.min);
+    snprintf(field, sizeof(field), "%s_max", name);
+    JAddNumberToObject(body, field, summary.max);
+    snprintf(field, sizeof(field), "%s_var", name);
+    JAddNumberToObject(body, field, summary.variance);
+    snprintf(field, sizeof(field), "%s_samples", name);
+    JAddNumberToObject(body, field, summary.count);
+}
+#endif
+
+// The identifiers of the regions of our state that are kept across sleeps that restart us from reset, which
+// must stay the same from one firmware version to the next
+#define STATE_COUNTER           1
+#define STATE_TEMPERATURE       2
+#define STATE_VOLTAGE           3
+
+// Simulate an event counter of some kind, which is kept across sleeps that restart us from reset
+static unsigned eventCounter = 0;
+
 // One-time initialization
 void setup() {
 
+#if AGGREGATION
+    aggregateInit(&temperatureAggregator, &temperatureConfig, millis());
+    aggregateInit(&voltageAggregator, &voltageConfig, millis());
+#endif
+
 	// "NoteNewRequest()" uses the bundled "J" json package to allocate a "req", which is a JSON object
 	// for the request to which we will then add Request arguments.  The function allocates a "req"
 	// request structure using malloc() and initializes its "req" field with the type of request.
@@ -75,7 +159,30 @@ void setup() {
 	//	   }
 	// Note that NoteRequest() always uses free() to release the request data structure, and it
 	// returns "true" if success and "false" if there is any failure.
+	// After a brown-out or watchdog reset the Notecard already has this configuration, so when we can
+	// remember across resets what we last applied we skip the request, and with it a transaction that
+	// would otherwise delay the first sample.
+#if BACKUP_REGISTERS
+	backupConfigure(req);
+#else
 	NoteRequest(req);
+#endif
+
+	// Arm the Notecard to raise ATTN when a command arrives, rather than polling for commands
+#ifdef EVENT_ATTN
+	NoteInboundRegister(INBOUND_FILE, commandReceived, NULL);
+	NoteInboundArm();
+#endif
+
+	// If this boot is the end of a sleep that restarted us from reset, put back the state that we had
+#if POWER_MANAGEMENT
+	NoteSnapshotRegister(STATE_COUNTER, &eventCounter, sizeof(eventCounter));
+#if AGGREGATION
+	NoteSnapshotRegister(STATE_TEMPERATURE, &temperatureAggregator, sizeof(temperatureAggregator));
+	NoteSnapshotRegister(STATE_VOLTAGE, &voltageAggregator, sizeof(voltageAggregator));
+#endif
+	powerRestore();
+#endif
 
 }
 
@@ -83,9 +190,28 @@ void setup() {
 void loop() {
 
 	// Simulate an event counter of some kind
-	static unsigned eventCounter = 0;
 	eventCounter = eventCounter + 1;
 
+	// If we were woken by ATTN, take delivery of the inbound notes that are waiting, which re-arms it
+#ifdef EVENT_ATTN
+	if ((eventOccurred() & EVENT_ATTN) != 0) {
+		eventClear(EVENT_ATTN);
+		NoteInboundDrain();
+	}
+#endif
+
+#if SENSORS
+	// Read the temperature of the MCU's die and the voltage of its analog supply using its own ADC, which
+	// needs no transactions with the Notecard and is done without the CPU's involvement while it sleeps.
+	JNUMBER temperature = 0;
+	JNUMBER voltage = 0;
+	sensorReading reading;
+	bool sampled = sensorSample(&reading);
+	if (sampled) {
+		temperature = (JNUMBER) reading.tempCentiC / 100;
+		voltage = (JNUMBER) reading.vddaMv / 1000;
+	}
+#else
 	// Rather than simulating a temperature reading, use a Notecard request to read the temp
 	// from the Notecard's built-in temperature sensor.  We use NoteRequestResponse() to indicate
 	// that we would like to examine the response of the transaction.  This method takes a "request" JSON
@@ -94,7 +220,10 @@ void loop() {
 	// check for NULL to ensure that there was enough memory available on the microcontroller to
 	// satisfy the allocation request.
 	JNUMBER temperature = 0;
+	bool sampled = true;
     J *rsp = NoteRequestResponse(NoteNewRequest("card.temp"));
+    if (rsp == NULL || NoteResponseError(rsp))
+        sampled = false;
     if (rsp != NULL) {
         temperature = JGetNumber(rsp, "value");
         NoteDeleteResponse(rsp);
@@ -103,34 +232,73 @@ void loop() {
 	// Do the same to retrieve the voltage that is detected by the Notecard on its V+ pin.
 	JNUMBER voltage = 0;
     rsp = NoteRequestResponse(NoteNewRequest("card.voltage"));
+    if (rsp == NULL || NoteResponseError(rsp))
+        sampled = false;
     if (rsp != NULL) {
         voltage = JGetNumber(rsp, "value");
         NoteDeleteResponse(rsp);
     }
+#endif
 
-	// Enqueue the measurement to the Notecard for transmission to the Notehub, adding the "start"
-	// flag for demonstration purposes to upload the data instantaneously, so that if you are looking
-	// at this on notehub.io you will see the data appearing 'live'.)
-    J *req = NoteNewRequest("note.add");
-	if (req != NULL) {
-	    JAddStringToObject(req, "file", "sensors.qo");
-#if myLiveDemo
-	    JAddBoolToObject(req, "start", true);
+	// Enqueue the measurement to the Notecard for transmission to the Notehub, starting a sync for
+	// demonstration purposes to upload the data instantaneously, so that if you are looking at this
+	// on notehub.io you will see the data appearing 'live'.  Because the body is always of the same
+	// shape, NoteAdd() registers a template for the Notefile from the first one, after which each
+	// note is stored and sent by the Notecard as a compact fixed-length record.
+#if AGGREGATION
+	// Only send a note if one of the signals has something to report, or if the button was pressed.  A
+	// sample that couldn't be taken is left out, rather than dragging the window's statistics toward zero.
+	uint32_t nowMs = millis();
+	int reasons = 0;
+	if (sampled) {
+		reasons |= aggregateAdd(&temperatureAggregator, temperature, nowMs);
+		reasons |= aggregateAdd(&voltageAggregator, voltage, nowMs);
+	}
+	bool report = (reasons != 0);
+#ifdef EVENT_BUTTON
+	if ((eventOccurred() & EVENT_BUTTON) != 0)
+		report = true;
+#endif
+#ifdef EVENT_ATTN
+	if (reportRequested)
+		report = true;
+	reportRequested = false;
+#endif
+#else
+	bool report = true;
 #endif
-		J *body = JCreateObject();
-		if (body != NULL) {
+	J *body = report ? JCreateObject() : NULL;
+	if (body != NULL) {
+#if AGGREGATION
+		addSummary(body, "temp", &temperatureAggregator, nowMs);
+		addSummary(body, VOLTAGE_FIELD, &voltageAggregator, nowMs);
+		JAddNumberToObject(body, "reasons", reasons);
+#else
+		if (sampled) {
 			JAddNumberToObject(body, "temp", temperature);
-			JAddNumberToObject(body, "voltage", voltage);
-			JAddNumberToObject(body, "count", eventCounter);
+			JAddNumberToObject(body, VOLTAGE_FIELD, voltage);
+		}
+#endif
+		JAddNumberToObject(body, "count", eventCounter);
+#if STACK_MONITOR
+		// Report how close the stack has come to the heap, so that a collision can be seen coming
+		JAddNumberToObject(body, "headroom", stackHeadroom());
+#endif
 #ifdef EVENT_BUTTON
-            if ((eventOccurred() & EVENT_BUTTON) != 0) {
-                JAddBoolToObject(body, "button", true);
-                eventClear(EVENT_BUTTON);
-            }
+        if ((eventOccurred() & EVENT_BUTTON) != 0) {
+            eventClear(EVENT_BUTTON);
+            JAddBoolToObject(body, "button", true);
+            // Count each press individually, even if several arrived in a burst
+            int presses = 0;
+            eventRecord rec;
+            while (eventGet(&rec))
+                if (rec.event == EVENT_BUTTON)
+                    presses++;
+            if (presses != 0)
+                JAddNumberToObject(body, "presses", presses);
+        }
 #endif
-		    JAddItemToObject(req, "body", body);
-		}
-	    NoteRequest(req);
+		NoteAdd("sensors.qo", body, myLiveDemo);
 	}
 
 	// Delay between measurements
@@ -7,8 +7,15 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include "stm32g0xx_ll_pwr.h"
+#include "stm32g0xx_ll_cortex.h"
 #include "main.h"
 #include "note.h"
+#include "timebase.h"
+#include "clock.h"
+#include "stack.h"
+#include "backup.h"
+#include "power.h"
 
 // See Inc/MAIN.H for definitions that select whether to use UART or I2C for the Notecard
 
@@ -30,7 +37,7 @@ bool uart1Initialized = false;
 // Low-power timer
 #ifdef EVENT_TIMER
 LPTIM_HandleTypeDef hlptim1;
-uint32_t totalTimerMs = 0;
+bool lptim1CompareWritePending = false;
 #endif
 
 // Data used for Notecard I/O functions
@@ -61,6 +68,11 @@ const char *noteI2CReceive(uint16_t DevAddress, uint8_t* pBuffer, uint16_t Size,
 // Main entry point
 int main(void) {
 
+    // Paint the stack before anything else touches free memory, so that its high-water mark can be measured
+#if STACK_MONITOR
+    stackPaint();
+#endif
+
     // Initialize peripherals
     HAL_Init();
     SystemClock_Config();
@@ -72,6 +84,21 @@ int main(void) {
     // Register callbacks with note-c subsystem that it needs for I/O, memory, timer
     NoteSetFn(malloc, free, delay, millis);
 
+    // Scale the clock to suit each phase of a Notecard transaction
+#if CLOCK_SCALING
+    NoteSetFnPhase(clockPhase);
+#endif
+
+    // Register a template for each Notefile from the first note added to it, remembering across resets,
+    // if we can, which templates have already been registered
+#if BACKUP_REGISTERS
+    NoteTemplateEntry templates[BACKUP_TEMPLATE_ENTRIES];
+    NoteTemplateRestore(templates, backupTemplateRestore(templates, BACKUP_TEMPLATE_ENTRIES));
+    NoteSetAutoTemplate(true, backupTemplateSave);
+#else
+    NoteSetAutoTemplate(true, NULL);
+#endif
+
     // Register callbacks for Notecard I/O
 #if NOTECARD_USE_I2C
     NoteSetFnI2C(NOTE_I2C_ADDR_DEFAULT, NOTE_I2C_MAX_DEFAULT, noteI2CReset, noteI2CTransmit, noteI2CReceive);
@@ -113,15 +140,16 @@ void SystemClock_Config(void) {
     if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK)
         Error_Handler();
 
-    // Initializes the peripherals clocks
+    // Initializes the peripherals clocks.  The USART and I2C are clocked by HSI16 rather than by PCLK, so
+    // that their timing doesn't change when SYSCLK is scaled.
     PeriphClkInit.PeriphClockSelection = 0;
 #if USE_UART
     PeriphClkInit.PeriphClockSelection |= RCC_PERIPHCLK_USART1;
-    PeriphClkInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_PCLK1;
+    PeriphClkInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_HSI;
 #endif
 #if USE_I2C
     PeriphClkInit.PeriphClockSelection |= RCC_PERIPHCLK_I2C1;
-    PeriphClkInit.I2c1ClockSelection = RCC_I2C1CLKSOURCE_PCLK1;
+    PeriphClkInit.I2c1ClockSelection = RCC_I2C1CLKSOURCE_HSI;
 #endif
 #ifdef EVENT_TIMER
     PeriphClkInit.PeriphClockSelection |= RCC_PERIPHCLK_LPTIM1;
@@ -130,8 +158,59 @@ void SystemClock_Config(void) {
     if (HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK)
         Error_Handler();
 
+    // Configure, but don't start, the PLL that boosts SYSCLK to 64MHz (HSI16 / M1 * N8 / R2)
+#if CLOCK_SCALING
+    MODIFY_REG(RCC->PLLCFGR, RCC_PLLCFGR_PLLSRC|RCC_PLLCFGR_PLLM|RCC_PLLCFGR_PLLN|RCC_PLLCFGR_PLLR|RCC_PLLCFGR_PLLREN,
+               RCC_PLLCFGR_PLLSRC_HSI | (0 << RCC_PLLCFGR_PLLM_Pos) | (8 << RCC_PLLCFGR_PLLN_Pos)
+               | (1 << RCC_PLLCFGR_PLLR_Pos) | RCC_PLLCFGR_PLLREN);
+#endif
+
 }
 
+// Switch the system clock between the normal mode and another.  Flash wait states must be added before
+// the clock goes up and may only be removed after it has come down, and the regulator must be out of
+// Low-power Run mode before the clock is raised above 2MHz.
+#if CLOCK_SCALING
+void MY_ClockSwitch(int from, int to) {
+
+    // Leave boost by switching back to HSI16, then stop the PLL and remove the wait states
+    if (from == CLOCK_BOOST) {
+        MODIFY_REG(RCC->CFGR, RCC_CFGR_SW, 0);
+        while ((RCC->CFGR & RCC_CFGR_SWS) != 0) ;
+        CLEAR_BIT(RCC->CR, RCC_CR_PLLON);
+        MODIFY_REG(FLASH->ACR, FLASH_ACR_LATENCY, 0);
+    }
+
+    // Leave low power by returning the regulator to its main mode, then undividing HSI16
+    if (from == CLOCK_LOWPOWER) {
+        CLEAR_BIT(PWR->CR1, PWR_CR1_LPR);
+        while (READ_BIT(PWR->SR2, PWR_SR2_REGLPF) != 0) ;
+        MODIFY_REG(RCC->CR, RCC_CR_HSIDIV, 0);
+    }
+
+    // Enter boost by adding the wait states, then starting the PLL and switching to it
+    if (to == CLOCK_BOOST) {
+        MODIFY_REG(FLASH->ACR, FLASH_ACR_LATENCY, FLASH_ACR_LATENCY_1);
+        while ((FLASH->ACR & FLASH_ACR_LATENCY) != FLASH_ACR_LATENCY_1) ;
+        SET_BIT(RCC->CR, RCC_CR_PLLON);
+        while (READ_BIT(RCC->CR, RCC_CR_PLLRDY) == 0) ;
+        MODIFY_REG(RCC->CFGR, RCC_CFGR_SW, RCC_CFGR_SW_1);
+        while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_1) ;
+    }
+
+    // Enter low power by dividing HSI16 by 8, then putting the regulator into Low-power Run mode
+    if (to == CLOCK_LOWPOWER) {
+        MODIFY_REG(RCC->CR, RCC_CR_HSIDIV, 3 << RCC_CR_HSIDIV_Pos);
+        SET_BIT(PWR->CR1, PWR_CR1_LPR);
+    }
+
+    // Re-derive the HAL tick from the new SYSCLK
+    SystemCoreClockUpdate();
+    HAL_InitTick(uwTickPrio);
+
+}
+#endif
+
 // I2C1 Initialization
 #if USE_I2C
 void MX_I2C1_Init(void) {
@@ -287,19 +366,18 @@ void MX_LPTIM1_Init(void) {
     if (HAL_LPTIM_Init(&hlptim1) != HAL_OK)
         Error_Handler();
 
-    // We want this timer to tick at the slowest possible rate, because
-    // any overhead spent in this ISR is simply energy that is burned.
-    // Start the timeout function in continuous interrupt mode (stm32l4xx_hal_lptim.c).
-    // According to this config, with 32k cloock and compare timeout = 65535,
-    // the Timeout period = (compare + 1) / Frequency (32KHz) = 2s
-    // Period is the maximum value of the auto-reload counter - can't go higher.
-    // Timeout is the value to be placed into the compare register - this is max
-#define Period      (uint32_t) 65535
-#define Timeout     (uint32_t) 32767
-#define LPTIM_MS    2000
-    if (HAL_LPTIM_TimeOut_Start_IT(&hlptim1, Period, Timeout) != HAL_OK)
+    // The counter free-runs through its full range as the time base (see timebase.c), interrupting
+    // only when it wraps and when it reaches the compare value that is programmed for the next
+    // deadline.  Interrupt enables may only be changed while the timer is disabled, so we enable
+    // compare match before starting the counter, which enables the auto-reload interrupts.
+    __HAL_LPTIM_ENABLE_IT(&hlptim1, LPTIM_IT_CMPM);
+    if (HAL_LPTIM_Counter_Start_IT(&hlptim1, TIMEBASE_COUNTER_MAX) != HAL_OK)
         Error_Handler();
 
+    // Until there's a deadline, park the compare where it coincides with the overflow
+    lptim1CompareWritePending = false;
+    MY_TimerSetCompare(TIMEBASE_COUNTER_MAX);
+
 }
 #endif
 
@@ -310,13 +388,20 @@ void MX_LPTIM1_DeInit(void) {
 }
 #endif
 
-// Compare match callback in non blocking mode
-// NOTE: THIS IS CALLED ONCE PER TICK (EVERY 2 SECONDS AS LPTIM1 IS PROGRAMMED)
+// Auto-reload match callback, called each time that the counter wraps (every 2 seconds)
 #ifdef EVENT_TIMER
-void HAL_LPTIM_CompareMatchCallback(LPTIM_HandleTypeDef *hlptim) {
+void HAL_LPTIM_AutoReloadMatchCallback(LPTIM_HandleTypeDef *hlptim) {
+
+    // Extend the counter, polling if a deadline became due during the wrap
+    if (timebaseOverflow())
+        eventPollTimer();
+
+}
+#endif
 
-    // Add to the total milliseconds since boot
-    totalTimerMs += LPTIM_MS;
+// Compare match callback, called when the counter reaches the next deadline
+#ifdef EVENT_TIMER
+void HAL_LPTIM_CompareMatchCallback(LPTIM_HandleTypeDef *hlptim) {
 
     // Poll the event poller to see if any events transpired
     eventPollTimer();
@@ -324,10 +409,240 @@ void HAL_LPTIM_CompareMatchCallback(LPTIM_HandleTypeDef *hlptim) {
 }
 #endif
 
+// Read the LPTIM1 counter, indicating whether or not it has wrapped without the overflow
+// interrupt having yet been serviced.  The counter is clocked asynchronously to the CPU, so
+// its value can only be trusted when two successive reads agree.
+#ifdef EVENT_TIMER
+uint16_t MY_TimerCounter(bool *overflowPending) {
+    uint16_t counter;
+    do {
+        counter = (uint16_t) hlptim1.Instance->CNT;
+    } while (counter != (uint16_t) hlptim1.Instance->CNT);
+    *overflowPending = __HAL_LPTIM_GET_FLAG(&hlptim1, LPTIM_FLAG_ARRM);
+    if (*overflowPending) {
+        do {
+            counter = (uint16_t) hlptim1.Instance->CNT;
+        } while (counter != (uint16_t) hlptim1.Instance->CNT);
+    }
+    return counter;
+}
+#endif
+
+// Program the LPTIM1 compare register, first waiting for any previous write to complete
+#ifdef EVENT_TIMER
+void MY_TimerSetCompare(uint16_t ticks) {
+    if (lptim1CompareWritePending)
+        while (!__HAL_LPTIM_GET_FLAG(&hlptim1, LPTIM_FLAG_CMPOK)) ;
+    __HAL_LPTIM_CLEAR_FLAG(&hlptim1, LPTIM_FLAG_CMPOK);
+    __HAL_LPTIM_COMPARE_SET(&hlptim1, ticks);
+    lptim1CompareWritePending = true;
+}
+#endif
+
 // This returns milliseconds since boot (which may wrap)
 #ifdef EVENT_TIMER
 uint32_t MY_TimerMs() {
-    return totalTimerMs;
+    return timebaseMs();
+}
+#endif
+
+// Read a TAMP backup register
+#if BACKUP_REGISTERS
+uint32_t MY_BackupRead(int index) {
+    __HAL_RCC_RTCAPB_CLK_ENABLE();
+    return (&TAMP->BKP0R)[index];
+}
+#endif
+
+// Write a TAMP backup register, which is in the backup domain and so is write-protected until access to
+// that domain is enabled
+#if BACKUP_REGISTERS
+void MY_BackupWrite(int index, uint32_t value) {
+    __HAL_RCC_PWR_CLK_ENABLE();
+    __HAL_RCC_RTCAPB_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+    (&TAMP->BKP0R)[index] = value;
+    HAL_PWR_DisableBkUpAccess();
+}
+#endif
+
+// Go into Standby, with SRAM retained, to be woken by the RTC's wakeup timer after a number of milliseconds,
+// which restarts us from reset.  The RTC is clocked by the LSI, which is already running for LPTIM1, and is
+// used for nothing else, so it is enabled here if it hasn't been.  The wakeup timer counts RTC/16, at 2kHz,
+// for as long as that fits in its 16 bits, and beyond that counts seconds.
+#if POWER_MANAGEMENT
+void MY_PowerStandby(uint32_t ms) {
+    __HAL_RCC_PWR_CLK_ENABLE();
+    __HAL_RCC_RTCAPB_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+    if ((RCC->BDCR & RCC_BDCR_RTCEN) == 0)
+        MODIFY_REG(RCC->BDCR, RCC_BDCR_RTCSEL, RCC_BDCR_RTCSEL_1|RCC_BDCR_RTCEN);
+
+    // Program the wakeup timer, which can only be done while it is disabled
+    uint32_t units = ms * 2;
+    uint32_t clock = 0;
+    if (units > RTC_WUTR_WUT) {
+        units = ms / 1000;
+        clock = RTC_CR_WUCKSEL_2;
+    }
+    if (units > RTC_WUTR_WUT)
+        units = RTC_WUTR_WUT;
+    RTC->WPR = 0xCA;
+    RTC->WPR = 0x53;
+    CLEAR_BIT(RTC->CR, RTC_CR_WUTE|RTC_CR_WUTIE);
+    while ((RTC->ICSR & RTC_ICSR_WUTWF) == 0) ;
+    RTC->WUTR = (units > 0 ? units - 1 : 0);
+    MODIFY_REG(RTC->CR, RTC_CR_WUCKSEL, clock);
+    RTC->SCR = RTC_SCR_CWUTF;
+    SET_BIT(RTC->CR, RTC_CR_WUTE|RTC_CR_WUTIE);
+    RTC->WPR = 0xFF;
+
+    // Enter Standby, keeping SRAM, with the RTC on the internal wakeup line
+    SET_BIT(PWR->CR3, PWR_CR3_EIWUL|PWR_CR3_RRS);
+    PWR->SCR = PWR_SCR_CWUF|PWR_SCR_CSBF;
+    LL_PWR_SetPowerMode(LL_PWR_MODE_STANDBY);
+    LL_LPM_EnableDeepSleep();
+    __DSB();
+    while (true)
+        __WFI();
+}
+#endif
+
+// Determine whether we were restarted by a wake from Standby, clearing the indication and stopping the
+// wakeup timer so that it doesn't fire again
+#if POWER_MANAGEMENT
+bool MY_PowerWokeFromStandby() {
+    __HAL_RCC_PWR_CLK_ENABLE();
+    if ((PWR->SR1 & PWR_SR1_SBF) == 0)
+        return false;
+    PWR->SCR = PWR_SCR_CSBF|PWR_SCR_CWUF;
+    __HAL_RCC_RTCAPB_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+    RTC->WPR = 0xCA;
+    RTC->WPR = 0x53;
+    CLEAR_BIT(RTC->CR, RTC_CR_WUTE|RTC_CR_WUTIE);
+    RTC->SCR = RTC_SCR_CWUTF;
+    RTC->WPR = 0xFF;
+    HAL_PWR_DisableBkUpAccess();
+    return true;
+}
+#endif
+
+// Factory calibration values, in the engineering bytes of system memory
+#if SENSORS
+#define SENSOR_TS_CAL1_ADDR     ((const uint16_t *) 0x1FFF75A8UL)
+#define SENSOR_VREFINT_CAL_ADDR ((const uint16_t *) 0x1FFF75AAUL)
+#define SENSOR_DMAREQ_ADC       5
+#endif
+
+// Start acquisition into a ring (see sensor.c).  TIM3's update event triggers a scan of the channels, each
+// conversion is accumulated by the oversampler, and DMA writes each result around the ring in circular mode,
+// interrupting only when it wraps.  The ADC kernel clock is taken from HSI16 so that conversion timing is
+// unaffected by clock scaling.  TIM3 is clocked by PCLK, and so its period is derived from the current clock,
+// which is that of the app phase unless acquisition is left running across a Notecard transaction.
+#if SENSORS
+void MY_SensorStart(uint16_t *ring, uint32_t count, uint32_t scanHz) {
+
+    // Clocks, and the external input pin in analog mode
+    MODIFY_REG(RCC->CCIPR, RCC_CCIPR_ADCSEL, RCC_CCIPR_ADCSEL_1);
+    __HAL_RCC_ADC_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    __HAL_RCC_TIM3_CLK_ENABLE();
+    SET_BIT(GPIOA->MODER, GPIO_MODER_MODE0);
+
+    // Power up the ADC's regulator, which needs 20uS to start (the loop is at least 4 cycles per
+    // iteration), and then calibrate the ADC, which must be done while it is disabled and without DMA.
+    // CFGR1 keeps its DMA enable from the last acquisition, because gating the clock doesn't reset it.
+    SET_BIT(ADC1->CR, ADC_CR_ADVREGEN);
+    for (volatile uint32_t i = SystemCoreClock / 200000; i > 0; i--) ;
+    ADC1->CFGR1 = 0;
+    SET_BIT(ADC1->CR, ADC_CR_ADCAL);
+    while (READ_BIT(ADC1->CR, ADC_CR_ADCAL) != 0) ;
+
+    // Scans are triggered by the rising edge of TIM3_TRGO, and each result is requested from DMA in
+    // circular mode.  Sixteen samples are summed without shifting, and sampling takes 160.5 cycles, or
+    // 10uS, which is more than the temperature sensor and VREFINT need.
+    ADC1->CFGR1 = ADC_CFGR1_DMAEN | ADC_CFGR1_DMACFG | ADC_CFGR1_EXTEN_0 | ADC_CFGR1_EXTSEL_0 | ADC_CFGR1_EXTSEL_1;
+    ADC1->CFGR2 = ADC_CFGR2_OVSE | ADC_CFGR2_OVSR_0 | ADC_CFGR2_OVSR_1;
+    ADC1->SMPR = ADC_SMPR_SMP1;
+    SET_BIT(ADC1_COMMON->CCR, ADC_CCR_TSEN | ADC_CCR_VREFEN);
+    ADC1->ISR = ADC_ISR_CCRDY;
+    ADC1->CHSELR = ADC_CHSELR_CHSEL0 | ADC_CHSELR_CHSEL12 | ADC_CHSELR_CHSEL13;
+    while (READ_BIT(ADC1->ISR, ADC_ISR_CCRDY) == 0) ;
+
+    // DMA from the data register around the ring, interrupting when it wraps
+    DMA1_Channel1->CCR = 0;
+    DMAMUX1_Channel0->CCR = SENSOR_DMAREQ_ADC;
+    DMA1_Channel1->CPAR = (uint32_t) &ADC1->DR;
+    DMA1_Channel1->CMAR = (uint32_t) ring;
+    DMA1_Channel1->CNDTR = count;
+    DMA1->IFCR = DMA_IFCR_CGIF1;
+    DMA1_Channel1->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0 | DMA_CCR_TCIE | DMA_CCR_EN;
+    HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+
+    // Enable the ADC, and arm it to convert on each trigger
+    ADC1->ISR = ADC_ISR_ADRDY;
+    SET_BIT(ADC1->CR, ADC_CR_ADEN);
+    while (READ_BIT(ADC1->ISR, ADC_ISR_ADRDY) == 0) ;
+    SET_BIT(ADC1->CR, ADC_CR_ADSTART);
+
+    // Set the timer's period, loading the prescaler before its update event is routed to TRGO so that
+    // doing so doesn't trigger a scan, and start it
+    uint32_t ticks = SystemCoreClock / scanHz;
+    TIM3->PSC = (ticks - 1) / 65536;
+    TIM3->ARR = ticks / (TIM3->PSC + 1) - 1;
+    TIM3->EGR = TIM_EGR_UG;
+    TIM3->CR2 = TIM_CR2_MMS_1;
+    SET_BIT(TIM3->CR1, TIM_CR1_CEN);
+
+}
+#endif
+
+// Stop acquisition and power everything down
+#if SENSORS
+void MY_SensorStop() {
+    CLEAR_BIT(TIM3->CR1, TIM_CR1_CEN);
+    if (READ_BIT(ADC1->CR, ADC_CR_ADSTART) != 0) {
+        SET_BIT(ADC1->CR, ADC_CR_ADSTP);
+        while (READ_BIT(ADC1->CR, ADC_CR_ADSTP) != 0) ;
+    }
+    if (READ_BIT(ADC1->CR, ADC_CR_ADEN) != 0) {
+        SET_BIT(ADC1->CR, ADC_CR_ADDIS);
+        while (READ_BIT(ADC1->CR, ADC_CR_ADEN) != 0) ;
+    }
+    CLEAR_BIT(ADC1_COMMON->CCR, ADC_CCR_TSEN | ADC_CCR_VREFEN);
+    CLEAR_BIT(ADC1->CR, ADC_CR_ADVREGEN);
+    HAL_NVIC_DisableIRQ(DMA1_Channel1_IRQn);
+    DMA1_Channel1->CCR = 0;
+    __HAL_RCC_TIM3_CLK_DISABLE();
+    __HAL_RCC_DMA1_CLK_DISABLE();
+    __HAL_RCC_ADC_CLK_DISABLE();
+}
+#endif
+
+// Wait in Sleep mode, rather than STOP mode, so that acquisition continues
+#if SENSORS
+void MY_SensorIdle() {
+    __WFI();
+}
+#endif
+
+// Read the factory calibration values
+#if SENSORS
+void MY_SensorCalibration(sensorCalibration *cal) {
+    cal->tsCal1 = *SENSOR_TS_CAL1_ADDR;
+    cal->vrefintCal = *SENSOR_VREFINT_CAL_ADDR;
+}
+#endif
+
+// DMA channel 1 interrupt, taken each time that the ring wraps
+#if SENSORS
+void MY_SensorIRQHandler() {
+    if (READ_BIT(DMA1->ISR, DMA_ISR_TCIF1) != 0) {
+        DMA1->IFCR = DMA_IFCR_CTCIF1;
+        sensorComplete();
+    }
 }
 #endif
 
@@ -380,6 +695,18 @@ void MX_GPIO_Init(void) {
     HAL_NVIC_EnableIRQ(GPIO_BUTTON_IRQ);
 #endif
 
+    // Initialize the Notecard's ATTN pin, which is pulled down so that it reads low if not wired
+#ifdef EVENT_ATTN
+    GPIO_ATTN_CLOCK_ENABLE();
+    GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+    GPIO_InitStruct.Pin = GPIO_ATTN_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_Init(GPIO_ATTN_PORT, &GPIO_InitStruct);
+    HAL_NVIC_SetPriority(GPIO_ATTN_IRQ, 0, 0);
+    HAL_NVIC_EnableIRQ(GPIO_ATTN_IRQ);
+#endif
+
 }
 
 // Called when a GPIO interrupt occurs
@@ -388,7 +715,13 @@ void HAL_GPIO_EXTI_Rising_Callback(uint16_t GPIO_Pin) {
     // Handle the button
 #ifdef EVENT_BUTTON
     if ((GPIO_Pin & GPIO_BUTTON_PIN) != 0)
-        event(EVENT_BUTTON);
+        eventPost(EVENT_BUTTON, GPIO_Pin);
+#endif
+
+    // Handle the Notecard's ATTN pin, which rises when an inbound note has arrived
+#ifdef EVENT_ATTN
+    if ((GPIO_Pin & GPIO_ATTN_PIN) != 0)
+        event(EVENT_ATTN);
 #endif
 
 }
@@ -408,9 +741,14 @@ void delay(uint32_t ms) {
     HAL_Delay(ms);
 }
 
-// Get the number of app milliseconds since boot (this will wrap)
+// Get the number of app milliseconds since boot (this will wrap).  When we have a low-power
+// timer this is taken from it, because the HAL tick stops while we are in STOP1 mode.
 long unsigned int millis() {
+#ifdef EVENT_TIMER
+    return (long unsigned int) MY_TimerMs();
+#else
     return (long unsigned int) HAL_GetTick();
+#endif
 }
 
 // Determine whether or not a debugger is actively connected.  We use
@@ -430,6 +768,11 @@ void MY_Sleep_DeInit() {
     MX_USART1_UART_DeInit();
 #endif
 
+    // The ADC has no clock in STOP mode, and its regulator would only waste power
+#if SENSORS
+    sensorStop();
+#endif
+
     // Notify the Note subsystem that these will need to be reinitialized
     // on the next call to any of the Note I/O functions
     NoteResetRequired();
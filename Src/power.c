@@ -0,0 +1,196 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// This module chooses how deeply to sleep.  Each time that the event handler is about to wait, it knows how
+// long it may sleep before its next deadline and whether a GPIO must be able to wake it, and from a model of
+// what each mode costs, in current while asleep and in energy spent going into and out of it, we pick the
+// mode that spends the least over that sleep.  A short sleep favors a mode that is cheap to enter and leave,
+// and a long one a mode that draws the least, so that a wait of a few milliseconds stays in LP Sleep while a
+// wait of a quarter of an hour may have the Notecard cut our power altogether.
+// Standby and Off restart us from reset, losing everything but SRAM in the first case and everything in the
+// second, so the app registers the regions of state that it needs to carry across them with the Notecard
+// library's snapshots, which are kept in a section of SRAM that isn't cleared at startup, or handed to the
+// Notecard to hold while we're off.  After setup() has initialized and registered everything, powerRestore()
+// puts back what was saved, if we're waking from such a sleep, and moves the time base on to where it would
+// have been.
+// The model and the accounting of residency are pure C, so that the choices made over a schedule of sleeps
+// and the energy that they spend can be simulated on a host.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "main.h"
+#include "note.h"
+#include "power.h"
+#include "timebase.h"
+
+#if POWER_MANAGEMENT
+
+// The cost of each mode
+static const powerModel powerModels[POWER_MODES] = {
+    [POWER_SLEEP] =     { .currentNA = 600000, .wakeUs = 1,       .transitionUJ = 0,   .minMs = 0,     .retainsState = true },
+    [POWER_LPSLEEP] =   { .currentNA = 60000,  .wakeUs = 20,      .transitionUJ = 0,   .minMs = 0,     .retainsState = true },
+    [POWER_STOP0] =     { .currentNA = 100000, .wakeUs = 5,       .transitionUJ = 1,   .minMs = 1,     .retainsState = true },
+    [POWER_STOP1] =     { .currentNA = 4000,   .wakeUs = 9,       .transitionUJ = 1,   .minMs = 1,     .retainsState = true },
+    [POWER_STANDBY] =   { .currentNA = 800,    .wakeUs = 2000,    .transitionUJ = 40,  .minMs = 2000,  .retainsState = false },
+    [POWER_OFF] =       { .currentNA = 0,      .wakeUs = 1000000, .transitionUJ = 600, .minMs = 60000, .retainsState = false },
+};
+
+// The snapshot that is kept in SRAM across Standby, which is marked as valid only once it has been taken
+#define POWER_IMAGE_MAGIC   0x504F5752UL
+typedef struct {
+    uint32_t magic;
+    char snapshot[POWER_SNAPSHOT_LEN];
+} powerImage;
+static powerImage powerRetained __attribute__((section(".noinit")));
+
+// Our own region of the snapshot, so that the time base and the energy spent can be carried across too
+typedef struct {
+    uint32_t resumeMs;
+    powerResidency residency;
+} powerCarried;
+static powerCarried powerCarry = {0};
+
+// Time spent in each mode
+static powerResidency powerStats = {0};
+
+// Get the cost of a mode
+const powerModel *powerModelOf(int mode) {
+    if (mode < 0 || mode >= POWER_MODES)
+        return NULL;
+    return &powerModels[mode];
+}
+
+// Estimate the energy, in nanojoules, of a sleep of a given duration in a mode
+static uint64_t powerCostNJ(int mode, uint32_t sleepMs) {
+    const powerModel *model = &powerModels[mode];
+    return ((uint64_t) model->currentNA * POWER_SUPPLY_MV * sleepMs) / 1000000 + (uint64_t) model->transitionUJ * 1000;
+}
+
+// Estimate the energy, in microjoules, of a sleep of a given duration in a mode
+uint32_t powerCostUJ(int mode, uint32_t sleepMs) {
+    return (uint32_t) (powerCostNJ(mode, sleepMs) / 1000);
+}
+
+// Whether a mode can be used for a sleep
+bool powerAllowed(int mode, uint32_t sleepMs, uint32_t needs) {
+    const powerModel *model = &powerModels[mode];
+    if ((needs & POWER_NEEDS_CLOCKS) != 0 && mode > POWER_LPSLEEP)
+        return false;
+    if ((needs & POWER_NEEDS_EXTI) != 0 && !model->retainsState)
+        return false;
+#if !CLOCK_SCALING
+    if (mode == POWER_LPSLEEP)
+        return false;
+#endif
+#if !POWER_NOTECARD_OFF
+    if (mode == POWER_OFF)
+        return false;
+#endif
+    // A mode that restarts from reset can only be woken by a timer, so it needs a deadline, and one far
+    // enough away that we can wake in time for it
+    if (!model->retainsState && sleepMs == POWER_FOREVER)
+        return false;
+    return (sleepMs >= model->minMs);
+}
+
+// Choose the mode that spends the least energy over a sleep.  A sleep with no deadline is costed as though
+// it were an hour, which is long enough for the deepest usable mode to win.
+int powerSelect(uint32_t sleepMs, uint32_t needs) {
+    uint32_t costMs = (sleepMs == POWER_FOREVER ? 60*60*1000UL : sleepMs);
+    int best = POWER_SLEEP;
+    uint64_t bestNJ = powerCostNJ(POWER_SLEEP, costMs);
+    for (int mode=POWER_SLEEP+1; mode<POWER_MODES; mode++) {
+        if (!powerAllowed(mode, sleepMs, needs))
+            continue;
+        uint64_t costNJ = powerCostNJ(mode, costMs);
+        if (costNJ < bestNJ) {
+            best = mode;
+            bestNJ = costNJ;
+        }
+    }
+    return best;
+}
+
+// If we're waking from Standby or Off, put back the state that was kept and move the time base on to when
+// we woke.  This must be called once, after setup() has initialized everything and registered its regions,
+// and returns true if the state was restored.
+bool powerRestore() {
+    NoteSnapshotRegister(POWER_SNAPSHOT_ID, &powerCarry, sizeof(powerCarry));
+    int restored = -1;
+    bool fromStandby = MY_PowerWokeFromStandby();
+    if (fromStandby && powerRetained.magic == POWER_IMAGE_MAGIC) {
+        powerRetained.snapshot[POWER_SNAPSHOT_LEN-1] = '\0';
+        restored = NoteSnapshotDecode(powerRetained.snapshot, NULL);
+    }
+#if POWER_NOTECARD_OFF
+    if (!fromStandby)
+        restored = NoteSnapshotWake(NULL);
+#endif
+    powerRetained.magic = 0;
+    if (restored < 0)
+        return false;
+    powerStats = powerCarry.residency;
+#ifdef EVENT_TIMER
+    timebaseResume(powerCarry.resumeMs);
+#endif
+    return true;
+}
+
+// Go into a mode that restarts from reset, having kept the app's state, so that we are restarted in time for
+// a deadline a given number of milliseconds away.  If this returns, the mode couldn't be entered, and the
+// caller should sleep some other way.
+bool powerSuspend(int mode, uint32_t sleepMs) {
+    if (!powerAllowed(mode, sleepMs, 0) || powerModels[mode].retainsState)
+        return false;
+
+    // Count the sleep as though it has already been taken
+    powerAccount(mode, sleepMs);
+    powerCarry.resumeMs = (uint32_t) millis() + sleepMs;
+    powerCarry.residency = powerStats;
+    uint32_t wakeMs = sleepMs - (powerModels[mode].wakeUs + 999) / 1000;
+
+    // Standby, which doesn't return unless the snapshot doesn't fit
+    if (mode == POWER_STANDBY && NoteSnapshotEncode(POWER_STATE_VERSION, powerRetained.snapshot, sizeof(powerRetained.snapshot)) >= 0) {
+        powerRetained.magic = POWER_IMAGE_MAGIC;
+        MY_PowerStandby(wakeMs);
+    }
+
+    // Off, for which the snapshot is given to the Notecard to hold, and from which we don't expect to return
+    // unless the Notecard isn't wired to cut our power
+#if POWER_NOTECARD_OFF
+    if (mode == POWER_OFF && NoteSnapshotSleep(POWER_STATE_VERSION, wakeMs / 1000, NULL))
+        delay(POWER_OFF_TIMEOUT_MS);
+#endif
+
+    // We're still running, so take back the sleep that we accounted for
+    powerRetained.magic = 0;
+    powerStats.ms[mode] -= sleepMs;
+    powerStats.entries[mode]--;
+    return false;
+}
+
+// Account for time spent in a mode
+void powerAccount(int mode, uint32_t ms) {
+    if (mode < 0 || mode >= POWER_MODES)
+        return;
+    powerStats.ms[mode] += ms;
+    powerStats.entries[mode]++;
+}
+
+// Get the time spent in each mode since a cold boot
+void powerGetResidency(powerResidency *residency) {
+    *residency = powerStats;
+}
+
+// Estimate the energy spent, in microjoules, over some residency
+uint32_t powerEnergyUJ(const powerResidency *residency) {
+    uint64_t nanojoules = 0;
+    for (int mode=0; mode<POWER_MODES; mode++) {
+        nanojoules += ((residency->ms[mode] * powerModels[mode].currentNA) / 1000) * POWER_SUPPLY_MV / 1000;
+        nanojoules += (uint64_t) residency->entries[mode] * powerModels[mode].transitionUJ * 1000;
+    }
+    return (uint32_t) (nanojoules / 1000);
+}
+
+#endif // POWER_MANAGEMENT
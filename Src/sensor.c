@@ -0,0 +1,122 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// This module samples the MCU's own ADC, so that readings of the die temperature, the supply voltage and an
+// external input don't each cost a transaction with the Notecard.  TIM3 triggers a scan of the channels at a
+// fixed rate, the ADC's hardware oversampler accumulates each conversion from many samples, and DMA writes
+// each result into a ring in circular mode, so the CPU isn't involved in any of it and is woken only once the
+// ring has been filled.  A reading is then a filtered value of each channel over the scans in the ring,
+// calibrated against the factory values that ST measures for each part.
+// Acquisition runs only while we're in Run or Sleep mode, because the ADC has no clock in STOP mode.  It can
+// be left running with sensorStart() while the app is awake, or sensorSample() can be used to take a fresh
+// burst of scans whenever a reading is needed, which is how the example uses it.
+// The hardware is accessed only through the MY_Sensor functions, so that the filtering and calibration here
+// can be exercised on a host against a simulated ring.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "main.h"
+#include "sensor.h"
+
+#if SENSORS
+
+// The ring into which DMA writes each scan
+static uint16_t sensorRing[SENSOR_SCANS*SENSOR_CHANNELS];
+
+// Whether acquisition is running, and whether the ring has been filled since it started
+static bool sensorRunning = false;
+static volatile bool sensorFilled = false;
+
+// Start acquisition, which continues until stopped
+void sensorStart() {
+    if (sensorRunning)
+        return;
+    sensorFilled = false;
+    MY_SensorStart(sensorRing, SENSOR_SCANS*SENSOR_CHANNELS, SENSOR_SCAN_HZ);
+    sensorRunning = true;
+}
+
+// Stop acquisition and power down the ADC, after which what's in the ring is no longer current
+void sensorStop() {
+    if (!sensorRunning)
+        return;
+    MY_SensorStop();
+    sensorRunning = false;
+    sensorFilled = false;
+}
+
+// Called from the DMA interrupt each time that the ring has been filled
+void sensorComplete() {
+    sensorFilled = true;
+}
+
+// Get a calibrated reading of what's in the ring, returning false if it hasn't yet been filled.  The DMA
+// may be writing the ring as we read it, which is harmless because each value is written whole.
+bool sensorRead(sensorReading *reading) {
+    if (!sensorFilled)
+        return false;
+    for (int channel=0; channel<SENSOR_CHANNELS; channel++)
+        reading->raw[channel] = sensorFilter(sensorRing, SENSOR_SCANS, channel);
+    sensorCalibration cal;
+    MY_SensorCalibration(&cal);
+    sensorCalibrate(&cal, reading);
+    return true;
+}
+
+// Take a fresh burst of scans and get a calibrated reading of them.  Acquisition is restarted even if it
+// was running, because after a sleep the ring may hold scans from before it.  While waiting we idle in
+// Sleep mode, from which the DMA interrupt wakes us.
+bool sensorSample(sensorReading *reading) {
+    bool wasRunning = sensorRunning;
+    sensorStop();
+    sensorStart();
+    uint32_t beganMs = millis();
+    while (!sensorFilled && (uint32_t) (millis() - beganMs) < SENSOR_TIMEOUT_MS)
+        MY_SensorIdle();
+    bool success = sensorRead(reading);
+    if (!wasRunning)
+        sensorStop();
+    return success;
+}
+
+// Filter one channel of the ring, returning the mean of its scans after discarding the highest and the
+// lowest, so that a single disturbed scan doesn't skew the result.
+uint32_t sensorFilter(const uint16_t *ring, int scans, int channel) {
+    uint32_t sum = 0;
+    uint16_t lowest = UINT16_MAX;
+    uint16_t highest = 0;
+    for (int i=0; i<scans; i++) {
+        uint16_t value = ring[i*SENSOR_CHANNELS + channel];
+        sum += value;
+        if (value < lowest)
+            lowest = value;
+        if (value > highest)
+            highest = value;
+    }
+    if (scans < 3)
+        return scans == 0 ? 0 : sum / scans;
+    sum -= lowest + highest;
+    scans -= 2;
+    return (sum + scans/2) / scans;
+}
+
+// Convert the filtered values into calibrated units.  VREFINT is known to be the voltage that yielded the
+// factory's reading of it at 3.0V, which tells us VDDA, and VDDA is the full scale of every other channel.
+// The temperature sensor is compared with its factory reading after rescaling it to what it would have read
+// at 3.0V, and the difference converted to degrees by the sensor's slope.
+void sensorCalibrate(const sensorCalibration *cal, sensorReading *reading) {
+    uint32_t vrefint = reading->raw[SENSOR_VREFINT];
+    if (vrefint == 0) {
+        reading->vddaMv = reading->tempCentiC = reading->inputMv = 0;
+        return;
+    }
+    uint32_t vddaMv = ((uint32_t) SENSOR_CAL_MV * cal->vrefintCal * SENSOR_OVERSAMPLE + vrefint/2) / vrefint;
+    reading->vddaMv = (int32_t) vddaMv;
+    reading->inputMv = (int32_t) ((reading->raw[SENSOR_INPUT] * vddaMv + SENSOR_FULL_SCALE/2) / SENSOR_FULL_SCALE);
+    int32_t delta = (int32_t) (reading->raw[SENSOR_TEMP] * vddaMv / SENSOR_CAL_MV) - (int32_t) cal->tsCal1 * SENSOR_OVERSAMPLE;
+    int64_t deltaCentiC = ((int64_t) delta * SENSOR_CAL_MV * 1000 * 100) / ((int64_t) SENSOR_FULL_SCALE * SENSOR_TS_SLOPE_UV);
+    reading->tempCentiC = SENSOR_TS_CAL1_C*100 + (int32_t) deltaCentiC;
+}
+
+#endif // SENSORS
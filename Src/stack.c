@@ -0,0 +1,61 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// This module measures how deep the stack has ever grown.  The stack grows down from the top of RAM toward
+// the heap, which _sbrk grows up toward the stack pointer, and nothing stops the two from meeting when the
+// stack, rather than the heap, is the one that grows.  At boot, before anything has been allocated, all of
+// the memory between the end of the static data and the stack is painted with a known word.  Anything that
+// the stack has since reached will have been overwritten, so the deepest point that it has reached is the
+// lowest word above the top of the heap that no longer holds the paint.  Finding it takes a scan of the
+// free memory, which is cheap enough to do once per pass through the app's loop.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "main.h"
+#include "stack.h"
+
+#if STACK_MONITOR
+
+// Symbols from the linker script, and the heap's current top from syscalls
+extern uint32_t _estack;
+extern char end asm("end");
+char *_sbrk(int incr);
+
+// The top of the heap, rounded up to a word
+static uint32_t *stackHeapTop() {
+    uintptr_t top = (uintptr_t) _sbrk(0);
+    return (uint32_t *) ((top + 3) & ~(uintptr_t) 3);
+}
+
+// Paint the free memory between the heap and the stack.  This must be called first thing in main(), before
+// anything is allocated.
+void stackPaint() {
+    uint32_t *p = (uint32_t *) (((uintptr_t) &end + 3) & ~(uintptr_t) 3);
+    uint32_t *limit = (uint32_t *) (__get_MSP() - STACK_PAINT_MARGIN);
+    while (p < limit)
+        *p++ = STACK_PAINT;
+}
+
+// Find the deepest point that the stack has reached
+static uint32_t *stackDeepest() {
+    uint32_t *p = stackHeapTop();
+    uint32_t *top = &_estack;
+    while (p < top && *p == STACK_PAINT)
+        p++;
+    return p;
+}
+
+// Get the most stack that has ever been used, in bytes
+uint32_t stackUsed() {
+    return (uint32_t) ((uintptr_t) &_estack - (uintptr_t) stackDeepest());
+}
+
+// Get the number of bytes that have never been touched between the top of the heap and the deepest point
+// that the stack has reached.  If this ever reaches zero, the two may have collided.
+uint32_t stackHeadroom() {
+    return (uint32_t) ((uintptr_t) stackDeepest() - (uintptr_t) stackHeapTop());
+}
+
+#endif // STACK_MONITOR
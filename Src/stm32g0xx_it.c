@@ -99,6 +99,13 @@ void EXTI4_15_IRQHandler( void ) {
   MY_GPIO_EXTI_IRQHandler(GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7|GPIO_PIN_8|GPIO_PIN_9|GPIO_PIN_10|GPIO_PIN_11|GPIO_PIN_12|GPIO_PIN_13|GPIO_PIN_14|GPIO_PIN_15);
 }
 
+// DMA1 channel 1 interrupt, used by sensor acquisition
+#if SENSORS
+void DMA1_Channel1_IRQHandler(void) {
+    MY_SensorIRQHandler();
+}
+#endif
+
 // LPTIM1 global interrupt
 #ifdef EVENT_TIMER
 void LPTIM1_IRQHandler(void) {
@@ -0,0 +1,119 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// This module implements a tickless clock that keeps running in STOP1 mode.  LPTIM1 free-runs through its
+// 16-bit range, and we extend it to 64 bits by counting its overflows, which gives us time with sub-millisecond
+// resolution without having to wake up periodically to maintain it.  Rather than taking an interrupt on every
+// tick, the compare register is only programmed for the next deadline that falls within the current pass
+// through the counter; if the deadline is further away than that, the overflow interrupt carries it forward.
+// The hardware itself is accessed only through MY_TimerCounter() and MY_TimerSetCompare(), so that everything
+// here can be exercised against a simulated counter.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "main.h"
+#include "timebase.h"
+
+#ifdef EVENT_TIMER
+
+// Number of times that the counter has wrapped since boot
+static volatile uint32_t timebaseOverflows = 0;
+
+// The next deadline, in ticks
+static volatile bool deadlineArmed = false;
+static volatile uint64_t deadlineTicks = 0;
+
+// Forwards
+static bool timebaseArm(uint64_t now);
+
+// Get the number of ticks since boot.  If we race with the overflow interrupt we simply try again, and if an
+// overflow is pending because interrupts are masked, we account for it ourselves.  The wrap is flagged, and
+// its interrupt taken, during the tick in which the counter sits at its maximum, before it has actually
+// wrapped, so we wait out that one tick rather than read a whole pass ahead.
+uint64_t timebaseTicks() {
+    uint32_t overflows;
+    uint16_t counter;
+    bool overflowPending;
+    do {
+        overflows = timebaseOverflows;
+        counter = MY_TimerCounter(&overflowPending);
+    } while (overflows != timebaseOverflows || counter == TIMEBASE_COUNTER_MAX);
+    if (overflowPending)
+        overflows++;
+    return ((uint64_t) overflows << TIMEBASE_COUNTER_BITS) | counter;
+}
+
+// Get the number of milliseconds since boot (this will wrap)
+uint32_t timebaseMs() {
+    return (uint32_t) (timebaseTicks() >> TIMEBASE_TICKS_PER_MS_SHIFT);
+}
+
+// Get the number of microseconds since boot
+uint64_t timebaseUs() {
+    return (timebaseTicks() * 1000000) / TIMEBASE_HZ;
+}
+
+// After waking from a mode that restarts us from reset, move the time base on to where it would have been had
+// it kept running, so that times taken before the sleep still compare correctly with times taken after it.
+// The counter itself can't be moved, so we move on by whole passes through it, which may leave us up to one
+// pass (about two seconds) ahead.  This must be called before any deadline has been set.
+void timebaseResume(uint32_t ms) {
+    uint64_t ticks = (uint64_t) ms << TIMEBASE_TICKS_PER_MS_SHIFT;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint64_t now = timebaseTicks();
+    if (ticks > now)
+        timebaseOverflows += (uint32_t) ((ticks - now + TIMEBASE_COUNTER_MAX) >> TIMEBASE_COUNTER_BITS);
+    __set_PRIMASK(primask);
+}
+
+// Set the deadline at which the compare interrupt should fire, in the same units as timebaseMs().  This
+// returns true if the deadline is already due, in which case no interrupt will be generated for it.
+bool timebaseSetDeadline(uint32_t ms) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint64_t now = timebaseTicks();
+    int32_t deltaMs = (int32_t) (ms - (uint32_t) (now >> TIMEBASE_TICKS_PER_MS_SHIFT));
+    if (deltaMs < 0)
+        deltaMs = 0;
+    deadlineTicks = ((now >> TIMEBASE_TICKS_PER_MS_SHIFT) + deltaMs) << TIMEBASE_TICKS_PER_MS_SHIFT;
+    deadlineArmed = true;
+    bool due = timebaseArm(now);
+    __set_PRIMASK(primask);
+    return due;
+}
+
+// Cancel the deadline, and move the compare to where it will coincide with the overflow interrupt
+void timebaseCancelDeadline() {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (deadlineArmed) {
+        deadlineArmed = false;
+        MY_TimerSetCompare(TIMEBASE_COUNTER_MAX);
+    }
+    __set_PRIMASK(primask);
+}
+
+// Called from the overflow interrupt.  This returns true if the deadline became due without a compare
+// having been armed for it, in which case the caller should poll for expiry.
+bool timebaseOverflow() {
+    timebaseOverflows++;
+    return timebaseArm(timebaseTicks());
+}
+
+// If the deadline falls within the current pass through the counter, arm the compare for it.  Returns
+// true if the deadline is too close, or already past, to be armed.
+static bool timebaseArm(uint64_t now) {
+    if (!deadlineArmed)
+        return false;
+    if (deadlineTicks < now + TIMEBASE_COMPARE_MARGIN)
+        return true;
+    if ((deadlineTicks >> TIMEBASE_COUNTER_BITS) == (now >> TIMEBASE_COUNTER_BITS))
+        MY_TimerSetCompare((uint16_t) deadlineTicks);
+    else
+        MY_TimerSetCompare(TIMEBASE_COUNTER_MAX);
+    return false;
+}
+
+#endif // EVENT_TIMER
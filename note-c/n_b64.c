@@ -79,6 +79,7 @@
  * Base64 encoder/decoder. Originally Apache file ap_base64.c
  */
 
+#include <limits.h>
 #include <string.h>
 #include "n_lib.h"
 
@@ -119,48 +120,84 @@ int JB64DecodeLen(const char *bufcoded)
     return nbytesdecoded + 1;
 }
 
-int JB64Decode(char *bufplain, const char *bufcoded)
+/*
+ * The exact number of bytes that JB64Decode will produce, without the
+ * terminator, so that a caller can check a payload before decoding it.
+ */
+int JB64DecodeExactLen(const char *bufcoded)
 {
-    int nbytesdecoded;
     register const unsigned char *bufin;
-    register unsigned char *bufout;
     register int nprbytes;
 
     bufin = (const unsigned char *) bufcoded;
     while (pr2six[*(bufin++)] <= 63);
     nprbytes = (bufin - (const unsigned char *) bufcoded) - 1;
-    nbytesdecoded = ((nprbytes + 3) / 4) * 3;
 
-    bufout = (unsigned char *) bufplain;
-    bufin = (const unsigned char *) bufcoded;
+    return (nprbytes / 4) * 3 + ((nprbytes & 3) > 1 ? (nprbytes & 3) - 1 : 0);
+}
 
-    while (nprbytes > 4) {
-    *(bufout++) =
-        (unsigned char) (pr2six[*bufin] << 2 | pr2six[bufin[1]] >> 4);
-    *(bufout++) =
-        (unsigned char) (pr2six[bufin[1]] << 4 | pr2six[bufin[2]] >> 2);
-    *(bufout++) =
-        (unsigned char) (pr2six[bufin[2]] << 6 | pr2six[bufin[3]]);
-    bufin += 4;
-    nprbytes -= 4;
-    }
+/*
+ * Incremental decoding.  Sextets are accumulated in the context, and each
+ * output byte is emitted as soon as the sextets that complete it arrive, so
+ * the coded text may be split anywhere and nothing is buffered beyond three
+ * sextets.  As with JB64Decode, decoding ends at the first byte that isn't
+ * part of the alphabet, which includes padding, and a lone trailing sextet
+ * is ignored.
+ */
+void JB64DecodeStart(JB64Decoder *ctx)
+{
+    ctx->bits = 0;
+    ctx->sextets = 0;
+    ctx->done = false;
+}
 
-    /* Note: (nprbytes == 1) would be an error, so just ingore that case */
-    if (nprbytes > 1) {
-    *(bufout++) =
-        (unsigned char) (pr2six[*bufin] << 2 | pr2six[bufin[1]] >> 4);
+int JB64DecodeUpdate(JB64Decoder *ctx, void *bufplain, int plainlen, const char *bufcoded, int codedlen)
+{
+    register const unsigned char *bufin = (const unsigned char *) bufcoded;
+    register unsigned char *bufout = (unsigned char *) bufplain;
+    int nbytesdecoded = 0;
+
+    while (!ctx->done && codedlen-- > 0) {
+    unsigned char six = pr2six[*(bufin++)];
+    unsigned char byte;
+    if (six > 63) {
+        ctx->done = true;
+        break;
+    }
+    ctx->bits = (ctx->bits << 6) | six;
+    switch (++ctx->sextets) {
+    case 1:
+        continue;
+    case 2:
+        byte = (unsigned char) (ctx->bits >> 4);
+        break;
+    case 3:
+        byte = (unsigned char) (ctx->bits >> 2);
+        break;
+    default:
+        byte = (unsigned char) ctx->bits;
+        ctx->bits = 0;
+        ctx->sextets = 0;
+        break;
     }
-    if (nprbytes > 2) {
-    *(bufout++) =
-        (unsigned char) (pr2six[bufin[1]] << 4 | pr2six[bufin[2]] >> 2);
+    if (nbytesdecoded == plainlen) {
+        ctx->done = true;
+        return -1;
     }
-    if (nprbytes > 3) {
-    *(bufout++) =
-        (unsigned char) (pr2six[bufin[2]] << 6 | pr2six[bufin[3]]);
+    bufout[nbytesdecoded++] = byte;
     }
 
-    *(bufout++) = '\0';
-    nbytesdecoded -= (4 - nprbytes) & 3;
+    return nbytesdecoded;
+}
+
+int JB64Decode(char *bufplain, const char *bufcoded)
+{
+    JB64Decoder ctx;
+    int nbytesdecoded;
+
+    JB64DecodeStart(&ctx);
+    nbytesdecoded = JB64DecodeUpdate(&ctx, bufplain, INT_MAX, bufcoded, INT_MAX);
+    bufplain[nbytesdecoded] = '\0';
     return nbytesdecoded;
 }
 
@@ -172,34 +209,85 @@ int JB64EncodeLen(int len)
     return ((len + 2) / 3 * 4) + 1;
 }
 
-int JB64Encode(char *encoded, const char *string, int len)
+/*
+ * Incremental encoding.  Up to two bytes that don't yet make up a full
+ * group of three are held in the context between calls, so each call
+ * writes at most JB64EncodeUpdateLen() characters, and the final call
+ * writes the last group with its padding, and a terminator.
+ */
+void JB64EncodeStart(JB64Encoder *ctx)
+{
+    ctx->pendingLen = 0;
+}
+
+int JB64EncodeUpdateLen(JB64Encoder *ctx, int len)
 {
-    int i;
-    char *p;
-
-    p = encoded;
-    for (i = 0; i < len - 2; i += 3) {
-    *p++ = basis_64[(string[i] >> 2) & 0x3F];
-    *p++ = basis_64[((string[i] & 0x3) << 4) |
-                    ((int) (string[i + 1] & 0xF0) >> 4)];
-    *p++ = basis_64[((string[i + 1] & 0xF) << 2) |
-                    ((int) (string[i + 2] & 0xC0) >> 6)];
-    *p++ = basis_64[string[i + 2] & 0x3F];
+    return (ctx->pendingLen + len) / 3 * 4;
+}
+
+int JB64EncodeUpdate(JB64Encoder *ctx, char *encoded, const void *plain, int len)
+{
+    const unsigned char *string = (const unsigned char *) plain;
+    unsigned char group[3];
+    char *p = encoded;
+
+    while (ctx->pendingLen + len >= 3) {
+    int i = 0;
+    for (; i < ctx->pendingLen; i++)
+        group[i] = ctx->pending[i];
+    for (; i < 3; i++, len--)
+        group[i] = *string++;
+    ctx->pendingLen = 0;
+    *p++ = basis_64[group[0] >> 2];
+    *p++ = basis_64[((group[0] & 0x3) << 4) | (group[1] >> 4)];
+    *p++ = basis_64[((group[1] & 0xF) << 2) | (group[2] >> 6)];
+    *p++ = basis_64[group[2] & 0x3F];
+
+    /* Once nothing is pending, whole groups come straight from the input */
+    for (; len >= 3; len -= 3, string += 3) {
+        *p++ = basis_64[string[0] >> 2];
+        *p++ = basis_64[((string[0] & 0x3) << 4) | (string[1] >> 4)];
+        *p++ = basis_64[((string[1] & 0xF) << 2) | (string[2] >> 6)];
+        *p++ = basis_64[string[2] & 0x3F];
     }
-    if (i < len) {
-    *p++ = basis_64[(string[i] >> 2) & 0x3F];
-    if (i == (len - 1)) {
-        *p++ = basis_64[((string[i] & 0x3) << 4)];
+    }
+    while (len-- > 0)
+    ctx->pending[ctx->pendingLen++] = *string++;
+
+    return p - encoded;
+}
+
+int JB64EncodeFinish(JB64Encoder *ctx, char *encoded)
+{
+    char *p = encoded;
+
+    if (ctx->pendingLen > 0) {
+    unsigned char c0 = ctx->pending[0];
+    *p++ = basis_64[c0 >> 2];
+    if (ctx->pendingLen == 1) {
+        *p++ = basis_64[((c0 & 0x3) << 4)];
         *p++ = '=';
     }
     else {
-        *p++ = basis_64[((string[i] & 0x3) << 4) |
-                        ((int) (string[i + 1] & 0xF0) >> 4)];
-        *p++ = basis_64[((string[i + 1] & 0xF) << 2)];
+        unsigned char c1 = ctx->pending[1];
+        *p++ = basis_64[((c0 & 0x3) << 4) | (c1 >> 4)];
+        *p++ = basis_64[((c1 & 0xF) << 2)];
     }
     *p++ = '=';
+    ctx->pendingLen = 0;
     }
 
-    *p++ = '\0';
+    *p = '\0';
     return p - encoded;
 }
+
+int JB64Encode(char *encoded, const char *string, int len)
+{
+    JB64Encoder ctx;
+    int n;
+
+    JB64EncodeStart(&ctx);
+    n = JB64EncodeUpdate(&ctx, encoded, string, len);
+    n += JB64EncodeFinish(&ctx, encoded + n);
+    return n + 1;
+}
@@ -0,0 +1,247 @@
+/*!
+ * @file n_batch.c
+ *
+ * Accumulation of many samples into the body of a single note, so that the
+ * cost of each note, which is the request around it, the transaction with
+ * the Notecard and the Notecard's storage of the note, is shared by all of
+ * the samples in it rather than paid for each one.  The samples are held
+ * as the text of a JSON array of rows, each of which is the sample's time
+ * offset from the first sample followed by its values, in a buffer that
+ * the caller provides, so that the memory used is fixed and no `J` tree is
+ * built until the batch is added.  The note's body is of the form:
+ *
+ *     {"base":1600000000,"fields":["temp","voltage"],
+ *      "samples":[[0,22.5,3.3],[15,22.6,3.3]]}
+ *
+ * Written by Ray Ozzie and Blues Inc. team.
+ *
+ * Copyright (c) 2019 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#include <stdio.h>
+#include "n_lib.h"
+
+//**************************************************************************/
+/*!
+    @brief  Empty a batch, leaving only the opening bracket of the array.
+    @param   batch  The batch's state.
+*/
+/**************************************************************************/
+static void batchReset(NoteBatch *batch) {
+    batch->buf[0] = '[';
+    batch->used = 1;
+    batch->count = 0;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Prepare to accumulate samples.
+    @param   batch  The batch's state, which the caller keeps.
+    @param   file  The notefile to which each batch is added.
+    @param   fields  The name of each value in a sample, which must remain
+             valid for as long as the batch is in use.
+    @param   fieldCount  The number of values in each sample, up to
+             `NOTE_BATCH_MAX_FIELDS`.
+    @param   buf  Where the samples are held.  Its length sets how many
+             bytes of samples a note can carry, and so bounds the memory
+             used both here and when the note is added.
+    @param   bufLen  The length of `buf`.
+*/
+/**************************************************************************/
+void NoteBatchBegin(NoteBatch *batch, const char *file, const char * const *fields, int fieldCount, char *buf, uint32_t bufLen) {
+    memset(batch, 0, sizeof(NoteBatch));
+    batch->file = file;
+    batch->fields = fields;
+    batch->fieldCount = (uint8_t) (fieldCount > NOTE_BATCH_MAX_FIELDS ? NOTE_BATCH_MAX_FIELDS : fieldCount);
+    batch->precision = -1;
+    batch->buf = buf;
+    batch->bufLen = bufLen;
+    batch->maxCount = NOTE_BATCH_MAX_SAMPLES;
+    batch->maxAgeMs = NOTE_BATCH_MAX_AGE_MS;
+    batchReset(batch);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Append text to the rows, provided that it leaves room for the
+            closing bracket and terminator that are added when the batch
+            is flushed.
+    @param   batch  The batch's state.
+    @param   at  Where to append, which may be beyond what is in use.
+    @param   text  The text.
+    @returns The offset following the text, or 0 if it doesn't fit.
+*/
+/**************************************************************************/
+static uint32_t batchAppend(NoteBatch *batch, uint32_t at, const char *text) {
+    uint32_t len = strlen(text);
+    if (at + len + 2 > batch->bufLen)
+        return 0;
+    memcpy(&batch->buf[at], text, len);
+    return at + len;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Add a sample as a row, if there's room for it.
+    @param   batch  The batch's state.
+    @param   values  The sample's values.
+    @param   nowMs  When the sample was taken.
+    @returns `true` if the row was added.
+*/
+/**************************************************************************/
+static bool batchAddRow(NoteBatch *batch, const JNUMBER *values, uint32_t nowMs) {
+    uint32_t offsetSecs = (batch->count == 0 ? 0 : (nowMs - batch->baseMs) / 1000);
+    char text[JNTOA_MAX+2];
+    snprintf(text, sizeof(text), "%s[%lu", batch->count == 0 ? "" : ",", (unsigned long) offsetSecs);
+    uint32_t at = batchAppend(batch, batch->used, text);
+    for (int i=0; at != 0 && i<batch->fieldCount; i++) {
+        text[0] = ',';
+        JNtoA(values[i], &text[1], batch->precision);
+        at = batchAppend(batch, at, text);
+    }
+    if (at != 0)
+        at = batchAppend(batch, at, "]");
+    if (at == 0)
+        return false;
+    if (batch->count == 0)
+        batch->baseMs = nowMs;
+    batch->used = at;
+    batch->count++;
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Whether a batch should be flushed, because it holds the maximum
+            number of samples or its first sample has reached the maximum
+            age.
+    @param   batch  The batch's state.
+    @returns `true` if the batch is due to be flushed.
+*/
+/**************************************************************************/
+bool NoteBatchDue(NoteBatch *batch) {
+    if (batch->count == 0)
+        return false;
+    if (batch->count >= batch->maxCount)
+        return true;
+    return (uint32_t) (_GetMs() - batch->baseMs) >= batch->maxAgeMs;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Add a sample to a batch, flushing the batch first if it is due
+            or if the sample won't fit, and afterward if the sample makes
+            it due.  If a flush fails on the way to the Notecard the samples
+            are kept, to be tried again on the next flush.
+    @param   batch  The batch's state.
+    @param   values  The sample's values, one for each field.
+    @returns `false` if the sample had to be dropped, because it couldn't
+             be fitted into the batch.
+*/
+/**************************************************************************/
+bool NoteBatchAdd(NoteBatch *batch, const JNUMBER *values) {
+    if (NoteBatchDue(batch))
+        NoteBatchFlush(batch);
+    uint32_t nowMs = _GetMs();
+    if (!batchAddRow(batch, values, nowMs)) {
+        if (batch->count != 0)
+            NoteBatchFlush(batch);
+        if (!batchAddRow(batch, values, nowMs)) {
+            batch->dropped++;
+            return false;
+        }
+    }
+    if (NoteBatchDue(batch))
+        NoteBatchFlush(batch);
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Flush a batch if it is due, which should be done periodically
+            so that the age limit is honored even when no samples arrive.
+    @param   batch  The batch's state.
+    @returns `false` if a flush was due and failed.
+*/
+/**************************************************************************/
+bool NoteBatchPoll(NoteBatch *batch) {
+    if (!NoteBatchDue(batch))
+        return true;
+    return NoteBatchFlush(batch);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Add the samples in a batch as a single note, and empty it.
+            The rows are sent directly from the batch's buffer, so the
+            only other memory needed is for the request around them and
+            its serialized text.  The base time is formatted here rather
+            than added as a number, because a JNUMBER that is a float
+            can't hold an epoch time exactly.
+    @param   batch  The batch's state.
+    @returns `true` if the batch was empty or was added successfully.  If
+             the request couldn't be completed, the batch is left as it was
+             so that it can be sent again, but if the Notecard rejected it,
+             which it would do every time, its samples are counted as
+             dropped and it is emptied, so that it can't block the batches
+             after it.
+*/
+/**************************************************************************/
+bool NoteBatchFlush(NoteBatch *batch) {
+    if (batch->count == 0)
+        return true;
+
+    // Close the array, in the room that was reserved for doing so
+    batch->buf[batch->used] = ']';
+    batch->buf[batch->used+1] = '\0';
+
+    // Build the request around the rows, which are referenced rather than copied
+    J *req = NoteNewRequest("note.add");
+    if (req == NULL)
+        return false;
+    J *body = JCreateObject();
+    J *fields = JCreateArray();
+    J *samples = JCreateRawReference(batch->buf);
+    if (body == NULL || fields == NULL || samples == NULL) {
+        JDelete(body);
+        JDelete(fields);
+        JDelete(samples);
+        JDelete(req);
+        return false;
+    }
+    JAddStringToObject(req, "file", batch->file);
+    if (batch->start)
+        JAddBoolToObject(req, "start", true);
+    char base[16];
+    if (NoteTimeValidST()) {
+        uint32_t ageSecs = (_GetMs() - batch->baseMs) / 1000;
+        snprintf(base, sizeof(base), "%lu", (unsigned long) (NoteTimeST() - ageSecs));
+        JAddItemToObject(body, "base", JCreateRawReference(base));
+    }
+    for (int i=0; i<batch->fieldCount; i++)
+        JAddItemToArray(fields, JCreateStringReference(batch->fields[i]));
+    JAddItemToObject(body, "fields", fields);
+    JAddItemToObject(body, "samples", samples);
+    JAddItemToObject(req, "body", body);
+
+    // Send it, keeping the samples only if it failed on the way
+    JTape *rsp = NoteRequestResponseTape(req);
+    if (rsp == NULL)
+        return false;
+    const char *err = JTapeGetString(rsp, 0, c_err);
+    bool success = (err[0] == '\0');
+    bool retry = (strstr(err, c_ioerr) != NULL);
+    JTapeDelete(rsp);
+    if (retry)
+        return false;
+    if (!success)
+        batch->dropped += batch->count;
+    batchReset(batch);
+    return success;
+
+}
@@ -174,6 +174,25 @@ static J *JNew_Item()
     return node;
 }
 
+/* The compact node layout has no prev link, so an item's predecessor is found by walking its parent's children. */
+#ifdef NOTE_JCOMPACT
+#define set_prev(item, p)
+static J *get_prev(const J *parent, const J *item)
+{
+    J *prev = NULL;
+    J *child = parent->child;
+    while ((child != NULL) && (child != item))
+    {
+        prev = child;
+        child = child->next;
+    }
+    return (child == item) ? prev : NULL;
+}
+#else
+#define set_prev(item, p) ((item)->prev = (p))
+#define get_prev(parent, item) ((item)->prev)
+#endif
+
 /* Delete a J structure. */
 N_CJSON_PUBLIC(void) JDelete(J *item)
 {
@@ -185,7 +204,7 @@ N_CJSON_PUBLIC(void) JDelete(J *item)
         {
             JDelete(item->child);
         }
-        if (!(item->type & JIsReference) && (item->valuestring != NULL))
+        if (!(item->type & (JIsReference | JNumber)) && (item->valuestring != NULL))
         {
             _Free(item->valuestring);
         }
@@ -215,6 +234,7 @@ typedef struct
     size_t length;
     size_t offset;
     size_t depth; /* How deeply nested (in arrays/objects) is the input at the current offset. */
+    Jbool insitu; /* Strings are unescaped in place, and the tree refers into the content rather than copying it. */
 } parse_buffer;
 
 /* check if the given size is left to read in a given parse buffer (starting with 1) */
@@ -285,22 +305,7 @@ loop_end:
         return false; /* parse_error */
     }
 
-    item->valuenumber = number;
-
-    /* use saturation in case of overflow */
-    if (number >= INT_MAX)
-    {
-        item->valueint = INT_MAX;
-    }
-    else if (number <= INT_MIN)
-    {
-        item->valueint = INT_MIN;
-    }
-    else
-    {
-        item->valueint = (int)number;
-    }
-
+    JSetNumberHelper(item, number);
     item->type = JNumber;
 
     input_buffer->offset += (size_t)(after_end - number_c_string);
@@ -310,6 +315,7 @@ loop_end:
 /* don't ask me, but the original JSetNumberValue returns an integer or JNUMBER */
 N_CJSON_PUBLIC(JNUMBER) JSetNumberHelper(J *object, JNUMBER number)
 {
+#ifndef NOTE_JCOMPACT
     if (number >= INT_MAX)
     {
         object->valueint = INT_MAX;
@@ -322,6 +328,7 @@ N_CJSON_PUBLIC(JNUMBER) JSetNumberHelper(J *object, JNUMBER number)
     {
         object->valueint = (int)number;
     }
+#endif
 
     return object->valuenumber = number;
 }
@@ -359,7 +366,8 @@ static unsigned char* ensure(printbuffer * const p, size_t needed)
         return NULL;
     }
 
-    needed += p->offset + 1;
+    /* callers include the terminating null in what they need */
+    needed += p->offset;
     if (needed <= p->length)
     {
         return p->buffer + p->offset;
@@ -421,20 +429,10 @@ static void update_offset(printbuffer * const buffer)
     buffer->offset += strlen((const char*)buffer_pointer);
 }
 
-/* Render the number nicely from the given item into a string. */
-static Jbool print_number(const J * const item, printbuffer * const output_buffer)
+/* Format a number into a temporary buffer, returning its length or -1 on failure. */
+static int format_number(JNUMBER d, unsigned char number_buffer[26])
 {
-    unsigned char *output_pointer = NULL;
-    JNUMBER d = item->valuenumber;
     int length = 0;
-    size_t i = 0;
-    unsigned char number_buffer[26]; /* temporary buffer to print the number into */
-    unsigned char decimal_point = get_decimal_point();
-
-    if (output_buffer == NULL)
-    {
-        return false;
-    }
 
     /* This checks for NaN and Infinity */
     if ((d * 0) != 0)
@@ -464,7 +462,30 @@ static Jbool print_number(const J * const item, printbuffer * const output_buffe
     }
 
     /* conversion failed or buffer overrun occured */
-    if ((length < 0) || (length > (int)(sizeof(number_buffer) - 1)))
+    if ((length < 0) || (length > 26 - 1))
+    {
+        return -1;
+    }
+
+    return length;
+}
+
+/* Render the number nicely from the given item into a string. */
+static Jbool print_number(const J * const item, printbuffer * const output_buffer)
+{
+    unsigned char *output_pointer = NULL;
+    int length = 0;
+    size_t i = 0;
+    unsigned char number_buffer[26]; /* temporary buffer to print the number into */
+    unsigned char decimal_point = get_decimal_point();
+
+    if (output_buffer == NULL)
+    {
+        return false;
+    }
+
+    length = format_number(item->valuenumber, number_buffer);
+    if (length < 0)
     {
         return false;
     }
@@ -671,8 +692,14 @@ static Jbool parse_string(J * const item, parse_buffer * const input_buffer)
         /* calculate approximate size of the output (overestimate) */
         size_t allocation_length = 0;
         size_t skipped_bytes = 0;
-        while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
+        while ((size_t)(input_end - input_buffer->content) < input_buffer->length)
         {
+            /* skip to the next quote or escape a word at a time */
+            input_end += NoteScanQuote(input_end, input_buffer->length - (size_t)(input_end - input_buffer->content));
+            if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end == '\"'))
+            {
+                break;
+            }
             /* is escape sequence */
             if (input_end[0] == '\\')
             {
@@ -691,12 +718,20 @@ static Jbool parse_string(J * const item, parse_buffer * const input_buffer)
             goto fail; /* string ended unexpectedly */
         }
 
-        /* This is at most how much we need for the output */
-        allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = (unsigned char*)_Malloc(allocation_length + 1);	// trailing '\0'
-        if (output == NULL)
+        /* when parsing in place, the unescaped output can never overtake the input, and the terminator replaces the closing quote */
+        if (input_buffer->insitu)
         {
-            goto fail; /* allocation failure */
+            output = (unsigned char*)input_pointer;
+        }
+        else
+        {
+            /* This is at most how much we need for the output */
+            allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
+            output = (unsigned char*)_Malloc(allocation_length + 1);	// trailing '\0'
+            if (output == NULL)
+            {
+                goto fail; /* allocation failure */
+            }
         }
     }
 
@@ -760,7 +795,7 @@ static Jbool parse_string(J * const item, parse_buffer * const input_buffer)
     /* zero terminate the output */
     *output_pointer = '\0';
 
-    item->type = JString;
+    item->type = input_buffer->insitu ? (JString | JIsReference) : JString;
     item->valuestring = (char*)output;
 
     input_buffer->offset = (size_t) (input_end - input_buffer->content);
@@ -769,7 +804,7 @@ static Jbool parse_string(J * const item, parse_buffer * const input_buffer)
     return true;
 
 fail:
-    if (output != NULL)
+    if ((output != NULL) && !input_buffer->insitu)
     {
         _Free(output);
     }
@@ -798,6 +833,45 @@ void htoa16(uint16_t n, unsigned char *p)
     *p = '\0';
 }
 
+/* Count the characters that escaping will add to a string, and get its unescaped length. */
+static size_t count_escapes(const unsigned char * const input, size_t * const input_length)
+{
+    const unsigned char *input_pointer = NULL;
+    size_t escape_characters = 0;
+
+    /* skip runs that needn't be escaped a word at a time */
+    for (input_pointer = input; ; input_pointer++)
+    {
+        input_pointer += NoteScanPlain(input_pointer);
+        if (*input_pointer == '\0')
+        {
+            break;
+        }
+        switch (*input_pointer)
+        {
+            case '\"':
+            case '\\':
+            case '\b':
+            case '\f':
+            case '\n':
+            case '\r':
+            case '\t':
+                /* one character escape sequence */
+                escape_characters++;
+                break;
+            default:
+                if (*input_pointer < 32)
+                {
+                    /* UTF-16 escape sequence uXXXX */
+                    escape_characters += 5;
+                }
+                break;
+        }
+    }
+    *input_length = (size_t)(input_pointer - input);
+    return escape_characters;
+}
+
 /* Render the cstring provided to an escaped version that can be printed. */
 static Jbool print_string_ptr(const unsigned char * const input, printbuffer * const output_buffer)
 {
@@ -816,7 +890,7 @@ static Jbool print_string_ptr(const unsigned char * const input, printbuffer * c
     /* empty string */
     if (input == NULL)
     {
-        output = ensure(output_buffer, 2);	// sizeof("\"\"")
+        output = ensure(output_buffer, 3);	// sizeof("\"\"")
         if (output == NULL)
         {
             return false;
@@ -828,33 +902,10 @@ static Jbool print_string_ptr(const unsigned char * const input, printbuffer * c
         return true;
     }
 
-    /* set "flag" to 1 if something needs to be escaped */
-    for (input_pointer = input; *input_pointer; input_pointer++)
-    {
-        switch (*input_pointer)
-        {
-            case '\"':
-            case '\\':
-            case '\b':
-            case '\f':
-            case '\n':
-            case '\r':
-            case '\t':
-                /* one character escape sequence */
-                escape_characters++;
-                break;
-            default:
-                if (*input_pointer < 32)
-                {
-                    /* UTF-16 escape sequence uXXXX */
-                    escape_characters += 5;
-                }
-                break;
-        }
-    }
-    output_length = (size_t)(input_pointer - input) + escape_characters;
+    escape_characters = count_escapes(input, &output_length);
+    output_length += escape_characters;
 
-    output = ensure(output_buffer, output_length + 2);	// sizeof("\"\"")
+    output = ensure(output_buffer, output_length + 3);	// sizeof("\"\"")
     if (output == NULL)
     {
         return false;
@@ -876,45 +927,46 @@ static Jbool print_string_ptr(const unsigned char * const input, printbuffer * c
     /* copy the string */
     for (input_pointer = input; *input_pointer != '\0'; (void)input_pointer++, output_pointer++)
     {
-        if ((*input_pointer > 31) && (*input_pointer != '\"') && (*input_pointer != '\\'))
+        /* copy any run of normal characters in one go */
+        size_t plain_length = NoteScanPlain(input_pointer);
+        memcpy(output_pointer, input_pointer, plain_length);
+        input_pointer += plain_length;
+        output_pointer += plain_length;
+        if (*input_pointer == '\0')
         {
-            /* normal character, copy */
-            *output_pointer = *input_pointer;
+            break;
         }
-        else
+        /* character needs to be escaped */
+        *output_pointer++ = '\\';
+        switch (*input_pointer)
         {
-            /* character needs to be escaped */
-            *output_pointer++ = '\\';
-            switch (*input_pointer)
-            {
-                case '\\':
-                    *output_pointer = '\\';
-                    break;
-                case '\"':
-                    *output_pointer = '\"';
-                    break;
-                case '\b':
-                    *output_pointer = 'b';
-                    break;
-                case '\f':
-                    *output_pointer = 'f';
-                    break;
-                case '\n':
-                    *output_pointer = 'n';
-                    break;
-                case '\r':
-                    *output_pointer = 'r';
-                    break;
-                case '\t':
-                    *output_pointer = 't';
-                    break;
-                default:
-                    /* escape and print as unicode codepoint */
-                    *output_pointer++ = 'u';
-                    htoa16(*input_pointer, output_pointer);
-                    output_pointer += 4;
-                    break;
-            }
+            case '\\':
+                *output_pointer = '\\';
+                break;
+            case '\"':
+                *output_pointer = '\"';
+                break;
+            case '\b':
+                *output_pointer = 'b';
+                break;
+            case '\f':
+                *output_pointer = 'f';
+                break;
+            case '\n':
+                *output_pointer = 'n';
+                break;
+            case '\r':
+                *output_pointer = 'r';
+                break;
+            case '\t':
+                *output_pointer = 't';
+                break;
+            default:
+                /* escape and print as unicode codepoint */
+                *output_pointer++ = 'u';
+                htoa16(*input_pointer, output_pointer);
+                output_pointer += 3; /* the loop steps past the last digit */
+                break;
         }
     }
     output[output_length + 1] = '\"';
@@ -945,9 +997,9 @@ static parse_buffer *buffer_skip_whitespace(parse_buffer * const buffer)
         return NULL;
     }
 
-    while (can_access_at_index(buffer, 0) && (buffer_at_offset(buffer)[0] <= 32))
+    if (can_access_at_index(buffer, 0))
     {
-       buffer->offset++;
+        buffer->offset += NoteScanWhitespace(buffer_at_offset(buffer), buffer->length - buffer->offset);
     }
 
     if (buffer->offset == buffer->length)
@@ -975,9 +1027,9 @@ static parse_buffer *skip_utf8_bom(parse_buffer * const buffer)
 }
 
 /* Parse an object - create a new root, and populate. */
-N_CJSON_PUBLIC(J *) JParseWithOpts(const char *value, const char **return_parse_end, Jbool require_null_terminated)
+static J *parse_with_opts(const char *value, const char **return_parse_end, Jbool require_null_terminated, Jbool insitu)
 {
-    parse_buffer buffer = { 0, 0, 0, 0 };
+    parse_buffer buffer = { 0, 0, 0, 0, 0 };
     J *item = NULL;
 
     /* reset error position */
@@ -992,6 +1044,7 @@ N_CJSON_PUBLIC(J *) JParseWithOpts(const char *value, const char **return_parse_
     buffer.content = (const unsigned char*)value;
     buffer.length = strlen((const char*)value) + 1;		// Trailing '\0'
     buffer.offset = 0;
+    buffer.insitu = insitu;
 
     item = JNew_Item();
     if (item == NULL) /* memory fail */
@@ -1053,64 +1106,205 @@ fail:
     return NULL;
 }
 
+/* Parse an object - create a new root, and populate. */
+N_CJSON_PUBLIC(J *) JParseWithOpts(const char *value, const char **return_parse_end, Jbool require_null_terminated)
+{
+    return parse_with_opts(value, return_parse_end, require_null_terminated, false);
+}
+
 /* Default options for JParse */
 N_CJSON_PUBLIC(J *) JParse(const char *value)
 {
-    return JParseWithOpts(value, 0, 0);
+    return parse_with_opts(value, 0, 0, false);
+}
+
+/* Parse a malloc'ed buffer in place, handing ownership of the buffer to the returned tree. */
+N_CJSON_PUBLIC(J *) JParseInSitu(char *value)
+{
+    J *item = parse_with_opts(value, 0, 0, true);
+    if (item == NULL)
+    {
+        return NULL;
+    }
+
+    /* an object or array has no valuestring of its own, so the root keeps the buffer there */
+    if (item->type & (JObject | JArray))
+    {
+        item->valuestring = value;
+        return item;
+    }
+
+    /* a bare string is moved to the front of the buffer, which it then owns; nothing else refers into it */
+    if (item->type & JString)
+    {
+        memmove(value, item->valuestring, strlen(item->valuestring) + 1);
+        item->type &= ~JIsReference;
+        item->valuestring = value;
+        return item;
+    }
+    _Free(value);
+    return item;
+}
+
+/* Compute the exact length of the printed form of a string, including its quotes. */
+static size_t measure_string(const unsigned char * const input)
+{
+    size_t input_length = 0;
+    size_t escape_characters = 0;
+
+    if (input == NULL)
+    {
+        return 2;
+    }
+    escape_characters = count_escapes(input, &input_length);
+    return input_length + escape_characters + 2;
+}
+
+/* Measure a number, in a frame of its own. */
+static int measure_number(JNUMBER d)
+{
+    unsigned char number_buffer[26];
+    return format_number(d, number_buffer);
 }
 
-#define cjson_min(a, b) ((a < b) ? a : b)
+/* Compute the exact length of the printed form of an item without allocating, mirroring print_value.
+ * The number buffer is kept out of this frame, which recurses. */
+static Jbool measure_value(const J * const item, size_t depth, Jbool format, size_t * const length)
+{
+    J *child = NULL;
+    size_t count = 0;
+    int number_length = 0;
+
+    if ((item == NULL) || (depth >= N_CJSON_NESTING_LIMIT))
+    {
+        return false;
+    }
+
+    switch ((item->type) & 0xFF)
+    {
+        case JNULL:
+            *length += c_null_len;
+            return true;
+
+        case JFalse:
+            *length += c_false_len;
+            return true;
+
+        case JTrue:
+            *length += c_true_len;
+            return true;
+
+        case JNumber:
+            number_length = measure_number(item->valuenumber);
+            if (number_length < 0)
+            {
+                return false;
+            }
+            *length += (size_t)number_length;
+            return true;
+
+        case JRaw:
+            if (item->valuestring == NULL)
+            {
+                return false;
+            }
+            *length += strlen(item->valuestring);
+            return true;
+
+        case JString:
+            *length += measure_string((const unsigned char*)item->valuestring);
+            return true;
+
+        case JArray:
+            /* brackets, and a separator between elements */
+            *length += 2;
+            for (child = item->child; child != NULL; child = child->next)
+            {
+                if (!measure_value(child, depth + 1, format, length))
+                {
+                    return false;
+                }
+                count++;
+            }
+            if (count > 1)
+            {
+                *length += (count - 1) * (format ? 2 : 1);
+            }
+            return true;
+
+        case JObject:
+            /* braces, and when formatted the newline after the opening one and the indent before the closing one */
+            *length += format ? (2 + 1 + depth) : 2;
+            for (child = item->child; child != NULL; child = child->next)
+            {
+                /* name, colon and value, and when formatted the indent, a tab after the colon and a newline */
+                *length += measure_string((const unsigned char*)child->string) + 1;
+                if (format)
+                {
+                    *length += (depth + 1) + 1 + 1;
+                }
+                if (!measure_value(child, depth + 1, format, length))
+                {
+                    return false;
+                }
+                count++;
+            }
+            if (count > 1)
+            {
+                *length += count - 1;
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
 
+/* Measure an item, then print it into a buffer of exactly the right size, so that there is just one allocation. */
 static unsigned char *print(const J * const item, Jbool format)
 {
-    static const size_t default_buffer_size = 128;
     printbuffer buffer[1];
-    unsigned char *printed = NULL;
+    size_t length = 0;
 
     memset(buffer, 0, sizeof(buffer));
 
+    if (!measure_value(item, 0, format, &length))
+    {
+        return NULL;
+    }
+
     /* create buffer */
-    buffer->buffer = (unsigned char*) _Malloc(default_buffer_size);
-    buffer->length = default_buffer_size;
+    buffer->buffer = (unsigned char*) _Malloc(length + 1);	// trailing '\0'
+    buffer->length = length + 1;
+    buffer->noalloc = true;
     buffer->format = format;
     if (buffer->buffer == NULL)
     {
-        goto fail;
+        return NULL;
     }
 
     /* print the value */
     if (!print_value(item, buffer))
     {
-        goto fail;
-    }
-    update_offset(buffer);
-
-    /* copy the JSON over to a new buffer */
-    printed = (unsigned char*) _Malloc(buffer->offset + 1);
-    if (printed == NULL)
-    {
-        goto fail;
+        _Free(buffer->buffer);
+        return NULL;
     }
-    memcpy(printed, buffer->buffer, cjson_min(buffer->length, buffer->offset + 1));
-    printed[buffer->offset] = '\0'; /* just to be sure */
+    buffer->buffer[length] = '\0'; /* just to be sure */
 
-    /* free the buffer */
-    _Free(buffer->buffer);
-
-    return printed;
+    return buffer->buffer;
+}
 
-fail:
-    if (buffer->buffer != NULL)
-    {
-        _Free(buffer->buffer);
-    }
+/* Compute the length of an item's printed form, excluding the terminating null, or -1 if it can't be printed. */
+N_CJSON_PUBLIC(int) JPrintLength(const J *item, Jbool format)
+{
+    size_t length = 0;
 
-    if (printed != NULL)
+    if (!measure_value(item, 0, format, &length) || (length > INT_MAX))
     {
-        _Free(printed);
+        return -1;
     }
 
-    return NULL;
+    return (int)length;
 }
 
 /* Render a J item/entity/structure to text. */
@@ -1198,7 +1392,9 @@ static Jbool parse_value(J * const item, parse_buffer * const input_buffer)
     if (can_read(input_buffer, 4) && (strncmp((const char*)buffer_at_offset(input_buffer), c_true, c_true_len) == 0))
     {
         item->type = JTrue;
+#ifndef NOTE_JCOMPACT
         item->valueint = 1;
+#endif
         input_buffer->offset += 4;
         return true;
     }
@@ -1355,7 +1551,7 @@ static Jbool parse_array(J * const item, parse_buffer * const input_buffer)
         {
             /* add to the end and advance */
             current_item->next = new_item;
-            new_item->prev = current_item;
+            set_prev(new_item, current_item);
             current_item = new_item;
         }
 
@@ -1401,7 +1597,7 @@ static Jbool print_array(const J * const item, printbuffer * const output_buffer
     size_t length = 0;
     J *current_element = item->child;
 
-    if (output_buffer == NULL)
+    if ((output_buffer == NULL) || (output_buffer->depth >= N_CJSON_NESTING_LIMIT))
     {
         return false;
     }
@@ -1509,7 +1705,7 @@ static Jbool parse_object(J * const item, parse_buffer * const input_buffer)
         {
             /* add to the end and advance */
             current_item->next = new_item;
-            new_item->prev = current_item;
+            set_prev(new_item, current_item);
             current_item = new_item;
         }
 
@@ -1525,6 +1721,10 @@ static Jbool parse_object(J * const item, parse_buffer * const input_buffer)
         /* swap valuestring and string, because we parsed the name */
         current_item->string = current_item->valuestring;
         current_item->valuestring = NULL;
+        if (input_buffer->insitu)
+        {
+            current_item->type = JStringIsConst; /* the name lives in the buffer */
+        }
 
         if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != ':'))
         {
@@ -1538,6 +1738,10 @@ static Jbool parse_object(J * const item, parse_buffer * const input_buffer)
         {
             goto fail; /* failed to parse value */
         }
+        if (input_buffer->insitu)
+        {
+            current_item->type |= JStringIsConst;
+        }
         buffer_skip_whitespace(input_buffer);
     }
     while (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == ','));
@@ -1572,7 +1776,7 @@ static Jbool print_object(const J * const item, printbuffer * const output_buffe
     size_t length = 0;
     J *current_item = item->child;
 
-    if (output_buffer == NULL)
+    if ((output_buffer == NULL) || (output_buffer->depth >= N_CJSON_NESTING_LIMIT))
     {
         return false;
     }
@@ -1779,7 +1983,7 @@ N_CJSON_PUBLIC(Jbool) JHasObjectItem(const J *object, const char *string)
 static void suffix_object(J *prev, J *item)
 {
     prev->next = item;
-    item->prev = prev;
+    set_prev(item, prev);
 }
 
 /* Utility for handling references. */
@@ -1800,7 +2004,8 @@ static J *create_reference(const J *item)
     memcpy(reference, item, sizeof(J));
     reference->string = NULL;
     reference->type |= JIsReference;
-    reference->next = reference->prev = NULL;
+    reference->next = NULL;
+    set_prev(reference, NULL);
     return reference;
 }
 
@@ -2033,20 +2238,23 @@ N_CJSON_PUBLIC(J*) JAddArrayToObject(J * const object, const char * const name)
 
 N_CJSON_PUBLIC(J *) JDetachItemViaPointer(J *parent, J * const item)
 {
+    J *prev = NULL;
+
     if ((parent == NULL) || (item == NULL))
     {
         return NULL;
     }
 
-    if (item->prev != NULL)
+    prev = get_prev(parent, item);
+    if (prev != NULL)
     {
         /* not the first element */
-        item->prev->next = item->next;
+        prev->next = item->next;
     }
     if (item->next != NULL)
     {
         /* not the last element */
-        item->next->prev = item->prev;
+        set_prev(item->next, prev);
     }
 
     if (item == parent->child)
@@ -2055,7 +2263,7 @@ N_CJSON_PUBLIC(J *) JDetachItemViaPointer(J *parent, J * const item)
         parent->child = item->next;
     }
     /* make sure the detached item doesn't point anywhere anymore */
-    item->prev = NULL;
+    set_prev(item, NULL);
     item->next = NULL;
 
     return item;
@@ -2104,6 +2312,7 @@ N_CJSON_PUBLIC(void) JDeleteItemFromObjectCaseSensitive(J *object, const char *s
 N_CJSON_PUBLIC(void) JInsertItemInArray(J *array, int which, J *newitem)
 {
     J *after_inserted = NULL;
+    J *prev = NULL;
 
     if (which < 0)
     {
@@ -2117,21 +2326,24 @@ N_CJSON_PUBLIC(void) JInsertItemInArray(J *array, int which, J *newitem)
         return;
     }
 
+    prev = get_prev(array, after_inserted);
     newitem->next = after_inserted;
-    newitem->prev = after_inserted->prev;
-    after_inserted->prev = newitem;
+    set_prev(newitem, prev);
+    set_prev(after_inserted, newitem);
     if (after_inserted == array->child)
     {
         array->child = newitem;
     }
     else
     {
-        newitem->prev->next = newitem;
+        prev->next = newitem;
     }
 }
 
 N_CJSON_PUBLIC(Jbool) JReplaceItemViaPointer(J * const parent, J * const item, J * replacement)
 {
+    J *prev = NULL;
+
     if ((parent == NULL) || (replacement == NULL) || (item == NULL))
     {
         return false;
@@ -2142,16 +2354,17 @@ N_CJSON_PUBLIC(Jbool) JReplaceItemViaPointer(J * const parent, J * const item, J
         return true;
     }
 
+    prev = get_prev(parent, item);
     replacement->next = item->next;
-    replacement->prev = item->prev;
+    set_prev(replacement, prev);
 
     if (replacement->next != NULL)
     {
-        replacement->next->prev = replacement;
+        set_prev(replacement->next, replacement);
     }
-    if (replacement->prev != NULL)
+    if (prev != NULL)
     {
-        replacement->prev->next = replacement;
+        prev->next = replacement;
     }
     if (parent->child == item)
     {
@@ -2159,7 +2372,7 @@ N_CJSON_PUBLIC(Jbool) JReplaceItemViaPointer(J * const parent, J * const item, J
     }
 
     item->next = NULL;
-    item->prev = NULL;
+    set_prev(item, NULL);
     JDelete(item);
 
     return true;
@@ -2256,21 +2469,7 @@ N_CJSON_PUBLIC(J *) JCreateNumber(JNUMBER num)
     if(item)
     {
         item->type = JNumber;
-        item->valuenumber = num;
-
-        /* use saturation in case of overflow */
-        if (num >= INT_MAX)
-        {
-            item->valueint = INT_MAX;
-        }
-        else if (num <= INT_MIN)
-        {
-            item->valueint = INT_MIN;
-        }
-        else
-        {
-            item->valueint = (int)num;
-        }
+        JSetNumberHelper(item, num);
     }
 
     return item;
@@ -2305,6 +2504,18 @@ N_CJSON_PUBLIC(J *) JCreateStringReference(const char *string)
     return item;
 }
 
+N_CJSON_PUBLIC(J *) JCreateRawReference(const char *raw)
+{
+    J *item = JNew_Item();
+    if (item != NULL)
+    {
+        item->type = JRaw | JIsReference;
+        item->valuestring = (char*)cast_away_const(raw);
+    }
+
+    return item;
+}
+
 N_CJSON_PUBLIC(J *) JCreateObjectReference(const J *child)
 {
     J *item = JNew_Item();
@@ -2493,10 +2704,17 @@ N_CJSON_PUBLIC(J *) JDuplicate(const J *item, Jbool recurse)
         goto fail;
     }
     /* Copy over all vars */
-    newitem->type = item->type & (~JIsReference);
+    newitem->type = item->type & (~(JIsReference | JStringIsConst));
+#ifndef NOTE_JCOMPACT
     newitem->valueint = item->valueint;
-    newitem->valuenumber = item->valuenumber;
-    if (item->valuestring)
+#endif
+    /* in the compact layout, valuenumber shares storage with valuestring */
+    if (item->type & JNumber)
+    {
+        newitem->valuenumber = item->valuenumber;
+    }
+    /* the root of an in-situ parse holds its buffer in valuestring, which must not be copied */
+    if (item->valuestring && (item->type & (JString | JRaw)))
     {
         newitem->valuestring = (char*)Jstrdup((unsigned char*)item->valuestring);
         if (!newitem->valuestring)
@@ -2506,7 +2724,8 @@ N_CJSON_PUBLIC(J *) JDuplicate(const J *item, Jbool recurse)
     }
     if (item->string)
     {
-        newitem->string = (item->type&JStringIsConst) ? item->string : (char*)Jstrdup((unsigned char*)item->string);
+        /* always copied, because a const name may point into the buffer of an in-situ parse */
+        newitem->string = (char*)Jstrdup((unsigned char*)item->string);
         if (!newitem->string)
         {
             goto fail;
@@ -2530,7 +2749,7 @@ N_CJSON_PUBLIC(J *) JDuplicate(const J *item, Jbool recurse)
         {
             /* If newitem->child already set, then crosswire ->prev and ->next and move on */
             next->next = newchild;
-            newchild->prev = next;
+            set_prev(newchild, next);
             next = newchild;
         }
         else
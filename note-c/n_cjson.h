@@ -70,23 +70,37 @@ extern "C"
 #define JStringIsConst 512
 
 /* The J structure: */
+/* With NOTE_JCOMPACT, a node has no prev link and no valueint, and its string and number share storage, */
+/* which on a 32-bit MCU shrinks it from 32 to 20 bytes.  Use the accessor functions rather than the fields. */
 typedef struct J
 {
     /* next/prev allow you to walk array/object chains. Alternatively, use GetArraySize/GetArrayItem/GetObjectItem */
     struct J *next;
+#ifndef NOTE_JCOMPACT
     struct J *prev;
+#endif
     /* An array or object item will have a child pointer pointing to a chain of the items in the array/object. */
     struct J *child;
 
     /* The type of the item, as above. */
     int type;
 
+#ifdef NOTE_JCOMPACT
+    union
+    {
+        /* The item's string, if type==JString  and type == JRaw */
+        char *valuestring;
+        /* The item's number, if type==JNumber */
+        JNUMBER valuenumber;
+    };
+#else
     /* The item's string, if type==JString  and type == JRaw */
     char *valuestring;
     /* writing to valueint is DEPRECATED, use JSetNumberValue instead */
     int valueint;
     /* The item's number, if type==JNumber */
     JNUMBER valuenumber;
+#endif
     /* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
     char *string;
 } J;
@@ -142,11 +156,16 @@ then using the N_CJSON_API_VISIBILITY flag to "export" the same symbols the way
 #endif
 #endif
 
-/* Limits how deeply nested arrays/objects can be before J rejects to parse them.
- * This is to prevent stack overflows. */
+/* Limits how deeply nested arrays/objects can be before J rejects to parse or print them.
+ * This is to prevent stack overflows, and on low-memory MCUs, whose stack is only a
+ * kilobyte or so, it is kept to what such a stack can hold. */
 #ifndef N_CJSON_NESTING_LIMIT
+#ifdef NOTE_LOWMEM
+#define N_CJSON_NESTING_LIMIT 16
+#else
 #define N_CJSON_NESTING_LIMIT 1000
 #endif
+#endif
 
 /* returns the version of J as a string */
 N_CJSON_PUBLIC(const char*) JVersion(void);
@@ -154,12 +173,15 @@ N_CJSON_PUBLIC(const char*) JVersion(void);
 /* Supply malloc, realloc and free functions to J */
 N_CJSON_PUBLIC(void) JInitHooks(JHooks* hooks);
 
-/* Memory Management: the caller is always responsible to free the results from all variants of JParse (with JDelete) and JPrint (with stdlib free, JHooks.free_fn, or JFree as appropriate). The exception is JPrintPreallocated, where the caller has full responsibility of the buffer. */
+/* Memory Management: the caller is always responsible to free the results from all variants of JParse (with JDelete) and JPrint (with JFree, because NoteMalloc prefixes each block with an accounting header). The exception is JPrintPreallocated, where the caller has full responsibility of the buffer. */
 /* Supply a block of JSON, and this returns a J object you can interrogate. */
 N_CJSON_PUBLIC(J *) JParse(const char *value);
 /* ParseWithOpts allows you to require (and check) that the JSON is null terminated, and to retrieve the pointer to the final byte parsed. */
 /* If you supply a ptr in return_parse_end and parsing fails, then return_parse_end will contain a pointer to the error so will match JGetErrorPtr(). */
 N_CJSON_PUBLIC(J *) JParseWithOpts(const char *value, const char **return_parse_end, Jbool require_null_terminated);
+/* ParseInSitu unescapes strings in place within a buffer obtained from JMalloc, rather than copying them, and takes ownership of that buffer on success so that it is freed by JDelete along with the tree. */
+/* On failure the caller still owns the buffer, whose contents will have been modified. Because names and string values refer into the buffer, an item detached from the tree is only valid until the tree itself is deleted; use JDuplicate to keep it longer. */
+N_CJSON_PUBLIC(J *) JParseInSitu(char *value);
 
 /* Render a J entity to text for transfer/storage. */
 N_CJSON_PUBLIC(char *) JPrint(const J *item);
@@ -168,8 +190,10 @@ N_CJSON_PUBLIC(char *) JPrintUnformatted(const J *item);
 /* Render a J entity to text using a buffered strategy. prebuffer is a guess at the final size. guessing well reduces reallocation. fmt=0 gives unformatted, =1 gives formatted */
 N_CJSON_PUBLIC(char *) JPrintBuffered(const J *item, int prebuffer, Jbool fmt);
 /* Render a J entity to text using a buffer already allocated in memory with given length. Returns 1 on success and 0 on failure. */
-/* NOTE: J is not always 100% accurate in estimating how much memory it will use, so to be safe allocate 5 bytes more than you actually need */
+/* A buffer of JPrintLength()+1 bytes is exactly large enough. */
 N_CJSON_PUBLIC(Jbool) JPrintPreallocated(J *item, char *buffer, const int length, const Jbool format);
+/* Compute the length of the text that JPrint (format true) or JPrintUnformatted (format false) would produce, without allocating. Returns -1 if it can't be printed. */
+N_CJSON_PUBLIC(int) JPrintLength(const J *item, Jbool format);
 /* Delete a J entity and all subentities. */
 N_CJSON_PUBLIC(void) JDelete(J *c);
 
@@ -214,6 +238,8 @@ N_CJSON_PUBLIC(J *) JCreateObject(void);
 /* Create a string where valuestring references a string so
  * it will not be freed by JDelete */
 N_CJSON_PUBLIC(J *) JCreateStringReference(const char *string);
+/* Create raw json that references text that will not be freed by JDelete */
+N_CJSON_PUBLIC(J *) JCreateRawReference(const char *raw);
 /* Create an object/arrray that only references it's elements so
  * they will not be freed by JDelete */
 N_CJSON_PUBLIC(J *) JCreateObjectReference(const J *child);
@@ -278,7 +304,11 @@ N_CJSON_PUBLIC(J*) JAddArrayToObject(J * const object, const char * const name);
 #define JConvertFromJSONString JParse
 
 /* When assigning an integer value, it needs to be propagated to valuenumber too. */
+#ifdef NOTE_JCOMPACT
+#define JSetIntValue(object, number) JSetNumberValue(object, number)
+#else
 #define JSetIntValue(object, number) ((object) ? (object)->valueint = (object)->valuenumber = (number) : (number))
+#endif
 /* helper for the JSetNumberValue macro */
 N_CJSON_PUBLIC(JNUMBER) JSetNumberHelper(J *object, JNUMBER number);
 #define JSetNumberValue(object, number) ((object != NULL) ? JSetNumberHelper(object, (JNUMBER)number) : (number))
@@ -11,6 +11,7 @@
  *
  */
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -93,6 +94,8 @@ bool JBoolValue(J *item) {
 char *JStringValue(J *item) {
 	if (item == NULL)
 		return "";
+	if (!JIsString(item) && !JIsRaw(item))
+		return NULL;
 	return item->valuestring;
 }
 
@@ -106,6 +109,8 @@ char *JStringValue(J *item) {
 JNUMBER JNumberValue(J *item) {
 	if (item == NULL)
 		return 0.0;
+	if (!JIsNumber(item))
+		return 0.0;
 	return item->valuenumber;
 }
 
@@ -138,7 +143,19 @@ JNUMBER JGetNumber(J *rsp, const char *field) {
 int JIntValue(J *item) {
 	if (item == NULL)
 		return 0;
+#ifdef NOTE_JCOMPACT
+	if (JIsTrue(item))
+		return 1;
+	if (!JIsNumber(item))
+		return 0;
+	if (item->valuenumber >= INT_MAX)
+		return INT_MAX;
+	if (item->valuenumber <= INT_MIN)
+		return INT_MIN;
+	return (int) item->valuenumber;
+#else
 	return item->valueint;
+#endif
 }
 
 //**************************************************************************/
@@ -265,15 +282,17 @@ bool JContainsString(J *rsp, const char *field, const char *substr) {
 /**************************************************************************/
 bool JAddBinaryToObject(J *req, const char *fieldName, const void *binaryData, uint32_t binaryDataLen) {
 	unsigned stringDataLen = JB64EncodeLen(binaryDataLen);
-	char *stringData = (char *) malloc(stringDataLen);
+	char *stringData = (char *) _Malloc(stringDataLen);
 	if (stringData == NULL)
 		return false;
 	JB64Encode(stringData, binaryData, binaryDataLen);
 	J *stringItem = JCreateStringReference(stringData);
 	if (stringItem == NULL) {
-		free(stringData);
+		_Free(stringData);
 		return false;
 	}
+	// The item owns the encoded string, so that it is freed along with the request
+	stringItem->type &= ~JIsReference;
 	JAddItemToObject(req, fieldName, stringItem);
 	return true;
 }
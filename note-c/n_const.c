@@ -24,3 +24,4 @@ const char *c_err = "err";
 const char *c_req = "req";
 const char *c_cmd = "cmd";
 const char *c_bad = "bad";
+const char *c_ioerr = "{io}";
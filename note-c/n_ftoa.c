@@ -38,8 +38,8 @@ char * JNtoA(JNUMBER f, char * buf, int original_precision)
 	char c;
 	long intPart;
 
-	// For our low-SRAM devices we'd rather have this on the stack
-	const JNUMBER rounders[JNTOA_PRECISION + 1] =
+	// Being static and const, this is kept in flash rather than copied onto the stack on each call
+	static const JNUMBER rounders[JNTOA_PRECISION + 1] =
 		{
 			0.5,				// 0
 			0.05,				// 1
@@ -55,7 +55,7 @@ char * JNtoA(JNUMBER f, char * buf, int original_precision)
 		};
 
 	// Check specifically for uncommon but bad floating point numbers that can't be converted
-	uint8_t fbytes[8];
+	uint8_t fbytes[sizeof(JNUMBER)];
 	memcpy(&fbytes, &f, sizeof(fbytes));
 	bool wasFF = true;
 	int i;
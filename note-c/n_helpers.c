@@ -24,10 +24,18 @@
 // such as the device location, its voltage level, and so on.  This file contains this kind of wrapper,
 // just implemented here as a convenience to all developers.
 
-// Time-related suppression timer and cache
+// Time-related suppression timer and cache.  Epoch time is extrapolated from a base using the
+// host's millisecond clock, corrected by the drift of that clock as measured between syncs with
+// the Notecard, so that once the time is known it costs no I/O to read it.
 static uint32_t timeBaseSetAtMs = 0;
-static JTIME timeBaseSec = 0;
+static uint64_t timeBaseEpochMs = 0;
+static uint32_t timeSyncAtMs = 0;
+static JTIME timeSyncSec = 0;
+static int32_t timeDriftPPM = 0;
+static bool timeDriftValid = false;
+static uint32_t timeResyncSecs = NOTE_TIME_RESYNC_MIN_SECS;
 static uint32_t timeTimer = 0;
+static uint32_t zoneRetrySecs = 10;
 static bool zoneStillUnavailable = true;
 static char curZone[48] = {0};
 static char curArea[64] = {0};
@@ -43,6 +51,16 @@ static bool locationValid = false;
 static uint32_t connectivityTimer = 0;
 static bool cardConnected = false;
 
+// Environment variable suppression timer and cache.  All of the variables are fetched with a single
+// request and packed into the table as consecutive pairs of null-terminated name and value, ended by an
+// empty name.  They are fetched again only when the Notecard reports that one has been modified since the
+// time at which they were last modified.
+static uint32_t envTimer = 0;
+static char envCache[NOTE_ENV_CACHE_LEN] = {0};
+static JTIME envModified = 0;
+static bool envLoaded = false;
+static bool envComplete = false;
+
 // Service config-related suppression timer and cache
 static uint32_t serviceConfigTimer = 0;
 static char scDevice[128] = {0};
@@ -73,7 +91,7 @@ bool NoteTimeValid() {
 /**************************************************************************/
 bool NoteTimeValidST() {
     NoteTimeST();
-    return (timeBaseSec != 0);
+    return (timeBaseEpochMs != 0);
 }
 
 //**************************************************************************/
@@ -89,16 +107,81 @@ JTIME NoteTime() {
 
 //**************************************************************************/
 /*!
-    @brief  Set the time.
+    @brief  Get the current epoch time in milliseconds, extrapolated from the
+            time base and corrected for the measured drift of the host clock.
+            The base is moved forward periodically so that the elapsed time
+            never approaches the wrap of the millisecond clock.
+    @returns  The current time in milliseconds, or 0 if not yet known.
+*/
+/**************************************************************************/
+static uint64_t timeNowMs() {
+    if (timeBaseEpochMs == 0)
+        return 0;
+    uint32_t now = _GetMs();
+    uint32_t elapsedMs = now - timeBaseSetAtMs;
+    int64_t correctedMs = (int64_t) elapsedMs + (((int64_t) elapsedMs * timeDriftPPM) / 1000000);
+    uint64_t epochMs = timeBaseEpochMs + correctedMs;
+    if (elapsedMs > NOTE_TIME_RESYNC_MAX_SECS*1000UL) {
+        timeBaseEpochMs = epochMs;
+        timeBaseSetAtMs = now;
+    }
+    return epochMs;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Set the time.  The first call seeds the clock.  Subsequent calls
+            are treated as resyncs: if enough time has passed since the last
+            one to measure it meaningfully, the drift of the host clock is
+            estimated from the interval and the clock is rebased.
     @param   seconds The UNIX Epoch time.
 */
 /**************************************************************************/
 static void setTime(JTIME seconds) {
-    timeBaseSec = seconds;
-    timeBaseSetAtMs = _GetMs();
+    uint32_t now = _GetMs();
+
+    // Estimate drift from the interval since the last sync, if it's long enough that the
+    // one-second resolution of the Notecard's time doesn't swamp the measurement.
+    if (timeSyncSec != 0) {
+        uint32_t hostMs = now - timeSyncAtMs;
+        int64_t errorMs = (int64_t) ((uint64_t) seconds * 1000) - (int64_t) timeNowMs();
+        if (hostMs < NOTE_TIME_RESYNC_MIN_SECS*1000UL && errorMs > -NOTE_TIME_STEP_SECS*1000L && errorMs < NOTE_TIME_STEP_SECS*1000L)
+            return;
+        int64_t cardMs = ((int64_t) seconds - (int64_t) timeSyncSec) * 1000;
+        int64_t ppm = ((cardMs - (int64_t) hostMs) * 1000000) / (int64_t) (hostMs == 0 ? 1 : hostMs);
+        if (hostMs >= NOTE_TIME_RESYNC_MIN_SECS*1000UL && ppm > -NOTE_TIME_DRIFT_MAX_PPM && ppm < NOTE_TIME_DRIFT_MAX_PPM) {
+            timeDriftPPM = timeDriftValid ? (int32_t) ((timeDriftPPM + ppm) / 2) : (int32_t) ppm;
+            timeDriftValid = true;
+            if (errorMs > -NOTE_TIME_STEP_SECS*1000L && errorMs < NOTE_TIME_STEP_SECS*1000L && timeResyncSecs < NOTE_TIME_RESYNC_MAX_SECS/2)
+                timeResyncSecs *= 2;
+        } else {
+            timeResyncSecs = NOTE_TIME_RESYNC_MIN_SECS;
+        }
+    }
+
+    // Rebase the clock on the time that we've been given
+    timeSyncSec = seconds;
+    timeSyncAtMs = now;
+    timeBaseEpochMs = (uint64_t) seconds * 1000;
+    timeBaseSetAtMs = now;
     _Debug("setting time\n");
 }
 
+//**************************************************************************/
+/*!
+    @brief  Get the drift of the host's millisecond clock relative to the
+            Notecard's, as measured between time syncs.
+    @param   ppm (out) Parts per million by which the host clock runs slow
+                  (positive) or fast (negative).
+    @returns  `true` if enough syncs have occurred for an estimate.
+*/
+/**************************************************************************/
+bool NoteTimeDrift(int32_t *ppm) {
+    if (ppm != NULL)
+        *ppm = timeDriftPPM;
+    return timeDriftValid;
+}
+
 //**************************************************************************/
 /*!
     @brief  Print a full, newline-terminated line.
@@ -143,7 +226,7 @@ bool NotePrint(const char *text) {
 */
 /**************************************************************************/
 bool NotePrintf(const char *format, ...) {
-    char line[256];
+    char line[FORMAT_LINE_MAX];
     va_list args;
     va_start(args, format);
     vsnprintf(line, sizeof(line), format, args);
@@ -161,10 +244,14 @@ bool NotePrintf(const char *format, ...) {
 /**************************************************************************/
 JTIME NoteTimeST() {
 
-    // If we haven't yet fetched the time, or if we still need the timezone, do so with a suppression
-    // timer so that we don't hammer the module before it's had a chance to connect to the network to fetch time.
-    if (timeBaseSec == 0 || zoneStillUnavailable) {
-        if (timerExpiredSecs(&timeTimer, 10)) {
+    // If we haven't yet fetched the time, or if we still need the timezone, or if it's time to resync
+    // the clock, do so with a suppression timer so that we don't hammer the module before it's had a
+    // chance to connect to the network to fetch time.  Once we have the time, retries for the zone back
+    // off, because it may legitimately be unavailable for a long time.
+    bool resyncDue = (timeBaseEpochMs != 0 && (_GetMs() - timeSyncAtMs) >= timeResyncSecs*1000UL);
+    if (timeBaseEpochMs == 0 || zoneStillUnavailable || resyncDue) {
+        uint32_t retrySecs = (timeBaseEpochMs == 0 || resyncDue) ? 10 : zoneRetrySecs;
+        if (timerExpiredSecs(&timeTimer, retrySecs)) {
 
             // Request time and zone info from the card
             J *rsp = NoteRequestResponse(NoteNewRequest("card.time"));
@@ -173,23 +260,22 @@ JTIME NoteTimeST() {
                     JTIME seconds = JGetInt(rsp, "time");
                     if (seconds != 0) {
 
-                        // Set the time if it hasn't yet been set
-						if (timeBaseSec == 0)
-	                        setTime(seconds);
+                        // Set the time, or resync it
+                        setTime(seconds);
+                        if (zoneStillUnavailable && zoneRetrySecs < NOTE_TIME_RESYNC_MIN_SECS)
+                            zoneRetrySecs *= 2;
 
                         // Get the zone
                         char *z = JGetString(rsp, "zone");
                         if (z[0] != '\0') {
-                            char zone[64];
-                            strlcpy(zone, z, sizeof(zone));
-                            // Only use the 3-letter abbrev
-                            char *sep = strchr(zone, ',');
+                            // Only use the 3-letter abbrev, trimmed in place rather than in a copy on the stack
+                            strlcpy(curZone, z, sizeof(curZone));
+                            char *sep = strchr(curZone, ',');
                             if (sep == NULL)
-                                zone[0] = '\0';
+                                curZone[0] = '\0';
                             else
                                 *sep = '\0';
-                            zoneStillUnavailable = (memcmp(zone, "UTC", 3) == 0);
-                            strlcpy(curZone, zone, sizeof(curZone));
+                            zoneStillUnavailable = (memcmp(curZone, "UTC", 3) == 0);
                             curZoneOffsetMins = JGetInt(rsp, "minutes");
                             strlcpy(curCountry, JGetString(rsp, "country"), sizeof(curCountry));
                             strlcpy(curArea, JGetString(rsp, "area"), sizeof(curArea));
@@ -202,11 +288,12 @@ JTIME NoteTimeST() {
         }
     }
 
-    // Adjust the base time by the number of seconds that have elapsed since the base.
-    JTIME adjustedTime = timeBaseSec + ((_GetMs() - timeBaseSetAtMs) / 1000);
+    // If we don't know the time, return the time since boot
+    if (timeBaseEpochMs == 0)
+        return (JTIME) (_GetMs() / 1000);
 
-    // Done
-    return adjustedTime;
+    // Extrapolate from the base
+    return (JTIME) (timeNowMs() / 1000);
 
 }
 
@@ -368,9 +455,10 @@ bool NoteSetEnvDefaultNumber(const char *variable, JNUMBER defaultVal) {
 */
 /**************************************************************************/
 JNUMBER NoteGetEnvNumber(const char *variable, JNUMBER defaultVal) {
-    char buf[32], buf2[32];;
-	snprintf(buf2, sizeof(buf2), "%f", defaultVal);
-    NoteGetEnv(variable, buf2, buf, sizeof(buf));
+    char buf[32];
+    NoteGetEnv(variable, NULL, buf, sizeof(buf));
+    if (buf[0] == '\0')
+        return defaultVal;
     return JAtoN(buf, NULL);
 }
 
@@ -383,9 +471,10 @@ JNUMBER NoteGetEnvNumber(const char *variable, JNUMBER defaultVal) {
 */
 /**************************************************************************/
 int NoteGetEnvInt(const char *variable, int defaultVal) {
-    char buf[32], buf2[32];;
-	snprintf(buf2, sizeof(buf2), "%d", defaultVal);
-    NoteGetEnv(variable, buf2, buf, sizeof(buf));
+    char buf[32];
+    NoteGetEnv(variable, NULL, buf, sizeof(buf));
+    if (buf[0] == '\0')
+        return defaultVal;
     return atoi(buf);
 }
 
@@ -418,6 +507,178 @@ void NoteGetEnv(const char *variable, const char *defaultVal, char *buf, uint32_
     }
 }
 
+//**************************************************************************/
+/*!
+    @brief  Ask the Notecard now whether any environment variable has been
+            modified since they were cached, and if so cache them again.
+    @returns `true` if the cache was changed.
+*/
+/**************************************************************************/
+bool NoteEnvRefresh() {
+    envTimer = 0;
+    return NoteEnvRefreshST();
+}
+
+//**************************************************************************/
+/*!
+    @brief  Pack the environment variables in the body of an `env.get`
+            response into the cache, as many as fit.  A number is cached as
+            the text that the Notecard sent, which loses nothing to parsing.
+    @param   tape  The response.
+    @param   body  The body, whose fields are the variables.
+    @returns `true` if all of them fit.
+*/
+/**************************************************************************/
+static bool envPack(JTape *tape, int body) {
+    uint32_t used = 0;
+    bool complete = true;
+    for (int var = JTapeFirst(tape, body); var >= 0; var = JTapeNext(tape, body, var)) {
+        const char *name = JTapeKey(tape, var);
+        const char *value = JTapeStringValue(tape, var);
+        uint32_t nameLen = strlen(name) + 1;
+        uint32_t valueLen = strlen(value) + 1;
+        if (JTapeType(tape, var) == JNumber) {
+            value = &tape->text[tape->token[var].start];
+            valueLen = tape->token[var].length + 1;
+        }
+        if (nameLen == 1 || used + nameLen + valueLen + 1 > sizeof(envCache)) {
+            complete = false;
+            continue;
+        }
+        memcpy(&envCache[used], name, nameLen);
+        memcpy(&envCache[used+nameLen], value, valueLen-1);
+        envCache[used+nameLen+valueLen-1] = '\0';
+        used += nameLen + valueLen;
+    }
+    envCache[used] = '\0';
+    return complete;
+}
+
+//**************************************************************************/
+/*!
+    @brief  If the suppression timer has expired, ask the Notecard whether
+            any environment variable has been modified since they were
+            cached, and if so cache them again.  The question and the
+            fetch are the same `env.get` request, whose `time` argument
+            makes the Notecard reply with an error rather than with the
+            variables if none has been modified, so each check costs a
+            single transaction.  If the request fails, what was cached is
+            kept.
+    @returns `true` if the cache was changed.
+*/
+/**************************************************************************/
+bool NoteEnvRefreshST() {
+    if (!timerExpiredSecs(&envTimer, NOTE_ENV_CHECK_SECS))
+        return false;
+    J *req = NoteNewRequest("env.get");
+    if (req == NULL)
+        return false;
+
+    // The time is sent and read back as text, because a JNUMBER that is a float can't hold an epoch time
+    // exactly, and were it rounded, either a modification would be missed or every check would refetch
+    char since[16];
+    if (envLoaded) {
+        snprintf(since, sizeof(since), "%lu", (unsigned long) envModified);
+        JAddItemToObject(req, "time", JCreateRawReference(since));
+    }
+    JTape *rsp = NoteRequestResponseTape(req);
+    if (rsp == NULL)
+        return false;
+    const char *err = JTapeGetString(rsp, 0, c_err);
+    if (err[0] != '\0') {
+        if (strstr(err, "{env-not-modified}") == NULL)
+            _Log(NOTE_LOG_WARN, NOTE_LOG_LIBRARY, "env not cached");
+        JTapeDelete(rsp);
+        return false;
+    }
+    envComplete = envPack(rsp, JTapeGetObject(rsp, 0, "body"));
+    if (!envComplete)
+        _Log(NOTE_LOG_WARN, NOTE_LOG_LIBRARY, "env cache full");
+    int modified = JTapeFind(rsp, 0, "time");
+    envModified = (JTapeType(rsp, modified) == JNumber ? (JTIME) strtoul(&rsp->text[rsp->token[modified].start], NULL, 10) : 0);
+    envLoaded = true;
+    JTapeDelete(rsp);
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Find a variable in the cache.
+    @param   variable The variable key.
+    @param   found (out) Whether the cache could answer, which it can if the
+             variable is in it, or if it holds every variable.
+    @returns The variable's value, or NULL if it isn't cached.
+*/
+/**************************************************************************/
+static const char *envLookup(const char *variable, bool *found) {
+    for (const char *name = envCache; envLoaded && *name != '\0'; ) {
+        const char *value = name + strlen(name) + 1;
+        if (strcmp(name, variable) == 0) {
+            *found = true;
+            return value;
+        }
+        name = value + strlen(value) + 1;
+    }
+    *found = (envLoaded && envComplete);
+    return NULL;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get a service environment variable from the cache, which costs
+            no I/O unless the suppression timer has expired.  A variable
+            that couldn't be cached is read from the Notecard.
+    @param   variable The variable key.
+    @param   defaultVal The default variable value.
+    @param   buf (out) The buffer in which to place the variable value.
+    @param   buflen The length of the output buffer.
+*/
+/**************************************************************************/
+void NoteGetEnvST(const char *variable, const char *defaultVal, char *buf, uint32_t buflen) {
+    NoteEnvRefreshST();
+    bool found;
+    const char *value = envLookup(variable, &found);
+    if (!found) {
+        NoteGetEnv(variable, defaultVal, buf, buflen);
+        return;
+    }
+    if (value == NULL || value[0] == '\0')
+        value = (defaultVal == NULL ? "" : defaultVal);
+    strlcpy(buf, value, buflen);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get a service environment variable integer from the cache.
+    @param   variable The variable key.
+    @param   defaultVal The default variable value.
+    @returns environment variable value.
+*/
+/**************************************************************************/
+int NoteGetEnvIntST(const char *variable, int defaultVal) {
+    char buf[32];
+    NoteGetEnvST(variable, NULL, buf, sizeof(buf));
+    if (buf[0] == '\0')
+        return defaultVal;
+    return atoi(buf);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get a service environment variable number from the cache.
+    @param   variable The variable key.
+    @param   defaultVal The default variable value.
+    @returns environment variable value.
+*/
+/**************************************************************************/
+JNUMBER NoteGetEnvNumberST(const char *variable, JNUMBER defaultVal) {
+    char buf[32];
+    NoteGetEnvST(variable, NULL, buf, sizeof(buf));
+    if (buf[0] == '\0')
+        return defaultVal;
+    return JAtoN(buf, NULL);
+}
+
 //**************************************************************************/
 /*!
     @brief  Determine if the Notecard is connected to the network.
@@ -815,28 +1076,27 @@ bool NoteSleep(char *stateb64, uint32_t seconds, const char *modes) {
 
 //**************************************************************************/
 /*!
-    @brief  Wake the module by restoring state into a state buffer of a
-            specified length, and fail if it isn't available or isn't that
-            length.
-    @param  stateLen A length of the state payload buffer to return to the host.
-    @param  state (out) The in-memory payload to return to the host.
-    @returns boolean. `true` if request was successful.
+    @brief  Ask the Notecard, after it has restored our power, for the state
+            that it held while we slept, noting the current time if the
+            response has it.
+    @returns The response, whose `payload` is the state, or NULL if it
+             couldn't be had.  The caller must delete it.
 */
 /**************************************************************************/
-bool NoteWake(int stateLen, void *state) {
+J *noteWakeResponse() {
 
     J *req = NoteNewRequest("card.attn");
     if (req == NULL)
-        return false;
+        return NULL;
 
     // Send it a command to request the saved state
     JAddBoolToObject(req, "start", true);
     J *rsp = NoteRequestResponse(req);
     if (rsp == NULL)
-        return false;
+        return NULL;
     if (NoteResponseError(rsp)) {
         NoteDeleteResponse(rsp);
-        return false;
+        return NULL;
     }
 
     // Note the current time, if the field is present
@@ -844,6 +1104,26 @@ bool NoteWake(int stateLen, void *state) {
     if (seconds != 0)
         setTime(seconds);
 
+    return rsp;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Wake the module by restoring state into a state buffer of a
+            specified length, and fail if it isn't available or isn't that
+            length.
+    @param  stateLen A length of the state payload buffer to return to the host.
+    @param  state (out) The in-memory payload to return to the host.
+    @returns boolean. `true` if request was successful.
+*/
+/**************************************************************************/
+bool NoteWake(int stateLen, void *state) {
+
+    // Request the saved state
+    J *rsp = noteWakeResponse();
+    if (rsp == NULL)
+        return false;
+
     // Exit if no payload
     char *payload = JGetString(rsp, "payload");
     if (payload[0] == '\0') {
@@ -857,22 +1137,16 @@ bool NoteWake(int stateLen, void *state) {
         return true;
     }
 
-    // Allocate a buffer for the payload.  (We can't decode in-place because we can't
-    // risk overwriting memory if the actual payload is even slightly different.)
-    char *p = (char *) _Malloc(JB64DecodeLen(payload));
-    if (p == NULL) {
-        NoteDeleteResponse(rsp);
-        return false;
-    }
-    int actualLen = JB64Decode(p, payload);
-    if (actualLen != stateLen) {
-        _Free(p);
+    // Check the length before touching the caller's state, so that a payload that is even slightly
+    // different leaves it as it was, and then decode directly into it rather than into a copy.
+    if (JB64DecodeExactLen(payload) != stateLen) {
         _Debug("*** discarding saved state\n");
         NoteDeleteResponse(rsp);
         return false;
     }
-    memcpy(state, p, stateLen);
-    _Free(p);
+    JB64Decoder decoder;
+    JB64DecodeStart(&decoder);
+    JB64DecodeUpdate(&decoder, state, stateLen, payload, strlen(payload));
 
     // State restored
     _Debug("STATE RESTORED\n");
@@ -1067,6 +1341,10 @@ bool NoteAdd(const char *target, J *body, bool urgent) {
         return false;
     }
 
+    // Make sure that the Notefile's template, if templates are being
+    // registered automatically, describes the body
+    noteTemplateApply(target, body);
+
     // Add the target notefile and body to the request.  Note that
     // JAddItemToObject passes ownership of the object to req
     JAddStringToObject(req, "file", target);
@@ -1117,9 +1395,9 @@ bool NoteSendToRoute(const char *method, const char *routeAlias, char *notefile,
         return false;
     }
 
-    // Extract the event, which we'll use as the body for the next transaction
+    // Extract the event, which we'll use as the body for the next transaction.  Its strings live in
+    // the response's buffer, so the response must outlive the request that the body is added to.
     body = JDetachItemFromObject(rsp, "body");
-    NoteDeleteResponse(rsp);
 
     // Create the post transaction
     char request[32];
@@ -1132,7 +1410,9 @@ bool NoteSendToRoute(const char *method, const char *routeAlias, char *notefile,
     JAddStringToObject(req, "route", routeAlias);
 
     // Perform the transaction
-    return NoteRequest(req);
+    bool success = NoteRequest(req);
+    NoteDeleteResponse(rsp);
+    return success;
 
 }
 
@@ -1294,7 +1574,7 @@ bool NoteDebugSyncStatus(int pollFrequencyMs, int maxLevel) {
 	JAddStringToObject(req, "file", "_synclog.qi");
 	JAddBoolToObject(req, "delete", true);
 	NoteSuspendTransactionDebug();
-	J *rsp = NoteRequestResponse(req);
+	JTape *rsp = NoteRequestResponseTape(req);
 	NoteResumeTransactionDebug();
 	if (rsp != NULL) {
 
@@ -1302,27 +1582,27 @@ bool NoteDebugSyncStatus(int pollFrequencyMs, int maxLevel) {
 		// that it's expected that this might return either a "note does not exist"
 		// error if there are no pending inbound notes, or a "file does not exist" error
 		// if the inbound queue hasn't yet been created on the service.
-		if (NoteResponseError(rsp)) {
+		if (JTapeGetString(rsp, 0, c_err)[0] != '\0') {
 			// Only stop polling quickly if we don't receive anything
 			lastCommStatusPollMs = _GetMs();
-			NoteDeleteResponse(rsp);
+			JTapeDelete(rsp);
 			return false;
 		}
 
 		// Get the note's body
-		J *body = JGetObject(rsp, "body");
-		if (body != NULL) {
-			if (maxLevel < 0 || JGetInt(body, "level") <= maxLevel) {
+		int body = JTapeGetObject(rsp, 0, "body");
+		if (body >= 0) {
+			if (maxLevel < 0 || (int) JTapeGetNumber(rsp, body, "level") <= maxLevel) {
 				_Debug("sync: ");
-				_Debug(JGetString(body, "subsystem"));
+				_Debug(JTapeGetString(rsp, body, "subsystem"));
 				_Debug(" ");
-				_Debug(JGetString(body, "text"));
+				_Debug(JTapeGetString(rsp, body, "text"));
 				_Debug("\n");
 			}
 		}
 
 		// Done with this response
-		NoteDeleteResponse(rsp);
+		JTapeDelete(rsp);
 		return true;
 	}
 
@@ -1330,9 +1610,9 @@ bool NoteDebugSyncStatus(int pollFrequencyMs, int maxLevel) {
 
 }
 
-// A general purpose, super nonperformant, but accurate way of figuring out how much memory
-// is available, while exercising the allocator to ensure that it competently deals with
-// adjacent block coalescing on free.
+// A general purpose and accurate way of figuring out how much memory is available, while
+// exercising the allocator to ensure that it competently deals with adjacent block coalescing
+// on free.  For cheap, continuous monitoring use NoteGetMemStats() instead.
 typedef struct objHeader_s {
     struct objHeader_s *prev;
     int length;
@@ -1340,44 +1620,53 @@ typedef struct objHeader_s {
 
 //**************************************************************************/
 /*!
-    @brief  Obtain the amount of free memory available on the Notecard.
-    @returns The number of bytes of memory available on the Notecard.
+    @brief  Obtain the amount of free memory available on the host.
+            Repeatedly binary-searches for the largest block that can be
+            allocated and holds onto it, so that the number of calls to the
+            allocator is proportional to the number of free regions rather
+            than to the size of the heap.
+    @returns The number of bytes of memory available.
 */
 /**************************************************************************/
 uint32_t NoteMemAvailable() {
 
-    // Allocate progressively smaller and smaller chunks
+    // Allocate the largest remaining block until even the smallest one fails
     objHeader *lastObj = NULL;
-    static int maxsize = 35000;
-    for (int i=maxsize; i>=sizeof(objHeader); i=i-sizeof(objHeader)) {
-        for (int j=0;;j++) {
-            objHeader *thisObj;
-            thisObj = (objHeader *) malloc(i);
-            if (thisObj == NULL)
-                break;
-            thisObj->prev = lastObj;
-            thisObj->length = i;
-            lastObj = thisObj;
+    int hi = 35000;
+    while (hi >= (int) sizeof(objHeader)) {
+        int lo = sizeof(objHeader);
+        objHeader *thisObj = (objHeader *) malloc(lo);
+        if (thisObj == NULL)
+            break;
+        free(thisObj);
+        while (lo < hi) {
+            int mid = lo + (hi - lo + 1) / 2;
+            thisObj = (objHeader *) malloc(mid);
+            if (thisObj == NULL) {
+                hi = mid - 1;
+            } else {
+                free(thisObj);
+                lo = mid;
+            }
         }
+        thisObj = (objHeader *) malloc(lo);
+        if (thisObj == NULL)
+            break;
+        thisObj->prev = lastObj;
+        thisObj->length = lo;
+        lastObj = thisObj;
+        hi = lo;
     }
 
     // Free the objects backwards
-    int lastLength = 0;
-    int lastLengthCount = 0;
     uint32_t total = 0;
     while (lastObj != NULL) {
-        if (lastObj->length != lastLength) {
-            lastLength = lastObj->length;
-            lastLengthCount = 1;
-        } else {
-            lastLengthCount++;
-        }
         objHeader *thisObj = lastObj;
         lastObj = lastObj->prev;
         total += thisObj->length;
         free(thisObj);
     }
 
-	return total;
-  
+    return total;
+
 }
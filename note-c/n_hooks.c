@@ -90,6 +90,13 @@ delayMsFn hookDelayMs = NULL;
 /**************************************************************************/
 getMsFn hookGetMs = NULL;
 //**************************************************************************/
+/*!
+    @brief  Hook for the calling platform's phase function, told as each
+            phase of a transaction begins.
+*/
+/**************************************************************************/
+phaseFn hookPhase = NULL;
+//**************************************************************************/
 /*!
     @brief  Hook for the calling platform's current active interface. Value is
             one of:
@@ -159,8 +166,12 @@ i2cReceiveFn hookI2CReceive = NULL;
 // Internal hooks
 typedef bool (*nNoteResetFn) (void);
 typedef const char * (*nTransactionFn) (char *, char **);
+typedef const char * (*nReceiveFn) (char **);
+typedef bool (*nResyncFn) (bool);
 static nNoteResetFn notecardReset = NULL;
 static nTransactionFn notecardTransaction = NULL;
+static nReceiveFn notecardReceive = NULL;
+static nResyncFn notecardResync = NULL;
 
 //**************************************************************************/
 /*!
@@ -212,6 +223,18 @@ void NoteSetFnDebugOutput(debugOutputFn fn) {
     hookDebugOutput = fn;
 }
 
+//**************************************************************************/
+/*!
+    @brief  Set the platform-specific function that is told as each phase
+            of a transaction begins, so that it can, for example, scale the
+            clock to suit the work being done.
+    @param   fn  A function pointer to call with each NOTE_PHASE_ value.
+*/
+/**************************************************************************/
+void NoteSetFnPhase(phaseFn fn) {
+    hookPhase = fn;
+}
+
 //**************************************************************************/
 /*!
     @brief  Determine if a debug output function has been set.
@@ -261,6 +284,8 @@ void NoteSetFnSerial(serialResetFn resetfn, serialTransmitFn transmitfn, serialA
 
     notecardReset = serialNoteReset;
     notecardTransaction = serialNoteTransaction;
+    notecardReceive = serialNoteReceive;
+    notecardResync = serialNoteResync;
 }
 
 //**************************************************************************/
@@ -287,6 +312,8 @@ void NoteSetFnI2C(uint32_t i2caddress, uint32_t i2cmax, i2cResetFn resetfn, i2cT
 
     notecardReset = i2cNoteReset;
     notecardTransaction = i2cNoteTransaction;
+    notecardReceive = i2cNoteReceive;
+    notecardResync = i2cNoteResync;
 }
 
 // Runtime hook wrappers
@@ -310,11 +337,21 @@ void NoteDebugln(const char *line) {
 /**************************************************************************/
 void NoteDebug(const char *line) {
 #ifndef NOTE_NODEBUG
-    if (hookDebugOutput != NULL)
-        hookDebugOutput(line);
+    noteLogWrite(NOTE_LOG_INFO, NOTE_LOG_LIBRARY, line, false);
 #endif
 }
 
+//**************************************************************************/
+/*!
+    @brief  Write directly to the debug output, bypassing the log.
+    @param   text  A string for output.
+*/
+/**************************************************************************/
+void NoteDebugOutput(const char *text) {
+    if (hookDebugOutput != NULL)
+        hookDebugOutput(text);
+}
+
 //**************************************************************************/
 /*!
     @brief  Write a formatted string to the debug output.
@@ -325,12 +362,12 @@ void NoteDebug(const char *line) {
 void NoteDebugf(const char *format, ...) {
 #ifndef NOTE_NODEBUG
     if (hookDebugOutput != NULL) {
-        char line[256];
+        char line[FORMAT_LINE_MAX];
         va_list args;
         va_start(args, format);
         vsnprintf(line, sizeof(line), format, args);
         va_end(args);
-        hookDebugOutput(line);
+        NoteDebug(line);
     }
 #endif
 }
@@ -375,6 +412,50 @@ void *malloc_show(size_t len) {
 }
 #endif
 
+#ifndef NOTE_NOMEMSTATS
+//**************************************************************************/
+/*!
+    @brief  Header prepended to each block so that NoteFree knows how much
+            is being released.  Sized so that the caller's pointer keeps the
+            alignment needed by the largest type that note-c stores.
+*/
+/**************************************************************************/
+typedef union {
+    size_t size;
+    JNUMBER number;
+    void *ptr;
+} memHeader;
+
+//**************************************************************************/
+/*!
+    @brief  Running allocation statistics.
+*/
+/**************************************************************************/
+static NoteMemStats memStats;
+//**************************************************************************/
+/*!
+    @brief  Allocation statistics broken down by transaction phase.
+*/
+/**************************************************************************/
+static NoteMemPhaseStats memPhaseStats[NOTE_PHASES];
+//**************************************************************************/
+/*!
+    @brief  Lowest and highest addresses ever handed out by the allocator,
+            used to estimate how much of the heap's footprint is holes.
+*/
+/**************************************************************************/
+static uintptr_t memSpanLow = 0;
+static uintptr_t memSpanHigh = 0;
+#endif
+
+//**************************************************************************/
+/*!
+    @brief  The phase of the transaction in progress, to which allocations
+            are attributed.
+*/
+/**************************************************************************/
+static int memPhase = NOTE_PHASE_APP;
+
 //**************************************************************************/
 /*!
     @brief  Allocate a memory chunk using the platform-specific hook.
@@ -384,11 +465,48 @@ void *malloc_show(size_t len) {
 void *NoteMalloc(size_t size) {
     if (hookMalloc == NULL)
         return NULL;
+#ifdef NOTE_NOMEMSTATS
 #if NOTE_SHOW_MALLOC
 	return malloc_show(size);
 #else
     return hookMalloc(size);
 #endif
+#else
+    NoteMemPhaseStats *phase = &memPhaseStats[memPhase];
+#if NOTE_SHOW_MALLOC
+	memHeader *hdr = (memHeader *) malloc_show(sizeof(memHeader) + size);
+#else
+    memHeader *hdr = (memHeader *) hookMalloc(sizeof(memHeader) + size);
+#endif
+    if (hdr == NULL) {
+        memStats.failures++;
+        if (size > memStats.largestFailure)
+            memStats.largestFailure = size;
+        phase->failures++;
+        return NULL;
+    }
+    hdr->size = size;
+
+    // Account for the block
+    memStats.allocs++;
+    memStats.liveBytes += size;
+    if (memStats.liveBytes > memStats.highWaterBytes)
+        memStats.highWaterBytes = memStats.liveBytes;
+    phase->allocs++;
+    phase->bytes += size;
+    if (memStats.liveBytes > phase->highWaterBytes)
+        phase->highWaterBytes = memStats.liveBytes;
+
+    // Track the address range that the heap has been seen to cover
+    uintptr_t low = (uintptr_t) hdr;
+    uintptr_t high = low + sizeof(memHeader) + size;
+    if (memSpanLow == 0 || low < memSpanLow)
+        memSpanLow = low;
+    if (high > memSpanHigh)
+        memSpanHigh = high;
+
+    return &hdr[1];
+#endif
 }
 
 //**************************************************************************/
@@ -398,8 +516,99 @@ void *NoteMalloc(size_t size) {
 */
 /**************************************************************************/
 void NoteFree(void *p) {
-    if (hookFree != NULL)
-        hookFree(p);
+    if (hookFree == NULL)
+        return;
+#ifdef NOTE_NOMEMSTATS
+    hookFree(p);
+#else
+    if (p == NULL)
+        return;
+    memHeader *hdr = &((memHeader *) p)[-1];
+    memStats.frees++;
+    memStats.liveBytes -= hdr->size;
+    hookFree(hdr);
+#endif
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the memory statistics maintained by NoteMalloc and NoteFree.
+            This is O(1) and touches no heap, so it is safe to call often.
+    @param   stats  The structure to fill in.
+    @returns `false` if statistics were compiled out with NOTE_NOMEMSTATS.
+*/
+/**************************************************************************/
+bool NoteGetMemStats(NoteMemStats *stats) {
+#ifdef NOTE_NOMEMSTATS
+    memset(stats, 0, sizeof(NoteMemStats));
+    return false;
+#else
+    *stats = memStats;
+
+    // The span covered by the heap, less what's live, is made up of holes and
+    // per-block overhead; report it as a percentage of the span.
+    uint32_t span = (uint32_t) (memSpanHigh - memSpanLow);
+    stats->spanBytes = span;
+    stats->fragmentationPct = 0;
+    if (span != 0 && span > memStats.liveBytes)
+        stats->fragmentationPct = (uint8_t) (((uint64_t) (span - memStats.liveBytes) * 100) / span);
+    return true;
+#endif
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the allocation statistics attributed to a transaction phase.
+    @param   phase  One of the NOTE_PHASE_ values.
+    @param   stats  The structure to fill in.
+    @returns `false` if the phase is invalid or statistics are compiled out.
+*/
+/**************************************************************************/
+bool NoteGetMemPhaseStats(int phase, NoteMemPhaseStats *stats) {
+    memset(stats, 0, sizeof(NoteMemPhaseStats));
+#ifdef NOTE_NOMEMSTATS
+    return false;
+#else
+    if (phase < 0 || phase >= NOTE_PHASES)
+        return false;
+    *stats = memPhaseStats[phase];
+    return true;
+#endif
+}
+
+//**************************************************************************/
+/*!
+    @brief  Reset the cumulative counters and high-water marks.  Live bytes
+            are retained because those blocks are still allocated.
+*/
+/**************************************************************************/
+void NoteResetMemStats() {
+#ifndef NOTE_NOMEMSTATS
+    uint32_t live = memStats.liveBytes;
+    memset(&memStats, 0, sizeof(memStats));
+    memset(memPhaseStats, 0, sizeof(memPhaseStats));
+    memStats.liveBytes = live;
+    memStats.highWaterBytes = live;
+#endif
+}
+
+//**************************************************************************/
+/*!
+    @brief  Set the phase of the transaction in progress, to which
+            subsequent allocations are attributed, and tell the platform's
+            phase hook, if any, when it changes.
+    @param   phase  One of the NOTE_PHASE_ values.
+    @returns The previous phase, so that it may be restored.
+*/
+/**************************************************************************/
+int NoteSetMemPhase(int phase) {
+    int prev = memPhase;
+    if (phase >= 0 && phase < NOTE_PHASES && phase != memPhase) {
+        memPhase = phase;
+        if (hookPhase != NULL)
+            hookPhase(phase);
+    }
+    return prev;
 }
 
 //**************************************************************************/
@@ -615,3 +824,34 @@ const char *NoteJSONTransaction(char *json, char **jsonResponse) {
         return "notecard not initialized";
     return notecardTransaction(json, jsonResponse);
 }
+
+//**************************************************************************/
+/*!
+    @brief  Read again the reply to a request that has already been sent,
+            using the currently-set platform hook.
+    @param   jsonResponse (out) A buffer with the JSON response.
+    @returns NULL if successful, or an error string if the read failed or
+             the hook has not been set.
+*/
+/**************************************************************************/
+const char *NoteJSONReceive(char **jsonResponse) {
+    if (notecardReceive == NULL)
+        return "notecard not initialized";
+    return notecardReceive(jsonResponse);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get back in step with the Notecard after a failed transaction,
+            using the currently-set platform hook.
+    @param   endLine  Whether to end a request that was cut off before the
+             end of its body, so that the Notecard rejects it.
+    @returns A boolean indicating whether the Notecard is back in step, or
+             `false` if a full reset is needed.
+*/
+/**************************************************************************/
+bool NoteResync(bool endLine) {
+    if (notecardResync == NULL)
+        return false;
+    return notecardResync(endLine);
+}
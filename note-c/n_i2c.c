@@ -29,7 +29,8 @@ static void _DelayIO() {
 /*!
     @brief  Given a JSON string, perform an I2C transaction with the Notecard.
     @param   json
-               A c-string containing the JSON request object.
+               A c-string containing the JSON request object, which is
+               modified during the transaction and restored before returning.
 		@param   jsonResponse
 							 An out parameter c-string buffer that will contain the JSON
 							 response from the Notercard.
@@ -38,15 +39,18 @@ static void _DelayIO() {
 /**************************************************************************/
 const char *i2cNoteTransaction(char *json, char **jsonResponse) {
 
-	// Append '\n' to the transaction
+	// Append '\n' to the transaction by temporarily replacing the terminating null, rather than copying it
 	int jsonLen = strlen(json)+1;
-	uint8_t *transmitBuf = (uint8_t *) _Malloc(jsonLen);
-	if (transmitBuf == NULL)
-		return ERRSTR("insufficient memory",c_mem);
-	memcpy(transmitBuf, json, jsonLen-1);
+	uint8_t *transmitBuf = (uint8_t *) json;
 	transmitBuf[jsonLen-1] = '\n';
 
 	// Transmit the request in chunks, but also in segments so as not to overwhelm the notecard's interrupt buffers
+	uint32_t transmitLen = jsonLen;
+#ifdef NOTE_TRACE
+	uint32_t sendMs = _GetMs();
+	uint32_t delayMs = 0;
+	uint32_t delayStartMs;
+#endif
 	const char *estr;
 	uint8_t *chunk = transmitBuf;
 	uint32_t sentInSegment = 0;
@@ -56,33 +60,67 @@ const char *i2cNoteTransaction(char *json, char **jsonResponse) {
 		_DelayIO();
 		estr = _I2CTransmit(_I2CAddress(), chunk, chunklen);
 		if (estr != NULL) {
-			_Free(transmitBuf);
+			transmitBuf[transmitLen-1] = '\0';
 			_I2CReset(_I2CAddress());
 			_UnlockI2C();
 #ifdef ERRDBG
-			_Debug("i2c transmit: ");
-			_Debug(estr);
-			_Debug("\n");
+			char msg[64];
+			strlcpy(msg, "i2c transmit: ", sizeof(msg));
+			strlcat(msg, estr, sizeof(msg));
+			_Log(NOTE_LOG_ERROR, NOTE_LOG_IO, msg);
+#endif
+#ifdef NOTE_TRACE
+			NoteTraceRecord(NOTE_TRACE_SEND, sendMs, _GetMs() - sendMs - delayMs, transmitLen - jsonLen, estr);
 #endif
+			// Unless this chunk carried the end of the request's body, the Notecard has only part of it
+			noteFaultSet(NOTE_FAULT_BUS, (jsonLen - chunklen > 1) ? NOTE_STAGE_SEND : NOTE_STAGE_SENT);
 			return estr;
 		}
 		_UnlockI2C();
 		chunk += chunklen;
 		jsonLen -= chunklen;
 		sentInSegment += chunklen;
+#ifdef NOTE_TRACE
+		delayStartMs = _GetMs();
+#endif
 		if (sentInSegment > CARD_REQUEST_I2C_SEGMENT_MAX_LEN) {
 			sentInSegment = 0;
 			_DelayMs(CARD_REQUEST_I2C_SEGMENT_DELAY_MS);
 		}
 		_DelayMs(CARD_REQUEST_I2C_CHUNK_DELAY_MS);
+#ifdef NOTE_TRACE
+		delayMs += _GetMs() - delayStartMs;
+#endif
 	}
+#ifdef NOTE_TRACE
+	NoteTraceRecord(NOTE_TRACE_SEND, sendMs, _GetMs() - sendMs - delayMs, transmitLen, NULL);
+	NoteTraceRecord(NOTE_TRACE_DELAY, sendMs, delayMs, 0, NULL);
+#endif
 
-	// Free the transmit buffer
-	_Free(transmitBuf);
+	// Restore the terminating null
+	transmitBuf[transmitLen-1] = '\0';
 
-    // If no reply expected, we're done
-    if (jsonResponse == NULL)
-        return NULL;
+	// If no reply expected, we're done
+	if (jsonResponse == NULL)
+		return NULL;
+
+	// Read the reply
+	return i2cNoteReceive(jsonResponse);
+
+}
+
+//**************************************************************************/
+/*!
+    @brief  Read a reply from the Notecard to a request that has been sent,
+            which is also used to read it again after a first attempt failed
+            before any of the reply had been read.
+		@param   jsonResponse
+							 An out parameter c-string buffer that will contain the JSON
+							 response from the Notercard.
+	@returns a c-string with an error, or `NULL` if no error ocurred.
+*/
+/**************************************************************************/
+const char *i2cNoteReceive(char **jsonResponse) {
 
 	// Dynamically grow the buffer as we read.	Note that we always put the +1 in the alloc
 	// so we can be assured that it can be null-terminated, which must be the case because
@@ -92,8 +130,9 @@ const char *i2cNoteTransaction(char *json, char **jsonResponse) {
 	char *jsonbuf = (char *) _Malloc(jsonbufAllocLen+1);
 	if (jsonbuf == NULL) {
 #ifdef ERRDBG
-		_Debug("transaction: jsonbuf malloc failed\n");
+		_Log(NOTE_LOG_ERROR, NOTE_LOG_IO, "transaction: jsonbuf malloc failed\n");
 #endif
+		noteFaultSet(NOTE_FAULT_MEMORY, NOTE_STAGE_WAIT);
 		return ERRSTR("insufficient memory",c_mem);
 	}
 
@@ -103,6 +142,10 @@ const char *i2cNoteTransaction(char *json, char **jsonResponse) {
 	int jsonbufLen = 0;
 	int chunklen = 0;
 	uint32_t startMs = _GetMs();
+#ifdef NOTE_TRACE
+	int tracePhase = NOTE_TRACE_WAIT;
+	uint32_t phaseMs = startMs;
+#endif
 	while (true) {
 
 		// Grow the buffer as necessary to read this next chunk
@@ -114,9 +157,13 @@ const char *i2cNoteTransaction(char *json, char **jsonResponse) {
 			char *jsonbufNew = (char *) _Malloc(jsonbufAllocLen+1);
 			if (jsonbufNew == NULL) {
 #ifdef ERRDBG
-				_Debug("transaction: jsonbuf grow malloc failed\n");
+				_Log(NOTE_LOG_ERROR, NOTE_LOG_IO, "transaction: jsonbuf grow malloc failed\n");
 #endif
 				_Free(jsonbuf);
+#ifdef NOTE_TRACE
+				NoteTraceRecord(tracePhase, phaseMs, _GetMs() - phaseMs, jsonbufLen, ERRSTR("insufficient memory",c_mem));
+#endif
+				noteFaultSet(NOTE_FAULT_MEMORY, NOTE_STAGE_RECEIVE);
 				return ERRSTR("insufficient memory",c_mem);
 			}
 			memcpy(jsonbufNew, jsonbuf, jsonbufLen);
@@ -133,8 +180,13 @@ const char *i2cNoteTransaction(char *json, char **jsonResponse) {
 		if (err != NULL) {
 			_Free(jsonbuf);
 #ifdef ERRDBG
-			_Debug("i2c receive error\n");
+			_Log(NOTE_LOG_ERROR, NOTE_LOG_IO, "i2c receive error\n");
+#endif
+#ifdef NOTE_TRACE
+			NoteTraceRecord(tracePhase, phaseMs, _GetMs() - phaseMs, jsonbufLen, err);
 #endif
+			// A failed poll before any of the reply has been read has lost nothing
+			noteFaultSet(NOTE_FAULT_BUS, (jsonbufLen == 0 && chunklen == 0) ? NOTE_STAGE_WAIT : NOTE_STAGE_RECEIVE);
 			return err;
 		}
 
@@ -149,6 +201,13 @@ const char *i2cNoteTransaction(char *json, char **jsonResponse) {
 
 		// For the next iteration, read the min of what's available and what we're permitted to read
 		chunklen = (int) (available > _I2CMax() ? _I2CMax() : available);
+#ifdef NOTE_TRACE
+		if (tracePhase == NOTE_TRACE_WAIT && chunklen > 0) {
+			NoteTraceRecord(NOTE_TRACE_WAIT, phaseMs, _GetMs() - phaseMs, 0, NULL);
+			tracePhase = NOTE_TRACE_RECEIVE;
+			phaseMs = _GetMs();
+		}
+#endif
 
 		// If there's something available on the notecard for us to receive, do it
 		if (chunklen > 0)
@@ -162,8 +221,15 @@ const char *i2cNoteTransaction(char *json, char **jsonResponse) {
 		if (_GetMs() >= startMs + (NOTECARD_TRANSACTION_TIMEOUT_SEC*1000)) {
 			_Free(jsonbuf);
 #ifdef ERRDBG
-			_Debug("reply to request didn't arrive from module in time\n");
+			_Log(NOTE_LOG_ERROR, NOTE_LOG_IO, "reply to request didn't arrive from module in time\n");
+#endif
+#ifdef NOTE_TRACE
+			NoteTraceRecord(tracePhase, phaseMs, _GetMs() - phaseMs, jsonbufLen, ERRSTR("notecard request or response was lost",c_timeout));
 #endif
+			if (jsonbufLen == 0)
+				noteFaultSet(NOTE_FAULT_BUSY, NOTE_STAGE_WAIT);
+			else
+				noteFaultSet(NOTE_FAULT_PARTIAL, NOTE_STAGE_RECEIVE);
 			return ERRSTR("notecard request or response was lost",c_timeout);
 		}
 
@@ -174,6 +240,9 @@ const char *i2cNoteTransaction(char *json, char **jsonResponse) {
 
 	// Null-terminate it, using the +1 space that we'd allocated in the buffer
 	jsonbuf[jsonbufLen] = '\0';
+#ifdef NOTE_TRACE
+	NoteTraceRecord(NOTE_TRACE_RECEIVE, phaseMs, _GetMs() - phaseMs, jsonbufLen, NULL);
+#endif
 
 	// Return it
 	*jsonResponse = jsonbuf;
@@ -204,7 +273,7 @@ bool i2cNoteReset() {
 	for (retries=0; !notecardReady && retries<3; retries++) {
 
 #ifdef ERRDBG
-		_Debug("i2c reset\n");
+		_Log(NOTE_LOG_INFO, NOTE_LOG_IO, "i2c reset\n");
 #endif
 
 		// Loop to drain all chunks of data that may be ready to transmit to us
@@ -241,7 +310,7 @@ bool i2cNoteReset() {
 		_LockI2C();
 		_I2CReset(_I2CAddress());
 		_UnlockI2C();
-		_Debug(ERRSTR("notecard not responding\n", "no notecard\n"));
+		_Log(NOTE_LOG_WARN, NOTE_LOG_IO, ERRSTR("notecard not responding\n", "no notecard\n"));
 		_DelayMs(2000);
 
 	}
@@ -249,3 +318,58 @@ bool i2cNoteReset() {
 	// Done
 	return notecardReady;
 }
+
+//**************************************************************************/
+/*!
+    @brief  Get back in step with the Notecard after a failed transaction,
+            without the delays and reinitialization of a full reset, by
+            draining whatever it was sending, until it has had nothing more
+            to send for a while.
+    @param   endLine  Whether to first end a request that was cut off before
+             the end of its body, which the Notecard can only reject, so
+             that it doesn't run into the next request.  A request that the
+             Notecard may have in full is never ended, lest it be done.
+    @returns a boolean. `true` if the Notecard answered, `false` if a full
+             reset is needed.
+*/
+/**************************************************************************/
+bool i2cNoteResync(bool endLine) {
+
+	// End a request that was cut off before the end of its body
+	const char *err = NULL;
+	if (endLine) {
+		_LockI2C();
+		_DelayIO();
+		err = _I2CTransmit(_I2CAddress(), (uint8_t *)c_newline, c_newline_len);
+		_UnlockI2C();
+		if (err != NULL)
+			return false;
+	}
+
+	// Drain until nothing more has become available for a while
+	int chunklen = 0;
+	uint32_t startMs = _GetMs();
+	uint32_t quietMs = startMs;
+	while (_GetMs() < startMs + NOTE_RESYNC_MAX_MS) {
+		uint32_t available;
+		uint8_t buffer[128];
+		chunklen = (chunklen > (int)sizeof(buffer)) ? (int)sizeof(buffer) : chunklen;
+		chunklen = (chunklen > (int)_I2CMax()) ? (int)_I2CMax() : chunklen;
+		_LockI2C();
+		_DelayIO();
+		err = _I2CReceive(_I2CAddress(), buffer, chunklen, &available);
+		_UnlockI2C();
+		if (err != NULL)
+			return false;
+		chunklen = (int) available;
+		if (available > 0) {
+			quietMs = _GetMs();
+			continue;
+		}
+		if (_GetMs() >= quietMs + NOTE_RESYNC_QUIET_MS)
+			return true;
+		_DelayMs(5);
+	}
+	return false;
+
+}
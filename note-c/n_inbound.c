@@ -0,0 +1,175 @@
+/*!
+ * @file n_inbound.c
+ *
+ * Delivery of inbound notes without polling.  Rather than asking the
+ * Notecard with note.get whether a note has arrived, which costs a
+ * transaction each time even when none has, the Notecard is armed with
+ * `card.attn` to raise its ATTN pin when any of the registered Notefiles
+ * changes.  The host waits for that edge, typically asleep, and only then
+ * drains the Notefiles, learning with a single `file.changes` how many
+ * notes each one holds so that each note costs exactly one `note.get`, with
+ * no request wasted on finding that a Notefile is empty.  Each note is
+ * handed to the handler registered for its Notefile, and deleted.
+ *
+ * Written by Ray Ozzie and Blues Inc. team.
+ *
+ * Copyright (c) 2019 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#include "n_lib.h"
+
+//**************************************************************************/
+/*!
+    @brief  The registered handlers.
+*/
+/**************************************************************************/
+typedef struct {
+    const char *file;
+    noteInboundFn fn;
+    void *context;
+} inboundHandler;
+static inboundHandler inboundHandlers[NOTE_INBOUND_HANDLERS] = {{0}};
+static int inboundCount = 0;
+
+//**************************************************************************/
+/*!
+    @brief  Register a handler for the notes that arrive in a Notefile.
+            This takes effect when the Notecard is next armed.
+    @param   file  The Notefile, typically ending in `.qi` or `.dbi`, whose
+             name must remain valid for as long as it is registered.
+    @param   fn  The handler, which is called once for each note.
+    @param   context  Passed to the handler.
+    @returns `false` if there's no room for another handler.
+*/
+/**************************************************************************/
+bool NoteInboundRegister(const char *file, noteInboundFn fn, void *context) {
+    for (int i=0; i<inboundCount; i++) {
+        if (strcmp(inboundHandlers[i].file, file) == 0) {
+            inboundHandlers[i].fn = fn;
+            inboundHandlers[i].context = context;
+            return true;
+        }
+    }
+    if (inboundCount >= NOTE_INBOUND_HANDLERS)
+        return false;
+    inboundHandlers[inboundCount].file = file;
+    inboundHandlers[inboundCount].fn = fn;
+    inboundHandlers[inboundCount].context = context;
+    inboundCount++;
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Add the names of the registered Notefiles to a request.
+    @param   req  The request.
+    @returns `false` if memory couldn't be allocated.
+*/
+/**************************************************************************/
+static bool inboundAddFiles(J *req) {
+    J *files = JCreateArray();
+    if (files == NULL)
+        return false;
+    for (int i=0; i<inboundCount; i++)
+        JAddItemToArray(files, JCreateStringReference(inboundHandlers[i].file));
+    JAddItemToObject(req, "files", files);
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Arm the Notecard to raise ATTN when a note arrives in any of the
+            registered Notefiles.  Arming drives ATTN low, so the host
+            should wait for its rising edge.  This must be done at boot,
+            because the Notecard may have been armed differently, and is
+            done again by each drain.
+    @returns `true` if the Notecard was armed.
+*/
+/**************************************************************************/
+bool NoteInboundArm() {
+    if (inboundCount == 0)
+        return false;
+    J *req = NoteNewRequest("card.attn");
+    if (req == NULL)
+        return false;
+    JAddStringToObject(req, "mode", "arm,files");
+    if (!inboundAddFiles(req)) {
+        JDelete(req);
+        return false;
+    }
+    return NoteRequest(req);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the oldest note in a Notefile, deleting it, and hand it to
+            the Notefile's handler.
+    @param   handler  The Notefile's handler.
+    @returns `true` if a note was handled.
+*/
+/**************************************************************************/
+static bool inboundNext(inboundHandler *handler) {
+    J *req = NoteNewRequest("note.get");
+    if (req == NULL)
+        return false;
+    JAddStringToObject(req, "file", handler->file);
+    JAddBoolToObject(req, "delete", true);
+    J *rsp = NoteRequestResponse(req);
+    if (rsp == NULL)
+        return false;
+    bool success = !NoteResponseError(rsp);
+    if (success && handler->fn != NULL)
+        handler->fn(handler->file, rsp, handler->context);
+    NoteDeleteResponse(rsp);
+    return success;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Re-arm the Notecard and deliver every note that is waiting in
+            the registered Notefiles to their handlers.  This should be
+            called when ATTN rises.  Re-arming comes first, so that a note
+            that arrives while draining raises ATTN again rather than being
+            missed.  With N notes waiting this costs N+2 transactions, and
+            with none it costs 2.
+    @returns The number of notes delivered, or -1 if the Notecard couldn't
+             be armed or asked what is waiting.
+*/
+/**************************************************************************/
+int NoteInboundDrain() {
+    if (!NoteInboundArm())
+        return -1;
+
+    // Find out how many notes are waiting in each Notefile
+    J *req = NoteNewRequest("file.changes");
+    if (req == NULL)
+        return -1;
+    if (!inboundAddFiles(req)) {
+        JDelete(req);
+        return -1;
+    }
+    J *rsp = NoteRequestResponse(req);
+    if (rsp == NULL)
+        return -1;
+    if (NoteResponseError(rsp)) {
+        NoteDeleteResponse(rsp);
+        return -1;
+    }
+    J *info = JGetObject(rsp, "info");
+    int waiting[NOTE_INBOUND_HANDLERS];
+    for (int i=0; i<inboundCount; i++)
+        waiting[i] = JGetInt(JGetObject(info, inboundHandlers[i].file), "total");
+    NoteDeleteResponse(rsp);
+
+    // Deliver them, stopping at a Notefile's first failure so that a bad Notefile doesn't stall the rest
+    int delivered = 0;
+    for (int i=0; i<inboundCount; i++)
+        for (int n=0; n<waiting[i] && inboundNext(&inboundHandlers[i]); n++)
+            delivered++;
+    return delivered;
+}
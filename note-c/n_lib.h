@@ -63,6 +63,76 @@ extern "C" {
 /**************************************************************************/
 #define CARD_REQUEST_SERIAL_SEGMENT_DELAY_MS 250
 
+/**************************************************************************/
+/*!
+    @brief  How long, in milliseconds, the bus must be quiet before a resync
+            after a failed transaction is complete, and the longest that a
+            resync may take before a full reset is needed instead.
+*/
+/**************************************************************************/
+#define NOTE_RESYNC_QUIET_MS 50
+#define NOTE_RESYNC_MAX_MS 500
+
+/**************************************************************************/
+/*!
+    @brief  How far a transaction had got when it failed, which decides how
+            it can be recovered.  While the Notecard can't yet have the end
+            of the request's body, what it got of it can be discarded and
+            the request resent, but once it may have the whole body, the
+            request mustn't be sent again lest it be done twice.  Before any
+            of the reply has been read the reply can be read again, but once
+            some of it has been read, the rest must be drained and the
+            failure reported.
+*/
+/**************************************************************************/
+#define NOTE_STAGE_SEND 0
+#define NOTE_STAGE_SENT 1
+#define NOTE_STAGE_WAIT 2
+#define NOTE_STAGE_RECEIVE 3
+
+/**************************************************************************/
+/*!
+    @brief  The shortest and longest intervals, in seconds, at which the
+            epoch clock is resynced with the Notecard.  The interval doubles
+            from the shortest to the longest as long as syncs agree with the
+            drift-corrected clock.
+*/
+/**************************************************************************/
+#define NOTE_TIME_RESYNC_MIN_SECS (15*60)
+#define NOTE_TIME_RESYNC_MAX_SECS (24*60*60)
+/**************************************************************************/
+/*!
+    @brief  A difference, in seconds, between the Notecard's time and our
+            own beyond which the clock is stepped immediately rather than
+            waiting for the next resync.
+*/
+/**************************************************************************/
+#define NOTE_TIME_STEP_SECS 5
+/**************************************************************************/
+/*!
+    @brief  The largest plausible drift of the host clock.  Anything beyond
+            this is assumed to be a change of the Notecard's time rather than
+            drift, and isn't used for estimation.
+*/
+/**************************************************************************/
+#define NOTE_TIME_DRIFT_MAX_PPM 100000
+/**************************************************************************/
+/*!
+    @brief  The interval, in seconds, at which the cache of environment
+            variables asks the Notecard whether any have been modified, and
+            the size of the table in which they are cached.
+*/
+/**************************************************************************/
+#ifndef NOTE_ENV_CHECK_SECS
+#define NOTE_ENV_CHECK_SECS 60
+#endif
+#ifndef NOTE_ENV_CACHE_LEN
+#ifdef NOTE_LOWMEM
+#define NOTE_ENV_CACHE_LEN 256
+#else
+#define NOTE_ENV_CACHE_LEN 1024
+#endif
+#endif
 /**************************************************************************/
 /*!
     @brief  Memory allocation chunk size.
@@ -74,11 +144,28 @@ extern "C" {
 #define ALLOC_CHUNK 128
 #endif
 
+/**************************************************************************/
+/*!
+    @brief  The longest line that the formatted output functions produce,
+            which is held on the stack.
+*/
+/**************************************************************************/
+#ifdef NOTE_LOWMEM
+#define FORMAT_LINE_MAX 96
+#else
+#define FORMAT_LINE_MAX 256
+#endif
+
 // Transactions
 const char *i2cNoteTransaction(char *json, char **jsonResponse);
+const char *i2cNoteReceive(char **jsonResponse);
 bool i2cNoteReset(void);
+bool i2cNoteResync(bool endLine);
 const char *serialNoteTransaction(char *json, char **jsonResponse);
+const char *serialNoteReceive(char **jsonResponse);
 bool serialNoteReset(void);
+bool serialNoteResync(bool endLine);
+void noteFaultSet(int fault, int stage);
 
 // Hooks
 void NoteLockNote(void);
@@ -92,7 +179,21 @@ const char *NoteI2CTransmit(uint16_t DevAddress, uint8_t* pBuffer, uint16_t Size
 const char *NoteI2CReceive(uint16_t DevAddress, uint8_t* pBuffer, uint16_t Size, uint32_t *avail);
 bool NoteHardReset(void);
 const char *NoteJSONTransaction(char *json, char **jsonResponse);
+const char *NoteJSONReceive(char **jsonResponse);
+bool NoteResync(bool endLine);
 bool NoteIsDebugOutputActive(void);
+void NoteDebugOutput(const char *text);
+void noteLogWrite(int level, uint32_t subsystem, const char *text, bool line);
+void noteTemplateApply(const char *target, J *body);
+J *noteWakeResponse(void);
+void NoteTraceBegin(void);
+void NoteTraceRecord(int event, uint32_t startMs, uint32_t durationMs, uint32_t bytes, const char *err);
+
+// Word-at-a-time scanning
+size_t NoteScanPlain(const unsigned char *s);
+size_t NoteScanWhitespace(const unsigned char *p, size_t len);
+size_t NoteScanQuote(const unsigned char *p, size_t len);
+bool NoteScanIsText(const unsigned char *p, size_t len);
 
 // Constants, a global optimization to save static string memory
 extern const char *c_null;
@@ -126,6 +227,7 @@ extern const char *c_cmd;
 #define	c_cmd_len 3
 
 extern const char *c_bad;
+extern const char *c_ioerr;
 #define	c_bad_len 3
 
 
@@ -142,6 +244,8 @@ extern const char *c_bad;
 #define _I2CReceive NoteI2CReceive
 #define _Reset NoteHardReset
 #define _Transaction NoteJSONTransaction
+#define _Receive NoteJSONReceive
+#define _Resync NoteResync
 #define _Malloc NoteMalloc
 #define _Free NoteFree
 #define _GetMs NoteGetMs
@@ -153,9 +257,11 @@ extern const char *c_bad;
 #ifdef NOTE_NODEBUG
 #define _Debug(x)
 #define _Debugln(x)
+#define _Log(level,subsystem,x)
 #else
 #define _Debug(x) NoteDebug(x)
 #define _Debugln(x) NoteDebugln(x)
+#define _Log(level,subsystem,x) do { if ((level) <= NOTE_LOG_LEVEL) NoteLog(level, subsystem, x); } while (0)
 #endif
 
 // End of C-callable functions
@@ -0,0 +1,235 @@
+/*!
+ * @file n_log.c
+ *
+ * Leveled, per-subsystem debug logging.  Each message carries a level and
+ * the subsystem that wrote it, and is written only if it passes both the
+ * compile-time floor, NOTE_LOG_LEVEL, below which calls compile away
+ * entirely, and the filter set at runtime.  Long messages, such as the
+ * bodies of requests and responses, can be truncated to a fixed length.
+ *
+ * When NOTE_LOG is defined, messages are not written to the debug output
+ * as they are logged, which on a slow debug UART can take longer than the
+ * transaction being logged.  Instead they are copied into a ring in RAM,
+ * and the app drains the ring with NoteLogDrain when it would otherwise be
+ * idle.  If the ring is full, messages are dropped whole, and the number
+ * of bytes dropped is reported when the ring is next drained.  Logging and
+ * draining must both be done from the app, never from an ISR.
+ *
+ * Written by Ray Ozzie and Blues Inc. team.
+ *
+ * Copyright (c) 2019 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#include <stdio.h>
+#include "n_lib.h"
+
+//**************************************************************************/
+/*!
+    @brief  The runtime filter, and the length beyond which messages are
+            truncated, or 0 to never truncate them.
+*/
+/**************************************************************************/
+static int logLevel = NOTE_LOG_LEVEL;
+static uint32_t logSubsystems = NOTE_LOG_ALL;
+static uint32_t logTruncateLen = NOTE_LOG_TRUNCATE;
+
+//**************************************************************************/
+/*!
+    @brief  The size of the pieces in which text is handed to the debug
+            output, which takes null-terminated strings.
+*/
+/**************************************************************************/
+#define LOG_PIECE_LEN 64
+
+#ifdef NOTE_LOG
+//**************************************************************************/
+/*!
+    @brief  The ring, and the free-running counts of bytes written into it
+            and drained from it, whose difference is the number held.
+*/
+/**************************************************************************/
+#if (NOTE_LOG_RING_SIZE & (NOTE_LOG_RING_SIZE - 1)) != 0
+#error "NOTE_LOG_RING_SIZE must be a power of two, so that the free-running counts index the ring across their wrap"
+#endif
+static char logRing[NOTE_LOG_RING_SIZE];
+static uint32_t logIn = 0;
+static uint32_t logOut = 0;
+static uint32_t logDropped = 0;
+#endif
+
+//**************************************************************************/
+/*!
+    @brief  Write the first `len` bytes of some text to the debug output.
+*/
+/**************************************************************************/
+static void logEmit(const char *text, uint32_t len) {
+    char piece[LOG_PIECE_LEN+1];
+    while (len > 0) {
+        uint32_t pieceLen = (len > LOG_PIECE_LEN ? LOG_PIECE_LEN : len);
+        memcpy(piece, text, pieceLen);
+        piece[pieceLen] = '\0';
+        NoteDebugOutput(piece);
+        text += pieceLen;
+        len -= pieceLen;
+    }
+}
+
+//**************************************************************************/
+/*!
+    @brief  Log the first `len` bytes of some text, either into the ring or
+            directly to the debug output.  Text placed in the ring must
+            first have been given room with logRoom.
+*/
+/**************************************************************************/
+static void logPut(const char *text, uint32_t len) {
+#ifdef NOTE_LOG
+    while (len > 0) {
+        uint32_t at = logIn % NOTE_LOG_RING_SIZE;
+        uint32_t chunk = NOTE_LOG_RING_SIZE - at;
+        if (chunk > len)
+            chunk = len;
+        memcpy(&logRing[at], text, chunk);
+        logIn += chunk;
+        text += chunk;
+        len -= chunk;
+    }
+#else
+    logEmit(text, len);
+#endif
+}
+
+//**************************************************************************/
+/*!
+    @brief  Check that the ring has room for a message, counting it as
+            dropped if it doesn't.
+*/
+/**************************************************************************/
+static bool logRoom(uint32_t len) {
+#ifdef NOTE_LOG
+    if (len > NOTE_LOG_RING_SIZE - (logIn - logOut)) {
+        logDropped += len;
+        return false;
+    }
+#else
+    (void) len;
+#endif
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Set which messages are logged.
+    @param   level  The most verbose level to log, which has no effect
+             beyond the compile-time floor of NOTE_LOG_LEVEL.
+    @param   subsystems  A mask of the NOTE_LOG_ subsystems to log.
+    @param   truncateLen  The length beyond which messages are truncated,
+             or 0 to never truncate them.
+*/
+/**************************************************************************/
+void NoteLogSetFilter(int level, uint32_t subsystems, uint32_t truncateLen) {
+    logLevel = level;
+    logSubsystems = subsystems;
+    logTruncateLen = truncateLen;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Determine whether a message would be logged, so that work done
+            only to compose it can be skipped.
+    @param   level  The message's level.
+    @param   subsystem  The subsystem that would write it.
+    @returns `true` if it would be logged.
+*/
+/**************************************************************************/
+bool NoteLogEnabled(int level, uint32_t subsystem) {
+    return (level <= NOTE_LOG_LEVEL && level <= logLevel && (subsystem & logSubsystems) != 0);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Log a message, which is truncated if need be.
+    @param   level  The message's level.
+    @param   subsystem  The subsystem that wrote it.
+    @param   text  The message.
+    @param   line  Whether the message is a whole line, which is terminated
+             if it isn't already, or a fragment of one.
+*/
+/**************************************************************************/
+void noteLogWrite(int level, uint32_t subsystem, const char *text, bool line) {
+    if (!NoteLogEnabled(level, subsystem))
+        return;
+#ifndef NOTE_LOG
+    if (!NoteIsDebugOutputActive())
+        return;
+#endif
+    uint32_t len = strlen(text);
+    bool truncated = (logTruncateLen != 0 && len > logTruncateLen);
+    if (truncated)
+        len = logTruncateLen;
+    bool newline = (truncated || (line && (len == 0 || text[len-1] != '\n')));
+    if (!logRoom(len + (truncated ? 3 : 0) + (newline ? c_newline_len : 0)))
+        return;
+    logPut(text, len);
+    if (truncated)
+        logPut("...", 3);
+    if (newline)
+        logPut(c_newline, c_newline_len);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Log a line of text.
+    @param   level  The message's level, one of the NOTE_LOG_ levels.
+    @param   subsystem  The subsystem that wrote it, one of the NOTE_LOG_
+             subsystems.
+    @param   text  The message.
+*/
+/**************************************************************************/
+void NoteLog(int level, uint32_t subsystem, const char *text) {
+    noteLogWrite(level, subsystem, text, true);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Write some of what has been logged to the debug output.  This
+            is meant to be called when the app would otherwise be idle.
+    @param   maxBytes  The most that should be written, to bound the time
+             taken, or 0 for no limit.
+    @returns `true` if anything remains to be written.
+*/
+/**************************************************************************/
+bool NoteLogDrain(uint32_t maxBytes) {
+#ifdef NOTE_LOG
+    if (logDropped != 0) {
+        char note[40];
+        snprintf(note, sizeof(note), "[log dropped %lu bytes]\r\n", (unsigned long) logDropped);
+        logDropped = 0;
+        logEmit(note, strlen(note));
+    }
+    bool limited = (maxBytes != 0);
+    while (logOut != logIn && (!limited || maxBytes > 0)) {
+        uint32_t at = logOut % NOTE_LOG_RING_SIZE;
+        uint32_t chunk = NOTE_LOG_RING_SIZE - at;
+        if (chunk > logIn - logOut)
+            chunk = logIn - logOut;
+        if (chunk > LOG_PIECE_LEN)
+            chunk = LOG_PIECE_LEN;
+        if (limited) {
+            if (chunk > maxBytes)
+                chunk = maxBytes;
+            maxBytes -= chunk;
+        }
+        logEmit(&logRing[at], chunk);
+        logOut += chunk;
+    }
+    return (logOut != logIn);
+#else
+    (void) maxBytes;
+    return false;
+#endif
+}
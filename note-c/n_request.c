@@ -19,24 +19,47 @@ static int suppressShowTransactions = 0;
 // Flag that gets set whenever an error occurs that should force a reset
 static bool resetRequired = true;
 
+// The class of the last failure and how far its transaction had got, as noted by the transport, and the
+// counts of failures and of what was done to recover from them
+static int faultClass = NOTE_FAULT_NONE;
+static int faultStage = NOTE_STAGE_SEND;
+static NoteFaultStats faultStats = {0};
+static int faultsInRow = 0;
+
+// Forwards
+static J *noteTransaction(J *req, JTape **tape);
+static const char *noteExchange(char *json, char **jsonResponse);
+static void noteFaultResync(bool endLine);
+
 /**************************************************************************/
 /*!
-    @brief  Create an error response document.
+    @brief  Create an error response document for a failure on this side of
+            the transaction, rather than one reported by the Notecard, which
+            is tagged with `{io}` so that a caller can tell a failure that
+            is worth retrying from a request that the Notecard rejected.
     @param   errmsg
-               The error message from the Notecard
+               The error message.
 	@returns a `J` cJSON object with the error response.
 */
 /**************************************************************************/
 static J *errDoc(const char *errmsg) {
+    char msg[64];
+    strlcpy(msg, errmsg, sizeof(msg));
+    strlcat(msg, " ", sizeof(msg));
+    strlcat(msg, c_ioerr, sizeof(msg));
     J *rspdoc = JCreateObject();
     if (rspdoc != NULL) {
-        JAddStringToObject(rspdoc, c_err, errmsg);
+        JAddStringToObject(rspdoc, c_err, msg);
 	}
-	if (suppressShowTransactions == 0) {
-	    _Debug("{\"err\":\"");
-		_Debug(errmsg);
-		_Debug("\"}\n");
+#ifndef NOTE_NODEBUG
+	if (suppressShowTransactions == 0 && NoteLogEnabled(NOTE_LOG_DEBUG, NOTE_LOG_REQUEST)) {
+	    char line[96];
+	    strlcpy(line, "{\"err\":\"", sizeof(line));
+	    strlcat(line, msg, sizeof(line));
+	    strlcat(line, "\"}", sizeof(line));
+	    _Log(NOTE_LOG_DEBUG, NOTE_LOG_REQUEST, line);
 	}
+#endif
     return rspdoc;
 }
 
@@ -178,6 +201,39 @@ char *NoteRequestResponseJSON(char *reqJSON) {
 
 }
 
+/**************************************************************************/
+/*!
+    @brief  Send a request to the Notecard and return the response as a tape
+            rather than as a `J` tree, for responses that will only be read.
+            Frees the request structure from memory after sending the request.
+    @param   req
+               The `J` cJSON request object.
+	@returns a tape holding the response, which will have an `err` field
+             if the transaction failed, or NULL if there is insufficient
+             memory.  Free it with `JTapeDelete`.
+*/
+/**************************************************************************/
+JTape *NoteRequestResponseTape(J *req) {
+    // Exit if null request.  This allows safe execution of the form NoteRequestResponseTape(NoteNewRequest("xxx"))
+    if (req == NULL)
+        return NULL;
+    // Execute the transaction
+    JTape *tape = NULL;
+    J *rsp = noteTransaction(req, &tape);
+    JDelete(req);
+    if (tape != NULL || rsp == NULL)
+        return tape;
+    // Errors come back as a small J document, which we convert so that they can be read in the same way
+    char *json = JPrintUnformatted(rsp);
+    JDelete(rsp);
+    if (json == NULL)
+        return NULL;
+    tape = JTapeParseInSitu(json);
+    if (tape == NULL)
+        JFree(json);
+    return tape;
+}
+
 /**************************************************************************/
 /*!
     @brief  Initiate a transaction to the Notecard and return the response.
@@ -190,6 +246,22 @@ char *NoteRequestResponseJSON(char *reqJSON) {
 */
 /**************************************************************************/
 J *NoteTransaction(J *req) {
+    return noteTransaction(req, NULL);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Perform a transaction with the Notecard.
+    @param   req
+               The `J` cJSON request object, which is not freed.
+    @param   tape
+               If non-NULL, a successful response is returned here as a
+               tape rather than as a `J` tree.
+	@returns a `J` cJSON object with the response, NULL if the response was
+             returned as a tape, or NULL if there is insufficient memory.
+*/
+/**************************************************************************/
+static J *noteTransaction(J *req, JTape **tape) {
 
     // Validate in case of memory failure of the requestor
     if (req == NULL)
@@ -209,31 +281,44 @@ J *NoteTransaction(J *req) {
     _LockNote();
 
     // Serialize the JSON requet
+#ifdef NOTE_TRACE
+    NoteTraceBegin();
+    uint32_t traceMs = _GetMs();
+#endif
+    int prevPhase = NoteSetMemPhase(NOTE_PHASE_PRINT);
     char *json = JPrintUnformatted(req);
+#ifdef NOTE_TRACE
+    NoteTraceRecord(NOTE_TRACE_PRINT, traceMs, _GetMs() - traceMs, json == NULL ? 0 : strlen(json), json == NULL ? c_bad : NULL);
+#endif
     if (json == NULL) {
+        NoteSetMemPhase(prevPhase);
         J *rsp = errDoc(ERRSTR("can't convert to JSON",c_bad));
         _UnlockNote();
         return rsp;
     }
     
 	if (suppressShowTransactions == 0) {
-	    _Debugln(json);
+	    _Log(NOTE_LOG_DEBUG, NOTE_LOG_REQUEST, json);
 	}
 
-    // Pertform the transaction
+    // Pertform the transaction, recovering from any failure as best we can
     char *responseJSON;
     const char *errStr;
-    if (noResponseExpected)
-        errStr = _Transaction(json, NULL);
-    else
-        errStr = _Transaction(json, &responseJSON);
+    NoteSetMemPhase(NOTE_PHASE_IO);
+#ifdef NOTE_TRACE
+    traceMs = _GetMs();
+#endif
+    errStr = noteExchange(json, noResponseExpected ? NULL : &responseJSON);
+#ifdef NOTE_TRACE
+    NoteTraceRecord(NOTE_TRACE_IO, traceMs, _GetMs() - traceMs, 0, errStr);
+#endif
 
     // Free the json
     JFree(json);
 
-    // If error, queue up a reset
+    // If error, it has already been recovered from as far as it can be
     if (errStr != NULL) {
-		NoteResetRequired();
+        NoteSetMemPhase(prevPhase);
         J *rsp = errDoc(errStr);
         _UnlockNote();
         return rsp;
@@ -241,28 +326,56 @@ J *NoteTransaction(J *req) {
 
     // Exit with a blank object (with no err field) if no response expected
     if (noResponseExpected) {
+        faultsInRow = 0;
+        NoteSetMemPhase(prevPhase);
         _UnlockNote();
         return JCreateObject();
     }
 
-    // Parse the reply from the card on the input stream
-    J *rspdoc = JParse(responseJSON);
-    if (rspdoc == NULL) {
-        _Debug("invalid JSON: ");
-		_Debug(responseJSON);
+    // Debug, before the reply is parsed in place and is no longer printable
+	if (suppressShowTransactions == 0) {
+	    _Log(NOTE_LOG_DEBUG, NOTE_LOG_REQUEST, responseJSON);
+	}
+
+    // Parse the reply from the card in place, so that its strings needn't be copied.  On success the
+    // buffer belongs to the response, whether a J tree or a tape, and is freed with it.
+    NoteSetMemPhase(NOTE_PHASE_PARSE);
+#ifdef NOTE_TRACE
+    uint32_t responseLen = strlen(responseJSON);
+    traceMs = _GetMs();
+#endif
+    J *rspdoc = NULL;
+    bool parsed;
+    if (tape != NULL) {
+        *tape = JTapeParseInSitu(responseJSON);
+        parsed = (*tape != NULL);
+    } else {
+        rspdoc = JParseInSitu(responseJSON);
+        parsed = (rspdoc != NULL);
+    }
+#ifdef NOTE_TRACE
+    NoteTraceRecord(NOTE_TRACE_PARSE, traceMs, _GetMs() - traceMs, responseLen, parsed ? NULL : c_bad);
+#endif
+    NoteSetMemPhase(prevPhase);
+    if (!parsed) {
+#ifndef NOTE_NODEBUG
+        char msg[96];
+        strlcpy(msg, "invalid JSON at: ", sizeof(msg));
+        strlcat(msg, tape != NULL ? responseJSON : JGetErrorPtr(), sizeof(msg));
+        _Log(NOTE_LOG_ERROR, NOTE_LOG_REQUEST, msg);
+#endif
         _Free(responseJSON);
+        faultStats.faults[NOTE_FAULT_DESYNC]++;
+        uint32_t recoveryMs = _GetMs();
+        noteFaultResync(false);
+        faultStats.recoveryMs += _GetMs() - recoveryMs;
         J *rsp = errDoc(ERRSTR("unrecognized response from card",c_bad));
         _UnlockNote();
         return rsp;
     }
 
-    // Debug
-	if (suppressShowTransactions == 0) {
-	    _Debugln(responseJSON);
-	}
-
-    // Discard the buffer now that it's parsed
-    _Free(responseJSON);
+    // Only a reply that made sense shows that we're in step with the Notecard
+    faultsInRow = 0;
 
     // Unlock
     _UnlockNote();
@@ -272,6 +385,147 @@ J *NoteTransaction(J *req) {
     
 }
 
+//**************************************************************************/
+/*!
+    @brief  Note the class of a failure of a transaction, and how far the
+            transaction had got, which the transports do just before
+            returning the error.
+    @param   fault  One of the `NOTE_FAULT_` classes.
+    @param   stage  One of the `NOTE_STAGE_` stages.
+*/
+/**************************************************************************/
+void noteFaultSet(int fault, int stage) {
+    faultClass = fault;
+    faultStage = stage;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get back in step with the Notecard after a failure that can't
+            be retried, by draining the bus, or if that fails, or if it
+            didn't help the last time, by having it fully reset before the
+            next transaction.
+    @param   endLine  Whether the request was cut off before the end of its
+             body, and must be ended so that the Notecard rejects it.
+*/
+/**************************************************************************/
+static void noteFaultResync(bool endLine) {
+    if (++faultsInRow < NOTE_RETRY_ESCALATE && _Resync(endLine)) {
+        faultStats.resyncs++;
+        return;
+    }
+    faultsInRow = 0;
+    faultStats.resets++;
+    NoteResetRequired();
+}
+
+//**************************************************************************/
+/*!
+    @brief  Exchange a request and its reply with the Notecard, recovering
+            from each failure according to its class and how far the
+            transaction had got.  A request that was cut off before the end
+            of its body is resent, after a backoff that doubles each time,
+            but one that the Notecard may have got in full is never resent,
+            lest it be done twice.  A reply that hadn't begun is read again,
+            and each is retried a limited number of times.  Once the
+            transaction can't be retried, the bus is drained so that the
+            next transaction starts in step, and only if that fails, or the
+            failure couldn't be classified, is a full reset required.
+    @param   json  The request, which the transport may modify during the
+             transaction but restores.
+    @param   jsonResponse (out) The reply, or NULL if none is expected.
+    @returns NULL if successful, or the error of the last attempt.
+*/
+/**************************************************************************/
+static const char *noteExchange(char *json, char **jsonResponse) {
+    int resends = 0;
+    int rereads = 0;
+    uint32_t attemptMs = _GetMs();
+    uint32_t failedMs = 0;
+    bool failed = false;
+    noteFaultSet(NOTE_FAULT_NONE, NOTE_STAGE_SEND);
+    const char *errStr = _Transaction(json, jsonResponse);
+    while (errStr != NULL) {
+
+        // Account for the failure, timing recovery from the start of the first attempt that failed
+        int fault = faultClass;
+        int stage = faultStage;
+        if (fault == NOTE_FAULT_NONE)
+            fault = NOTE_FAULT_OTHER;
+        faultStats.faults[fault]++;
+        if (!failed) {
+            failed = true;
+            failedMs = attemptMs;
+        }
+        attemptMs = _GetMs();
+
+        // A failure that couldn't be classified needs a full reset
+        if (fault == NOTE_FAULT_OTHER) {
+            faultStats.resets++;
+            NoteResetRequired();
+            break;
+        }
+
+        // Resend a request that was cut off before the end of its body, once the Notecard has rejected
+        // what it got of it
+        if (stage == NOTE_STAGE_SEND && resends < NOTE_RETRY_SEND) {
+            if (!_Resync(true)) {
+                faultStats.resets++;
+                NoteResetRequired();
+                break;
+            }
+            faultStats.resyncs++;
+            _DelayMs(NOTE_RETRY_BACKOFF_MS << resends);
+            resends++;
+            faultStats.resends++;
+            attemptMs = _GetMs();
+            noteFaultSet(NOTE_FAULT_NONE, NOTE_STAGE_SEND);
+            errStr = _Transaction(json, jsonResponse);
+            continue;
+        }
+
+        // Read again a reply that hadn't begun, in case the Notecard was busy
+        if (stage == NOTE_STAGE_WAIT && fault != NOTE_FAULT_MEMORY && jsonResponse != NULL && rereads < NOTE_RETRY_READ) {
+            rereads++;
+            faultStats.rereads++;
+            noteFaultSet(NOTE_FAULT_NONE, NOTE_STAGE_WAIT);
+            errStr = _Receive(jsonResponse);
+            continue;
+        }
+
+        // Otherwise, get back in step for the next transaction and give up on this one
+        noteFaultResync(stage == NOTE_STAGE_SEND);
+        break;
+
+    }
+    if (failed) {
+        faultStats.recoveryMs += _GetMs() - failedMs;
+        if (errStr == NULL)
+            faultStats.recovered++;
+    }
+    return errStr;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the counts of failures of transactions with the Notecard,
+            by class, and of what was done to recover from them.
+    @param   stats (out) The counts.
+*/
+/**************************************************************************/
+void NoteGetFaultStats(NoteFaultStats *stats) {
+    *stats = faultStats;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Clear the counts of failures of transactions with the Notecard.
+*/
+/**************************************************************************/
+void NoteClearFaultStats() {
+    memset(&faultStats, 0, sizeof(faultStats));
+}
+
 /**************************************************************************/
 /*!
     @brief  Mark that a reset will be required before doing further I/O on
@@ -0,0 +1,172 @@
+/*!
+ * @file n_scan.c
+ *
+ * Word-at-a-time scanning kernels used by the JSON parser and printer, and
+ * by the serial transport to validate what it receives.  Each one examines
+ * four bytes per step using the usual SIMD-within-a-register identities,
+ * and drops back to a byte at a time only to handle the word in which
+ * something of interest was found.  Cortex-M0+ faults on unaligned word
+ * loads, so the bytes before the first word boundary are handled singly.
+ *
+ * Written by Ray Ozzie and Blues Inc. team.
+ *
+ * Copyright (c) 2019 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#include "n_lib.h"
+
+//**************************************************************************/
+/*!
+    @brief  Byte-lane helpers.  For a 32-bit word `v`, scanHasLess is nonzero
+            if any byte is less than `n`, scanHasMore is nonzero if any byte
+            is greater than `n`, and scanHasByte is nonzero if any byte
+            equals `c`.  They say whether such a byte is present, not where.
+*/
+/**************************************************************************/
+#define SCAN_ONES               0x01010101UL
+#define SCAN_HIGHS              0x80808080UL
+#define scanHasLess(v,n)        (((v) - SCAN_ONES*(n)) & ~(v) & SCAN_HIGHS)
+#define scanHasMore(v,n)        ((((v) + SCAN_ONES*(127-(n))) | (v)) & SCAN_HIGHS)
+#define scanHasZero(v)          scanHasLess(v,1)
+#define scanHasByte(v,c)        scanHasZero((v) ^ (SCAN_ONES*(c)))
+#define scanAligned(p)          ((((uintptr_t) (p)) & 3) == 0)
+
+//**************************************************************************/
+/*!
+    @brief  The type through which words are loaded, which may alias the
+            bytes of any buffer.
+*/
+/**************************************************************************/
+#ifdef __GNUC__
+typedef uint32_t __attribute__((__may_alias__)) scanWord;
+#define SCAN_OVERREADS __attribute__((no_sanitize_address))
+#else
+typedef uint32_t scanWord;
+#define SCAN_OVERREADS
+#endif
+
+//**************************************************************************/
+/*!
+    @brief  Whether a byte of a string can be printed in JSON as-is.
+*/
+/**************************************************************************/
+#define scanIsPlain(c)          ((c) >= 0x20 && (c) != '\"' && (c) != '\\')
+
+//**************************************************************************/
+/*!
+    @brief  Measure the leading run of a string that can be printed in JSON
+            without escaping.  The terminating null is not part of the run,
+            so the byte at the returned offset is either the null or a byte
+            that must be escaped.  Because loads are aligned, the word that
+            holds the terminator may be read in full, which is harmless but
+            which must be hidden from the address sanitizer in host builds.
+    @param   s  A null-terminated string.
+    @returns The length of the run.
+*/
+/**************************************************************************/
+SCAN_OVERREADS size_t NoteScanPlain(const unsigned char *s) {
+    const unsigned char *p = s;
+    while (!scanAligned(p)) {
+        if (!scanIsPlain(*p))
+            return (size_t) (p - s);
+        p++;
+    }
+    for (;;) {
+        uint32_t v = *(const scanWord *) p;
+        if (scanHasLess(v, 0x20) || scanHasByte(v, '\"') || scanHasByte(v, '\\'))
+            break;
+        p += 4;
+    }
+    while (scanIsPlain(*p))
+        p++;
+    return (size_t) (p - s);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Measure the leading run of JSON whitespace, which like the parser
+            we take to be any byte up to and including a space.
+    @param   p  The text.
+    @param   len  The number of bytes that may be examined.
+    @returns The length of the run.
+*/
+/**************************************************************************/
+size_t NoteScanWhitespace(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    while (i < len && !scanAligned(p+i)) {
+        if (p[i] > 0x20)
+            return i;
+        i++;
+    }
+    while (i+4 <= len) {
+        uint32_t v = *(const scanWord *) (p+i);
+        if (scanHasMore(v, 0x20))
+            break;
+        i += 4;
+    }
+    while (i < len && p[i] <= 0x20)
+        i++;
+    return i;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Find the next quote or backslash within the body of a JSON
+            string.
+    @param   p  The text.
+    @param   len  The number of bytes that may be examined.
+    @returns The offset of the byte found, or `len` if there is none.
+*/
+/**************************************************************************/
+size_t NoteScanQuote(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    while (i < len && !scanAligned(p+i)) {
+        if (p[i] == '\"' || p[i] == '\\')
+            return i;
+        i++;
+    }
+    while (i+4 <= len) {
+        uint32_t v = *(const scanWord *) (p+i);
+        if (scanHasByte(v, '\"') || scanHasByte(v, '\\'))
+            break;
+        i += 4;
+    }
+    while (i < len && p[i] != '\"' && p[i] != '\\')
+        i++;
+    return i;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Check that a buffer holds only non-null 7-bit ASCII, as does
+            anything that the Notecard sends.
+    @param   p  The data.
+    @param   len  The number of bytes to check.
+    @returns `true` if every byte is valid.
+*/
+/**************************************************************************/
+bool NoteScanIsText(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    while (i < len && !scanAligned(p+i)) {
+        if (p[i] == 0 || (p[i] & 0x80) != 0)
+            return false;
+        i++;
+    }
+    while (i+4 <= len) {
+        uint32_t v = *(const scanWord *) (p+i);
+        if ((v & SCAN_HIGHS) != 0 || scanHasZero(v))
+            return false;
+        i += 4;
+    }
+    while (i < len) {
+        if (p[i] == 0 || (p[i] & 0x80) != 0)
+            return false;
+        i++;
+    }
+    return true;
+}
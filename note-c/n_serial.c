@@ -29,6 +29,11 @@ const char *serialNoteTransaction(char *json, char **jsonResponse) {
 	// Transmit the request in segments so as not to overwhelm the notecard's interrupt buffers
 	uint32_t segOff = 0;
 	uint32_t segLeft = strlen(json);
+#ifdef NOTE_TRACE
+	uint32_t jsonLen = segLeft;
+	uint32_t sendMs = _GetMs();
+	uint32_t delayMs = 0;
+#endif
 	while (true) {
 		size_t segLen = segLeft;
 		if (segLen > CARD_REQUEST_SERIAL_SEGMENT_MAX_LEN)
@@ -40,12 +45,41 @@ const char *serialNoteTransaction(char *json, char **jsonResponse) {
 			break;
 		}
 		segOff += segLen;
+#ifdef NOTE_TRACE
+		uint32_t delayStartMs = _GetMs();
+		_DelayMs(CARD_REQUEST_SERIAL_SEGMENT_DELAY_MS);
+		delayMs += _GetMs() - delayStartMs;
+#else
 		_DelayMs(CARD_REQUEST_SERIAL_SEGMENT_DELAY_MS);
+#endif
 	}
+#ifdef NOTE_TRACE
+	NoteTraceRecord(NOTE_TRACE_SEND, sendMs, _GetMs() - sendMs - delayMs, jsonLen, NULL);
+	if (delayMs != 0)
+		NoteTraceRecord(NOTE_TRACE_DELAY, sendMs, delayMs, 0, NULL);
+#endif
+
+	// If no reply expected, we're done
+	if (jsonResponse == NULL)
+		return NULL;
 
-    // If no reply expected, we're done
-    if (jsonResponse == NULL)
-        return NULL;
+	// Read the reply
+	return serialNoteReceive(jsonResponse);
+
+}
+
+/**************************************************************************/
+/*!
+    @brief  Read a reply from the Notecard to a request that has been sent,
+            which is also used to read it again after a first attempt found
+            that no reply had begun.
+		@param   jsonResponse
+							 An out parameter c-string buffer that will contain the JSON
+							 response from the Notercard.
+	@returns a c-string with an error, or `NULL` if no error ocurred.
+*/
+/**************************************************************************/
+const char *serialNoteReceive(char **jsonResponse) {
 
 	// Wait for something to become available, processing timeout errors up-front
 	// because the json parse operation immediately following is subject to the
@@ -55,12 +89,19 @@ const char *serialNoteTransaction(char *json, char **jsonResponse) {
 	for (startMs = _GetMs(); !_SerialAvailable(); ) {
 		if (_GetMs() >= startMs + (NOTECARD_TRANSACTION_TIMEOUT_SEC*1000)) {
 #ifdef ERRDBG
-			_Debug("reply to request didn't arrive from module in time\n");
+			_Log(NOTE_LOG_ERROR, NOTE_LOG_IO, "reply to request didn't arrive from module in time\n");
+#endif
+#ifdef NOTE_TRACE
+			NoteTraceRecord(NOTE_TRACE_WAIT, startMs, _GetMs() - startMs, 0, ERRSTR("transaction timeout",c_timeout));
 #endif
+			noteFaultSet(NOTE_FAULT_BUSY, NOTE_STAGE_WAIT);
 			return ERRSTR("transaction timeout",c_timeout);
 		}
 		_DelayMs(10);
 	}
+#ifdef NOTE_TRACE
+	NoteTraceRecord(NOTE_TRACE_WAIT, startMs, _GetMs() - startMs, 0, NULL);
+#endif
 
 	// Allocate a buffer for input, noting that we always put the +1 in the alloc so we can be assured
 	// that it can be null-terminated.	This must be the case because json parsing requires a
@@ -69,11 +110,13 @@ const char *serialNoteTransaction(char *json, char **jsonResponse) {
 	char *jsonbuf = (char *) _Malloc(jsonbufAllocLen+1);
 	if (jsonbuf == NULL) {
 #ifdef ERRDBG
-		_Debug("transaction: jsonbuf malloc failed\n");
+		_Log(NOTE_LOG_ERROR, NOTE_LOG_IO, "transaction: jsonbuf malloc failed\n");
 #endif
+		noteFaultSet(NOTE_FAULT_MEMORY, NOTE_STAGE_WAIT);
 		return ERRSTR("insufficient memory",c_mem);
 	}
 	int jsonbufLen = 0;
+	int jsonbufChecked = 0;
 	char ch = 0;
 	startMs = _GetMs();
 	while (ch != '\n') {
@@ -81,12 +124,17 @@ const char *serialNoteTransaction(char *json, char **jsonResponse) {
 			ch = 0;
 			if (_GetMs() >= startMs + (NOTECARD_TRANSACTION_TIMEOUT_SEC*1000)) {
 #ifdef ERRDBG
+				char msg[96];
 				jsonbuf[jsonbufLen] = '\0';
-				_Debug("received only partial reply after timeout:\n");
-				_Debug(jsonbuf);
-				_Debug("\n");
+				strlcpy(msg, "received only partial reply after timeout: ", sizeof(msg));
+				strlcat(msg, jsonbuf, sizeof(msg));
+				_Log(NOTE_LOG_ERROR, NOTE_LOG_IO, msg);
 #endif
 				_Free(jsonbuf);
+#ifdef NOTE_TRACE
+				NoteTraceRecord(NOTE_TRACE_RECEIVE, startMs, _GetMs() - startMs, jsonbufLen, ERRSTR("transaction incomplete",c_timeout));
+#endif
+				noteFaultSet(NOTE_FAULT_PARTIAL, NOTE_STAGE_RECEIVE);
 				return ERRSTR("transaction incomplete",c_timeout);
 			}
 			_DelayMs(1);
@@ -94,25 +142,38 @@ const char *serialNoteTransaction(char *json, char **jsonResponse) {
 		}
 		ch = _SerialReceive();
 
-		// Because serial I/O can be error-prone, catch common bad data early, knowing that we only accept ASCII
-		if (ch == 0 || (ch & 0x80) != 0) {
+		// Append into the json buffer
+		jsonbuf[jsonbufLen++] = ch;
+
+		// Because serial I/O can be error-prone, catch common bad data early, knowing that we only accept ASCII.
+		// This is checked a word at a time, whenever the buffer fills or the reply is complete.
+		bool chunkComplete = (jsonbufLen >= jsonbufAllocLen || ch == '\n');
+		if (chunkComplete && !NoteScanIsText((uint8_t *)&jsonbuf[jsonbufChecked], jsonbufLen - jsonbufChecked)) {
 #ifdef ERRDBG
-			_Debug("invalid data received on serial port from notecard\n");
+			_Log(NOTE_LOG_ERROR, NOTE_LOG_IO, "invalid data received on serial port from notecard\n");
 #endif
 			_Free(jsonbuf);
+#ifdef NOTE_TRACE
+			NoteTraceRecord(NOTE_TRACE_RECEIVE, startMs, _GetMs() - startMs, jsonbufLen, ERRSTR("serial communications error",c_timeout));
+#endif
+			noteFaultSet(NOTE_FAULT_DESYNC, NOTE_STAGE_RECEIVE);
 			return ERRSTR("serial communications error",c_timeout);
 		}
 
-		// Append into the json buffer
-		jsonbuf[jsonbufLen++] = ch;
+		// Grow the json buffer
 		if (jsonbufLen >= jsonbufAllocLen) {
+			jsonbufChecked = jsonbufLen;
 			jsonbufAllocLen += ALLOC_CHUNK;
 			char *jsonbufNew = (char *) _Malloc(jsonbufAllocLen+1);
 			if (jsonbufNew == NULL) {
 #ifdef ERRDBG
-				_Debug("transaction: jsonbuf malloc grow failed\n");
+				_Log(NOTE_LOG_ERROR, NOTE_LOG_IO, "transaction: jsonbuf malloc grow failed\n");
 #endif
 				_Free(jsonbuf);
+#ifdef NOTE_TRACE
+				NoteTraceRecord(NOTE_TRACE_RECEIVE, startMs, _GetMs() - startMs, jsonbufLen, ERRSTR("insufficient memory",c_mem));
+#endif
+				noteFaultSet(NOTE_FAULT_MEMORY, NOTE_STAGE_RECEIVE);
 				return ERRSTR("insufficient memory",c_mem);
 			}
 			memcpy(jsonbufNew, jsonbuf, jsonbufLen);
@@ -123,6 +184,9 @@ const char *serialNoteTransaction(char *json, char **jsonResponse) {
 
 	// Null-terminate it, using the +1 space that we'd allocated in the buffer
 	jsonbuf[jsonbufLen] = '\0';
+#ifdef NOTE_TRACE
+	NoteTraceRecord(NOTE_TRACE_RECEIVE, startMs, _GetMs() - startMs, jsonbufLen, NULL);
+#endif
 
 	// Return it
 	*jsonResponse = jsonbuf;
@@ -151,7 +215,7 @@ bool serialNoteReset() {
 	for (retries=0; retries<10; retries++) {
 
 #ifdef ERRDBG
-		_Debug("serial reset\n");
+		_Log(NOTE_LOG_INFO, NOTE_LOG_IO, "serial reset\n");
 #endif
 
 		// Send a newline to the module to clean out request/response processing
@@ -177,9 +241,9 @@ bool serialNoteReset() {
 		}
 
 #ifdef ERRDBG
-		_Debug(somethingFound ? "unrecognized data from notecard\n" : "notecard not responding\n");
+		_Log(NOTE_LOG_WARN, NOTE_LOG_IO, somethingFound ? "unrecognized data from notecard\n" : "notecard not responding\n");
 #else
-		_Debug("no notecard\n");
+		_Log(NOTE_LOG_WARN, NOTE_LOG_IO, "no notecard\n");
 #endif
 		_DelayMs(500);
 		_SerialReset();
@@ -189,3 +253,41 @@ bool serialNoteReset() {
 	// Done
 	return notecardReady;
 }
+
+//**************************************************************************/
+/*!
+    @brief  Get back in step with the Notecard after a failed transaction,
+            without the delays and reinitialization of a full reset, by
+            draining whatever it was sending, until the line goes quiet.
+    @param   endLine  Whether to first end a request that was cut off before
+             the end of its body, which the Notecard can only reject, so
+             that it doesn't run into the next request.  A request that the
+             Notecard may have in full is never ended, lest it be done.
+    @returns a boolean. `true` if the Notecard answered, `false` if a full
+             reset is needed.
+*/
+/**************************************************************************/
+bool serialNoteResync(bool endLine) {
+
+	// End a request that was cut off, to which the Notecard replies once it has finished with anything earlier
+	if (endLine)
+		_SerialTransmit((uint8_t *)c_newline, c_newline_len, true);
+
+	// Drain until the line has been quiet for a while, after the end of a line if anything came at all.  A
+	// Notecard that wasn't sent anything owes us no reply, so for it quiet is enough.
+	bool answered = !endLine;
+	uint32_t startMs = _GetMs();
+	uint32_t quietMs = startMs;
+	while (_GetMs() < startMs + NOTE_RESYNC_MAX_MS) {
+		if (_SerialAvailable()) {
+			answered = (_SerialReceive() == '\n');
+			quietMs = _GetMs();
+			continue;
+		}
+		if (answered && _GetMs() >= quietMs + NOTE_RESYNC_QUIET_MS)
+			return true;
+		_DelayMs(1);
+	}
+	return false;
+
+}
@@ -0,0 +1,362 @@
+/*!
+ * @file n_snapshot.c
+ *
+ * Snapshots of the host's state that the Notecard holds while it has cut
+ * the host's power, or that the host keeps itself in memory that survives
+ * its own low-power modes.  Rather than one opaque buffer of exactly the right
+ * length, the state is registered as a list of regions, each identified by
+ * a number, and a snapshot records each region's identifier and length
+ * alongside its contents, under a schema version of the app's choosing and
+ * a CRC of the whole.  On restore each saved region is matched to the
+ * registered region with the same identifier, and as much is copied as
+ * both have, so a firmware upgrade that appends fields to a region, or adds
+ * a region, keeps what was saved and leaves the new fields as they were
+ * initialized.
+ *
+ * A region whose contents are still what they were when it was registered,
+ * which is typically the state it was initialized to at boot, is saved as
+ * a marker without its contents.  The snapshot is base64-encoded region by
+ * region straight into the payload, with no binary copy of it, and is
+ * decoded a byte at a time straight into the regions, once to verify it and
+ * once to restore it, so that a damaged snapshot leaves every region as it
+ * was.
+ *
+ * The binary form, before encoding, is a header of the magic byte, the
+ * format, the schema version (16 bits) and the number of regions, then for
+ * each region its identifier, its flags, its length (16 bits) and, unless
+ * it is unchanged, its contents, and finally a CRC-32 of all of that.
+ * Multi-byte values are little-endian.
+ *
+ * Written by Ray Ozzie and Blues Inc. team.
+ *
+ * Copyright (c) 2019 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#include "n_lib.h"
+
+//**************************************************************************/
+/*!
+    @brief  The layout of a snapshot.
+*/
+/**************************************************************************/
+#define SNAPSHOT_MAGIC          0x53
+#define SNAPSHOT_FORMAT         1
+#define SNAPSHOT_HEADER_LEN     5
+#define SNAPSHOT_REGION_LEN     4
+#define SNAPSHOT_CRC_LEN        4
+#define SNAPSHOT_UNCHANGED      0x01
+
+//**************************************************************************/
+/*!
+    @brief  The registered regions, and for each a CRC of its contents when
+            it was registered.
+*/
+/**************************************************************************/
+typedef struct {
+    void *region;
+    uint16_t len;
+    uint8_t id;
+    uint32_t baseline;
+} snapshotRegion;
+static snapshotRegion snapshotRegions[NOTE_SNAPSHOT_REGIONS];
+static int snapshotCount = 0;
+
+//**************************************************************************/
+/*!
+    @brief  Fold bytes into a CRC-32, computed bit by bit so that it needs
+            no table in flash.
+    @param   crc  The CRC so far, which starts at 0.
+    @param   data  The bytes.
+    @param   len  The number of bytes.
+    @returns The new CRC.
+*/
+/**************************************************************************/
+static uint32_t snapshotCRC(uint32_t crc, const void *data, uint32_t len) {
+    const uint8_t *p = (const uint8_t *) data;
+    crc = ~crc;
+    while (len-- > 0) {
+        crc ^= *p++;
+        for (int bit=0; bit<8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Register a region of state to be kept in each snapshot.  The
+            region's contents as they are now are its baseline, so this is
+            best done once the region has been initialized.
+    @param   id  The region's identifier, which must not change between
+             firmware versions.
+    @param   region  The region.
+    @param   len  Its length, which a later firmware version may increase
+             by appending fields.
+    @returns `false` if there's no room to register another region.
+*/
+/**************************************************************************/
+bool NoteSnapshotRegister(uint8_t id, void *region, uint16_t len) {
+    int i;
+    for (i=0; i<snapshotCount; i++)
+        if (snapshotRegions[i].id == id)
+            break;
+    if (i == snapshotCount) {
+        if (snapshotCount >= NOTE_SNAPSHOT_REGIONS)
+            return false;
+        snapshotCount++;
+    }
+    snapshotRegions[i].id = id;
+    snapshotRegions[i].region = region;
+    snapshotRegions[i].len = len;
+    snapshotRegions[i].baseline = snapshotCRC(0, region, len);
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Whether a region has changed since it was registered.
+    @param   r  The region.
+    @returns `true` if it has changed.
+*/
+/**************************************************************************/
+static bool snapshotChanged(const snapshotRegion *r) {
+    return snapshotCRC(0, r->region, r->len) != r->baseline;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Encode some of a snapshot, folding it into its CRC.
+    @param   enc  The encoder.
+    @param   out  Where the encoded text is written, which is advanced.
+    @param   crc  The CRC, which is updated.
+    @param   data  The bytes.
+    @param   len  The number of bytes.
+*/
+/**************************************************************************/
+static void snapshotPut(JB64Encoder *enc, char **out, uint32_t *crc, const void *data, uint32_t len) {
+    *crc = snapshotCRC(*crc, data, len);
+    *out += JB64EncodeUpdate(enc, *out, data, (int) len);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Size a snapshot of the registered regions, noting which of them
+            have changed.
+    @param   changed (out) Whether each region has changed.
+    @returns The length of the snapshot before it is encoded.
+*/
+/**************************************************************************/
+static uint32_t snapshotLen(bool *changed) {
+    uint32_t len = SNAPSHOT_HEADER_LEN + SNAPSHOT_CRC_LEN;
+    for (int i=0; i<snapshotCount; i++) {
+        changed[i] = snapshotChanged(&snapshotRegions[i]);
+        len += SNAPSHOT_REGION_LEN + (changed[i] ? snapshotRegions[i].len : 0);
+    }
+    return len;
+}
+
+//**************************************************************************/
+/*!
+    @brief  The size of buffer needed to hold a snapshot of the registered
+            regions as they are now.
+    @returns The number of characters, including the terminating null.
+*/
+/**************************************************************************/
+uint32_t NoteSnapshotEncodeLen() {
+    bool changed[NOTE_SNAPSHOT_REGIONS];
+    return JB64EncodeLen(snapshotLen(changed));
+}
+
+//**************************************************************************/
+/*!
+    @brief  Take a snapshot of the registered regions, base64-encoded into a
+            buffer, such as one in memory that the host retains while it is
+            in a low-power mode.
+    @param   version  The version of the app's schema of its state, which is
+             given back when the snapshot is restored.
+    @param   coded  The buffer.
+    @param   codedLen  Its size.
+    @returns The length of the snapshot, or -1 if it doesn't fit.
+*/
+/**************************************************************************/
+int NoteSnapshotEncode(uint16_t version, char *coded, uint32_t codedLen) {
+    bool changed[NOTE_SNAPSHOT_REGIONS];
+    if ((uint32_t) JB64EncodeLen(snapshotLen(changed)) > codedLen)
+        return -1;
+
+    // Encode it straight from the regions
+    JB64Encoder enc;
+    JB64EncodeStart(&enc);
+    char *out = coded;
+    uint32_t crc = 0;
+    uint8_t header[SNAPSHOT_HEADER_LEN] = {SNAPSHOT_MAGIC, SNAPSHOT_FORMAT, (uint8_t) version, (uint8_t) (version >> 8), (uint8_t) snapshotCount};
+    snapshotPut(&enc, &out, &crc, header, sizeof(header));
+    for (int i=0; i<snapshotCount; i++) {
+        snapshotRegion *r = &snapshotRegions[i];
+        uint8_t regionHeader[SNAPSHOT_REGION_LEN] = {r->id, changed[i] ? 0 : SNAPSHOT_UNCHANGED, (uint8_t) r->len, (uint8_t) (r->len >> 8)};
+        snapshotPut(&enc, &out, &crc, regionHeader, sizeof(regionHeader));
+        if (changed[i])
+            snapshotPut(&enc, &out, &crc, r->region, r->len);
+    }
+    uint8_t trailer[SNAPSHOT_CRC_LEN] = {(uint8_t) crc, (uint8_t) (crc >> 8), (uint8_t) (crc >> 16), (uint8_t) (crc >> 24)};
+    out += JB64EncodeUpdate(&enc, out, trailer, sizeof(trailer));
+    out += JB64EncodeFinish(&enc, out);
+    return (int) (out - coded);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Take a snapshot of the registered regions and ask the Notecard
+            to hold it while it cuts our power for a while.
+    @param   version  The version of the app's schema of its state, which is
+             given back when the snapshot is restored.
+    @param   seconds  How long to sleep.
+    @param   modes  Further `card.attn` modes, or NULL.
+    @returns `true` if the Notecard accepted it.
+*/
+/**************************************************************************/
+bool NoteSnapshotSleep(uint16_t version, uint32_t seconds, const char *modes) {
+    uint32_t payloadLen = NoteSnapshotEncodeLen();
+    char *payload = (char *) _Malloc(payloadLen);
+    if (payload == NULL)
+        return false;
+    bool success = (NoteSnapshotEncode(version, payload, payloadLen) >= 0 && NoteSleep(payload, seconds, modes));
+    _Free(payload);
+    return success;
+}
+
+//**************************************************************************/
+/*!
+    @brief  The state of decoding a snapshot a byte at a time.
+*/
+/**************************************************************************/
+typedef struct {
+    const char *coded;
+    uint32_t pos;
+    uint32_t len;
+    JB64Decoder dec;
+    uint32_t crc;
+} snapshotReader;
+
+//**************************************************************************/
+/*!
+    @brief  Decode the next bytes of a snapshot, folding them into its CRC.
+    @param   rd  The reader.
+    @param   dst  Where the bytes are written, or NULL to skip them.
+    @param   n  The number of bytes.
+    @returns `false` if the snapshot ended first.
+*/
+/**************************************************************************/
+static bool snapshotGet(snapshotReader *rd, void *dst, uint32_t n) {
+    uint8_t *p = (uint8_t *) dst;
+    while (n > 0) {
+        uint8_t byte;
+        if (rd->pos >= rd->len)
+            return false;
+        if (JB64DecodeUpdate(&rd->dec, &byte, 1, &rd->coded[rd->pos++], 1) != 1)
+            continue;
+        rd->crc = snapshotCRC(rd->crc, &byte, 1);
+        if (p != NULL)
+            *p++ = byte;
+        n--;
+    }
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Go through a snapshot, either only verifying it or also copying
+            each saved region into the registered region of the same
+            identifier, as much as both of them have.
+    @param   coded  The snapshot's base64 text.
+    @param   restore  Whether to copy into the regions.
+    @param   version (out) The schema version, if not NULL.
+    @returns The number of regions restored, or -1 if the snapshot is
+             damaged or of an unknown format.
+*/
+/**************************************************************************/
+static int snapshotRead(const char *coded, bool restore, uint16_t *version) {
+    snapshotReader rd = {.coded = coded, .pos = 0, .len = strlen(coded), .crc = 0};
+    JB64DecodeStart(&rd.dec);
+    uint8_t header[SNAPSHOT_HEADER_LEN];
+    if (!snapshotGet(&rd, header, sizeof(header)) || header[0] != SNAPSHOT_MAGIC || header[1] != SNAPSHOT_FORMAT)
+        return -1;
+    if (version != NULL)
+        *version = (uint16_t) (header[2] | (header[3] << 8));
+    int restored = 0;
+    for (int n=0; n<header[4]; n++) {
+        uint8_t regionHeader[SNAPSHOT_REGION_LEN];
+        if (!snapshotGet(&rd, regionHeader, sizeof(regionHeader)))
+            return -1;
+        uint16_t savedLen = (uint16_t) (regionHeader[2] | (regionHeader[3] << 8));
+        if ((regionHeader[1] & SNAPSHOT_UNCHANGED) != 0)
+            continue;
+        snapshotRegion *r = NULL;
+        for (int i=0; r == NULL && i<snapshotCount; i++)
+            if (snapshotRegions[i].id == regionHeader[0])
+                r = &snapshotRegions[i];
+        uint16_t copyLen = (r == NULL ? 0 : (r->len < savedLen ? r->len : savedLen));
+        if (!snapshotGet(&rd, restore ? (r == NULL ? NULL : r->region) : NULL, copyLen))
+            return -1;
+        if (!snapshotGet(&rd, NULL, savedLen - copyLen))
+            return -1;
+        if (r != NULL)
+            restored++;
+    }
+    uint32_t crc = rd.crc;
+    uint8_t trailer[SNAPSHOT_CRC_LEN];
+    if (!snapshotGet(&rd, trailer, sizeof(trailer)))
+        return -1;
+    if (crc != ((uint32_t) trailer[0] | ((uint32_t) trailer[1] << 8) | ((uint32_t) trailer[2] << 16) | ((uint32_t) trailer[3] << 24)))
+        return -1;
+    return restored;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Restore the registered regions from a snapshot.  This should be
+            called once the regions have been initialized and registered.  A
+            region that wasn't in the snapshot, or that was unchanged when
+            it was taken, is left as it is, as is every region if the
+            snapshot is damaged.
+    @param   coded  The snapshot, as encoded by NoteSnapshotEncode.
+    @param   version (out) The schema version under which the snapshot was
+             taken, if not NULL, with which the app can migrate anything
+             that appending fields can't handle.
+    @returns The number of regions restored, or -1 if the snapshot couldn't
+             be used.
+*/
+/**************************************************************************/
+int NoteSnapshotDecode(const char *coded, uint16_t *version) {
+    int restored = -1;
+    if (coded[0] != '\0' && snapshotRead(coded, false, NULL) >= 0)
+        restored = snapshotRead(coded, true, version);
+    if (restored < 0)
+        _Log(NOTE_LOG_WARN, NOTE_LOG_LIBRARY, "snapshot discarded");
+    return restored;
+}
+
+//**************************************************************************/
+/*!
+    @brief  After the Notecard has restored our power, restore the registered
+            regions from the snapshot that it held, as NoteSnapshotDecode
+            does.
+    @param   version (out) The schema version under which the snapshot was
+             taken, if not NULL.
+    @returns The number of regions restored, or -1 if there was no snapshot
+             or it couldn't be used.
+*/
+/**************************************************************************/
+int NoteSnapshotWake(uint16_t *version) {
+    J *rsp = noteWakeResponse();
+    if (rsp == NULL)
+        return -1;
+    int restored = NoteSnapshotDecode(JGetString(rsp, "payload"), version);
+    NoteDeleteResponse(rsp);
+    return restored;
+}
@@ -0,0 +1,584 @@
+/*!
+ * @file n_tape.c
+ *
+ * A flat, read-only alternative to the J tree for responses that are only
+ * inspected.  A JTape is a single allocation holding an array of tokens
+ * followed by a copy of the response text, in which strings have been
+ * unescaped and terminated in place.  Each token records the size of the
+ * subtree rooted at it, so that skipping over a value of any complexity is a
+ * single addition, and lookups never touch the heap.
+ *
+ * Written by Ray Ozzie and Blues Inc. team.
+ *
+ * Copyright (c) 2019 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#include "n_lib.h"
+
+//**************************************************************************/
+/*!
+    @brief  How deeply arrays and objects may be nested in a tape.  Parsing
+            is recursive, so this bounds the stack that it can use.
+*/
+/**************************************************************************/
+#ifdef NOTE_LOWMEM
+#define JTAPE_NESTING_LIMIT 16
+#else
+#define JTAPE_NESTING_LIMIT 64
+#endif
+
+//**************************************************************************/
+/*!
+    @brief  The state of a parse.  The text is parsed twice: once to count
+            the tokens, when `token` is NULL and nothing is written, and once
+            into the tape's own copy of the text to fill them in.
+*/
+/**************************************************************************/
+typedef struct {
+    char *text;
+    uint32_t offset;
+    JTapeToken *token;
+    uint32_t count;
+} tapeParser;
+
+// Forwards
+static bool tapeValue(tapeParser *tp, int depth);
+
+//**************************************************************************/
+/*!
+    @brief  Skip over whitespace in the text being parsed.
+*/
+/**************************************************************************/
+static void tapeSkipWhitespace(tapeParser *tp) {
+    while (tp->text[tp->offset] != '\0' && (uint8_t) tp->text[tp->offset] <= ' ')
+        tp->offset++;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Append a token, if filling in the tape, and count it.
+    @returns The index of the token.
+*/
+/**************************************************************************/
+static uint32_t tapeAdd(tapeParser *tp, uint8_t type, uint32_t start) {
+    if (tp->token != NULL) {
+        JTapeToken *t = &tp->token[tp->count];
+        t->start = (uint16_t) start;
+        t->length = 0;
+        t->size = 1;
+        t->type = type;
+    }
+    return tp->count++;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Parse four hex digits of a \\u escape.
+    @returns The code unit, or -1 if the digits are invalid.
+*/
+/**************************************************************************/
+static int32_t tapeHex4(const char *p) {
+    int32_t value = 0;
+    for (int i=0; i<4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    return value;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Parse a string that begins at the current offset, adding a token
+            for it.  When filling in the tape the string is unescaped in
+            place, which is safe because the output can never overtake the
+            input, and is terminated where its closing quote was.
+    @returns `false` if the string is malformed.
+*/
+/**************************************************************************/
+static bool tapeString(tapeParser *tp) {
+    uint32_t start = tp->offset + 1;
+    uint32_t index = tapeAdd(tp, JString, start);
+    char *in = &tp->text[start];
+    char *out = in;
+    bool fill = (tp->token != NULL);
+    while (*in != '\"') {
+        if (*in == '\0')
+            return false;
+        if (*in != '\\') {
+            if (fill)
+                *out = *in;
+            out++;
+            in++;
+            continue;
+        }
+        in++;
+        char c;
+        switch (*in) {
+        case 'b':
+            c = '\b';
+            break;
+        case 'f':
+            c = '\f';
+            break;
+        case 'n':
+            c = '\n';
+            break;
+        case 'r':
+            c = '\r';
+            break;
+        case 't':
+            c = '\t';
+            break;
+        case '\"':
+        case '\\':
+        case '/':
+            c = *in;
+            break;
+        case 'u': {
+            int32_t codepoint = tapeHex4(in+1);
+            if (codepoint < 0)
+                return false;
+            in += 5;
+            if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+                if (in[0] != '\\' || in[1] != 'u')
+                    return false;
+                int32_t low = tapeHex4(in+2);
+                if (low < 0xDC00 || low > 0xDFFF)
+                    return false;
+                codepoint = 0x10000 + (((codepoint & 0x3FF) << 10) | (low & 0x3FF));
+                in += 6;
+            }
+            uint8_t utf8[4];
+            int len;
+            if (codepoint < 0x80) {
+                utf8[0] = (uint8_t) codepoint;
+                len = 1;
+            } else if (codepoint < 0x800) {
+                utf8[0] = (uint8_t) (0xC0 | (codepoint >> 6));
+                utf8[1] = (uint8_t) (0x80 | (codepoint & 0x3F));
+                len = 2;
+            } else if (codepoint < 0x10000) {
+                utf8[0] = (uint8_t) (0xE0 | (codepoint >> 12));
+                utf8[1] = (uint8_t) (0x80 | ((codepoint >> 6) & 0x3F));
+                utf8[2] = (uint8_t) (0x80 | (codepoint & 0x3F));
+                len = 3;
+            } else {
+                utf8[0] = (uint8_t) (0xF0 | (codepoint >> 18));
+                utf8[1] = (uint8_t) (0x80 | ((codepoint >> 12) & 0x3F));
+                utf8[2] = (uint8_t) (0x80 | ((codepoint >> 6) & 0x3F));
+                utf8[3] = (uint8_t) (0x80 | (codepoint & 0x3F));
+                len = 4;
+            }
+            for (int i=0; i<len; i++) {
+                if (fill)
+                    *out = (char) utf8[i];
+                out++;
+            }
+            continue;
+        }
+        default:
+            return false;
+        }
+        if (fill)
+            *out = c;
+        out++;
+        in++;
+    }
+    if (fill) {
+        *out = '\0';
+        tp->token[index].length = (uint16_t) (out - &tp->text[start]);
+    }
+    tp->offset = (uint32_t) (in + 1 - tp->text);
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Parse an array or object that begins at the current offset.
+    @returns `false` if it is malformed or too deeply nested.
+*/
+/**************************************************************************/
+static bool tapeContainer(tapeParser *tp, int depth) {
+    bool isObject = (tp->text[tp->offset] == '{');
+    char close = isObject ? '}' : ']';
+    if (depth >= JTAPE_NESTING_LIMIT)
+        return false;
+    uint32_t index = tapeAdd(tp, isObject ? JObject : JArray, tp->offset);
+    uint32_t members = 0;
+    tp->offset++;
+    tapeSkipWhitespace(tp);
+    if (tp->text[tp->offset] != close) {
+        for (;;) {
+            if (isObject) {
+                tapeSkipWhitespace(tp);
+                if (tp->text[tp->offset] != '\"' || !tapeString(tp))
+                    return false;
+                tapeSkipWhitespace(tp);
+                if (tp->text[tp->offset] != ':')
+                    return false;
+                tp->offset++;
+            }
+            if (!tapeValue(tp, depth+1))
+                return false;
+            members++;
+            tapeSkipWhitespace(tp);
+            if (tp->text[tp->offset] != ',')
+                break;
+            tp->offset++;
+        }
+        if (tp->text[tp->offset] != close)
+            return false;
+    }
+    tp->offset++;
+    if (tp->token != NULL) {
+        tp->token[index].size = (uint16_t) (tp->count - index);
+        tp->token[index].length = (uint16_t) members;
+    }
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Parse any value that begins after whitespace at the current
+            offset.
+    @returns `false` if it is malformed.
+*/
+/**************************************************************************/
+static bool tapeValue(tapeParser *tp, int depth) {
+    tapeSkipWhitespace(tp);
+    uint32_t start = tp->offset;
+    const char *p = &tp->text[start];
+    switch (*p) {
+    case '{':
+    case '[':
+        return tapeContainer(tp, depth);
+    case '\"':
+        return tapeString(tp);
+    case 't':
+        if (strncmp(p, "true", 4) != 0)
+            return false;
+        tapeAdd(tp, JTrue, start);
+        tp->offset += 4;
+        return true;
+    case 'f':
+        if (strncmp(p, "false", 5) != 0)
+            return false;
+        tapeAdd(tp, JFalse, start);
+        tp->offset += 5;
+        return true;
+    case 'n':
+        if (strncmp(p, "null", 4) != 0)
+            return false;
+        tapeAdd(tp, JNULL, start);
+        tp->offset += 4;
+        return true;
+    }
+    if (*p != '-' && (*p < '0' || *p > '9'))
+        return false;
+    char *end;
+    JAtoN(p, &end);
+    if (end == p)
+        return false;
+    uint32_t index = tapeAdd(tp, JNumber, start);
+    if (tp->token != NULL)
+        tp->token[index].length = (uint16_t) (end - p);
+    tp->offset += (uint32_t) (end - p);
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Parse JSON text into a tape, either copying the text into the
+            tape's own allocation or taking ownership of it where it lies.
+    @param   json  The JSON text, which must be less than 64KB.
+    @param   inSitu  Whether to take ownership of the text rather than copy it.
+    @returns The tape, or NULL if the text is malformed or there is
+             insufficient memory.
+*/
+/**************************************************************************/
+static JTape *tapeParse(char *json, bool inSitu) {
+    if (json == NULL)
+        return NULL;
+
+    // Count the tokens
+    tapeParser tp = {0};
+    tp.text = json;
+    if (!tapeValue(&tp, 0))
+        return NULL;
+    tapeSkipWhitespace(&tp);
+    if (tp.text[tp.offset] != '\0')
+        return NULL;
+    uint32_t length = tp.offset + strlen(&tp.text[tp.offset]);
+    if (length > 0xffff || tp.count > 0xffff)
+        return NULL;
+
+    // Allocate the header and the tokens, and unless the text is being taken over, the text, in one block
+    JTape *tape = (JTape *) _Malloc(sizeof(JTape) + (tp.count * sizeof(JTapeToken)) + (inSitu ? 0 : length + 1));
+    if (tape == NULL)
+        return NULL;
+    tape->count = (uint16_t) tp.count;
+    tape->inSitu = inSitu;
+    tape->token = (JTapeToken *) &tape[1];
+    if (inSitu) {
+        tape->text = json;
+    } else {
+        tape->text = (char *) &tape->token[tp.count];
+        memcpy(tape->text, json, length+1);
+    }
+
+    // Fill in the tokens, which cannot fail because the text has already been validated
+    tp.text = tape->text;
+    tp.offset = 0;
+    tp.token = tape->token;
+    tp.count = 0;
+    tapeValue(&tp, 0);
+    return tape;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Parse JSON text into a newly-allocated tape.  The text is copied,
+            so the caller retains ownership of it.
+    @param   json  The JSON text, which must be less than 64KB.
+    @returns The tape, to be freed with JTapeDelete, or NULL if the text is
+             malformed or there is insufficient memory.
+*/
+/**************************************************************************/
+JTape *JTapeParse(const char *json) {
+    return tapeParse((char *) json, false);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Parse JSON text into a tape that refers to the text where it lies,
+            unescaping its strings in place, rather than copying it.
+    @param   json  The JSON text, which must be less than 64KB, in a buffer
+             obtained from _Malloc.  On success the tape takes ownership of
+             the buffer, which is freed along with it by JTapeDelete.  On
+             failure the buffer is unchanged and still belongs to the caller.
+    @returns The tape, or NULL if the text is malformed or there is
+             insufficient memory.
+*/
+/**************************************************************************/
+JTape *JTapeParseInSitu(char *json) {
+    return tapeParse(json, true);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Free a tape.
+    @param   tape  The tape, which may be NULL.
+*/
+/**************************************************************************/
+void JTapeDelete(JTape *tape) {
+    if (tape != NULL && tape->inSitu)
+        _Free(tape->text);
+    _Free(tape);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the type of a token.
+    @param   tape  The tape.
+    @param   index  The token.
+    @returns One of the J types, or JInvalid if there is no such token.
+*/
+/**************************************************************************/
+int JTapeType(JTape *tape, int index) {
+    if (tape == NULL || index < 0 || index >= tape->count)
+        return JInvalid;
+    return tape->token[index].type;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the number of members of an array or object.
+    @param   tape  The tape.
+    @param   index  The array or object.
+    @returns The number of members, or 0 if it is not an array or object.
+*/
+/**************************************************************************/
+int JTapeSize(JTape *tape, int index) {
+    int type = JTapeType(tape, index);
+    if (type != JArray && type != JObject)
+        return 0;
+    return tape->token[index].length;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the first value within an array or object.
+    @param   tape  The tape.
+    @param   container  The array or object.
+    @returns The index of the value, or -1 if it is empty.
+*/
+/**************************************************************************/
+int JTapeFirst(JTape *tape, int container) {
+    if (JTapeSize(tape, container) == 0)
+        return -1;
+    return container + (tape->token[container].type == JObject ? 2 : 1);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the value that follows another within an array or object,
+            skipping over the whole of the former's subtree.
+    @param   tape  The tape.
+    @param   container  The array or object.
+    @param   index  The current value.
+    @returns The index of the next value, or -1 if there are no more.
+*/
+/**************************************************************************/
+int JTapeNext(JTape *tape, int container, int index) {
+    int type = JTapeType(tape, container);
+    if ((type != JArray && type != JObject) || index <= container)
+        return -1;
+    int next = index + tape->token[index].size;
+    if (type == JObject)
+        next++;
+    if (next >= container + tape->token[container].size)
+        return -1;
+    return next;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the name of a member of an object.
+    @param   tape  The tape.
+    @param   index  The member's value, as returned by JTapeFirst, JTapeNext
+             or JTapeFind.
+    @returns The name, which remains valid until the tape is deleted.
+*/
+/**************************************************************************/
+const char *JTapeKey(JTape *tape, int index) {
+    if (JTapeType(tape, index-1) != JString)
+        return c_nullstring;
+    return &tape->text[tape->token[index-1].start];
+}
+
+//**************************************************************************/
+/*!
+    @brief  Find a member of an object by name, ignoring case as JGetObjectItem
+            does.
+    @param   tape  The tape.
+    @param   object  The object, where 0 is the root of the tape.
+    @param   field  The name of the member.
+    @returns The index of the member's value, or -1 if it is not present.
+*/
+/**************************************************************************/
+int JTapeFind(JTape *tape, int object, const char *field) {
+    if (JTapeType(tape, object) != JObject)
+        return -1;
+    for (int index = JTapeFirst(tape, object); index >= 0; index = JTapeNext(tape, object, index)) {
+        const char *key = JTapeKey(tape, index);
+        int i;
+        for (i=0; key[i] != '\0' && field[i] != '\0'; i++) {
+            char a = key[i], b = field[i];
+            if (a >= 'A' && a <= 'Z')
+                a += 'a' - 'A';
+            if (b >= 'A' && b <= 'Z')
+                b += 'a' - 'A';
+            if (a != b)
+                break;
+        }
+        if (key[i] == field[i])
+            return index;
+    }
+    return -1;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the value of a string token.
+    @param   tape  The tape.
+    @param   index  The token.
+    @returns The string, or an empty string if the token is not a string.
+*/
+/**************************************************************************/
+const char *JTapeStringValue(JTape *tape, int index) {
+    if (JTapeType(tape, index) != JString)
+        return c_nullstring;
+    return &tape->text[tape->token[index].start];
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the value of a number token.
+    @param   tape  The tape.
+    @param   index  The token.
+    @returns The number, or 0.0 if the token is not a number.
+*/
+/**************************************************************************/
+JNUMBER JTapeNumberValue(JTape *tape, int index) {
+    if (JTapeType(tape, index) != JNumber)
+        return 0.0;
+    return JAtoN(&tape->text[tape->token[index].start], NULL);
+}
+
+//**************************************************************************/
+/*!
+    @brief  Return a string from the specified object within a tape.
+    @param   tape  The tape.
+    @param   object  The object, where 0 is the root of the tape.
+    @param   field  The field to return.
+    @returns The string, or an empty string if not present.
+*/
+/**************************************************************************/
+const char *JTapeGetString(JTape *tape, int object, const char *field) {
+    return JTapeStringValue(tape, JTapeFind(tape, object, field));
+}
+
+//**************************************************************************/
+/*!
+    @brief  Return a number from the specified object within a tape.
+    @param   tape  The tape.
+    @param   object  The object, where 0 is the root of the tape.
+    @param   field  The field to return.
+    @returns The number, or 0.0 if not present.
+*/
+/**************************************************************************/
+JNUMBER JTapeGetNumber(JTape *tape, int object, const char *field) {
+    return JTapeNumberValue(tape, JTapeFind(tape, object, field));
+}
+
+//**************************************************************************/
+/*!
+    @brief  Return a boolean from the specified object within a tape.
+    @param   tape  The tape.
+    @param   object  The object, where 0 is the root of the tape.
+    @param   field  The field to return.
+    @returns `true` only if the field is present and true.
+*/
+/**************************************************************************/
+bool JTapeGetBool(JTape *tape, int object, const char *field) {
+    return JTapeType(tape, JTapeFind(tape, object, field)) == JTrue;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Return an object from the specified object within a tape.
+    @param   tape  The tape.
+    @param   object  The object, where 0 is the root of the tape.
+    @param   field  The field to return.
+    @returns The index of the object, or -1 if not present.
+*/
+/**************************************************************************/
+int JTapeGetObject(JTape *tape, int object, const char *field) {
+    int index = JTapeFind(tape, object, field);
+    if (JTapeType(tape, index) != JObject)
+        return -1;
+    return index;
+}
@@ -0,0 +1,315 @@
+/*!
+ * @file n_template.c
+ *
+ * Automatic registration of Notefile templates.  When enabled, the first
+ * body added to a Notefile with NoteAdd has a template inferred from it,
+ * which is registered with `note.template` so that the Notecard stores and
+ * syncs that Notefile's notes as compact fixed-length records rather than
+ * as free-form JSON.  Each later body is validated against the template,
+ * and if it has a field that the template lacks, or a string too long for
+ * it, the two are merged and the wider template registered in its place.
+ * Fields only grow, so this settles after the first few notes.
+ *
+ * Templates may only describe flat bodies of numbers, strings and bools,
+ * so a body that holds an object, an array or a null is sent as-is.
+ *
+ * The table of registrations is small, and holds for each Notefile a hash
+ * of its name and a hash of its template, which carries the template's
+ * number of fields.  Those can be saved, through a hook, to storage that
+ * survives a reset, and restored at boot, so that a template that has
+ * already been registered isn't registered again.  Only the hash survives,
+ * so after a reset the bodies sent to a Notefile are gathered into a
+ * provisional template, which the registered one is taken to cover for as
+ * long as it has fewer fields, until it either matches the hash or proves
+ * to differ from it, and only then is a template registered.
+ *
+ * Written by Ray Ozzie and Blues Inc. team.
+ *
+ * Copyright (c) 2019 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#include "n_lib.h"
+
+//**************************************************************************/
+/*!
+    @brief  The type hint of every number in a template, which is a float
+            of the same size as a JNUMBER.  It is added as raw JSON, because
+            a float JNUMBER can't be printed as exactly `14.1`.
+*/
+/**************************************************************************/
+#ifdef NOTE_FLOAT
+static const char templateNumber[] = "14.1";
+#else
+static const char templateNumber[] = "18.1";
+#endif
+
+//**************************************************************************/
+/*!
+    @brief  The registrations, and for each the template itself, which is
+            only known once a body has been sent to the Notefile since
+            boot.  Until then an entry that was restored holds only hashes,
+            and its template is the provisional one gathered from the
+            bodies sent since, which isn't yet known to be the whole of it.
+*/
+/**************************************************************************/
+static bool templateEnabled = false;
+static templateSaveFn templateSave = NULL;
+static NoteTemplateEntry templateTable[NOTE_TEMPLATE_ENTRIES] = {{0}};
+static J *templateBodies[NOTE_TEMPLATE_ENTRIES] = {NULL};
+static bool templateKnown[NOTE_TEMPLATE_ENTRIES] = {false};
+static uint8_t templateEvict = 0;
+
+//**************************************************************************/
+/*!
+    @brief  Enable or disable automatic registration of templates by
+            NoteAdd.
+    @param   enable  Whether to register templates.
+    @param   saveFn  If not NULL, called with the whole table each time that
+             it changes, so that it can be saved and later restored with
+             NoteTemplateRestore.
+*/
+/**************************************************************************/
+void NoteSetAutoTemplate(bool enable, templateSaveFn saveFn) {
+    templateEnabled = enable;
+    templateSave = saveFn;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Restore a table of registrations that was saved before a reset.
+            This should be called at boot, before any notes are added.
+    @param   entries  The saved entries.
+    @param   count  The number of entries, of which at most
+             `NOTE_TEMPLATE_ENTRIES` are used.
+*/
+/**************************************************************************/
+void NoteTemplateRestore(const NoteTemplateEntry *entries, int count) {
+    for (int i=0; i<NOTE_TEMPLATE_ENTRIES; i++) {
+        JDelete(templateBodies[i]);
+        templateBodies[i] = NULL;
+        templateKnown[i] = false;
+        if (i < count)
+            templateTable[i] = entries[i];
+        else
+            memset(&templateTable[i], 0, sizeof(NoteTemplateEntry));
+    }
+}
+
+//**************************************************************************/
+/*!
+    @brief  Fold bytes into a 32-bit FNV-1a hash.
+    @param   hash  The hash so far.
+    @param   data  The bytes.
+    @param   len  The number of bytes.
+    @returns The new hash.
+*/
+/**************************************************************************/
+static uint32_t templateHash(uint32_t hash, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *) data;
+    while (len-- > 0) {
+        hash ^= *p++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+#define TEMPLATE_HASH_START 2166136261UL
+
+//**************************************************************************/
+/*!
+    @brief  Hash a template from its field names, types and string lengths,
+            which is all that distinguishes one template from another.  The
+            fields are hashed separately and summed, so that a template
+            gathered from bodies in another order hashes the same.  The
+            low byte is the number of fields, so that a template gathered
+            from fewer bodies can be seen to be narrower than a registered
+            one that is known only by its hash.
+    @param   tmpl  The template.
+    @returns The hash, which is never zero, because a template has at least
+             one field, so that zero can mark an empty entry.
+*/
+/**************************************************************************/
+static uint32_t templateHashBody(J *tmpl) {
+    uint32_t hash = 0;
+    uint32_t fields = 0;
+    for (J *field = tmpl->child; field != NULL; field = field->next) {
+        uint32_t fieldHash = templateHash(TEMPLATE_HASH_START, field->string, strlen(field->string) + 1);
+        uint32_t kind = (uint32_t) (field->type & 0xFF);
+        if (kind == JString)
+            kind |= (uint32_t) strlen(field->valuestring) << 8;
+        hash += templateHash(fieldHash, &kind, sizeof(kind));
+        fields++;
+    }
+    return (hash << 8) | (fields > 0xFF ? 0xFF : fields);
+}
+#define TEMPLATE_FIELDS(hash) ((hash) & 0xFF)
+
+//**************************************************************************/
+/*!
+    @brief  Infer the template for one field of a body.  Strings are given
+            room for a multiple of `NOTE_TEMPLATE_STRING_LEN` characters, so
+            that a string that varies a little in length doesn't keep
+            widening the template.
+    @param   field  The field.
+    @returns The field's template, or NULL if a template can't describe
+             the field or if memory couldn't be allocated.
+*/
+/**************************************************************************/
+static J *templateField(J *field) {
+    switch (field->type & 0xFF) {
+    case JTrue:
+    case JFalse:
+        return JCreateTrue();
+    case JNumber:
+        return JCreateRawReference(templateNumber);
+    case JString: {
+        size_t len = strlen(field->valuestring);
+        len = ((len / NOTE_TEMPLATE_STRING_LEN) + 1) * NOTE_TEMPLATE_STRING_LEN;
+        if (len > NOTE_TEMPLATE_STRING_MAX)
+            return NULL;
+        char placeholder[NOTE_TEMPLATE_STRING_MAX+1];
+        memset(placeholder, 'x', len);
+        placeholder[len] = '\0';
+        return JCreateString(placeholder);
+    }
+    }
+    return NULL;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Whether a field of a body fits the template for it.
+    @param   field  The field.
+    @param   tmpl  The field's template, or NULL if it has none.
+    @returns `true` if the field fits.
+*/
+/**************************************************************************/
+static bool templateFits(J *field, J *tmpl) {
+    if (tmpl == NULL)
+        return false;
+    switch (field->type & 0xFF) {
+    case JTrue:
+    case JFalse:
+        return (tmpl->type & 0xFF) == JTrue;
+    case JNumber:
+        return (tmpl->type & 0xFF) == JRaw;
+    case JString:
+        return (tmpl->type & 0xFF) == JString && strlen(field->valuestring) <= strlen(tmpl->valuestring);
+    }
+    return false;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Merge a body into a template, adding the fields that the
+            template lacks and widening those that the body doesn't fit.
+    @param   tmpl  The template, which is modified, or an empty object to
+             infer a template from the body alone.
+    @param   body  The body.
+    @returns `false` if the body can't be described by a template, or if
+             memory couldn't be allocated, in which case the template may
+             have been partly modified.
+*/
+/**************************************************************************/
+static bool templateMerge(J *tmpl, J *body) {
+    if (body->child == NULL)
+        return false;
+    for (J *field = body->child; field != NULL; field = field->next) {
+        J *existing = JGetObjectItemCaseSensitive(tmpl, field->string);
+        if (templateFits(field, existing))
+            continue;
+        J *item = templateField(field);
+        if (item == NULL)
+            return false;
+        if (existing == NULL)
+            JAddItemToObject(tmpl, field->string, item);
+        else
+            JReplaceItemInObjectCaseSensitive(tmpl, field->string, item);
+    }
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Make sure that a body fits the template registered for its
+            Notefile, registering one if there is none or widening the one
+            that there is if need be.  This is called by NoteAdd before a
+            body is sent, and a body is sent whether or not this succeeds.
+    @param   target  The Notefile.
+    @param   body  The body.
+*/
+/**************************************************************************/
+void noteTemplateApply(const char *target, J *body) {
+
+    // Nothing to do unless enabled, or for a body that can't have a template
+    if (!templateEnabled || target == NULL || body == NULL || (body->type & 0xFF) != JObject)
+        return;
+
+    // Find the Notefile's entry, and if there's a template for it that the body fits, we're done, which for a
+    // provisional template is because the registered one covers it
+    uint32_t fileHash = templateHash(TEMPLATE_HASH_START, target, strlen(target));
+    if (fileHash == 0)
+        fileHash = 1;
+    int entry = -1;
+    for (int i=0; i<NOTE_TEMPLATE_ENTRIES; i++)
+        if (templateTable[i].fileHash == fileHash)
+            entry = i;
+    if (entry >= 0 && templateBodies[entry] != NULL) {
+        bool fits = true;
+        for (J *field = body->child; fits && field != NULL; field = field->next)
+            fits = templateFits(field, JGetObjectItemCaseSensitive(templateBodies[entry], field->string));
+        if (fits)
+            return;
+    }
+
+    // Build the template that the body needs, widening any that we already have
+    J *tmpl = (entry >= 0 && templateBodies[entry] != NULL) ? JDuplicate(templateBodies[entry], true) : JCreateObject();
+    if (tmpl == NULL)
+        return;
+    if (!templateMerge(tmpl, body)) {
+        JDelete(tmpl);
+        return;
+    }
+    uint32_t tmplHash = templateHashBody(tmpl);
+
+    // If this is the template that was registered before a reset, adopt it without registering it again, and
+    // while it has fewer fields than that one, take it to be covered by it, provisionally
+    if (entry >= 0 && !templateKnown[entry]) {
+        uint32_t savedHash = templateTable[entry].templateHash;
+        if (tmplHash == savedHash || TEMPLATE_FIELDS(tmplHash) < TEMPLATE_FIELDS(savedHash)) {
+            JDelete(templateBodies[entry]);
+            templateBodies[entry] = tmpl;
+            templateKnown[entry] = (tmplHash == savedHash);
+            return;
+        }
+    }
+
+    // Register it, taking a new entry if need be, evicting the oldest if the table is full
+    J *registered = JDuplicate(tmpl, true);
+    if (registered == NULL || !NoteTemplate(target, registered)) {
+        _Log(NOTE_LOG_ERROR, NOTE_LOG_LIBRARY, "template not registered");
+        JDelete(tmpl);
+        return;
+    }
+    if (entry < 0) {
+        for (int i=0; entry < 0 && i<NOTE_TEMPLATE_ENTRIES; i++)
+            if (templateTable[i].fileHash == 0)
+                entry = i;
+        if (entry < 0) {
+            entry = templateEvict;
+            templateEvict = (uint8_t) ((templateEvict + 1) % NOTE_TEMPLATE_ENTRIES);
+        }
+    }
+    JDelete(templateBodies[entry]);
+    templateBodies[entry] = tmpl;
+    templateKnown[entry] = true;
+    templateTable[entry].fileHash = fileHash;
+    templateTable[entry].templateHash = tmplHash;
+    if (templateSave != NULL)
+        templateSave(templateTable, NOTE_TEMPLATE_ENTRIES);
+
+}
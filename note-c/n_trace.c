@@ -0,0 +1,195 @@
+/*!
+ * @file n_trace.c
+ *
+ * An opt-in profiler for Notecard transactions.  When NOTE_TRACE is defined,
+ * NoteTransaction and the Serial and I2C transports record how long each
+ * phase of a transaction took, how many bytes it moved, and whether it
+ * failed, into a small fixed-size ring in RAM.  The ring can be dumped to the
+ * debug output or summarized per phase, either on-target or from a host build.
+ *
+ * Written by Ray Ozzie and Blues Inc. team.
+ *
+ * Copyright (c) 2019 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#include "n_lib.h"
+
+#ifdef NOTE_TRACE
+
+//**************************************************************************/
+/*!
+    @brief  The ring of the most recent trace entries, and the index of the
+            slot that will be written next.
+*/
+/**************************************************************************/
+static NoteTraceEntry traceRing[NOTE_TRACE_ENTRIES];
+static uint32_t traceNext = 0;
+//**************************************************************************/
+/*!
+    @brief  Sequence number of the transaction currently being traced.
+*/
+/**************************************************************************/
+static uint16_t traceSeq = 0;
+
+//**************************************************************************/
+/*!
+    @brief  Short names for the trace events, used when dumping the ring.
+*/
+/**************************************************************************/
+static const char *traceEventName[NOTE_TRACE_EVENTS] = {
+    "print", "send", "delay", "wait", "recv", "io", "parse"
+};
+
+//**************************************************************************/
+/*!
+    @brief  Mark the start of a new transaction, so that the entries recorded
+            until the next call can be grouped together.
+*/
+/**************************************************************************/
+void NoteTraceBegin() {
+    traceSeq++;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Record a completed phase of the current transaction.
+    @param   event  One of the NOTE_TRACE_ values.
+    @param   startMs  When the phase began.
+    @param   durationMs  How long the phase took.
+    @param   bytes  The number of bytes that the phase processed.
+    @param   err  The error that ended the phase, or NULL.
+*/
+/**************************************************************************/
+void NoteTraceRecord(int event, uint32_t startMs, uint32_t durationMs, uint32_t bytes, const char *err) {
+    NoteTraceEntry *entry = &traceRing[traceNext % NOTE_TRACE_ENTRIES];
+    entry->startMs = startMs;
+    entry->durationMs = durationMs > 0xffff ? 0xffff : (uint16_t) durationMs;
+    entry->bytes = bytes > 0xffff ? 0xffff : (uint16_t) bytes;
+    entry->seq = traceSeq;
+    entry->event = (uint8_t) event;
+    entry->err = err;
+    traceNext++;
+}
+
+#endif
+
+//**************************************************************************/
+/*!
+    @brief  Discard everything that has been traced so far.
+*/
+/**************************************************************************/
+void NoteTraceClear() {
+#ifdef NOTE_TRACE
+    traceNext = 0;
+#endif
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get the number of entries currently held in the trace ring.
+    @returns The count, which is zero if tracing is compiled out.
+*/
+/**************************************************************************/
+int NoteTraceCount() {
+#ifdef NOTE_TRACE
+    return traceNext < NOTE_TRACE_ENTRIES ? (int) traceNext : NOTE_TRACE_ENTRIES;
+#else
+    return 0;
+#endif
+}
+
+//**************************************************************************/
+/*!
+    @brief  Get an entry from the trace ring.
+    @param   index  The entry to get, where 0 is the oldest one retained.
+    @param   entry  The structure to fill in.
+    @returns `false` if there is no such entry.
+*/
+/**************************************************************************/
+bool NoteTraceGet(int index, NoteTraceEntry *entry) {
+#ifdef NOTE_TRACE
+    int count = NoteTraceCount();
+    if (index < 0 || index >= count)
+        return false;
+    uint32_t first = traceNext - count;
+    *entry = traceRing[(first + index) % NOTE_TRACE_ENTRIES];
+    return true;
+#else
+    (void) index;
+    (void) entry;
+    return false;
+#endif
+}
+
+//**************************************************************************/
+/*!
+    @brief  Summarize the durations recorded for one kind of trace event,
+            using the nearest-rank method for percentiles.
+    @param   event  One of the NOTE_TRACE_ values.
+    @param   summary  The structure to fill in.
+    @returns `false` if nothing has been recorded for that event.
+*/
+/**************************************************************************/
+bool NoteTraceSummarize(int event, NoteTraceSummary *summary) {
+    memset(summary, 0, sizeof(NoteTraceSummary));
+#ifdef NOTE_TRACE
+    // Gather the durations for this event in ascending order
+    uint16_t sorted[NOTE_TRACE_ENTRIES];
+    int n = 0;
+    int count = NoteTraceCount();
+    for (int i=0; i<count; i++) {
+        NoteTraceEntry *entry = &traceRing[(traceNext - count + i) % NOTE_TRACE_ENTRIES];
+        if (entry->event != event)
+            continue;
+        if (entry->err != NULL)
+            summary->errors++;
+        summary->bytes += entry->bytes;
+        int j = n++;
+        while (j > 0 && sorted[j-1] > entry->durationMs) {
+            sorted[j] = sorted[j-1];
+            j--;
+        }
+        sorted[j] = entry->durationMs;
+    }
+    if (n == 0)
+        return false;
+    summary->count = n;
+    summary->p50Ms = sorted[(n * 50 + 99) / 100 - 1];
+    summary->p99Ms = sorted[(n * 99 + 99) / 100 - 1];
+    summary->maxMs = sorted[n-1];
+    return true;
+#else
+    (void) event;
+    return false;
+#endif
+}
+
+//**************************************************************************/
+/*!
+    @brief  Write the trace ring, oldest entry first, followed by a per-phase
+            summary, to the debug output.
+*/
+/**************************************************************************/
+void NoteTraceDump() {
+#ifdef NOTE_TRACE
+    int count = NoteTraceCount();
+    for (int i=0; i<count; i++) {
+        NoteTraceEntry entry;
+        NoteTraceGet(i, &entry);
+        NoteDebugf("trace %u %s @%lu %ums %ub%s%s\n", entry.seq, traceEventName[entry.event],
+                   (unsigned long) entry.startMs, entry.durationMs, entry.bytes,
+                   entry.err == NULL ? "" : " ", entry.err == NULL ? "" : entry.err);
+    }
+    for (int event=0; event<NOTE_TRACE_EVENTS; event++) {
+        NoteTraceSummary summary;
+        if (NoteTraceSummarize(event, &summary))
+            NoteDebugf("trace %s n:%u p50:%ums p99:%ums max:%ums err:%u\n", traceEventName[event],
+                       summary.count, summary.p50Ms, summary.p99Ms, summary.maxMs, summary.errors);
+    }
+#endif
+}
@@ -0,0 +1,201 @@
+/*!
+ * @file n_upload.c
+ *
+ * Chunked upload of a blob that is too large to hold in RAM, such as a
+ * waveform capture in flash or the contents of a log.  The blob is read a
+ * little at a time through a callback, base64-encoded as it is read, and
+ * posted to a route as a sequence of `web.post` fragments, each of which
+ * carries its offset within the blob and the blob's total length so that
+ * the Notecard can reassemble them.  Only one fragment is ever in memory, so
+ * the RAM needed is set by the fragment size and not by the size of the
+ * blob.  The offset of the first fragment not yet acknowledged is kept in
+ * the upload's state, so that after a failure the upload can be resumed
+ * from there, even across a reboot if the state is saved.
+ *
+ * Written by Ray Ozzie and Blues Inc. team.
+ *
+ * Copyright (c) 2019 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#include "n_lib.h"
+
+//**************************************************************************/
+/*!
+    @brief  How many bytes are read from the source at a time.  This is a
+            multiple of three so that each piece encodes without carrying
+            bytes over to the next.
+*/
+/**************************************************************************/
+#define UPLOAD_READ_LEN 48
+
+//**************************************************************************/
+/*!
+    @brief  Prepare to upload a blob.
+    @param   upload  The upload's state, which the caller keeps for as long
+             as the upload is in progress.
+    @param   route  The alias of the route to post the blob to.
+    @param   name  An optional name to append to the route's URL, or NULL.
+    @param   total  The length of the blob.
+    @param   readFn  The function through which the blob is read.
+    @param   readContext  Passed to `readFn`, for example to identify the
+             flash region or log to read from.
+*/
+/**************************************************************************/
+void NoteUploadBegin(NoteUpload *upload, const char *route, const char *name, uint32_t total, noteUploadReadFn readFn, void *readContext) {
+    memset(upload, 0, sizeof(NoteUpload));
+    upload->route = route;
+    upload->name = name;
+    upload->total = total;
+    upload->chunkLen = NOTE_UPLOAD_CHUNK_LEN;
+    upload->readFn = readFn;
+    upload->readContext = readContext;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Whether every byte of a blob has been acknowledged.
+    @param   upload  The upload's state.
+    @returns `true` if the upload is complete.
+*/
+/**************************************************************************/
+bool NoteUploadComplete(NoteUpload *upload) {
+    return upload->offset >= upload->total;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Read the next fragment of a blob and encode it, into a string
+            allocated to fit it exactly.
+    @param   upload  The upload's state.
+    @param   len  The number of bytes to read.
+    @returns The encoded fragment, or NULL if memory couldn't be allocated
+             or the source couldn't be read.
+*/
+/**************************************************************************/
+static char *uploadEncode(NoteUpload *upload, uint32_t len) {
+    char *encoded = (char *) _Malloc(JB64EncodeLen(len));
+    if (encoded == NULL)
+        return NULL;
+    JB64Encoder encoder;
+    JB64EncodeStart(&encoder);
+    uint8_t piece[UPLOAD_READ_LEN];
+    uint32_t encodedLen = 0;
+    for (uint32_t done = 0; done < len; ) {
+        uint32_t pieceLen = len - done;
+        if (pieceLen > sizeof(piece))
+            pieceLen = sizeof(piece);
+        if (upload->readFn(upload->readContext, upload->offset + done, piece, pieceLen) != pieceLen) {
+            _Free(encoded);
+            return NULL;
+        }
+        encodedLen += JB64EncodeUpdate(&encoder, &encoded[encodedLen], piece, pieceLen);
+        done += pieceLen;
+    }
+    JB64EncodeFinish(&encoder, &encoded[encodedLen]);
+    return encoded;
+}
+
+//**************************************************************************/
+/*!
+    @brief  Send the next fragment of a blob, once.
+    @param   upload  The upload's state.
+    @returns `true` if the Notecard accepted the fragment, in which case
+             the upload's offset has been moved past it.
+*/
+/**************************************************************************/
+bool NoteUploadNext(NoteUpload *upload) {
+
+    // Nothing to do if the whole blob has been sent
+    if (NoteUploadComplete(upload))
+        return true;
+    uint32_t len = upload->total - upload->offset;
+    if (len > upload->chunkLen)
+        len = upload->chunkLen;
+
+    // Build the request around the encoded fragment, which is owned by the request once it is added
+    J *req = NoteNewRequest("web.post");
+    if (req == NULL)
+        return false;
+    int prevPhase = NoteSetMemPhase(NOTE_PHASE_PRINT);
+    char *encoded = uploadEncode(upload, len);
+    NoteSetMemPhase(prevPhase);
+    J *payload = (encoded == NULL ? NULL : JCreateStringReference(encoded));
+    if (payload == NULL) {
+        if (encoded != NULL)
+            _Free(encoded);
+        JDelete(req);
+        upload->failures++;
+        return false;
+    }
+    payload->type &= ~JIsReference;
+    JAddStringToObject(req, "route", upload->route);
+    if (upload->name != NULL)
+        JAddStringToObject(req, "name", upload->name);
+    JAddItemToObject(req, "payload", payload);
+    JAddNumberToObject(req, "offset", upload->offset);
+    JAddNumberToObject(req, "total", upload->total);
+
+    // Send it, and treat an HTTP status other than success as a failure, just as we would an error
+    JTape *rsp = NoteRequestResponseTape(req);
+    if (rsp == NULL) {
+        upload->failures++;
+        return false;
+    }
+    int result = (int) JTapeGetNumber(rsp, 0, "result");
+    bool success = (JTapeGetString(rsp, 0, c_err)[0] == '\0' && result < 300);
+    JTapeDelete(rsp);
+    if (!success) {
+        upload->failures++;
+        return false;
+    }
+
+    // Move past the fragment
+    upload->offset += len;
+    upload->failures = 0;
+    return true;
+
+}
+
+//**************************************************************************/
+/*!
+    @brief  Send a blob, or what remains of it, retrying any fragment that
+            fails up to `NOTE_UPLOAD_RETRIES` times with a growing pause
+            between attempts.  If this returns `false`, calling it again
+            resumes the upload from the first fragment not acknowledged,
+            with its retries renewed.
+    @param   upload  The upload's state.
+    @returns `true` if the whole blob has been sent.
+*/
+/**************************************************************************/
+bool NoteUploadRun(NoteUpload *upload) {
+    upload->failures = 0;
+    while (!NoteUploadComplete(upload)) {
+        if (NoteUploadNext(upload))
+            continue;
+        if (upload->failures >= NOTE_UPLOAD_RETRIES)
+            return false;
+        _DelayMs(NOTE_UPLOAD_RETRY_DELAY_MS * upload->failures);
+    }
+    return true;
+}
+
+//**************************************************************************/
+/*!
+    @brief  A read function for blobs that are directly addressable, such
+            as a region of flash.
+    @param   context  The address of the start of the blob.
+    @param   offset  The offset within the blob at which to read.
+    @param   buf  Where to put what is read.
+    @param   len  How many bytes to read.
+    @returns The number of bytes read, which is always `len`.
+*/
+/**************************************************************************/
+uint32_t NoteUploadReadMemory(void *context, uint32_t offset, void *buf, uint32_t len) {
+    memcpy(buf, (const uint8_t *) context + offset, len);
+    return len;
+}
@@ -68,6 +68,12 @@
 #define	ERRDBG
 #endif
 
+// On those same MCUs, use a compact J node layout that saves a third of the RAM taken by each node
+// of a request or response.  Define NOTE_JFULL to keep the standard cJSON node layout instead.
+#if defined(NOTE_LOWMEM) && !defined(NOTE_JFULL)
+#define NOTE_JCOMPACT
+#endif
+
 // UNIX Epoch time (also known as POSIX time) is the  number of seconds that have elapsed since
 // 00:00:00 Thursday, 1 January 1970, Coordinated Universal Time (UTC).  In this project, it always
 // originates from the Notecard, which synchronizes the time from both the cell network and GPS.
@@ -88,6 +94,7 @@ typedef void (*freeFn) (void *);
 typedef void (*delayMsFn) (uint32_t ms);
 typedef long unsigned int (*getMsFn) (void);
 typedef size_t (*debugOutputFn) (const char *text);
+typedef void (*phaseFn) (int phase);
 typedef bool (*serialResetFn) (void);
 typedef void (*serialTransmitFn) (uint8_t *data, size_t len, bool flush);
 typedef bool (*serialAvailableFn) (void);
@@ -96,13 +103,260 @@ typedef bool (*i2cResetFn) (uint16_t DevAddress);
 typedef const char * (*i2cTransmitFn) (uint16_t DevAddress, uint8_t* pBuffer, uint16_t Size);
 typedef const char * (*i2cReceiveFn) (uint16_t DevAddress, uint8_t* pBuffer, uint16_t Size, uint32_t *avail);
 
+// Phases of a transaction, used to attribute resource usage and reported to the phase hook
+#define NOTE_PHASE_APP      0   // Outside of any transaction
+#define NOTE_PHASE_PRINT    1   // Serializing the request
+#define NOTE_PHASE_IO       2   // Talking to the Notecard
+#define NOTE_PHASE_PARSE    3   // Parsing the response
+#define NOTE_PHASES         4
+
+// Memory statistics maintained by NoteMalloc and NoteFree, unless NOTE_NOMEMSTATS is defined
+typedef struct {
+    uint32_t liveBytes;         // Bytes currently allocated
+    uint32_t highWaterBytes;    // Peak of liveBytes
+    uint32_t allocs;            // Successful allocations
+    uint32_t frees;             // Non-NULL frees
+    uint32_t failures;          // Allocations that returned NULL
+    uint32_t largestFailure;    // Size of the largest allocation that failed
+    uint32_t spanBytes;         // Address range that the heap has been seen to cover
+    uint8_t fragmentationPct;   // Share of that range that isn't live data
+} NoteMemStats;
+typedef struct {
+    uint32_t allocs;            // Successful allocations made in this phase
+    uint32_t bytes;             // Total bytes requested in this phase
+    uint32_t failures;          // Allocations that returned NULL in this phase
+    uint32_t highWaterBytes;    // Peak of total live bytes seen while in this phase
+} NoteMemPhaseStats;
+
+// Transaction trace, recorded only when NOTE_TRACE is defined
+#ifndef NOTE_TRACE_ENTRIES
+#define NOTE_TRACE_ENTRIES  32
+#endif
+#define NOTE_TRACE_PRINT    0   // Serializing the request
+#define NOTE_TRACE_SEND     1   // Putting the request on the wire, excluding segment delays
+#define NOTE_TRACE_DELAY    2   // Pausing between segments so as not to overrun the Notecard
+#define NOTE_TRACE_WAIT     3   // Waiting for the Notecard to begin its reply
+#define NOTE_TRACE_RECEIVE  4   // Reading the reply
+#define NOTE_TRACE_IO       5   // The whole exchange with the Notecard
+#define NOTE_TRACE_PARSE    6   // Parsing the response
+#define NOTE_TRACE_EVENTS   7
+typedef struct {
+    uint32_t startMs;           // When the phase began
+    uint16_t durationMs;        // How long it took, saturating
+    uint16_t bytes;             // Bytes processed, saturating
+    uint16_t seq;               // Transaction that this entry belongs to
+    uint8_t event;              // One of the NOTE_TRACE_ values
+    const char *err;            // Error that ended the phase, or NULL
+} NoteTraceEntry;
+typedef struct {
+    uint16_t count;             // Entries for this event currently in the ring
+    uint16_t errors;            // How many of them failed
+    uint32_t bytes;             // Bytes processed across them
+    uint16_t p50Ms;             // Median duration
+    uint16_t p99Ms;             // 99th percentile duration
+    uint16_t maxMs;             // Longest duration
+} NoteTraceSummary;
+
+// Debug log levels and subsystems.  Messages more verbose than NOTE_LOG_LEVEL are compiled out, and
+// when NOTE_LOG is defined, messages are held in a ring of NOTE_LOG_RING_SIZE bytes until drained.
+#define NOTE_LOG_ERROR      1
+#define NOTE_LOG_WARN       2
+#define NOTE_LOG_INFO       3
+#define NOTE_LOG_DEBUG      4
+#ifndef NOTE_LOG_LEVEL
+#define NOTE_LOG_LEVEL      NOTE_LOG_DEBUG
+#endif
+#define NOTE_LOG_LIBRARY    0x00000001  // Messages from the library itself
+#define NOTE_LOG_REQUEST    0x00000002  // The bodies of requests and responses
+#define NOTE_LOG_IO         0x00000004  // The Serial and I2C transports
+#define NOTE_LOG_APP        0x00000008  // The first of those available to the app
+#define NOTE_LOG_ALL        0xFFFFFFFF
+#ifndef NOTE_LOG_TRUNCATE
+#ifdef NOTE_LOWMEM
+#define NOTE_LOG_TRUNCATE   96
+#else
+#define NOTE_LOG_TRUNCATE   0
+#endif
+#endif
+#ifndef NOTE_LOG_RING_SIZE
+#ifdef NOTE_LOWMEM
+#define NOTE_LOG_RING_SIZE  512
+#else
+#define NOTE_LOG_RING_SIZE  4096
+#endif
+#endif
+
+// A flat, read-only parse of a JSON response, held in a single allocation.  Tokens are addressed by
+// index, with the root at index 0, and the members of an object are each preceded by a name token.
+typedef struct {
+    uint16_t start;             // Offset of the token's text, which for strings is unescaped and terminated
+    uint16_t length;            // Length of a string or number, or the number of members of an array or object
+    uint16_t size;              // Number of tokens in the subtree rooted at this one, including itself
+    uint16_t type;              // One of the J types
+} JTapeToken;
+typedef struct {
+    uint16_t count;             // Number of tokens
+    bool inSitu;                // Whether the text is a separate buffer that the tape took over
+    JTapeToken *token;          // The tokens, which follow this header in the same allocation
+    char *text;                 // The text, which otherwise follows the tokens
+} JTape;
+
+// Contexts for encoding and decoding base64 a piece at a time, so that neither side of a large
+// payload needs to be held in memory in full.  JB64EncodeFinish writes at most 4 characters plus
+// a terminator, and JB64DecodeUpdate returns -1 if the plaintext would overflow the buffer.
+typedef struct {
+    uint8_t pending[2];         // Bytes that don't yet make up a full group of three
+    uint8_t pendingLen;
+} JB64Encoder;
+typedef struct {
+    uint32_t bits;              // Sextets received but not yet fully emitted
+    uint8_t sextets;            // How many of them, within the current group of four
+    bool done;                  // The end of the coded text, or an overflow, was reached
+} JB64Decoder;
+
+// The state of a chunked upload of a blob that is read, a piece at a time, through a callback
+// which returns the number of bytes that it read.  The fragment size bounds the RAM used.
+#ifndef NOTE_UPLOAD_CHUNK_LEN
+#ifdef NOTE_LOWMEM
+#define NOTE_UPLOAD_CHUNK_LEN       384
+#else
+#define NOTE_UPLOAD_CHUNK_LEN       3072
+#endif
+#endif
+#define NOTE_UPLOAD_RETRIES         3
+#define NOTE_UPLOAD_RETRY_DELAY_MS  1000
+typedef uint32_t (*noteUploadReadFn) (void *context, uint32_t offset, void *buf, uint32_t len);
+typedef struct {
+    const char *route;          // Alias of the route to post to
+    const char *name;           // Optional name to append to the route's URL
+    uint32_t total;             // Length of the blob
+    uint32_t offset;            // Bytes acknowledged so far, from which the upload resumes
+    uint32_t chunkLen;          // Bytes of the blob sent in each fragment
+    uint8_t failures;           // Consecutive failures of the current fragment
+    noteUploadReadFn readFn;
+    void *readContext;
+} NoteUpload;
+
+// The state of a batch of samples that are accumulated into the body of a single note.  Each sample is
+// appended as a compact row of its time offset, in seconds from the first sample, and its values, to a
+// buffer of the caller's that bounds the RAM used.  The batch is added as a note when it holds the
+// maximum number of samples, when the next row wouldn't fit, or when its first sample is too old.
+#define NOTE_BATCH_MAX_FIELDS       8
+#ifndef NOTE_BATCH_MAX_SAMPLES
+#define NOTE_BATCH_MAX_SAMPLES      32
+#endif
+#ifndef NOTE_BATCH_MAX_AGE_MS
+#define NOTE_BATCH_MAX_AGE_MS       (15*60*1000)
+#endif
+typedef struct {
+    const char *file;           // The notefile to add to
+    const char * const *fields; // The name of each value in a sample
+    uint8_t fieldCount;
+    int8_t precision;           // Digits of precision of each value, or -1 for the default
+    bool start;                 // Whether to start a sync as each note is added
+    char *buf;                  // The rows, as the text of a JSON array
+    uint32_t bufLen;
+    uint32_t used;
+    uint32_t count;             // Samples in the batch
+    uint32_t maxCount;
+    uint32_t maxAgeMs;
+    uint32_t baseMs;            // When the first sample was added
+    uint32_t dropped;           // Samples lost because the batch was full or was rejected
+} NoteBatch;
+
+// A registration of a template by NoteAdd, identified by hashes of the Notefile's name and of the
+// template, which is all that needs to be saved across a reset to avoid registering it again.  The
+// string fields of an inferred template hold a multiple of NOTE_TEMPLATE_STRING_LEN characters.
+#ifndef NOTE_TEMPLATE_ENTRIES
+#define NOTE_TEMPLATE_ENTRIES       2
+#endif
+#define NOTE_TEMPLATE_STRING_LEN    16
+#define NOTE_TEMPLATE_STRING_MAX    64
+typedef struct {
+    uint32_t fileHash;
+    uint32_t templateHash;
+} NoteTemplateEntry;
+typedef void (*templateSaveFn) (const NoteTemplateEntry *entries, int count);
+
+// The handlers to which inbound notes are dispatched, by Notefile, as they are drained after the Notecard
+// has signalled on its ATTN pin that one of the Notefiles has changed.  Each handler is given the whole
+// response to note.get, holding the note's body, payload and time, which it must not delete.
+#ifndef NOTE_INBOUND_HANDLERS
+#define NOTE_INBOUND_HANDLERS       4
+#endif
+typedef void (*noteInboundFn) (const char *file, J *note, void *context);
+
+// The regions of state kept in a snapshot while the Notecard has cut the host's power.  Each is saved with
+// its identifier and length, so that a later firmware version may append fields to a region or add regions.
+#ifndef NOTE_SNAPSHOT_REGIONS
+#define NOTE_SNAPSHOT_REGIONS       8
+#endif
+
+// Classes of failure of a transaction with the Notecard.  Rather than every failure forcing a full reset
+// before the next transaction, each is recovered from according to how far the transaction had got: a
+// request that was cut off before the end of its body is resent after a backoff, a reply that hadn't begun
+// is read again, and a reply that was cut off or garbled is drained so as to get back in step.  A request
+// that the Notecard may have got in full is never resent.  Only when recovery fails, or for a failure that
+// can't be classified, is the Notecard fully reset.
+#define NOTE_FAULT_NONE             0
+#define NOTE_FAULT_BUS              1   // The bus reported an error
+#define NOTE_FAULT_PARTIAL          2   // The reply stopped partway
+#define NOTE_FAULT_BUSY             3   // No reply began in time
+#define NOTE_FAULT_DESYNC           4   // The reply was garbled or couldn't be parsed
+#define NOTE_FAULT_MEMORY           5   // The reply couldn't be buffered
+#define NOTE_FAULT_OTHER            6   // Anything else
+#define NOTE_FAULTS                 7
+#ifndef NOTE_RETRY_SEND
+#define NOTE_RETRY_SEND             2   // Times that a request that was cut off before its end is resent
+#endif
+#ifndef NOTE_RETRY_READ
+#define NOTE_RETRY_READ             1   // Times that a reply that hadn't begun is read again
+#endif
+#ifndef NOTE_RETRY_ESCALATE
+#define NOTE_RETRY_ESCALATE         2   // Failed transactions in a row after which the Notecard is reset
+#endif
+#ifndef NOTE_RETRY_BACKOFF_MS
+#define NOTE_RETRY_BACKOFF_MS       50  // Before the first resend, doubling for each one after
+#endif
+typedef struct {
+    uint32_t faults[NOTE_FAULTS];   // Failures of each class, including those recovered from
+    uint32_t resends;               // Requests that were sent again
+    uint32_t rereads;               // Replies that were read again
+    uint32_t resyncs;               // Times that the bus was drained to get back in step
+    uint32_t resets;                // Full resets that a failure led to
+    uint32_t recovered;             // Transactions that succeeded after a failure
+    uint32_t recoveryMs;            // Time spent recovering, including transactions that were repeated
+} NoteFaultStats;
+
 // External API
 bool NoteReset(void);
 void NoteResetRequired(void);
+void NoteGetFaultStats(NoteFaultStats *stats);
+void NoteClearFaultStats(void);
 #define NoteNewBody JCreateObject
 J *NoteNewRequest(const char *request);
 J *NoteNewCommand(const char *request);
 J *NoteRequestResponse(J *req);
+JTape *NoteRequestResponseTape(J *req);
+void NoteUploadBegin(NoteUpload *upload, const char *route, const char *name, uint32_t total, noteUploadReadFn readFn, void *readContext);
+bool NoteUploadNext(NoteUpload *upload);
+bool NoteUploadRun(NoteUpload *upload);
+bool NoteUploadComplete(NoteUpload *upload);
+uint32_t NoteUploadReadMemory(void *context, uint32_t offset, void *buf, uint32_t len);
+void NoteBatchBegin(NoteBatch *batch, const char *file, const char * const *fields, int fieldCount, char *buf, uint32_t bufLen);
+bool NoteBatchAdd(NoteBatch *batch, const JNUMBER *values);
+bool NoteBatchDue(NoteBatch *batch);
+bool NoteBatchPoll(NoteBatch *batch);
+bool NoteBatchFlush(NoteBatch *batch);
+bool NoteInboundRegister(const char *file, noteInboundFn fn, void *context);
+bool NoteInboundArm(void);
+int NoteInboundDrain(void);
+bool NoteSnapshotRegister(uint8_t id, void *region, uint16_t len);
+uint32_t NoteSnapshotEncodeLen(void);
+int NoteSnapshotEncode(uint16_t version, char *coded, uint32_t codedLen);
+int NoteSnapshotDecode(const char *coded, uint16_t *version);
+bool NoteSnapshotSleep(uint16_t version, uint32_t seconds, const char *modes);
+int NoteSnapshotWake(uint16_t *version);
 char *NoteRequestResponseJSON(char *reqJSON);
 void NoteSuspendTransactionDebug(void);
 void NoteResumeTransactionDebug(void);
@@ -115,6 +369,7 @@ J *NoteTransaction(J *req);
 bool NoteErrorContains(const char *errstr, const char *errtype);
 void NoteErrorClean(char *errbuf);
 void NoteSetFnDebugOutput(debugOutputFn fn);
+void NoteSetFnPhase(phaseFn fn);
 void NoteSetFnMutex(mutexFn lockI2Cfn, mutexFn unlockI2Cfn, mutexFn lockNotefn, mutexFn unlockNotefn);
 void NoteSetFnDefault(mallocFn mallocfn, freeFn freefn, delayMsFn delayfn, getMsFn millisfn);
 void NoteSetFn(mallocFn mallocfn, freeFn freefn, delayMsFn delayfn, getMsFn millisfn);
@@ -128,6 +383,10 @@ void NoteSetI2CAddress(uint32_t i2caddress);
 void NoteDebug(const char *message);
 void NoteDebugln(const char *message);
 void NoteDebugf(const char *format, ...);
+void NoteLog(int level, uint32_t subsystem, const char *text);
+bool NoteLogEnabled(int level, uint32_t subsystem);
+void NoteLogSetFilter(int level, uint32_t subsystems, uint32_t truncateLen);
+bool NoteLogDrain(uint32_t maxBytes);
 void *NoteMalloc(size_t size);
 void NoteFree(void *);
 long unsigned int NoteGetMs(void);
@@ -137,6 +396,15 @@ void NoteUnlockI2C(void);
 uint32_t NoteI2CAddress(void);
 uint32_t NoteI2CMax(void);
 uint32_t NoteMemAvailable(void);
+bool NoteGetMemStats(NoteMemStats *stats);
+bool NoteGetMemPhaseStats(int phase, NoteMemPhaseStats *stats);
+void NoteResetMemStats(void);
+int NoteSetMemPhase(int phase);
+void NoteTraceClear(void);
+int NoteTraceCount(void);
+bool NoteTraceGet(int index, NoteTraceEntry *entry);
+bool NoteTraceSummarize(int event, NoteTraceSummary *summary);
+void NoteTraceDump(void);
 bool NotePrint(const char *text);
 	void NotePrintln(const char *line);
 bool NotePrintf(const char *format, ...);
@@ -163,6 +431,21 @@ bool JIsExactString(J *rsp, const char *field, const char *teststr);
 bool JContainsString(J *rsp, const char *field, const char *substr);
 bool JAddBinaryToObject(J *req, const char *fieldName, const void *binaryData, uint32_t binaryDataLen);
 const char *JGetItemName(const J * item);
+JTape *JTapeParse(const char *json);
+JTape *JTapeParseInSitu(char *json);
+void JTapeDelete(JTape *tape);
+int JTapeType(JTape *tape, int index);
+int JTapeSize(JTape *tape, int index);
+int JTapeFirst(JTape *tape, int container);
+int JTapeNext(JTape *tape, int container, int index);
+int JTapeFind(JTape *tape, int object, const char *field);
+const char *JTapeKey(JTape *tape, int index);
+const char *JTapeStringValue(JTape *tape, int index);
+JNUMBER JTapeNumberValue(JTape *tape, int index);
+const char *JTapeGetString(JTape *tape, int object, const char *field);
+JNUMBER JTapeGetNumber(JTape *tape, int object, const char *field);
+bool JTapeGetBool(JTape *tape, int object, const char *field);
+int JTapeGetObject(JTape *tape, int object, const char *field);
 
 // Helper functions for apps that wish to limit their C library dependencies
 #define JNTOA_PRECISION (10)
@@ -173,12 +456,20 @@ int JB64EncodeLen(int len);
 int JB64Encode(char * coded_dst, const char *plain_src,int len_plain_src);
 int JB64DecodeLen(const char * coded_src);
 int JB64Decode(char * plain_dst, const char *coded_src);
+int JB64DecodeExactLen(const char * coded_src);
+void JB64EncodeStart(JB64Encoder *ctx);
+int JB64EncodeUpdateLen(JB64Encoder *ctx, int len_plain_src);
+int JB64EncodeUpdate(JB64Encoder *ctx, char *coded_dst, const void *plain_src, int len_plain_src);
+int JB64EncodeFinish(JB64Encoder *ctx, char *coded_dst);
+void JB64DecodeStart(JB64Decoder *ctx);
+int JB64DecodeUpdate(JB64Decoder *ctx, void *plain_dst, int len_plain_dst, const char *coded_src, int len_coded_src);
 
 // High-level helper functions that are both useful and serve to show developers how to call the API
 bool NoteTimeValid(void);
 bool NoteTimeValidST(void);
 JTIME NoteTime(void);
 JTIME NoteTimeST(void);
+bool NoteTimeDrift(int32_t *ppm);
 bool NoteRegion(char **retCountry, char **retArea, char **retZone, int *retZoneOffset);
 bool NoteLocationValid(char *errbuf, uint32_t errbuflen);
 bool NoteLocationValidST(char *errbuf, uint32_t errbuflen);
@@ -188,6 +479,11 @@ void NoteGetEnv(const char *variable, const char *defaultVal, char *buf, uint32_
 bool NoteSetEnvDefault(const char *variable, char *buf);
 bool NoteSetEnvDefaultNumber(const char *variable, JNUMBER defaultVal);
 bool NoteSetEnvDefaultInt(const char *variable, int defaultVal);
+bool NoteEnvRefresh(void);
+bool NoteEnvRefreshST(void);
+int NoteGetEnvIntST(const char *variable, int defaultVal);
+JNUMBER NoteGetEnvNumberST(const char *variable, JNUMBER defaultVal);
+void NoteGetEnvST(const char *variable, const char *defaultVal, char *buf, uint32_t buflen);
 bool NoteIsConnected(void);
 bool NoteIsConnectedST(void);
 bool NoteGetNetStatus(char *statusBuf, int statusBufLen);
@@ -209,6 +505,8 @@ bool NoteSetProductID(const char *productID);
 bool NoteSetUploadMode(const char *uploadMode, int uploadMinutes, bool align);
 bool NoteSetSyncMode(const char *uploadMode, int uploadMinutes, int downloadMinutes, bool align, bool sync);
 bool NoteTemplate(const char *target, J *body);
+void NoteSetAutoTemplate(bool enable, templateSaveFn saveFn);
+void NoteTemplateRestore(const NoteTemplateEntry *entries, int count);
 #define NoteSend NoteAdd
 bool NoteAdd(const char *target, J *body, bool urgent);
 bool NoteSendToRoute(const char *method, const char *routeAlias, char *notefile, J *body);
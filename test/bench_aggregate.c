@@ -0,0 +1,36 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Microbenchmark of adding a sample to an aggregator in Src/aggregate.c, with every trigger enabled, so that
+// the cost of aggregation per sample can be weighed against that of the note that it may save.  It is built
+// optimized and without sanitizers, with:  make -C test bench.  The M0+ has no FPU, so there each sample
+// costs a few software float operations rather than the host's few nanoseconds.
+
+#include <stdio.h>
+#include <time.h>
+#include "aggregate.h"
+
+#define BENCH_SIGNALS   16
+#define BENCH_SAMPLES   10000000
+
+int main() {
+    aggregateConfig config = { .windowMs = 60*60*1000, .heartbeatMs = 12*60*60*1000, .deadband = 0.5f,
+                               .ratePerSec = 1.0f, .thresholds = true, .low = 0, .high = 40 };
+    static aggregator agg[BENCH_SIGNALS];
+    for (int s=0; s<BENCH_SIGNALS; s++)
+        aggregateInit(&agg[s], &config, 0);
+    aggregateSummary summary;
+
+    volatile int sink = 0;
+    clock_t start = clock();
+    for (uint32_t i=0; i<BENCH_SAMPLES; i++) {
+        aggregator *a = &agg[i % BENCH_SIGNALS];
+        uint32_t ms = i * 15;
+        if (aggregateAdd(a, 22.0f + (float) (i % 7) * 0.03f, ms) != 0)
+            sink += aggregateFlush(a, &summary, ms);
+    }
+    double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    printf("aggregate bench: %.1f ns per sample, %d bytes per signal\n", seconds * 1e9 / BENCH_SAMPLES, (int) sizeof(aggregator));
+    return 0;
+}
@@ -0,0 +1,64 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Microbenchmark of note-c's word-at-a-time scanning kernels in n_scan.c against plain byte-at-a-time
+// loops, over a long run of ordinary text.  It is built optimized and without sanitizers, with:
+// make -C test bench.  The host's figures are only a guide to the M0+, but the ratio shows what taking
+// four bytes per step is worth.
+
+#include <stdio.h>
+#include <time.h>
+#include "n_lib.h"
+
+#define BENCH_LEN       4096
+#define BENCH_ROUNDS    20000
+
+// The byte-at-a-time loops, kept out of line so that the compiler can't vectorize them into the caller
+__attribute__((noinline)) static size_t refPlain(const unsigned char *s) {
+    size_t i = 0;
+    while (s[i] >= 0x20 && s[i] != '"' && s[i] != '\\')
+        i++;
+    return i;
+}
+
+__attribute__((noinline)) static size_t refQuote(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    while (i < len && p[i] != '"' && p[i] != '\\')
+        i++;
+    return i;
+}
+
+__attribute__((noinline)) static bool refIsText(const unsigned char *p, size_t len) {
+    for (size_t i=0; i<len; i++)
+        if (p[i] == 0 || (p[i] & 0x80) != 0)
+            return false;
+    return true;
+}
+
+static double seconds(clock_t since) {
+    return (double) (clock() - since) / CLOCKS_PER_SEC;
+}
+
+int main() {
+    static unsigned char text[BENCH_LEN];
+    for (int i=0; i<BENCH_LEN-1; i++)
+        text[i] = 'a' + i % 26;
+    text[BENCH_LEN-1] = '\0';
+
+    volatile size_t sink = 0;
+    clock_t start = clock();
+    for (int k=0; k<BENCH_ROUNDS; k++)
+        sink += refPlain(text) + refQuote(text, BENCH_LEN-1) + refIsText(text, BENCH_LEN-1);
+    double bytewise = seconds(start);
+
+    start = clock();
+    for (int k=0; k<BENCH_ROUNDS; k++)
+        sink += NoteScanPlain(text) + NoteScanQuote(text, BENCH_LEN-1) + NoteScanIsText(text, BENCH_LEN-1);
+    double wordwise = seconds(start);
+
+    double mb = (3.0 * BENCH_LEN * BENCH_ROUNDS) / 1e6;
+    printf("scan bench: byte at a time %.3fs (%.0f MB/s), word at a time %.3fs (%.0f MB/s), %.1fx\n",
+           bytewise, mb / bytewise, wordwise, mb / wordwise, bytewise / wordwise);
+    return 0;
+}
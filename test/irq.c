@@ -0,0 +1,49 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Simulated PRIMASK.  Masking interrupts takes a lock that a thread standing in for an ISR also holds for as
+// long as the ISR runs, so that an ISR never interleaves with a critical section of the app, and the app
+// never interleaves with an ISR, just as on a single core.  Within an ISR, masking is nested and free.
+
+#include <pthread.h>
+#include "stm32g0xx.h"
+
+static pthread_mutex_t irqLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread uint32_t irqMasked = 0;
+static __thread bool irqInHandler = false;
+
+uint32_t __get_PRIMASK() {
+    return irqMasked;
+}
+
+void __disable_irq() {
+    if (!irqInHandler && !irqMasked)
+        pthread_mutex_lock(&irqLock);
+    irqMasked = 1;
+}
+
+void __enable_irq() {
+    if (!irqInHandler && irqMasked)
+        pthread_mutex_unlock(&irqLock);
+    irqMasked = 0;
+}
+
+void __set_PRIMASK(uint32_t primask) {
+    if (primask)
+        __disable_irq();
+    else
+        __enable_irq();
+}
+
+// Bracket the body of a simulated ISR
+void irqEnter() {
+    pthread_mutex_lock(&irqLock);
+    irqInHandler = true;
+}
+
+void irqExit() {
+    irqInHandler = false;
+    irqMasked = 0;
+    pthread_mutex_unlock(&irqLock);
+}
@@ -0,0 +1,97 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// A simulated Notecard, attached through note-c's serial hooks, for host tests of note-c and of the app's
+// use of it.  Each request that the host sends is parsed and handed to the test's handler, whose reply
+// is queued for the host to receive.  As on a real Notecard, commands get no reply, and an empty line is
+// answered with an empty line.  Time is simulated, and passes only when note-c delays.
+
+#ifndef NOTECARD_H
+#define NOTECARD_H
+
+#include <stdlib.h>
+#include "n_lib.h"
+
+#define NOTECARD_BUFFER_LEN     65536
+
+// The test's handler of requests, which returns a reply allocated with malloc, without its newline, or
+// NULL for no reply at all
+typedef char * (*notecardHandlerFn) (J *req);
+
+static notecardHandlerFn notecardHandler;
+static char notecardTx[NOTECARD_BUFFER_LEN];
+static size_t notecardTxLen = 0;
+static char notecardRx[NOTECARD_BUFFER_LEN];
+static size_t notecardRxHead = 0, notecardRxLen = 0;
+static unsigned long notecardMs = 0;
+static int notecardRequests = 0;
+
+// Queue bytes for the host to receive
+static void notecardReply(const char *text, size_t len) {
+    memcpy(&notecardRx[notecardRxLen], text, len);
+    notecardRxLen += len;
+}
+
+// The serial hooks
+static bool notecardSerialReset() {
+    return true;
+}
+
+static void notecardSerialTransmit(uint8_t *data, size_t len, bool flush) {
+    memcpy(&notecardTx[notecardTxLen], data, len);
+    notecardTxLen += len;
+    if (notecardTxLen == 0 || notecardTx[notecardTxLen-1] != '\n')
+        return;
+    notecardTx[--notecardTxLen] = '\0';
+    if (notecardTxLen > 0 && notecardTx[notecardTxLen-1] == '\r')
+        notecardTx[--notecardTxLen] = '\0';
+    if (notecardTxLen == 0) {
+        notecardReply("\r\n", 2);
+        return;
+    }
+    J *req = JParse(notecardTx);
+    notecardTxLen = 0;
+    notecardRequests++;
+    char *rsp = notecardHandler(req);
+    if (rsp != NULL && !JIsPresent(req, "cmd")) {
+        notecardReply(rsp, strlen(rsp));
+        notecardReply("\n", 1);
+    }
+    free(rsp);
+    JDelete(req);
+}
+
+static bool notecardSerialAvailable() {
+    return notecardRxHead < notecardRxLen;
+}
+
+static char notecardSerialReceive() {
+    char ch = notecardRx[notecardRxHead++];
+    if (notecardRxHead == notecardRxLen)
+        notecardRxHead = notecardRxLen = 0;
+    return ch;
+}
+
+// The platform hooks
+static void notecardDelay(uint32_t ms) {
+    notecardMs += ms;
+}
+
+static long unsigned int notecardMillis() {
+    return notecardMs;
+}
+
+// Attach the simulated Notecard, with the given handler of requests
+static void notecardBegin(notecardHandlerFn handler) {
+    notecardHandler = handler;
+    NoteSetFnDefault(malloc, free, notecardDelay, notecardMillis);
+    NoteSetFnSerial(notecardSerialReset, notecardSerialTransmit, notecardSerialAvailable, notecardSerialReceive);
+}
+
+// A reply, allocated as the handler must return it
+static char *notecardText(const char *text) {
+    return strdup(text);
+}
+
+#endif // NOTECARD_H
@@ -0,0 +1,123 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Report of the worst-case stack used by each of note-c's public APIs over a corpus of JSON documents and
+// a session with a simulated Notecard.  note-c is built with -finstrument-functions so that every call
+// into it records the lowest frame reached.  Run it with:  make -C test stack
+// The figures are for the host's ABI at -O0, so they are for comparison between versions, and between
+// APIs, rather than a measure of what the M0+ will use, whose frames are smaller.
+
+#include <stdio.h>
+#include "notecard.h"
+
+#define REPORT_MAX      32
+#define DOC_MAX         4096
+
+// The lowest frame seen since measuring began
+static uintptr_t stackLowest;
+
+__attribute__((no_instrument_function)) void __cyg_profile_func_enter(void *fn, void *site) {
+    uintptr_t frame = (uintptr_t) __builtin_frame_address(0);
+    if (frame < stackLowest)
+        stackLowest = frame;
+}
+
+__attribute__((no_instrument_function)) void __cyg_profile_func_exit(void *fn, void *site) {
+}
+
+// The worst seen for each API, in the order in which they were first measured
+static const char *reportName[REPORT_MAX];
+static size_t reportWorst[REPORT_MAX];
+static int reportCount = 0;
+
+static void reportRecord(const char *name, size_t used) {
+    int i;
+    for (i=0; i<reportCount; i++)
+        if (strcmp(reportName[i], name) == 0)
+            break;
+    if (i == reportCount) {
+        if (reportCount >= REPORT_MAX)
+            return;
+        reportName[reportCount++] = name;
+    }
+    if (used > reportWorst[i])
+        reportWorst[i] = used;
+}
+
+// Measure the stack used below this frame by a call
+#define MEASURE(name, call) do {                                        \
+        uintptr_t base = (uintptr_t) __builtin_frame_address(0);       \
+        stackLowest = base;                                             \
+        call;                                                           \
+        reportRecord(name, base - stackLowest);                         \
+    } while (0)
+
+// The simulated Notecard's replies, which are chosen to exercise the parsing of each API's response
+static char *handler(J *req) {
+    if (JIsExactString(req, "req", "card.time"))
+        return notecardText("{\"time\":1700000000,\"zone\":\"CET,Europe/Berlin\",\"minutes\":60,\"country\":\"DE\",\"area\":\"Berlin\"}");
+    if (JIsExactString(req, "req", "card.attn"))
+        return notecardText("{\"time\":1700000000,\"payload\":\"AAECAwQFBgcICQ==\"}");
+    if (JIsExactString(req, "req", "card.status"))
+        return notecardText("{\"status\":\"{normal}\",\"usb\":true,\"connected\":true,\"signals\":3,\"time\":1699999000}");
+    return notecardText("{\"result\":200,\"body\":{\"a\":[1,2,{\"b\":\"x\\u00e9\"}],\"t\":1.5}}");
+}
+
+// Parse, print, copy and free a document in each of the ways that note-c can
+static void measureDocument(const char *doc) {
+    J *json = NULL;
+    char *text = NULL;
+    JTape *tape = NULL;
+    MEASURE("JParse", json = JParse(doc));
+    MEASURE("JPrintUnformatted", text = JPrintUnformatted(json));
+    JFree(text);
+    MEASURE("JPrint", text = JPrint(json));
+    JFree(text);
+    MEASURE("JDuplicate", JDelete(JDuplicate(json, true)));
+    MEASURE("JDelete", JDelete(json));
+    MEASURE("JTapeParse", tape = JTapeParse(doc));
+    JTapeDelete(tape);
+}
+
+int main(int argc, char *argv[]) {
+    notecardBegin(handler);
+
+    // The corpus
+    static char doc[DOC_MAX];
+    for (int i=1; i<argc; i++) {
+        FILE *f = fopen(argv[i], "r");
+        if (f == NULL) {
+            fprintf(stderr, "can't open %s\n", argv[i]);
+            return 1;
+        }
+        size_t len = fread(doc, 1, sizeof(doc)-1, f);
+        fclose(f);
+        doc[len] = '\0';
+        measureDocument(doc);
+    }
+
+    // A session with the Notecard
+    char text[32];
+    uint8_t state[10];
+    MEASURE("NoteRequestResponse", NoteDeleteResponse(NoteRequestResponse(NoteNewRequest("note.get"))));
+    MEASURE("NoteRequestResponseTape", JTapeDelete(NoteRequestResponseTape(NoteNewRequest("note.get"))));
+    MEASURE("NoteTimeST", NoteTimeST());
+    MEASURE("NoteGetStatusST", NoteGetStatusST(text, sizeof(text), NULL, NULL, NULL));
+    MEASURE("NoteSleep", NoteSleep("AAEC", 60, "usb"));
+    MEASURE("NoteWake", NoteWake(sizeof(state), state));
+    MEASURE("JNtoA", JNtoA(3.14159, text, -1));
+    MEASURE("NoteDebugf", NoteDebugf("x %d\n", 1));
+
+    printf("worst-case stack over %d documents and a Notecard session\n", argc-1);
+    for (int i=0; i<reportCount; i++)
+        printf("  %-26s %5zu\n", reportName[i], reportWorst[i]);
+
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    if (mem.liveBytes != 0) {
+        printf("%u bytes leaked\n", (unsigned) mem.liveBytes);
+        return 1;
+    }
+    return 0;
+}
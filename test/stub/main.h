@@ -0,0 +1,49 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Host stand-in for Inc/main.h, so that the app's modules can be built and tested on a host.  The feature
+// headers are the real ones, and the MY_ functions that reach the hardware are defined by each test.
+
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "stm32g0xx_hal.h"
+
+long unsigned int millis(void);
+void delay(uint32_t ms);
+
+bool MY_Debug(void);
+void MY_Sleep_DeInit(void);
+
+#include "event.h"
+#include "clock.h"
+#if CLOCK_SCALING
+void MY_ClockSwitch(int from, int to);
+#endif
+#include "backup.h"
+#if BACKUP_REGISTERS
+uint32_t MY_BackupRead(int index);
+void MY_BackupWrite(int index, uint32_t value);
+#endif
+#include "sensor.h"
+#if SENSORS
+void MY_SensorStart(uint16_t *ring, uint32_t count, uint32_t scanHz);
+void MY_SensorStop(void);
+void MY_SensorIdle(void);
+void MY_SensorCalibration(sensorCalibration *cal);
+#endif
+#include "power.h"
+#if POWER_MANAGEMENT
+void MY_PowerStandby(uint32_t ms);
+bool MY_PowerWokeFromStandby(void);
+#endif
+#ifdef EVENT_TIMER
+uint32_t MY_TimerMs(void);
+uint16_t MY_TimerCounter(bool *overflowPending);
+void MY_TimerSetCompare(uint16_t ticks);
+#endif
+
+#endif /* __MAIN_H */
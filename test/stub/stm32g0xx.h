@@ -0,0 +1,36 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Host stand-in for the CMSIS and HAL headers.  PRIMASK is simulated by irq.c, so that a thread standing in
+// for an ISR is held off while the app has interrupts masked, and everything else that touches the core or
+// its peripherals does nothing.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq(void);
+void __enable_irq(void);
+void irqEnter(void);
+void irqExit(void);
+
+#define __DSB()
+#define __ISB()
+#define __WFI()
+#define SystemCoreClockUpdate()
+#define HAL_GetTick()                       ((uint32_t) millis())
+#define HAL_Delay(ms)                       delay(ms)
+#define HAL_SuspendTick()
+#define HAL_ResumeTick()
+#define HAL_GPIO_WritePin(port,pin,state)
+#define LL_PWR_EnableFlashPowerDownInStop()
+#define LL_PWR_SetPowerMode(mode)
+#define LL_PWR_EnableSRAMRetention()
+#define LL_LPM_EnableEventOnPend()
+#define LL_LPM_DisableSleepOnExit()
+#define LL_LPM_EnableDeepSleep()
+#define LL_LPM_EnableSleep()
@@ -0,0 +1,3 @@
+// Host stand-in, see stm32g0xx.h
+#pragma once
+#include "stm32g0xx.h"
@@ -0,0 +1,21 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// The least that a test needs: a check that reports where it failed, and a count of failures from which
+// the test's exit status is taken.
+
+#pragma once
+
+#include <stdio.h>
+
+static int testFailures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            testFailures++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT(name) (printf("%s: %s\n", (name), testFailures == 0 ? "PASS" : "FAIL"), testFailures != 0)
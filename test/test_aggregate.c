@@ -0,0 +1,183 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of the aggregation of samples into windows in Src/aggregate.c: the statistics of a window against a
+// two-pass computation, and each of the triggers on its own.  Then a week of samples every 15 seconds, as
+// the example takes them, is aggregated for a few typical signals, and the notes that would be sent are
+// counted against the one per sample that would be sent without aggregation.
+
+#include <math.h>
+#include <stdlib.h>
+#include "aggregate.h"
+#include "test.h"
+
+#define SAMPLE_MS       15000
+#define WEEK_SAMPLES    (7*24*60*60*1000/SAMPLE_MS)
+#define HOUR_MS         (60*60*1000)
+
+// Uniform noise of up to a given amplitude either way
+static float noise(float amplitude) {
+    return amplitude * (2.0f * rand() / (float) RAND_MAX - 1.0f);
+}
+
+static void testStatistics() {
+    aggregateConfig config = { .windowMs = HOUR_MS };
+    aggregator agg;
+    aggregateInit(&agg, &config, 0);
+    aggregateSummary summary;
+    CHECK(!aggregateFlush(&agg, &summary, 0));
+
+    // Values with a large offset, which a naive sum of squares would lose the variance of
+    float values[1000];
+    for (int i=0; i<1000; i++) {
+        values[i] = 1000.0f + noise(2.0f);
+        CHECK(aggregateAdd(&agg, values[i], i) == 0);
+    }
+    double sum = 0, squares = 0;
+    float min = values[0], max = values[0];
+    for (int i=0; i<1000; i++) {
+        sum += values[i];
+        min = values[i] < min ? values[i] : min;
+        max = values[i] > max ? values[i] : max;
+    }
+    double mean = sum / 1000;
+    for (int i=0; i<1000; i++)
+        squares += (values[i] - mean) * (values[i] - mean);
+    double variance = squares / 999;
+    CHECK(aggregateFlush(&agg, &summary, 1000));
+    CHECK(summary.count == 1000 && summary.min == min && summary.max == max);
+    CHECK(summary.startMs == 0 && summary.endMs == 999);
+    CHECK(fabs(summary.mean - mean) < 1e-3);
+    CHECK(fabs(summary.variance - variance) < variance * 1e-3);
+
+    // A single sample has no variance, and the flush began an empty window
+    CHECK(!aggregateFlush(&agg, &summary, 1000));
+    aggregateAdd(&agg, 5, 1001);
+    CHECK(aggregateFlush(&agg, &summary, 1002));
+    CHECK(summary.count == 1 && summary.mean == 5 && summary.variance == 0);
+}
+
+static void testDeadbandAndHeartbeat() {
+    aggregateConfig config = { .windowMs = 1000, .heartbeatMs = 10000, .deadband = 0.5f };
+    aggregator agg;
+    aggregateInit(&agg, &config, 0);
+    aggregateSummary summary;
+
+    // The first window is always reported
+    CHECK(aggregateAdd(&agg, 20, 0) == 0);
+    CHECK(aggregateAdd(&agg, 20, 1000) == AGGREGATE_WINDOW);
+    CHECK(aggregateFlush(&agg, &summary, 1000));
+
+    // A window within the deadband isn't, and is discarded when the next sample is added
+    CHECK(aggregateAdd(&agg, 20.4f, 1500) == 0);
+    CHECK(aggregateAdd(&agg, 20.4f, 2000) == 0);
+    CHECK(aggregateAdd(&agg, 20.4f, 2500) == 0);
+    CHECK(agg.count == 1 && agg.startMs == 2500);
+
+    // One outside it is, and its statistics include the sample that closed it
+    CHECK(aggregateAdd(&agg, 21, 3500) == AGGREGATE_WINDOW);
+    CHECK(aggregateFlush(&agg, &summary, 3500));
+    CHECK(summary.count == 2 && fabs(summary.mean - 20.7f) < 1e-5);
+
+    // A signal that stays within the deadband is reported when the heartbeat is due, and not before
+    int heartbeats = 0;
+    for (uint32_t ms=4000; ms<=13500; ms+=500) {
+        int reasons = aggregateAdd(&agg, 21, ms);
+        CHECK((reasons & ~AGGREGATE_HEARTBEAT) == 0);
+        if (reasons != 0) {
+            heartbeats++;
+            CHECK(ms - 3500 >= config.heartbeatMs);
+            aggregateFlush(&agg, &summary, ms);
+        }
+    }
+    CHECK(heartbeats == 1);
+}
+
+static void testThresholds() {
+    aggregateConfig config = { .windowMs = HOUR_MS, .thresholds = true, .low = 0, .high = 40 };
+    aggregator agg;
+    aggregateInit(&agg, &config, 0);
+
+    // Crossing a threshold, either way, is due immediately, and staying beyond it isn't
+    CHECK(aggregateAdd(&agg, 20, 0) == 0);
+    CHECK(aggregateAdd(&agg, 41, 1) == AGGREGATE_THRESHOLD);
+    CHECK(aggregateAdd(&agg, 45, 2) == 0);
+    CHECK(aggregateAdd(&agg, 39, 3) == AGGREGATE_THRESHOLD);
+    CHECK(aggregateAdd(&agg, -1, 4) == AGGREGATE_THRESHOLD);
+    CHECK(aggregateAdd(&agg, 50, 5) == AGGREGATE_THRESHOLD);
+
+    // Without thresholds, nothing is
+    config.thresholds = false;
+    aggregateInit(&agg, &config, 0);
+    CHECK(aggregateAdd(&agg, 20, 0) == 0);
+    CHECK(aggregateAdd(&agg, 100, 1) == 0);
+}
+
+static void testRate() {
+    aggregateConfig config = { .windowMs = HOUR_MS, .ratePerSec = 1.0f };
+    aggregator agg;
+    aggregateInit(&agg, &config, 0);
+
+    // The first sample has nothing to compare with, and then a change faster than the rate, either way, is due
+    CHECK(aggregateAdd(&agg, 20, 0) == 0);
+    CHECK(aggregateAdd(&agg, 20.5f, 1000) == 0);
+    CHECK(aggregateAdd(&agg, 22.5f, 2000) == AGGREGATE_RATE);
+    CHECK(aggregateAdd(&agg, 20, 3000) == AGGREGATE_RATE);
+    CHECK(aggregateAdd(&agg, 28, 13000) == 0);
+}
+
+// A week of samples of a signal, returning the number of notes sent and those sent for a threshold
+static int week(const char *label, float (*signal)(uint32_t ms), int *thresholdNotes) {
+    aggregateConfig config = { .windowMs = HOUR_MS, .heartbeatMs = 12*HOUR_MS, .deadband = 0.5f,
+                               .thresholds = true, .low = 0, .high = 40 };
+    aggregator agg;
+    aggregateInit(&agg, &config, 0);
+    aggregateSummary summary;
+    int notes = 0;
+    *thresholdNotes = 0;
+    for (uint32_t i=0; i<WEEK_SAMPLES; i++) {
+        uint32_t ms = i * SAMPLE_MS;
+        int reasons = aggregateAdd(&agg, signal(ms), ms);
+        if (reasons != 0 && aggregateFlush(&agg, &summary, ms)) {
+            notes++;
+            if (reasons & AGGREGATE_THRESHOLD)
+                (*thresholdNotes)++;
+        }
+    }
+    printf("  %-36s %4d notes (%.0fx fewer)\n", label, notes, (double) WEEK_SAMPLES / notes);
+    return notes;
+}
+
+static float stable(uint32_t ms) {
+    (void) ms;
+    return 22.0f + noise(0.1f);
+}
+
+static float diurnal(uint32_t ms) {
+    return 20.0f + 4.0f * (float) sin(2 * M_PI * ms / (24.0 * HOUR_MS)) + noise(0.1f);
+}
+
+static float excursion(uint32_t ms) {
+    bool hot = ms >= 72*HOUR_MS && ms < 72*HOUR_MS + 24*HOUR_MS/10;
+    return (hot ? 45.0f : 22.0f) + noise(0.1f);
+}
+
+int main() {
+    srand(1);
+    testStatistics();
+    testDeadbandAndHeartbeat();
+    testThresholds();
+    testRate();
+
+    printf("aggregate: a week of %d samples, each of which would be a note without aggregation\n", WEEK_SAMPLES);
+    int thresholdNotes;
+    int notes = week("stable at 22C +/-0.1", stable, &thresholdNotes);
+    CHECK(notes <= 1 + 7*24/12);
+    notes = week("20C +/-4 diurnal swing", diurnal, &thresholdNotes);
+    CHECK(notes > 7*24/12 && notes < WEEK_SAMPLES / 100);
+    notes = week("stable, with 2.4h past 40C", excursion, &thresholdNotes);
+    CHECK(thresholdNotes == 2 && notes < 7*24/12 + 6);
+
+    return TEST_RESULT("aggregate");
+}
@@ -0,0 +1,142 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of the state kept in the backup registers by Src/backup.c, against simulated registers that survive
+// a simulated reset and are cleared by a simulated power cycle, and a simulated Notecard that keeps its hub
+// configuration.  The boot-time hub.set must reach the Notecard after every power cycle and every change of
+// configuration, and otherwise be skipped, or, when built with BACKUP_CONFIG_VERIFY, be confirmed with a
+// hub.get that catches a Notecard that was reconfigured behind our back.
+
+#include "main.h"
+#include "backup.h"
+#include "notecard.h"
+#include "test.h"
+
+#if BACKUP_CONFIG_VERIFY
+#define TEST_NAME       "backup (verify)"
+#else
+#define TEST_NAME       "backup"
+#endif
+
+// The registers, and the Notecard's hub configuration
+static uint32_t simRegisters[BACKUP_REGISTER_COUNT];
+static int simWrites = 0;
+static J *hubConfig = NULL;
+static int hubSets = 0, hubGets = 0;
+static bool rejecting = false;
+
+uint32_t MY_BackupRead(int index) {
+    CHECK(index >= 0 && index < BACKUP_REGISTER_COUNT);
+    return simRegisters[index];
+}
+
+void MY_BackupWrite(int index, uint32_t value) {
+    CHECK(index >= 0 && index < BACKUP_REGISTER_COUNT);
+    simRegisters[index] = value;
+    simWrites++;
+}
+
+static char *handler(J *req) {
+    if (JIsExactString(req, "req", "hub.set")) {
+        hubSets++;
+        if (rejecting)
+            return notecardText("{\"err\":\"hub.set: mode is not valid\"}");
+        JDelete(hubConfig);
+        hubConfig = JDuplicate(req, true);
+        JDeleteItemFromObject(hubConfig, "req");
+        return notecardText("{}");
+    }
+    if (JIsExactString(req, "req", "hub.get")) {
+        hubGets++;
+        if (hubConfig == NULL)
+            return notecardText("{}");
+        char *text = JPrintUnformatted(hubConfig);
+        char *rsp = notecardText(text);
+        JFree(text);
+        return rsp;
+    }
+    return notecardText("{}");
+}
+
+// The example's configuration, in a given mode
+static J *config(const char *mode) {
+    J *req = NoteNewRequest("hub.set");
+    JAddStringToObject(req, "product", "com.example:sensor");
+    JAddStringToObject(req, "mode", mode);
+    JAddNumberToObject(req, "outbound", 60);
+    return req;
+}
+
+// A boot, returning whether the configuration was sent to the Notecard, and checking how it was decided
+static bool boot(const char *mode) {
+    int setsWere = hubSets, getsWere = hubGets;
+    bool applied = backupConfigure(config(mode));
+    CHECK(applied == !rejecting);
+#if BACKUP_CONFIG_VERIFY
+    CHECK(hubGets - getsWere <= 1);
+#else
+    CHECK(hubGets == getsWere);
+#endif
+    return hubSets > setsWere;
+}
+
+int main() {
+    notecardBegin(handler);
+    CHECK(!backupConfigure(NULL));
+
+    // A cold boot configures the Notecard, and saves the fingerprint once it has succeeded
+    CHECK(boot("periodic"));
+    uint32_t periodic = simRegisters[BACKUP_CONFIG];
+    CHECK(periodic != 0);
+
+    // A reset with the same configuration doesn't send it again, or only confirms that the Notecard has it
+    CHECK(!boot("periodic"));
+    CHECK(!boot("periodic"));
+    CHECK(simRegisters[BACKUP_CONFIG] == periodic);
+
+    // A change of configuration is sent, and its fingerprint replaces the old one
+    CHECK(boot("continuous"));
+    CHECK(simRegisters[BACKUP_CONFIG] != periodic && simRegisters[BACKUP_CONFIG] != 0);
+    CHECK(!boot("continuous"));
+
+    // A configuration that the Notecard rejects leaves no fingerprint, so that it is sent again next time
+    rejecting = true;
+    CHECK(boot("bogus"));
+    CHECK(simRegisters[BACKUP_CONFIG] == 0);
+    rejecting = false;
+    CHECK(boot("continuous"));
+
+    // A Notecard reconfigured, or swapped, while we kept power is caught only by verifying
+    JReplaceItemInObject(hubConfig, "mode", JCreateString("off"));
+#if BACKUP_CONFIG_VERIFY
+    CHECK(boot("continuous"));
+    CHECK(JIsExactString(hubConfig, "mode", "continuous"));
+#else
+    CHECK(!boot("continuous"));
+#endif
+
+    // A power cycle clears the registers, and the configuration is sent again
+    memset(simRegisters, 0, sizeof(simRegisters));
+    CHECK(boot("continuous"));
+
+    // The template registrations round-trip, and registers that haven't changed aren't written
+    NoteTemplateEntry entries[BACKUP_TEMPLATE_ENTRIES] = { { 0x12345678, 0x9abc0003 }, { 0xdeadbeef, 0x00000102 } };
+    backupTemplateSave(entries, BACKUP_TEMPLATE_ENTRIES);
+    int writesWere = simWrites;
+    backupTemplateSave(entries, BACKUP_TEMPLATE_ENTRIES);
+    CHECK(simWrites == writesWere);
+    NoteTemplateEntry restored[BACKUP_TEMPLATE_ENTRIES + 1];
+    CHECK(backupTemplateRestore(restored, BACKUP_TEMPLATE_ENTRIES + 1) == BACKUP_TEMPLATE_ENTRIES);
+    CHECK(memcmp(restored, entries, sizeof(entries)) == 0);
+    backupTemplateSave(entries, 1);
+    CHECK(backupTemplateRestore(restored, BACKUP_TEMPLATE_ENTRIES) == BACKUP_TEMPLATE_ENTRIES);
+    CHECK(restored[1].fileHash == 0 && restored[1].templateHash == 0);
+    CHECK(simRegisters[BACKUP_CONFIG] != 0);
+
+    JDelete(hubConfig);
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+    return TEST_RESULT(TEST_NAME);
+}
@@ -0,0 +1,95 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of note-c's batching of samples into the body of a single note (n_batch.c) against a simulated
+// Notecard, which can be made to lose a request on the way, or to reject the notes it is sent.
+
+#include "notecard.h"
+#include "test.h"
+
+#define FIELDS          2
+#define BUF_LEN         1024
+
+static const char * const fields[FIELDS] = { "temp", "voltage" };
+static char buf[BUF_LEN];
+static bool losing = false, rejecting = false;
+static int notes = 0, rows = 0, rejected = 0;
+
+// Count the notes added and the rows in each, unless the request is to be lost or rejected
+static char *handler(J *req) {
+    if (!JIsExactString(req, "req", "note.add"))
+        return notecardText("{}");
+    if (losing)
+        return NULL;
+    if (rejecting) {
+        rejected++;
+        return notecardText("{\"err\":\"error adding note: invalid notefile name\"}");
+    }
+    J *body = JGetObject(req, "body");
+    J *samples = JGetObjectItem(body, "samples");
+    CHECK(JGetArraySize(JGetObjectItem(body, "fields")) == FIELDS);
+    for (int i=0; i<JGetArraySize(samples); i++)
+        CHECK(JGetArraySize(JGetArrayItem(samples, i)) == FIELDS + 1);
+    notes++;
+    rows += JGetArraySize(samples);
+    return notecardText("{\"total\":1}");
+}
+
+static bool add(NoteBatch *batch, int i) {
+    JNUMBER values[FIELDS] = { 20 + i, 3 };
+    notecardMs += 1000;
+    return NoteBatchAdd(batch, values);
+}
+
+int main() {
+    notecardBegin(handler);
+    NoteBatch batch;
+    NoteBatchBegin(&batch, "sensors.qo", fields, FIELDS, buf, sizeof(buf));
+
+    // A full batch is added as a single note
+    for (int i=0; i<NOTE_BATCH_MAX_SAMPLES; i++)
+        CHECK(add(&batch, i));
+    CHECK(notes == 1 && rows == NOTE_BATCH_MAX_SAMPLES && batch.count == 0);
+
+    // A request that's lost on the way keeps the samples, which go with the next flush
+    for (int i=0; i<5; i++)
+        CHECK(add(&batch, i));
+    losing = true;
+    CHECK(!NoteBatchFlush(&batch));
+    CHECK(batch.count == 5 && batch.dropped == 0);
+    losing = false;
+    CHECK(add(&batch, 5));
+    CHECK(NoteBatchFlush(&batch));
+    CHECK(notes == 2 && rows == NOTE_BATCH_MAX_SAMPLES + 6);
+
+    // A batch that the Notecard rejects is dropped rather than retried, so it doesn't block those after it
+    for (int i=0; i<5; i++)
+        CHECK(add(&batch, i));
+    rejecting = true;
+    CHECK(!NoteBatchFlush(&batch));
+    CHECK(batch.count == 0 && batch.dropped == 5 && rejected == 1);
+    for (int i=0; i<2*NOTE_BATCH_MAX_SAMPLES; i++)
+        add(&batch, i);
+    CHECK(batch.dropped == 5 + 2*NOTE_BATCH_MAX_SAMPLES && rejected == 3);
+    CHECK(batch.count == 0);
+    rejecting = false;
+    for (int i=0; i<NOTE_BATCH_MAX_SAMPLES; i++)
+        CHECK(add(&batch, i));
+    CHECK(notes == 3 && rows == 2*NOTE_BATCH_MAX_SAMPLES + 6);
+
+    // Rows that fill the buffer before the batch is due flush it to make room
+    NoteBatch small;
+    char smallBuf[64];
+    NoteBatchBegin(&small, "sensors.qo", fields, FIELDS, smallBuf, sizeof(smallBuf));
+    int notesWere = notes;
+    for (int i=0; i<10; i++)
+        CHECK(add(&small, i));
+    CHECK(notes > notesWere && small.dropped == 0);
+    CHECK(NoteBatchFlush(&small));
+
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+    return TEST_RESULT("batch");
+}
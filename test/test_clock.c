@@ -0,0 +1,167 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Simulation of the energy that the clock policy in Src/clock.c saves on a transaction.  Transactions are
+// made with note-c against a simulated Notecard, with time simulated in microseconds: the serial link runs at
+// 9600 baud, the Notecard takes a while to begin its reply, and serializing and parsing take a number of CPU
+// cycles per byte, whose duration depends on the clock that they run at.  Each transaction is made once at
+// the normal clock throughout, as before the clock was scaled, and once with the policy applied by the phase
+// hook, and the energy that clock.c estimates from its residency in each mode is compared.
+
+#include <stdio.h>
+#include "main.h"
+#include "clock.h"
+#include "timebase.h"
+#include "notecard.h"
+#include "test.h"
+
+// The assumptions of the simulation
+#define SIM_BYTE_US             1042    // 10 bits at 9600 baud
+#define SIM_LATENCY_US          20000   // From the end of a request to the start of its reply
+#define SIM_PRINT_CYCLES        300     // Per byte of request serialized
+#define SIM_PARSE_CYCLES        500     // Per byte of response parsed
+#define SIM_PLL_LOCK_US         50
+
+static const uint32_t simMhz[CLOCK_MODES] = {
+    [CLOCK_LOWPOWER] = 2,
+    [CLOCK_NORMAL] = 16,
+    [CLOCK_BOOST] = 64,
+};
+
+// Simulated time, and the state of the transaction in progress
+static uint64_t simUs = 0, simReplyUs = 0;
+static bool simScaling = false;
+static int simPhase = NOTE_PHASE_APP;
+static size_t simRequestLen = 0, simResponseLen = 0;
+static int simSwitches = 0;
+
+uint64_t timebaseTicks() {
+    return simUs * TIMEBASE_HZ / 1000000;
+}
+
+long unsigned int millis() {
+    return (long unsigned int) (simUs / 1000);
+}
+
+void delay(uint32_t ms) {
+    simUs += (uint64_t) ms * 1000;
+}
+
+void MY_ClockSwitch(int from, int to) {
+    (void) from;
+    simSwitches++;
+    if (to == CLOCK_BOOST)
+        simUs += SIM_PLL_LOCK_US;
+}
+
+// Spend some CPU cycles at the current clock
+static void simCycles(uint64_t cycles) {
+    simUs += cycles / simMhz[clockMode()];
+}
+
+// The phase hook charges the CPU time of the phase that is ending at the clock it ran at, and then applies
+// the policy for the phase that is beginning, if the clock is being scaled
+static void simPhaseHook(int phase) {
+    if (simPhase == NOTE_PHASE_PRINT)
+        simCycles((uint64_t) simRequestLen * SIM_PRINT_CYCLES);
+    if (simPhase == NOTE_PHASE_PARSE)
+        simCycles((uint64_t) simResponseLen * SIM_PARSE_CYCLES);
+    simPhase = phase;
+    if (simScaling)
+        clockPhase(phase);
+}
+
+// The serial link, which takes time to cross, and a Notecard that takes time to reply
+static void simTransmit(uint8_t *data, size_t len, bool flush) {
+    simUs += len * SIM_BYTE_US;
+    simReplyUs = simUs + SIM_LATENCY_US;
+    notecardSerialTransmit(data, len, flush);
+}
+
+static bool simAvailable() {
+    return simUs >= simReplyUs && notecardSerialAvailable();
+}
+
+static char simReceive() {
+    simUs += SIM_BYTE_US;
+    simResponseLen++;
+    return notecardSerialReceive();
+}
+
+static char *handler(J *req) {
+    if (JIsExactString(req, "req", "card.status"))
+        return notecardText("{\"status\":\"{normal}\",\"usb\":true,\"storage\":8,\"time\":1700000000,\"connected\":true,\"cell\":true}");
+    return notecardText("{\"total\":1}");
+}
+
+// Make a transaction, returning the energy it took and how long
+static uint32_t transact(J *req, bool scaling, uint32_t *us) {
+    simScaling = scaling;
+    simRequestLen = JPrintLength(req, false);
+    simResponseLen = 0;
+    clockResetResidency();
+    uint64_t beganUs = simUs;
+    J *rsp = NoteRequestResponse(JDuplicate(req, true));
+    CHECK(rsp != NULL && !NoteResponseError(rsp));
+    NoteDeleteResponse(rsp);
+    *us = (uint32_t) (simUs - beganUs);
+    CHECK(clockMode() == CLOCK_NORMAL);
+    clockResidency residency;
+    clockGetResidency(&residency);
+    return clockEnergyUJ(&residency);
+}
+
+// Make a transaction both ways and report the difference, returning the factor by which energy was saved
+static double compare(const char *label, J *req) {
+    uint32_t normalUs, scaledUs;
+    uint32_t normalUJ = transact(req, false, &normalUs);
+    int switchesWere = simSwitches;
+    uint32_t scaledUJ = transact(req, true, &scaledUs);
+    printf("  %-24s %5u uJ in %7.1f ms, scaled %5u uJ in %7.1f ms (%.1fx), %d switches\n", label,
+           (unsigned) normalUJ, normalUs / 1000.0, (unsigned) scaledUJ, scaledUs / 1000.0,
+           (double) normalUJ / scaledUJ, simSwitches - switchesWere);
+    CHECK(scaledUJ < normalUJ);
+    CHECK(scaledUs <= normalUs + SIM_PLL_LOCK_US * 2);
+    JDelete(req);
+    return (double) normalUJ / scaledUJ;
+}
+
+int main() {
+    notecardBegin(handler);
+    NoteSetFn(malloc, free, delay, millis);
+    NoteSetFnSerial(notecardSerialReset, simTransmit, simAvailable, simReceive);
+    NoteSetFnPhase(simPhaseHook);
+
+    // The first transaction resets the serial link, which isn't what's being measured
+    CHECK(NoteRequest(NoteNewRequest("card.version")));
+
+    printf("clock: energy per transaction at 16MHz throughout, and with the clock scaled to each phase\n");
+
+    // A small request, whose time is almost all spent waiting on the bus
+    J *req = NoteNewRequest("note.add");
+    J *body = JCreateObject();
+    JAddNumberToObject(body, "temp", 21.5);
+    JAddNumberToObject(body, "count", 7);
+    JAddItemToObject(req, "body", body);
+    CHECK(compare("small note.add", req) >= 4);
+
+    // A request with a longer response
+    CHECK(compare("card.status", NoteNewRequest("card.status")) >= 4);
+
+    // A request long enough to be sent in segments, with pauses between them
+    req = NoteNewRequest("note.add");
+    body = JCreateObject();
+    for (int i=0; i<40; i++) {
+        char name[24];
+        snprintf(name, sizeof(name), "reading%d", i);
+        JAddNumberToObject(body, name, 1000.25 + i);
+    }
+    JAddItemToObject(req, "body", body);
+    CHECK(compare("segmented note.add", req) >= 4);
+
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+    return TEST_RESULT("clock");
+}
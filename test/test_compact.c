@@ -0,0 +1,201 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of the compact J node layout (NOTE_JCOMPACT), which has no prev link and keeps a node's string and
+// number in the same storage, so that its predecessor is found by walking its parent's children, and its
+// value is only valid for its type.  Items are detached, inserted and replaced at the start, middle and end
+// of arrays and objects, and values are read back through every accessor.  Built with NOTE_FLOAT, as the
+// firmware is, which selects the compact layout, and again with NOTE_JFULL for the standard layout, which
+// must behave identically.  Each build also reports the heap taken by the documents in corpus, per node, as
+// measured on the host, whose pointers are twice the size of the M0+'s.
+
+#include <glob.h>
+#include <stdlib.h>
+#include "n_lib.h"
+#include "test.h"
+
+#ifdef NOTE_JCOMPACT
+#define TEST_NAME       "compact"
+#else
+#define TEST_NAME       "compact (full layout)"
+#endif
+
+// Check that a tree prints as expected, and that it is intact when walked forwards
+static void expect(J *tree, const char *expected) {
+    char *text = JPrintUnformatted(tree);
+    CHECK(text != NULL && strcmp(text, expected) == 0);
+    if (text != NULL && strcmp(text, expected) != 0)
+        printf("  got %s, expected %s\n", text, expected);
+    JFree(text);
+    int count = 0;
+    for (J *item = tree->child; item != NULL; item = item->next)
+        count++;
+    CHECK(count == JGetArraySize(tree));
+}
+
+static J *numbers(int count) {
+    J *array = JCreateArray();
+    for (int i=0; i<count; i++)
+        JAddItemToArray(array, JCreateNumber(i));
+    return array;
+}
+
+static void testArrays() {
+
+    // Detaching from the end, the start and the middle
+    J *array = numbers(5);
+    J *item = JDetachItemFromArray(array, 4);
+    CHECK(item != NULL && JNumberValue(item) == 4 && item->next == NULL);
+    JDelete(item);
+    expect(array, "[0,1,2,3]");
+    JDelete(JDetachItemFromArray(array, 0));
+    expect(array, "[1,2,3]");
+    JDeleteItemFromArray(array, 1);
+    expect(array, "[1,3]");
+    CHECK(JDetachItemFromArray(array, 2) == NULL && JDetachItemFromArray(array, -1) == NULL);
+    JDeleteItemFromArray(array, 0);
+    JDeleteItemFromArray(array, 0);
+    expect(array, "[]");
+    CHECK(array->child == NULL);
+
+    // Inserting at the start, the middle and the end, and past the end, which appends
+    JInsertItemInArray(array, 0, JCreateNumber(2));
+    JInsertItemInArray(array, 0, JCreateNumber(0));
+    JInsertItemInArray(array, 1, JCreateNumber(1));
+    JInsertItemInArray(array, 3, JCreateNumber(3));
+    JInsertItemInArray(array, 10, JCreateNumber(4));
+    expect(array, "[0,1,2,3,4]");
+
+    // Replacing the start, the middle and the end, in place
+    JReplaceItemInArray(array, 0, JCreateString("a"));
+    JReplaceItemInArray(array, 2, JCreateString("c"));
+    JReplaceItemInArray(array, 4, JCreateString("e"));
+    expect(array, "[\"a\",1,\"c\",3,\"e\"]");
+    CHECK(JReplaceItemViaPointer(array, JGetArrayItem(array, 1), JCreateBool(true)));
+    CHECK(JReplaceItemViaPointer(array, JGetArrayItem(array, 3), JCreateNull()));
+    expect(array, "[\"a\",true,\"c\",null,\"e\"]");
+
+    // Moving the last item to the front, by detaching it and inserting it
+    item = JDetachItemViaPointer(array, JGetArrayItem(array, 4));
+    JInsertItemInArray(array, 0, item);
+    expect(array, "[\"e\",\"a\",true,\"c\",null]");
+    JDelete(array);
+}
+
+static void testObjects() {
+    J *object = JCreateObject();
+    JAddNumberToObject(object, "a", 1);
+    JAddStringToObject(object, "b", "two");
+    JAddNumberToObject(object, "c", 3);
+    JAddBoolToObject(object, "d", false);
+    expect(object, "{\"a\":1,\"b\":\"two\",\"c\":3,\"d\":false}");
+
+    // Detaching by name from the middle, the end and the start
+    J *item = JDetachItemFromObject(object, "b");
+    CHECK(item != NULL && strcmp(JStringValue(item), "two") == 0 && item->next == NULL);
+    JDelete(item);
+    expect(object, "{\"a\":1,\"c\":3,\"d\":false}");
+    JDeleteItemFromObject(object, "d");
+    JDeleteItemFromObjectCaseSensitive(object, "a");
+    expect(object, "{\"c\":3}");
+    CHECK(JDetachItemFromObject(object, "missing") == NULL);
+
+    // Replacing by name keeps the position, and renames the replacement
+    JAddNumberToObject(object, "e", 5);
+    JAddNumberToObject(object, "f", 6);
+    JReplaceItemInObject(object, "e", JCreateString("five"));
+    JReplaceItemInObjectCaseSensitive(object, "c", JCreateNumber(30));
+    JReplaceItemInObject(object, "f", JCreateObject());
+    expect(object, "{\"c\":30,\"e\":\"five\",\"f\":{}}");
+
+    // A duplicate is deep and independent
+    J *copy = JDuplicate(object, true);
+    JDeleteItemFromObject(object, "e");
+    expect(copy, "{\"c\":30,\"e\":\"five\",\"f\":{}}");
+    expect(object, "{\"c\":30,\"f\":{}}");
+    JDelete(copy);
+    JDelete(object);
+}
+
+// The value of a node is read only through the accessor for its type
+static void testValues() {
+    J *number = JCreateNumber(-42.5);
+    J *string = JCreateString("hello");
+    J *integer = JCreateNumber(0);
+    CHECK(JNumberValue(number) == -42.5 && JStringValue(number) == NULL);
+    CHECK(JNumberValue(string) == 0 && strcmp(JStringValue(string), "hello") == 0);
+    JSetIntValue(integer, 7);
+    CHECK(JNumberValue(integer) == 7);
+    JSetNumberValue(integer, 123456);
+    CHECK(JNumberValue(integer) == 123456);
+    J *object = JCreateObject();
+    JAddItemToObject(object, "n", number);
+    JAddItemToObject(object, "s", string);
+    JAddItemToObject(object, "i", integer);
+    CHECK(JGetInt(object, "n") == -42 && JGetInt(object, "i") == 123456 && JGetInt(object, "s") == 0);
+    CHECK(JGetNumber(object, "s") == 0 && strcmp(JGetString(object, "n"), "") == 0);
+
+    // Replacing a string with a number, and back, frees the string and nothing else
+    JReplaceItemInObject(object, "s", JCreateNumber(1));
+    JReplaceItemInObject(object, "n", JCreateString("x"));
+    expect(object, "{\"n\":\"x\",\"s\":1,\"i\":123456}");
+    JDelete(object);
+}
+
+// The nodes in a tree
+static int nodes(J *item) {
+    int count = 0;
+    for (; item != NULL; item = item->next)
+        count += 1 + nodes(item->child);
+    return count;
+}
+
+// The heap taken by each of the documents in corpus once parsed
+static void measure() {
+    glob_t docs;
+    if (glob("corpus/*.json", 0, NULL, &docs) != 0) {
+        printf("%s: no corpus to measure\n", TEST_NAME);
+        return;
+    }
+    printf("%s: %d-byte nodes, heap taken by the corpus once parsed, excluding the allocator's headers\n", TEST_NAME, (int) sizeof(J));
+    int totalNodes = 0;
+    uint32_t totalBytes = 0;
+    for (size_t d=0; d<docs.gl_pathc; d++) {
+        FILE *f = fopen(docs.gl_pathv[d], "rb");
+        if (f == NULL)
+            continue;
+        char text[4096];
+        size_t len = fread(text, 1, sizeof(text) - 1, f);
+        text[len] = '\0';
+        fclose(f);
+        NoteMemStats before, after;
+        NoteGetMemStats(&before);
+        J *json = JParse(text);
+        NoteGetMemStats(&after);
+        CHECK(json != NULL);
+        if (json == NULL)
+            continue;
+        int count = nodes(json);
+        uint32_t bytes = after.liveBytes - before.liveBytes;
+        printf("  %-22s %4d nodes %6u bytes\n", docs.gl_pathv[d], count, (unsigned) bytes);
+        totalNodes += count;
+        totalBytes += bytes;
+        JDelete(json);
+    }
+    globfree(&docs);
+    if (totalBytes != 0)
+        printf("  %-22s %4d nodes %6u bytes, %.1f nodes per KB\n", "all", totalNodes, (unsigned) totalBytes, totalNodes * 1024.0 / totalBytes);
+}
+
+int main() {
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    testArrays();
+    testObjects();
+    testValues();
+    measure();
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+    return TEST_RESULT(TEST_NAME);
+}
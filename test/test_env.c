@@ -0,0 +1,110 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of note-c's cache of environment variables (n_helpers.c) against a simulated Notecard: an app that
+// reads ten tunables and one unset variable every 15 seconds, first directly and then from the cache, with
+// a variable modified partway through.  The time of the last modification isn't a multiple of a float's
+// precision at that magnitude, so that it is only answered with {env-not-modified} if it is carried exactly.
+
+#include "notecard.h"
+#include "test.h"
+
+#define TUNABLES        10
+#define LOOPS           100
+#define LOOP_MS         15000
+#define MODIFIED        1700000123UL
+
+#ifdef NOTE_FLOAT
+#define TEST_NAME       "env (float)"
+#else
+#define TEST_NAME       "env"
+#endif
+
+static uint32_t modifiedTime = MODIFIED;
+static int modifiedValue = 1;
+static int fetches = 0, unmodified = 0;
+
+// The time that a request asks about, read from its text, because a JNUMBER that is a float can't hold it
+static uint32_t requestTime() {
+    const char *time = strstr(notecardTx, "\"time\":");
+    return time == NULL ? 0 : (uint32_t) strtoul(time + 7, NULL, 10);
+}
+
+static char *handler(J *req) {
+    if (!JIsExactString(req, "req", "env.get"))
+        return notecardText("{}");
+    char *rsp = malloc(1024);
+    if (JIsPresent(req, "name")) {
+        const char *name = JGetString(req, "name");
+        if (strncmp(name, "tune", 4) == 0 && atoi(&name[4]) < TUNABLES)
+            sprintf(rsp, "{\"text\":\"%d\"}", atoi(&name[4]) == 0 ? modifiedValue : atoi(&name[4]));
+        else
+            strcpy(rsp, "{}");
+        return rsp;
+    }
+    uint32_t since = requestTime();
+    if (since != 0 && since >= modifiedTime) {
+        unmodified++;
+        strcpy(rsp, "{\"err\":\"environment hasn't been modified {env-not-modified}\"}");
+        return rsp;
+    }
+    fetches++;
+    int len = sprintf(rsp, "{\"body\":{");
+    for (int i=0; i<TUNABLES; i++)
+        len += sprintf(&rsp[len], "%s\"tune%d\":\"%d\"", i == 0 ? "" : ",", i, i == 0 ? modifiedValue : i);
+    sprintf(&rsp[len], "},\"time\":%lu}", (unsigned long) modifiedTime);
+    return rsp;
+}
+
+// A loop of the app, returning the sum of what it read
+static int readTunables(bool cached) {
+    int sum = 0;
+    for (int i=0; i<=TUNABLES; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "tune%d", i);
+        char value[16];
+        if (cached)
+            NoteGetEnvST(name, "-1", value, sizeof(value));
+        else
+            NoteGetEnv(name, "-1", value, sizeof(value));
+        sum += atoi(value);
+    }
+    return sum;
+}
+
+static int run(bool cached) {
+    modifiedTime = MODIFIED;
+    modifiedValue = 1;
+    fetches = unmodified = 0;
+    int requestsWere = notecardRequests;
+    for (int loop=0; loop<LOOPS; loop++) {
+        if (loop == LOOPS/2) {
+            modifiedTime += 700;
+            modifiedValue = 100;
+        }
+        int sum = readTunables(cached);
+        int expected = (TUNABLES-1) * TUNABLES / 2 + modifiedValue - 1;
+        // From the cache, a modification is only seen once the next check is due
+        bool stale = (cached && loop >= LOOPS/2 && loop < LOOPS/2 + NOTE_ENV_CHECK_SECS*1000/LOOP_MS);
+        CHECK(sum == expected || (stale && sum == expected - modifiedValue + 1));
+        notecardMs += LOOP_MS;
+    }
+    return notecardRequests - requestsWere;
+}
+
+int main() {
+    notecardBegin(handler);
+    int direct = run(false);
+    int cached = run(true);
+    printf("%s: %d transactions read directly, %d from the cache, of which %d fetched the variables and %d found them unmodified\n",
+           TEST_NAME, direct, cached, fetches, unmodified);
+    CHECK(direct == LOOPS * (TUNABLES + 1));
+    CHECK(cached <= LOOPS * LOOP_MS / (NOTE_ENV_CHECK_SECS * 1000) + 1);
+    CHECK(fetches == 2);
+    CHECK(unmodified == cached - fetches);
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+    return TEST_RESULT(TEST_NAME);
+}
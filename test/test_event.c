@@ -0,0 +1,169 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of the event flags and the ISR event queue in Src/event.c, with a thread standing in for the ISRs.
+// Each simulated interrupt runs between irqEnter() and irqExit(), so that it is held off while the app has
+// interrupts masked, as it would be on the M0+.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include "main.h"
+#include "event.h"
+#include "test.h"
+
+#define FLAG_ROUNDS     20000
+#define QUEUE_RECORDS   200000
+#define QUEUE_BURST     (EVENT_QUEUE_DEPTH * 3)
+
+// The hardware and the modules that event.c uses, which these tests don't exercise
+static atomic_uint simMs = 0;
+uint32_t MY_TimerMs() { return atomic_load(&simMs); }
+long unsigned int millis() { return atomic_load(&simMs); }
+void delay(uint32_t ms) { usleep(ms); }
+bool MY_Debug() { return true; }
+void MY_Sleep_DeInit() {}
+bool timebaseSetDeadline(uint32_t ms) { return false; }
+void timebaseCancelDeadline() {}
+void clockSet(int mode) {}
+int clockMode() { return CLOCK_NORMAL; }
+static const powerModel stop1 = { .retainsState = true };
+const powerModel *powerModelOf(int mode) { return &stop1; }
+int powerSelect(uint32_t sleepMs, uint32_t needs) { return POWER_STOP1; }
+bool powerSuspend(int mode, uint32_t sleepMs) { return false; }
+void powerAccount(int mode, uint32_t ms) {}
+
+// Raise a simulated interrupt that sets a flag
+static void isrEvent(uint32_t e) {
+    irqEnter();
+    event(e);
+    irqExit();
+}
+
+// Raise a simulated interrupt that posts a record
+static bool isrPost(uint32_t e, uint32_t data) {
+    irqEnter();
+    bool queued = eventPost(e, data);
+    irqExit();
+    return queued;
+}
+
+// The ISR sets EVENT_BUTTON and waits for the app to see it, while the app keeps setting and clearing
+// EVENT_ATTN.  A read-modify-write by the app that wasn't atomic would sooner or later undo the ISR's
+// write, and the ISR would wait in vain.
+static atomic_int flagsSeen = 0;
+static atomic_int flagsLost = 0;
+static void *flagISR(void *arg) {
+    for (int i=0; i<FLAG_ROUNDS; i++) {
+        int seen = atomic_load(&flagsSeen);
+        isrEvent(EVENT_BUTTON);
+        struct timespec start, now;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do {
+            sched_yield();
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        } while (atomic_load(&flagsSeen) == seen && now.tv_sec - start.tv_sec < 2);
+        if (atomic_load(&flagsSeen) == seen) {
+            atomic_fetch_add(&flagsLost, 1);
+            atomic_fetch_add(&flagsSeen, 1);
+        }
+    }
+    return NULL;
+}
+
+// The ISR posts a stream of numbered records in bursts, some larger than the queue, while the app drains
+static atomic_int postsDone = 0;
+static atomic_uint postsQueued = 0;
+static void *queueISR(void *arg) {
+    uint32_t seq = 0;
+    while (seq < QUEUE_RECORDS) {
+        int burst = 1 + (seq % QUEUE_BURST);
+        for (int i=0; i<burst && seq < QUEUE_RECORDS; i++) {
+            atomic_fetch_add(&simMs, 1);
+            if (isrPost(EVENT_BUTTON, seq++))
+                atomic_fetch_add(&postsQueued, 1);
+        }
+        usleep(1);
+    }
+    atomic_store(&postsDone, 1);
+    return NULL;
+}
+
+static void *lateISR(void *arg) {
+    usleep(20000);
+    isrPost(EVENT_ATTN, 7);
+    return NULL;
+}
+
+int main() {
+    pthread_t isr;
+
+    // Flags set by an ISR are never lost to the app's own updates of other flags
+    pthread_create(&isr, NULL, flagISR, NULL);
+    while (atomic_load(&flagsSeen) < FLAG_ROUNDS) {
+        event(EVENT_ATTN);
+        eventClear(EVENT_ATTN);
+        if ((eventOccurred() & EVENT_BUTTON) != 0) {
+            eventClear(EVENT_BUTTON);
+            atomic_fetch_add(&flagsSeen, 1);
+        }
+        sched_yield();
+    }
+    pthread_join(isr, NULL);
+    CHECK(atomic_load(&flagsLost) == 0);
+    eventClear(0xFFFFFFFF);
+
+    // A burst larger than the queue keeps the oldest records and counts the rest as dropped, but the flag
+    // is set regardless
+    for (int i=0; i<EVENT_QUEUE_DEPTH+5; i++)
+        isrPost(EVENT_BUTTON, i);
+    CHECK(eventDropped() == 5);
+    CHECK((eventOccurred() & EVENT_BUTTON) != 0);
+    eventRecord rec;
+    int got = 0;
+    while (eventGet(&rec)) {
+        CHECK(rec.data == (uint32_t) got && rec.event == EVENT_BUTTON);
+        got++;
+    }
+    CHECK(got == EVENT_QUEUE_DEPTH);
+    eventClear(0xFFFFFFFF);
+
+    // Drained concurrently with an ISR posting bursts, every record that was queued arrives once, in order,
+    // with nondecreasing timestamps
+    uint32_t droppedBefore = eventDropped();
+    pthread_create(&isr, NULL, queueISR, NULL);
+    uint32_t received = 0;
+    int64_t lastData = -1;
+    uint32_t lastMs = 0;
+    bool ordered = true;
+    while (true) {
+        bool done = atomic_load(&postsDone);
+        while (eventGet(&rec)) {
+            if ((int64_t) rec.data <= lastData || rec.ms < lastMs)
+                ordered = false;
+            lastData = rec.data;
+            lastMs = rec.ms;
+            received++;
+        }
+        if (done)
+            break;
+    }
+    pthread_join(isr, NULL);
+    uint32_t dropped = eventDropped() - droppedBefore;
+    printf("event queue: %u records posted in bursts of up to %d, %u received, %u dropped\n", QUEUE_RECORDS, QUEUE_BURST, received, dropped);
+    CHECK(ordered);
+    CHECK(received == atomic_load(&postsQueued));
+    CHECK(received + dropped == QUEUE_RECORDS);
+    eventClear(0xFFFFFFFF);
+
+    // Waiting for an event returns when an ISR posts it
+    pthread_create(&isr, NULL, lateISR, NULL);
+    CHECK(eventWait(EVENT_ATTN, 0));
+    pthread_join(isr, NULL);
+    CHECK(eventGet(&rec) && rec.event == EVENT_ATTN && rec.data == 7);
+
+    return TEST_RESULT("event");
+}
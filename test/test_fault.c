@@ -0,0 +1,287 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of note-c's recovery from failed transactions (n_request.c), over both serial and I2C, against a
+// simulated Notecard that can be made to fail a request in each of the ways that a real bus and card do.
+// The Notecard of notecard.h answers at once and never fails, so this test has its own, whose replies take
+// time to arrive.  Each request carries a sequence number, so that the card can count the times that each
+// was done, and the host can tell whether the transaction after a failure is back in step.
+
+#include <stdlib.h>
+#include "n_lib.h"
+#include "test.h"
+
+#define I2C_MAX             30
+#define REPLY_MS            20
+#define BUSY_MS             12000   // Longer than a transaction waits, but less than two
+#define SEQUENCES           64
+
+// The failures that can be made to happen to the next request
+enum {
+    FAULT_NONE,
+    FAULT_BUSY,         // The reply comes too late for the first read of it
+    FAULT_PARTIAL,      // The reply stops halfway
+    FAULT_GARBLED,      // The reply can't be parsed
+    FAULT_SEND,         // I2C: the first chunk of the request fails, having been half sent
+    FAULT_SEND_END,     // I2C: the last chunk fails, having sent all of the body but its newline
+    FAULT_POLL,         // I2C: the first poll for the reply fails
+    FAULT_DEAD,         // The card doesn't answer again until it's reset
+};
+
+static int fault = FAULT_NONE;
+static unsigned long nowMs = 0;
+static char line[4096];
+static size_t lineLen = 0;
+static char queue[8192];
+static size_t queueHead = 0, queueLen = 0;
+static unsigned long queueReadyMs = 0;
+static int done[SEQUENCES];
+static int rejected = 0;
+static int cardResets = 0;
+static int nextSeq = 1;
+
+// Queue bytes for the host to receive, from a given time
+static void cardQueue(const char *text, size_t len, unsigned long readyMs) {
+    memcpy(&queue[queueLen], text, len);
+    queueLen += len;
+    queueReadyMs = readyMs;
+}
+
+// Do a line that the card has received in full, rejecting one that isn't exactly one request
+static void cardLine() {
+    line[lineLen] = '\0';
+    lineLen = 0;
+    if (fault == FAULT_DEAD)
+        return;
+    if (line[0] == '\0') {
+        cardQueue("\r\n", 2, nowMs);
+        return;
+    }
+    J *req = JParseWithOpts(line, NULL, true);
+    if (req == NULL) {
+        rejected++;
+        const char *err = "{\"err\":\"unrecognized request\"}\r\n";
+        cardQueue(err, strlen(err), nowMs + REPLY_MS);
+        return;
+    }
+    int seq = JGetInt(req, "seq");
+    done[seq % SEQUENCES]++;
+    JDelete(req);
+    char rsp[64];
+    snprintf(rsp, sizeof(rsp), "{\"seq\":%d}\r\n", seq);
+    int f = fault;
+    if (f != FAULT_SEND && f != FAULT_SEND_END && f != FAULT_POLL)
+        fault = FAULT_NONE;
+    if (f == FAULT_BUSY)
+        cardQueue(rsp, strlen(rsp), nowMs + BUSY_MS);
+    else if (f == FAULT_PARTIAL)
+        cardQueue(rsp, strlen(rsp) / 2, nowMs + REPLY_MS);
+    else if (f == FAULT_GARBLED)
+        cardQueue("{\"seq\"::}\r\n", 11, nowMs + REPLY_MS);
+    else
+        cardQueue(rsp, strlen(rsp), nowMs + REPLY_MS);
+}
+
+static void cardReceive(const uint8_t *data, size_t len) {
+    for (size_t i=0; i<len; i++) {
+        if (data[i] == '\n')
+            cardLine();
+        else if (data[i] != '\r')
+            line[lineLen++] = (char) data[i];
+    }
+}
+
+static bool cardAvailable() {
+    return queueHead < queueLen && nowMs >= queueReadyMs;
+}
+
+static char cardSend() {
+    char ch = queue[queueHead++];
+    if (queueHead == queueLen)
+        queueHead = queueLen = 0;
+    return ch;
+}
+
+// Resetting the port is what brings a dead card back
+static void cardReset() {
+    cardResets++;
+    if (fault == FAULT_DEAD)
+        fault = FAULT_NONE;
+}
+
+// The serial hooks
+static bool serialReset() {
+    cardReset();
+    return true;
+}
+
+static void serialTransmit(uint8_t *data, size_t len, bool flush) {
+    (void) flush;
+    cardReceive(data, len);
+}
+
+// The I2C hooks, which take the place of the card's framing of chunks
+static bool i2cReset(uint16_t address) {
+    (void) address;
+    cardReset();
+    return true;
+}
+
+static const char *i2cTransmit(uint16_t address, uint8_t *data, uint16_t len) {
+    (void) address;
+    bool last = (len > 0 && data[len-1] == '\n');
+    if ((fault == FAULT_SEND && lineLen == 0) || (fault == FAULT_SEND_END && last)) {
+        cardReceive(data, fault == FAULT_SEND ? len / 2 : len - 1u);
+        fault = FAULT_NONE;
+        return "i2c: write error";
+    }
+    cardReceive(data, len);
+    return NULL;
+}
+
+static const char *i2cReceive(uint16_t address, uint8_t *data, uint16_t len, uint32_t *available) {
+    (void) address;
+    if (fault == FAULT_POLL && len == 0) {
+        fault = FAULT_NONE;
+        return "i2c: incorrect amount of data";
+    }
+    for (int i=0; i<len; i++)
+        data[i] = (uint8_t) cardSend();
+    *available = cardAvailable() ? (uint32_t) (queueLen - queueHead) : 0;
+    return NULL;
+}
+
+// The platform hooks
+static void delayMs(uint32_t ms) {
+    nowMs += ms;
+}
+
+static long unsigned int getMs() {
+    return nowMs;
+}
+
+// Do a request long enough to take several I2C chunks, returning its sequence number if the reply was
+// the one to it, -1 if the transaction failed, or -2 if the reply was to some other request
+static int transact() {
+    int seq = nextSeq++;
+    J *req = NoteNewRequest("note.add");
+    JAddNumberToObject(req, "seq", seq);
+    J *body = JCreateObject();
+    JAddNumberToObject(body, "temp", 21);
+    JAddNumberToObject(body, "humid", 40);
+    JAddItemToObject(req, "body", body);
+    J *rsp = NoteRequestResponse(req);
+    int result = -2;
+    if (rsp == NULL || JIsPresent(rsp, "err"))
+        result = -1;
+    else if (JGetInt(rsp, "seq") == seq)
+        result = seq;
+    NoteDeleteResponse(rsp);
+    return result;
+}
+
+// Make the next request fail, and check that it was recovered from, or not, as it should have been, and
+// that the transaction after it is in step
+static void faulted(const char *name, int f, bool recovers) {
+    NoteClearFaultStats();
+    unsigned long startMs = nowMs;
+    fault = f;
+    int seq = nextSeq;
+    int result = transact();
+    NoteFaultStats stats;
+    NoteGetFaultStats(&stats);
+    printf("%-8s %s after %lums, %u resends, %u rereads, %u resyncs, %u resets\n", name, result > 0 ? "recovered" : "failed",
+           nowMs - startMs, (unsigned) stats.resends, (unsigned) stats.rereads, (unsigned) stats.resyncs, (unsigned) stats.resets);
+    CHECK((result == seq) == recovers);
+    CHECK(done[seq % SEQUENCES] <= 1);
+    CHECK(transact() > 0);
+}
+
+static void run(bool i2c) {
+    fault = FAULT_NONE;
+    queueHead = queueLen = lineLen = 0;
+    if (i2c)
+        NoteSetFnI2C(NOTE_I2C_ADDR_DEFAULT, I2C_MAX, i2cReset, i2cTransmit, i2cReceive);
+    else
+        NoteSetFnSerial(serialReset, serialTransmit, cardAvailable, cardSend);
+    NoteResetRequired();
+    printf("%s:\n", i2c ? "i2c" : "serial");
+    CHECK(transact() > 0);
+
+    // A reply that's late is read again, and one that stops partway or is garbled is drained, without a
+    // full reset, and within a little more than the quiet interval that the drain waits for
+    faulted("busy", FAULT_BUSY, true);
+    NoteFaultStats stats;
+    NoteGetFaultStats(&stats);
+    CHECK(stats.rereads == 1 && stats.resets == 0);
+    faulted("partial", FAULT_PARTIAL, false);
+    faulted("garbled", FAULT_GARBLED, false);
+    NoteGetFaultStats(&stats);
+    CHECK(stats.faults[NOTE_FAULT_DESYNC] == 1 && stats.resyncs == 1 && stats.resets == 0);
+    CHECK(stats.recoveryMs < 2 * NOTE_RESYNC_QUIET_MS);
+
+    // Replies that are garbled time after time lead to a full reset, even though each was read in full
+    NoteClearFaultStats();
+    int resetsWere = cardResets;
+    for (int i=0; i<NOTE_RETRY_ESCALATE; i++) {
+        fault = FAULT_GARBLED;
+        CHECK(transact() == -1);
+    }
+    NoteGetFaultStats(&stats);
+    CHECK(stats.resets == 1);
+    CHECK(transact() > 0);
+    CHECK(cardResets > resetsWere);
+
+    if (i2c) {
+
+        // A request cut off before the end of its body is rejected by the card and sent again, and done once
+        int rejectedWere = rejected;
+        faulted("send", FAULT_SEND, true);
+        NoteGetFaultStats(&stats);
+        CHECK(stats.resends == 1 && rejected == rejectedWere + 1);
+
+        // One whose body the card may have got in full is never sent again, nor ended so that it's done
+        int seq = nextSeq;
+        fault = FAULT_SEND_END;
+        NoteClearFaultStats();
+        CHECK(transact() == -1);
+        NoteGetFaultStats(&stats);
+        CHECK(stats.resends == 0);
+        CHECK(done[seq % SEQUENCES] == 0);
+        transact();
+        CHECK(done[seq % SEQUENCES] == 0);
+        CHECK(transact() > 0);
+
+        // A failed poll for a reply that hadn't begun is simply read again
+        faulted("poll", FAULT_POLL, true);
+        NoteGetFaultStats(&stats);
+        CHECK(stats.rereads == 1 && stats.resyncs == 0);
+
+    }
+
+    // A card that has stopped answering is reset once draining hasn't brought it back
+    NoteClearFaultStats();
+    fault = FAULT_DEAD;
+    resetsWere = cardResets;
+    for (int i=0; i<NOTE_RETRY_ESCALATE; i++)
+        CHECK(transact() == -1);
+    NoteGetFaultStats(&stats);
+    CHECK(stats.resets == 1);
+    CHECK(transact() > 0);
+    CHECK(cardResets > resetsWere);
+
+    // No request was ever done twice
+    for (int i=0; i<SEQUENCES; i++)
+        CHECK(done[i] <= 1);
+}
+
+int main() {
+    NoteSetFnDefault(malloc, free, delayMs, getMs);
+    run(false);
+    run(true);
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+    return TEST_RESULT("fault");
+}
@@ -0,0 +1,148 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of note-c's delivery of inbound notes (n_inbound.c) against a simulated Notecard that holds a queue
+// of notes in each of its Notefiles, and that can be made to fail to get the notes of one of them.
+
+#include "notecard.h"
+#include "test.h"
+
+#define FILES           3
+
+static const char * const files[FILES] = { "commands.qi", "config.qi", "firmware.qi" };
+static int queued[FILES], next[FILES];
+static int armed = 0, changes = 0, gets = 0;
+static bool armFirst = false, failChanges = false;
+static int failing = -1;
+
+static int fileIndex(const char *file) {
+    for (int i=0; i<FILES; i++)
+        if (strcmp(files[i], file) == 0)
+            return i;
+    return -1;
+}
+
+static char *handler(J *req) {
+    if (JIsExactString(req, "req", "card.attn")) {
+        CHECK(JIsExactString(req, "mode", "arm,files"));
+        armed++;
+        armFirst = (changes == 0 && gets == 0);
+        return notecardText("{}");
+    }
+    char *rsp = malloc(256);
+    if (JIsExactString(req, "req", "file.changes")) {
+        CHECK(armed > 0);
+        changes++;
+        if (failChanges) {
+            strcpy(rsp, "{\"err\":\"file-changes: io error\"}");
+            return rsp;
+        }
+        int len = sprintf(rsp, "{\"total\":0,\"info\":{");
+        J *names = JGetObjectItem(req, "files");
+        for (int i=0; i<JGetArraySize(names); i++) {
+            int f = fileIndex(JStringValue(JGetArrayItem(names, i)));
+            if (f >= 0 && queued[f] > 0)
+                len += sprintf(&rsp[len], "%s\"%s\":{\"total\":%d}", len > 19 ? "," : "", files[f], queued[f]);
+        }
+        strcpy(&rsp[len], "}}");
+    } else if (JIsExactString(req, "req", "note.get")) {
+        gets++;
+        int f = fileIndex(JGetString(req, "file"));
+        CHECK(f >= 0 && JGetBool(req, "delete"));
+        if (f == failing)
+            strcpy(rsp, "{\"err\":\"note-get: io error\"}");
+        else if (f < 0 || queued[f] == 0)
+            strcpy(rsp, "{\"err\":\"no note is available {note-noexist}\"}");
+        else {
+            queued[f]--;
+            sprintf(rsp, "{\"body\":{\"seq\":%d}}", next[f]++);
+        }
+    } else {
+        strcpy(rsp, "{}");
+    }
+    return rsp;
+}
+
+// Each handler checks that its notes arrive in order, and counts them
+static int handled[FILES], expected[FILES];
+
+static void inbound(const char *file, J *note, void *context) {
+    int f = (int) (intptr_t) context;
+    CHECK(strcmp(file, files[f]) == 0);
+    CHECK(JGetInt(JGetObject(note, "body"), "seq") == expected[f]++);
+    handled[f]++;
+}
+
+// A drain, returning what it delivered and checking that it cost a transaction per note and two more
+static int drain() {
+    int requestsWere = notecardRequests;
+    armed = changes = gets = 0;
+    int delivered = NoteInboundDrain();
+    CHECK(armed == 1 && armFirst);
+    if (delivered >= 0 && failing < 0 && !failChanges)
+        CHECK(notecardRequests - requestsWere == delivered + 2);
+    return delivered;
+}
+
+int main() {
+    notecardBegin(handler);
+
+    // Nothing can be armed or drained until a handler is registered
+    CHECK(!NoteInboundArm());
+    CHECK(NoteInboundDrain() == -1);
+    for (int f=0; f<FILES; f++)
+        CHECK(NoteInboundRegister(files[f], inbound, (void *) (intptr_t) f));
+    CHECK(NoteInboundArm());
+
+    // With nothing waiting, a drain costs only the arm and the changes
+    CHECK(drain() == 0);
+    CHECK(gets == 0);
+
+    // Every note waiting is delivered to its Notefile's handler, in order, with one note.get each
+    queued[0] = 5;
+    queued[2] = 2;
+    CHECK(drain() == 7);
+    CHECK(handled[0] == 5 && handled[1] == 0 && handled[2] == 2 && gets == 7);
+    CHECK(queued[0] == 0 && queued[2] == 0);
+
+    // A Notefile whose notes can't be got stops at its first failure, without stalling the others, and its
+    // notes are delivered by the next drain
+    queued[0] = 3;
+    queued[1] = 4;
+    queued[2] = 1;
+    failing = 1;
+    CHECK(drain() == 4);
+    CHECK(handled[0] == 8 && handled[1] == 0 && handled[2] == 3 && queued[1] == 4);
+    failing = -1;
+    CHECK(drain() == 4);
+    CHECK(handled[1] == 4);
+
+    // Registering a Notefile again replaces its handler, which may be none, in which case its notes are
+    // still deleted
+    CHECK(NoteInboundRegister(files[1], NULL, NULL));
+    queued[1] = 2;
+    CHECK(drain() == 2);
+    CHECK(handled[1] == 4 && queued[1] == 0);
+
+    // A drain that can't learn what is waiting fails, rather than guessing
+    failChanges = true;
+    queued[0] = 1;
+    CHECK(drain() == -1);
+    CHECK(gets == 0 && queued[0] == 1);
+    failChanges = false;
+    CHECK(drain() == 1);
+
+    // There's room for only so many Notefiles
+    static char extra[NOTE_INBOUND_HANDLERS][16];
+    for (int i=FILES; i<NOTE_INBOUND_HANDLERS; i++) {
+        snprintf(extra[i], sizeof(extra[i]), "extra%d.qi", i);
+        CHECK(NoteInboundRegister(extra[i], inbound, NULL));
+    }
+    CHECK(!NoteInboundRegister("toomany.qi", inbound, NULL));
+
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+    return TEST_RESULT("inbound");
+}
@@ -0,0 +1,58 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests that on small MCUs, where the stack is only a kilobyte or so, J and the tape parser both accept
+// documents nested right up to N_CJSON_NESTING_LIMIT, and reject anything deeper, whether parsing it or
+// printing it, rather than overflow the stack.  Built with NOTE_FLOAT, as the firmware is.
+
+#include <stdlib.h>
+#include "n_lib.h"
+#include "test.h"
+
+// A document of arrays nested to the given depth
+static void nested(char *doc, int depth) {
+    for (int i=0; i<depth; i++)
+        *doc++ = '[';
+    *doc++ = '1';
+    for (int i=0; i<depth; i++)
+        *doc++ = ']';
+    *doc = '\0';
+}
+
+int main() {
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    char doc[2 * N_CJSON_NESTING_LIMIT + 8];
+
+    for (int depth=N_CJSON_NESTING_LIMIT-1; depth<=N_CJSON_NESTING_LIMIT+1; depth++) {
+        bool allowed = (depth <= N_CJSON_NESTING_LIMIT);
+
+        // Parsing
+        nested(doc, depth);
+        J *json = JParse(doc);
+        CHECK((json != NULL) == allowed);
+        JDelete(json);
+        JTape *tape = JTapeParse(doc);
+        CHECK((tape != NULL) == allowed);
+        JTapeDelete(tape);
+
+        // Printing a tree built by hand
+        J *root = JCreateArray();
+        J *inner = root;
+        for (int i=1; i<depth; i++) {
+            J *array = JCreateArray();
+            JAddItemToArray(inner, array);
+            inner = array;
+        }
+        char *text = JPrintUnformatted(root);
+        CHECK((text != NULL) == allowed);
+        JFree(text);
+        JDelete(root);
+    }
+
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+
+    return TEST_RESULT("nesting");
+}
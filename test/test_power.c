@@ -0,0 +1,144 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Simulation of the choices made by the energy model in Src/power.c.  Each schedule is a run of identical
+// sleeps, for which the energy spent in the modes chosen is compared with that of always using STOP1, as
+// the example did before the depth of each sleep was chosen.  The points at which the choice moves to a
+// deeper mode, as a sleep gets longer, are also reported, so that a change to the model can be seen.
+// Then the app's state is taken through Standby, whose restart from reset is simulated with a longjmp back
+// to the start of the app's setup, leaving memory as it was, just as SRAM is kept.
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+#include "aggregate.h"
+#include "note.h"
+#include "test.h"
+
+// The hardware
+static jmp_buf simReset;
+static bool simWokeFromStandby = false;
+static unsigned long simMs = 0;
+static uint32_t simResumedMs = 0;
+long unsigned int millis() { return simMs; }
+void delay(uint32_t ms) { simMs += ms; }
+void timebaseResume(uint32_t ms) { simResumedMs = ms; simMs = ms; }
+void MY_PowerStandby(uint32_t ms) {
+    simWokeFromStandby = true;
+    simMs += ms;
+    longjmp(simReset, 1);
+}
+bool MY_PowerWokeFromStandby() {
+    bool woke = simWokeFromStandby;
+    simWokeFromStandby = false;
+    return woke;
+}
+
+static const char *modeName[POWER_MODES] = {"Sleep", "LP Sleep", "STOP0", "STOP1", "Standby", "Off"};
+
+// Run a schedule, returning the mode chosen, and the energy per day spent in it and in STOP1
+static int schedule(const char *label, uint32_t periodMs, uint32_t needs, int cycles, double *ujPerDay, double *stop1UJPerDay) {
+    powerResidency chosen = {0}, stop1 = {0};
+    int mode = -1;
+    for (int i=0; i<cycles; i++) {
+        mode = powerSelect(periodMs, needs);
+        chosen.ms[mode] += periodMs;
+        chosen.entries[mode]++;
+        stop1.ms[POWER_STOP1] += periodMs;
+        stop1.entries[POWER_STOP1]++;
+    }
+    double days = ((double) periodMs * cycles) / (24.0*60*60*1000);
+    *ujPerDay = powerEnergyUJ(&chosen) / days;
+    *stop1UJPerDay = powerEnergyUJ(&stop1) / days;
+    printf("  %-32s %-8s %10.0f uJ/day, STOP1 %10.0f uJ/day (%.1fx)\n", label, modeName[mode], *ujPerDay, *stop1UJPerDay, *stop1UJPerDay / *ujPerDay);
+    return mode;
+}
+
+int main() {
+    double uj, stop1UJ;
+
+    printf("power: cost of a sleep of 1ms, 15s and 15min in each mode\n");
+    for (int mode=0; mode<POWER_MODES; mode++)
+        printf("  %-8s %6u uJ %8u uJ %10u uJ\n", modeName[mode], powerCostUJ(mode, 1), powerCostUJ(mode, 15000), powerCostUJ(mode, 900000));
+
+    printf("power: schedules\n");
+
+    // A short wait while peripherals need their clocks stays out of the STOP modes
+    CHECK(schedule("3ms wait, peripherals running", 3, POWER_NEEDS_CLOCKS, 1000, &uj, &stop1UJ) == POWER_LPSLEEP);
+
+    // A wait too short to repay the cost of going into and out of STOP1 stays in LP Sleep
+    int mode = schedule("3ms wait", 3, 0, 1000, &uj, &stop1UJ);
+    CHECK(mode == POWER_LPSLEEP && uj < stop1UJ);
+
+    // A wait that a button can end can't restart from reset
+    mode = schedule("15s period, button can wake", 15000, POWER_NEEDS_EXTI, 1000, &uj, &stop1UJ);
+    CHECK(powerModelOf(mode)->retainsState && uj <= stop1UJ);
+
+    // Long waits for a timer are where the deeper modes pay
+    mode = schedule("15s period, timer only", 15000, 0, 1000, &uj, &stop1UJ);
+    CHECK(mode == POWER_STANDBY && uj < stop1UJ);
+    mode = schedule("15min period, timer only", 900000, 0, 100, &uj, &stop1UJ);
+    CHECK(mode == (POWER_NOTECARD_OFF ? POWER_OFF : POWER_STANDBY) && uj < stop1UJ / 2);
+
+    // A wait with no deadline can only be ended by an event
+    CHECK(powerModelOf(powerSelect(POWER_FOREVER, 0))->retainsState);
+
+    // As a sleep gets longer, the mode chosen only ever gets deeper
+    printf("power: crossovers, timer only:");
+    int last = -1;
+    bool deeper = true;
+    for (uint32_t ms=0; ms<60*60*1000UL; ms += (ms < 100 ? 1 : ms < 10000 ? 10 : 1000)) {
+        mode = powerSelect(ms, 0);
+        if (mode != last) {
+            printf(" %s at %lums", modeName[mode], (unsigned long) ms);
+            if (mode < last)
+                deeper = false;
+            last = mode;
+        }
+    }
+    printf("\n");
+    CHECK(deeper);
+
+    // The app's state, as the example keeps it
+    static unsigned counter;
+    static aggregator temperature;
+    static const aggregateConfig config = { .windowMs = 60000, .deadband = 0.5 };
+    static volatile int boots = 0;
+    setjmp(simReset);
+    boots++;
+
+    // The app's setup, which initializes its state and then restores it if we woke from Standby
+    counter = 0;
+    aggregateInit(&temperature, &config, simMs);
+    NoteSnapshotRegister(1, &counter, sizeof(counter));
+    NoteSnapshotRegister(2, &temperature, sizeof(temperature));
+    bool restored = powerRestore();
+    if (boots == 1) {
+        CHECK(!restored);
+        counter = 42;
+        aggregateAdd(&temperature, 21.5f, simMs);
+        aggregateAdd(&temperature, 22.5f, simMs + 1000);
+        simMs += 1000;
+        powerSuspend(POWER_STANDBY, 15000);
+        CHECK(false);
+    }
+    powerResidency residency;
+    powerGetResidency(&residency);
+    printf("power: after Standby, restored %d, counter %u, %u samples with mean %.2f, resumed at %lums\n", restored, counter, (unsigned) temperature.count, temperature.mean, (unsigned long) simResumedMs);
+    CHECK(restored && counter == 42 && temperature.count == 2 && temperature.mean == 22.0f);
+    CHECK(simResumedMs == 16000);
+    CHECK(residency.entries[POWER_STANDBY] == 1 && residency.ms[POWER_STANDBY] == 15000);
+
+    // State too large to be kept in SRAM rules out Standby, without counting the sleep
+    static uint8_t large[POWER_SNAPSHOT_LEN];
+    memset(large, 1, sizeof(large));
+    NoteSnapshotRegister(3, large, sizeof(large));
+    large[0] = 2;
+    CHECK(!powerSuspend(POWER_STANDBY, 15000));
+    powerGetResidency(&residency);
+    CHECK(residency.entries[POWER_STANDBY] == 1);
+
+    return TEST_RESULT("power");
+}
@@ -0,0 +1,133 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests that JPrintLength measures exactly what JPrint and JPrintUnformatted print, because the buffer that
+// they print into is allocated at exactly the measured size, so that any difference would overrun it.
+// Random trees of every type are measured and printed, with numbers of every magnitude, strings that need
+// every kind of escape, and nesting up to and beyond N_CJSON_NESTING_LIMIT.  The sanitizers catch an overrun
+// that the comparison alone would miss.  Built both with and without NOTE_FLOAT.
+
+#include <math.h>
+#include <stdlib.h>
+#include "n_lib.h"
+#include "test.h"
+
+#define TREES           20000
+
+#ifdef NOTE_FLOAT
+#define TEST_NAME       "print (float)"
+#else
+#define TEST_NAME       "print"
+#endif
+
+static const JNUMBER numbers[] = { 0, -0.0, 1, -1, 0.5, 1e-7, -3.25e-12, 123456789, 4294967295.0, -2147483648.0,
+                                   1e15, 1.7976931348623157e308, 2.2250738585072014e-308, 3.14159265358979, 1e300 * 10, NAN };
+
+static void randomString(char *text, int maxLen) {
+    static const char pool[] = "abcXYZ09 \"\\/\b\f\n\r\t\x01\x1f\x7f\xc3\xa9";
+    int len = rand() % maxLen;
+    for (int i=0; i<len; i++)
+        text[i] = pool[rand() % (sizeof(pool) - 1)];
+    text[len] = '\0';
+}
+
+static J *randomValue(int depth, int maxDepth) {
+    char text[40];
+    int kind = rand() % (depth < maxDepth ? 9 : 6);
+    switch (kind) {
+    case 0:
+        return JCreateNull();
+    case 1:
+        return JCreateBool(rand() % 2);
+    case 2:
+        return JCreateNumber(numbers[rand() % (sizeof(numbers) / sizeof(numbers[0]))]);
+    case 3:
+        return JCreateNumber((JNUMBER) (rand() - RAND_MAX/2) / (JNUMBER) (1 + rand() % 1000));
+    case 4:
+        randomString(text, sizeof(text));
+        return JCreateString(text);
+    case 5:
+        return JCreateRaw("[1,\"two\"]");
+    case 6:
+    case 7: {
+        J *object = JCreateObject();
+        for (int i=rand() % 5; i>0; i--) {
+            randomString(text, 12);
+            JAddItemToObject(object, text, randomValue(depth+1, maxDepth));
+        }
+        return object;
+    }
+    default: {
+        J *array = JCreateArray();
+        for (int i=rand() % 5; i>0; i--)
+            JAddItemToArray(array, randomValue(depth+1, maxDepth));
+        return array;
+    }
+    }
+}
+
+// Measure and print a tree both ways, returning whether it could be
+static bool check(J *tree) {
+    bool printed = true;
+    for (int format=0; format<2; format++) {
+        int len = JPrintLength(tree, format);
+        char *text = format ? JPrint(tree) : JPrintUnformatted(tree);
+        CHECK((len < 0) == (text == NULL));
+        if (text != NULL) {
+            CHECK((size_t) len == strlen(text));
+            JFree(text);
+        } else {
+            printed = false;
+        }
+    }
+    return printed;
+}
+
+int main() {
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    srand(1);
+
+    // Random trees, most within the nesting limit and some beyond it, which can't be printed
+    int printed = 0;
+    for (int i=0; i<TREES; i++) {
+        J *tree = randomValue(0, 1 + rand() % (N_CJSON_NESTING_LIMIT + 4));
+        if (check(tree))
+            printed++;
+        JDelete(tree);
+    }
+    printf("%s: %d of %d random trees printed, the rest nested too deeply\n", TEST_NAME, printed, TREES);
+    CHECK(printed > TREES / 2);
+
+    // Each number and each character on its own, including those that need escaping as \u00XX
+    for (size_t i=0; i<sizeof(numbers)/sizeof(numbers[0]); i++) {
+        J *number = JCreateNumber(numbers[i]);
+        CHECK(check(number));
+        JDelete(number);
+    }
+    for (int c=1; c<256; c++) {
+        char text[2] = { (char) c, '\0' };
+        J *object = JCreateObject();
+        JAddStringToObject(object, text, text);
+        CHECK(check(object));
+        JDelete(object);
+    }
+
+    // Nesting right up to the limit prints, and one deeper doesn't
+    for (int depth=N_CJSON_NESTING_LIMIT-1; depth<=N_CJSON_NESTING_LIMIT+1; depth++) {
+        J *root = JCreateObject();
+        J *inner = root;
+        for (int i=1; i<depth; i++) {
+            J *child = (i % 2) ? JCreateArray() : JCreateObject();
+            if (JIsArray(inner))
+                JAddItemToArray(inner, child);
+            else
+                JAddItemToObject(inner, "k", child);
+            inner = child;
+        }
+        CHECK(check(root) == (depth <= N_CJSON_NESTING_LIMIT));
+        JDelete(root);
+    }
+
+    return TEST_RESULT(TEST_NAME);
+}
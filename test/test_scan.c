@@ -0,0 +1,91 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Fuzz test of note-c's word-at-a-time scanning kernels in n_scan.c against plain byte-at-a-time
+// equivalents, over random lengths, random alignments, and mixes of bytes chosen to put the byte that
+// ends a scan in every lane of a word.
+
+#include <stdlib.h>
+#include "n_lib.h"
+#include "test.h"
+
+#define FUZZ_ROUNDS     2000000
+#define FUZZ_MAX_LEN    64
+
+// The byte-at-a-time equivalents
+static size_t refPlain(const unsigned char *s) {
+    size_t i = 0;
+    while (s[i] >= 0x20 && s[i] != '"' && s[i] != '\\')
+        i++;
+    return i;
+}
+
+static size_t refWhitespace(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    while (i < len && p[i] <= 0x20)
+        i++;
+    return i;
+}
+
+static size_t refQuote(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    while (i < len && p[i] != '"' && p[i] != '\\')
+        i++;
+    return i;
+}
+
+static bool refIsText(const unsigned char *p, size_t len) {
+    for (size_t i=0; i<len; i++)
+        if (p[i] == 0 || (p[i] & 0x80) != 0)
+            return false;
+    return true;
+}
+
+// Fill a buffer with one of several mixes: any byte at all, letters with an occasional arbitrary byte,
+// whitespace with an occasional letter, or printable text with an occasional arbitrary byte
+static void fill(unsigned char *p, int len, int mix) {
+    for (int i=0; i<len; i++) {
+        int r = rand();
+        switch (mix) {
+        case 0:
+            p[i] = (unsigned char) r;
+            break;
+        case 1:
+            p[i] = (r % 20 == 0) ? (unsigned char) (r >> 8) : 'a' + r % 26;
+            break;
+        case 2:
+            p[i] = (r % 10 == 0) ? 'x' : " \t\r\n"[r % 4];
+            break;
+        default:
+            p[i] = (r % 30 == 0) ? (unsigned char) (r >> 8) : 0x21 + r % 90;
+            break;
+        }
+    }
+}
+
+int main() {
+    static unsigned char buf[FUZZ_MAX_LEN + 16];
+    long mismatches[4] = {0};
+
+    srand(1);
+    for (long round=0; round<FUZZ_ROUNDS; round++) {
+        int len = rand() % FUZZ_MAX_LEN;
+        unsigned char *p = &buf[rand() % 4];
+        fill(p, len + 8, rand() % 4);
+        p[len] = '\0';
+        if (NoteScanPlain(p) != refPlain(p))
+            mismatches[0]++;
+        if (NoteScanWhitespace(p, len) != refWhitespace(p, len))
+            mismatches[1]++;
+        if (NoteScanQuote(p, len) != refQuote(p, len))
+            mismatches[2]++;
+        if (NoteScanIsText(p, len) != refIsText(p, len))
+            mismatches[3]++;
+    }
+    printf("scan: %d random buffers, mismatches plain %ld whitespace %ld quote %ld text %ld\n", FUZZ_ROUNDS, mismatches[0], mismatches[1], mismatches[2], mismatches[3]);
+    for (int i=0; i<4; i++)
+        CHECK(mismatches[i] == 0);
+
+    return TEST_RESULT("scan");
+}
@@ -0,0 +1,132 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of the filtering and calibration of the MCU's own ADC in Src/sensor.c, against a simulated ADC that
+// fills the ring with what a part with given factory calibration values would convert at a given supply
+// voltage, die temperature and input voltage.
+
+#include <stdlib.h>
+#include <string.h>
+#include "main.h"
+#include "sensor.h"
+#include "test.h"
+
+// A part's factory values, as converted at 3.0V: VREFINT at its typical 1.212V, and the temperature sensor
+// at its typical 760mV at 30C
+static const sensorCalibration simCal = { .tsCal1 = 1037, .vrefintCal = 1654 };
+
+// The conditions that the simulated ADC converts
+static int32_t simVddaMv, simTempCentiC, simInputMv;
+static int simStarts = 0, simStops = 0;
+static bool simTriggered = true;
+static uint16_t *simRing;
+static uint32_t simCount;
+static unsigned long simMs = 0;
+
+long unsigned int millis() {
+    return simMs;
+}
+
+void delay(uint32_t ms) {
+    simMs += ms;
+}
+
+// The oversampled conversion of a voltage, with a little noise
+static uint16_t simConvert(double mv) {
+    double counts = mv * SENSOR_FULL_SCALE / simVddaMv + (rand() % 5) - 2;
+    return (uint16_t) (counts < 0 ? 0 : counts > 65535 ? 65535 : counts);
+}
+
+void MY_SensorStart(uint16_t *ring, uint32_t count, uint32_t scanHz) {
+    (void) scanHz;
+    simStarts++;
+    simRing = ring;
+    simCount = count;
+    memset(ring, 0, count * sizeof(uint16_t));
+}
+
+void MY_SensorStop() {
+    simStops++;
+}
+
+// Each idle fills the ring, as the DMA would before its interrupt woke us
+void MY_SensorIdle() {
+    simMs++;
+    if (!simTriggered)
+        return;
+    double vrefintMv = simCal.vrefintCal * (double) SENSOR_CAL_MV / 4095;
+    double tsMv = simCal.tsCal1 * (double) SENSOR_CAL_MV / 4095 + (simTempCentiC - SENSOR_TS_CAL1_C*100) * SENSOR_TS_SLOPE_UV / 100000.0;
+    for (uint32_t i=0; i<simCount; i += SENSOR_CHANNELS) {
+        simRing[i+SENSOR_INPUT] = simConvert(simInputMv);
+        simRing[i+SENSOR_TEMP] = simConvert(tsMv);
+        simRing[i+SENSOR_VREFINT] = simConvert(vrefintMv);
+    }
+    sensorComplete();
+}
+
+void MY_SensorCalibration(sensorCalibration *cal) {
+    *cal = simCal;
+}
+
+int main() {
+
+    // The filter discards the highest and lowest scans, rounds the mean of the rest, and copes with too few
+    uint16_t ring[6*SENSOR_CHANNELS] = {0};
+    uint16_t values[6] = { 1000, 1002, 60000, 1001, 3, 1003 };
+    for (int i=0; i<6; i++)
+        ring[i*SENSOR_CHANNELS + SENSOR_TEMP] = values[i];
+    CHECK(sensorFilter(ring, 6, SENSOR_TEMP) == 1002);
+    CHECK(sensorFilter(ring, 6, SENSOR_INPUT) == 0);
+    CHECK(sensorFilter(ring, 2, SENSOR_TEMP) == 1001);
+    CHECK(sensorFilter(ring, 0, SENSOR_TEMP) == 0);
+    for (int i=0; i<6; i++)
+        ring[i*SENSOR_CHANNELS + SENSOR_VREFINT] = 65535;
+    CHECK(sensorFilter(ring, 6, SENSOR_VREFINT) == 65535);
+
+    // Calibration recovers the conditions across the supply's range, to within a few counts' worth
+    int32_t vddas[] = { 1800, 2400, 3000, 3300, 3600 };
+    int32_t temps[] = { -4000, 0, 2500, 3000, 8500, 12500 };
+    int32_t worstMv = 0, worstCentiC = 0;
+    for (size_t v=0; v<sizeof(vddas)/sizeof(vddas[0]); v++) {
+        for (size_t t=0; t<sizeof(temps)/sizeof(temps[0]); t++) {
+            simVddaMv = vddas[v];
+            simTempCentiC = temps[t];
+            simInputMv = simVddaMv / 3;
+            sensorReading reading;
+            CHECK(sensorSample(&reading));
+            int32_t errMv = abs(reading.vddaMv - simVddaMv);
+            int32_t errCentiC = abs(reading.tempCentiC - simTempCentiC);
+            CHECK(errMv <= 3);
+            CHECK(abs(reading.inputMv - simInputMv) <= 2);
+            CHECK(errCentiC <= 25);
+            if (errMv > worstMv)
+                worstMv = errMv;
+            if (errCentiC > worstCentiC)
+                worstCentiC = errCentiC;
+        }
+    }
+    printf("sensor: worst error %dmV of VDDA and %d.%02dC\n", (int) worstMv, (int) worstCentiC / 100, (int) worstCentiC % 100);
+
+    // A ring with no VREFINT reading yields nothing rather than dividing by zero
+    sensorReading reading = { .raw = { 100, 100, 0 } };
+    sensorCalibrate(&simCal, &reading);
+    CHECK(reading.vddaMv == 0 && reading.tempCentiC == 0 && reading.inputMv == 0);
+
+    // Each sample restarts acquisition and leaves it stopped, unless it was already running
+    int starts = simStarts, stops = simStops;
+    CHECK(sensorSample(&reading));
+    CHECK(simStarts == starts + 1 && simStops == stops + 1);
+    sensorStart();
+    CHECK(sensorSample(&reading));
+    CHECK(simStarts == starts + 3 && simStops == stops + 2);
+    sensorStop();
+
+    // An ADC that is never triggered times out rather than hanging
+    simTriggered = false;
+    unsigned long beganMs = simMs;
+    CHECK(!sensorSample(&reading));
+    CHECK(simMs - beganMs >= SENSOR_TIMEOUT_MS);
+
+    return TEST_RESULT("sensor");
+}
@@ -0,0 +1,88 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of note-c's snapshots of the host's state (n_snapshot.c), held by a simulated Notecard across a
+// sleep, and kept by the host itself in a buffer, including a firmware upgrade that appends a field to a
+// region and snapshots that are damaged or missing.
+
+#include "notecard.h"
+#include "test.h"
+
+// The Notecard holds the payload of a card.attn sleep, and gives it back when asked on waking
+static char held[4096];
+static char *handler(J *req) {
+    if (JIsExactString(req, "cmd", "card.attn") && JIsPresent(req, "payload")) {
+        strlcpy(held, JGetString(req, "payload"), sizeof(held));
+        return NULL;
+    }
+    if (JIsExactString(req, "req", "card.attn") && JGetBool(req, "start")) {
+        char *rsp = malloc(strlen(held) + 64);
+        sprintf(rsp, "{\"payload\":\"%s\",\"time\":1700000000}", held);
+        return rsp;
+    }
+    return notecardText("{}");
+}
+
+// The state of two firmware versions, the second of which appends a field to the first region
+typedef struct { uint32_t count; float mean[8]; } stateV1;
+typedef struct { uint32_t count; float mean[8]; uint16_t added; } stateV2;
+static stateV1 v1;
+static stateV2 v2;
+static uint8_t config[64];
+static uint8_t large[200];
+
+int main() {
+    notecardBegin(handler);
+
+    // Version 1 sleeps with the first region changed, and the others as they were initialized, which are
+    // sent as markers rather than in full
+    memset(config, 7, sizeof(config));
+    NoteSnapshotRegister(1, &v1, sizeof(v1));
+    NoteSnapshotRegister(2, config, sizeof(config));
+    NoteSnapshotRegister(3, large, sizeof(large));
+    v1.count = 42;
+    v1.mean[3] = 1.5f;
+    CHECK(NoteSnapshotSleep(1, 60, NULL));
+    printf("snapshot: %zu characters, against %d for all of the state\n", strlen(held), JB64EncodeLen(sizeof(v1) + sizeof(config) + sizeof(large)));
+    CHECK(strlen(held) < (size_t) JB64EncodeLen(sizeof(v1)) + 32);
+
+    // Version 2 wakes, and keeps what was saved while its new field keeps the value it was initialized to
+    memset(&v2, 0, sizeof(v2));
+    v2.added = 99;
+    memset(config, 7, sizeof(config));
+    NoteSnapshotRegister(1, &v2, sizeof(v2));
+    NoteSnapshotRegister(2, config, sizeof(config));
+    NoteSnapshotRegister(3, large, sizeof(large));
+    uint16_t version = 0;
+    CHECK(NoteSnapshotWake(&version) == 1);
+    CHECK(version == 1 && v2.count == 42 && v2.mean[3] == 1.5f && v2.added == 99 && config[5] == 7);
+
+    // A damaged snapshot changes nothing
+    v2.count = 5;
+    CHECK(NoteSnapshotSleep(2, 60, NULL));
+    held[10] ^= 1;
+    v2.count = 0;
+    CHECK(NoteSnapshotWake(&version) == -1);
+    CHECK(v2.count == 0);
+
+    // Nor does the lack of one
+    held[0] = '\0';
+    CHECK(NoteSnapshotWake(&version) == -1);
+
+    // Kept in the host's own buffer, a snapshot must fit, and is restored the same way
+    char buf[128];
+    v2.count = 7;
+    CHECK(NoteSnapshotEncode(3, buf, 8) == -1);
+    int len = NoteSnapshotEncode(3, buf, sizeof(buf));
+    CHECK(len > 0 && len < (int) NoteSnapshotEncodeLen() && (size_t) len == strlen(buf));
+    v2.count = 0;
+    CHECK(NoteSnapshotDecode(buf, &version) == 1);
+    CHECK(version == 3 && v2.count == 7);
+
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+
+    return TEST_RESULT("snapshot");
+}
@@ -0,0 +1,101 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of note-c's automatic registration of templates (n_template.c) against a simulated Notecard, with
+// bodies like the example's, whose optional fields come and go, and with the table of registrations saved
+// and restored across simulated resets.
+
+#include "notecard.h"
+#include "test.h"
+
+static int registrations = 0, notes = 0;
+static NoteTemplateEntry saved[NOTE_TEMPLATE_ENTRIES];
+
+static char *handler(J *req) {
+    if (JIsExactString(req, "req", "note.template"))
+        registrations++;
+    if (JIsExactString(req, "req", "note.add"))
+        notes++;
+    return notecardText("{}");
+}
+
+static void save(const NoteTemplateEntry *entries, int count) {
+    memcpy(saved, entries, count * sizeof(NoteTemplateEntry));
+}
+
+// A body like the example's, with the button's fields only when it was pressed, and the summary's only
+// when there was something to summarize
+static void add(const char *file, bool button, bool summary, const char *extra) {
+    J *body = JCreateObject();
+    JAddNumberToObject(body, "count", 7);
+    JAddNumberToObject(body, "temp", 21.5);
+    if (button) {
+        JAddBoolToObject(body, "button", true);
+        JAddNumberToObject(body, "presses", 2);
+    }
+    if (summary) {
+        JAddNumberToObject(body, "temp_min", 20);
+        JAddNumberToObject(body, "temp_max", 23);
+    }
+    if (extra != NULL)
+        JAddStringToObject(body, extra, "on");
+    CHECK(NoteAdd(file, body, false));
+}
+
+// A reset, after which the table is restored from what was saved
+static void reset() {
+    NoteTemplateRestore(saved, NOTE_TEMPLATE_ENTRIES);
+}
+
+int main() {
+    notecardBegin(handler);
+    NoteSetAutoTemplate(true, save);
+
+    // The template widens as the optional fields first appear, and then settles
+    add("data.qo", false, false, NULL);
+    add("data.qo", true, false, NULL);
+    add("data.qo", false, true, NULL);
+    add("data.qo", true, true, NULL);
+    add("data.qo", false, false, NULL);
+    CHECK(registrations == 3 && notes == 5);
+
+    // After a reset, bodies without the optional fields are covered by what was registered, and once they
+    // have all been seen again the template is known, all without registering it again
+    for (int i=0; i<3; i++) {
+        reset();
+        add("data.qo", false, false, NULL);
+        add("data.qo", false, true, NULL);
+        add("data.qo", true, false, NULL);
+        add("data.qo", true, true, NULL);
+        add("data.qo", false, false, NULL);
+    }
+    CHECK(registrations == 3);
+
+    // A body with a field that wasn't registered before the reset is registered as soon as it's seen, even
+    // while the template is still provisional, when the field makes it wider than the registered one
+    reset();
+    add("data.qo", true, true, "mode");
+    CHECK(registrations == 4);
+    add("data.qo", false, false, NULL);
+    CHECK(registrations == 4);
+
+    // As is a body with as many fields as the registered template, but not the same ones
+    reset();
+    add("data.qo", true, true, "fan");
+    CHECK(registrations == 5);
+
+    // A second Notefile has its own entry, and both survive a reset
+    add("other.qo", false, false, NULL);
+    CHECK(registrations == 6);
+    reset();
+    add("other.qo", false, false, NULL);
+    add("data.qo", true, true, "fan");
+    CHECK(registrations == 6);
+
+    NoteTemplateRestore(NULL, 0);
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+    return TEST_RESULT("template");
+}
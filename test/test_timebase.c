@@ -0,0 +1,168 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of the tickless time base in Src/timebase.c against a simulated LPTIM1.  As on the hardware, the
+// counter free-runs through 16 bits, the autoreload match flag is set during the tick in which the counter
+// sits at its maximum, and the compare match flag during the tick in which it equals the compare register.
+
+#include <string.h>
+#include "main.h"
+#include "timebase.h"
+#include "test.h"
+
+// The simulated timer
+static uint64_t simTicks = 0;
+static uint16_t simCounter = 0;
+static uint16_t simCompare = TIMEBASE_COUNTER_MAX;
+static bool simARRM = false;
+static bool simCMPM = false;
+static int simReads = 0;
+
+// A deadline, as the event handler keeps it
+static bool pollArmed = false;
+static uint32_t pollDeadlineMs = 0;
+static uint64_t pollFiredTicks = 0;
+
+static void simTick() {
+    simReads = 0;
+    simTicks++;
+    simCounter = (uint16_t) (simCounter + 1);
+    if (simCounter == TIMEBASE_COUNTER_MAX)
+        simARRM = true;
+    if (simCounter == simCompare)
+        simCMPM = true;
+}
+
+// The counter runs on while it is being read, so a loop that waits for it to move sees it move
+uint16_t MY_TimerCounter(bool *overflowPending) {
+    if (simReads++ > 0 && simCounter == TIMEBASE_COUNTER_MAX)
+        simTick();
+    *overflowPending = simARRM;
+    return simCounter;
+}
+
+void MY_TimerSetCompare(uint16_t ticks) {
+    simCompare = ticks;
+}
+
+static void poll() {
+    if (pollArmed && (int32_t) (timebaseMs() - pollDeadlineMs) >= 0) {
+        pollArmed = false;
+        timebaseCancelDeadline();
+        pollFiredTicks = simTicks;
+    }
+}
+
+// Service pending interrupts in the order that the HAL's handler does, unless they are masked
+static void simService() {
+    if (__get_PRIMASK())
+        return;
+    if (simCMPM) {
+        irqEnter();
+        simCMPM = false;
+        poll();
+        irqExit();
+    }
+    if (simARRM) {
+        irqEnter();
+        simARRM = false;
+        if (timebaseOverflow())
+            poll();
+        irqExit();
+    }
+}
+
+static void simAdvance(uint64_t ticks) {
+    while (ticks-- > 0) {
+        simTick();
+        simService();
+    }
+}
+
+// Set a deadline a number of milliseconds away and run until it fires, returning how many ticks late it
+// was, or -1 if it didn't fire within a second of being due
+static int64_t deadlineLateness(uint32_t deltaMs) {
+    pollDeadlineMs = timebaseMs() + deltaMs;
+    pollArmed = true;
+    uint64_t dueTicks = (uint64_t) (timebaseTicks() >> TIMEBASE_TICKS_PER_MS_SHIFT << TIMEBASE_TICKS_PER_MS_SHIFT) + ((uint64_t) deltaMs << TIMEBASE_TICKS_PER_MS_SHIFT);
+    if (dueTicks < simTicks)
+        dueTicks = simTicks;
+    if (timebaseSetDeadline(pollDeadlineMs))
+        poll();
+    uint64_t limit = dueTicks + TIMEBASE_HZ;
+    while (pollArmed && simTicks < limit)
+        simAdvance(1);
+    if (pollArmed)
+        return -1;
+    return (int64_t) pollFiredTicks - (int64_t) dueTicks;
+}
+
+int main() {
+
+    // The time base matches the true time on every tick over several passes through the counter
+    bool exact = true;
+    for (int i=0; i<5*65536; i++) {
+        simAdvance(1);
+        if (timebaseTicks() != simTicks)
+            exact = false;
+    }
+    CHECK(exact);
+    CHECK(timebaseMs() == (uint32_t) (simTicks / 32));
+    CHECK(timebaseUs() == simTicks * 1000000 / TIMEBASE_HZ);
+
+    // With interrupts masked across a wrap, the pending overflow is accounted for
+    simAdvance(65536 - simCounter - 100);
+    __disable_irq();
+    for (int i=0; i<200; i++)
+        simTick();
+    CHECK(simARRM);
+    CHECK(timebaseTicks() == simTicks);
+    __enable_irq();
+    simService();
+    CHECK(timebaseTicks() == simTicks);
+
+    // In the tick during which the counter sits at its maximum, the wrap is already flagged but hasn't
+    // happened, and the time base mustn't read a whole pass ahead, whether or not it has been serviced
+    simAdvance(65535 - simCounter - 1);
+    __disable_irq();
+    simTick();
+    CHECK(simCounter == TIMEBASE_COUNTER_MAX && simARRM);
+    uint64_t ticks = timebaseTicks();
+    CHECK(ticks == simTicks);
+    __enable_irq();
+    simService();
+    simAdvance(65535 - simCounter - 1);
+    simTick();
+    CHECK(simCounter == TIMEBASE_COUNTER_MAX);
+    irqEnter();
+    simARRM = false;
+    timebaseOverflow();
+    irqExit();
+    ticks = timebaseTicks();
+    CHECK(ticks == simTicks);
+
+    // Deadlines fire within the compare margin of when they are due, whether they fall in this pass
+    // through the counter or in a later one, or are already due
+    static const uint32_t deltas[] = {0, 1, 2, 7, 100, 1000, 2047, 2048, 2049, 4095, 4097, 10000, 60000};
+    for (int start=0; start<4; start++) {
+        simAdvance(12345 + start * 16411);
+        for (size_t i=0; i<sizeof(deltas)/sizeof(deltas[0]); i++) {
+            int64_t late = deadlineLateness(deltas[i]);
+            if (late < 0 || late > TIMEBASE_COMPARE_MARGIN + 1)
+                printf("deadline +%ums fired %lld ticks late\n", (unsigned) deltas[i], (long long) late);
+            CHECK(late >= 0 && late <= TIMEBASE_COMPARE_MARGIN + 1);
+        }
+    }
+
+    // Idle, the compare is parked on the overflow, so that the timer interrupts only once per pass
+    CHECK(simCompare == TIMEBASE_COUNTER_MAX);
+
+    // After a sleep that restarted us from reset, the time base moves on by whole passes to at least
+    // where it would have been
+    uint32_t before = timebaseMs();
+    timebaseResume(before + 900000);
+    CHECK(timebaseMs() >= before + 900000 && timebaseMs() < before + 900000 + 2048 + 1);
+
+    return TEST_RESULT("timebase");
+}
@@ -0,0 +1,162 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of note-c's transaction trace (n_trace.c), built with NOTE_TRACE, against a simulated Notecard on a
+// serial link that takes a millisecond per byte each way, and that takes a while to begin each reply, so
+// that every phase of a transaction takes a known time.  The entries recorded for a transaction, their
+// summaries per phase, the wrapping of the ring, and the dump to the debug output are all checked.
+
+#include "notecard.h"
+#include "test.h"
+
+#define LATENCY_MS      20
+
+static unsigned long replyMs = 0;
+static bool silent = false;
+static int replyLen = 11;
+
+// The link, which takes a millisecond per byte, and a Notecard that takes a while to reply
+static void linkTransmit(uint8_t *data, size_t len, bool flush) {
+    notecardMs += len;
+    replyMs = notecardMs + LATENCY_MS;
+    notecardSerialTransmit(data, len, flush);
+}
+
+static bool linkAvailable() {
+    return notecardMs >= replyMs && notecardSerialAvailable();
+}
+
+static char linkReceive() {
+    notecardMs++;
+    return notecardSerialReceive();
+}
+
+// A reply of a given length, not including its newline, or none at all
+static char *handler(J *req) {
+    if (JIsExactString(req, "req", "card.version"))
+        return notecardText("{\"version\":\"notecard-1.0\"}");
+    if (silent)
+        return NULL;
+    char *rsp = malloc(replyLen + 1);
+    int len = sprintf(rsp, "{\"total\":1");
+    while (len < replyLen - 1)
+        rsp[len++] = ' ';
+    strcpy(&rsp[len], "}");
+    return rsp;
+}
+
+// The debug output, captured
+static char debug[8192];
+static size_t debugLen = 0;
+
+static size_t debugOutput(const char *text) {
+    size_t len = strlen(text);
+    if (debugLen + len < sizeof(debug)) {
+        memcpy(&debug[debugLen], text, len + 1);
+        debugLen += len;
+    }
+    return len;
+}
+
+static bool transact(const char *body) {
+    J *req = NoteNewRequest("note.add");
+    JAddItemToObject(req, "body", JParse(body));
+    return NoteRequest(req);
+}
+
+int main() {
+    notecardBegin(handler);
+    NoteSetFnSerial(notecardSerialReset, linkTransmit, linkAvailable, linkReceive);
+
+    // The first transaction resets the link, which isn't traced
+    CHECK(NoteRequest(NoteNewRequest("card.version")));
+    NoteTraceClear();
+    CHECK(NoteTraceCount() == 0);
+
+    // A transaction records each of its phases in order, under one sequence number, with the bytes that
+    // each moved and the time that each took
+    const char *body = "{\"temp\":21.5}";
+    unsigned long beganMs = notecardMs;
+    CHECK(transact(body));
+    int count = NoteTraceCount();
+    CHECK(count == 6);
+    NoteTraceEntry entries[6];
+    for (int i=0; i<count && i<6; i++)
+        CHECK(NoteTraceGet(i, &entries[i]));
+    CHECK(!NoteTraceGet(count, &entries[0]) && !NoteTraceGet(-1, &entries[0]));
+    static const int order[6] = { NOTE_TRACE_PRINT, NOTE_TRACE_SEND, NOTE_TRACE_WAIT, NOTE_TRACE_RECEIVE, NOTE_TRACE_IO, NOTE_TRACE_PARSE };
+    for (int i=0; i<6; i++)
+        CHECK(entries[i].event == order[i] && entries[i].seq == entries[0].seq && entries[i].err == NULL);
+    uint32_t requestLen = entries[0].bytes;
+    CHECK(requestLen == strlen("{\"req\":\"note.add\",\"body\":{\"temp\":21.5}}"));
+    CHECK(entries[1].bytes == requestLen && entries[1].durationMs == requestLen + c_newline_len);
+    CHECK(entries[2].durationMs >= LATENCY_MS && entries[2].durationMs < LATENCY_MS + 10);
+    CHECK(entries[3].bytes == (uint32_t) replyLen + 1 && entries[3].durationMs == (uint32_t) replyLen + 1);
+    CHECK(entries[4].durationMs == entries[1].durationMs + entries[2].durationMs + entries[3].durationMs);
+    CHECK(entries[0].startMs == beganMs && entries[4].startMs == beganMs);
+
+    // A request long enough to be sent in segments records the pauses between them apart from the sending
+    char longBody[600];
+    int len = sprintf(longBody, "{\"text\":\"");
+    while (len < 500)
+        longBody[len++] = 'x';
+    strcpy(&longBody[len], "\"}");
+    NoteTraceClear();
+    CHECK(transact(longBody));
+    NoteTraceSummary summary;
+    CHECK(NoteTraceSummarize(NOTE_TRACE_DELAY, &summary));
+    CHECK(summary.count == 1 && summary.maxMs == 2 * CARD_REQUEST_SERIAL_SEGMENT_DELAY_MS);
+    CHECK(NoteTraceSummarize(NOTE_TRACE_SEND, &summary));
+    CHECK(summary.maxMs < 600);
+
+    // Replies of five different lengths summarize by nearest rank
+    NoteTraceClear();
+    for (int i=1; i<=5; i++) {
+        replyLen = 10 + i;
+        CHECK(transact(body));
+    }
+    CHECK(NoteTraceSummarize(NOTE_TRACE_RECEIVE, &summary));
+    CHECK(summary.count == 5 && summary.errors == 0);
+    CHECK(summary.p50Ms == 14 && summary.p99Ms == 16 && summary.maxMs == 16);
+    CHECK(summary.bytes == 12 + 13 + 14 + 15 + 16);
+    CHECK(!NoteTraceSummarize(NOTE_TRACE_DELAY, &summary) && summary.count == 0);
+
+    // Only the most recent entries are kept, oldest first
+    for (int i=0; i<3; i++)
+        CHECK(transact(body));
+    CHECK(NoteTraceCount() == NOTE_TRACE_ENTRIES);
+    NoteTraceEntry oldest, newest;
+    CHECK(NoteTraceGet(0, &oldest) && NoteTraceGet(NOTE_TRACE_ENTRIES-1, &newest));
+    CHECK(newest.event == NOTE_TRACE_PARSE && newest.seq - oldest.seq == (NOTE_TRACE_ENTRIES - 1) / 6);
+    CHECK(NoteTraceSummarize(NOTE_TRACE_RECEIVE, &summary) && summary.count < 8);
+
+    // A Notecard that doesn't reply is recorded as an error in the wait
+    replyLen = 11;
+    NoteTraceClear();
+    silent = true;
+    CHECK(!transact(body));
+    silent = false;
+    CHECK(NoteTraceSummarize(NOTE_TRACE_WAIT, &summary));
+    CHECK(summary.errors >= 1 && summary.maxMs >= NOTECARD_TRANSACTION_TIMEOUT_SEC * 1000);
+    CHECK(NoteTraceSummarize(NOTE_TRACE_IO, &summary) && summary.errors >= 1);
+
+    // The dump lists each entry and then a summary of each phase that was seen
+    NoteTraceClear();
+    CHECK(transact(body));
+    NoteSetFnDebugOutput(debugOutput);
+    NoteTraceDump();
+    NoteSetFnDebugOutput(NULL);
+    char line[64];
+    NoteTraceGet(0, &entries[0]);
+    snprintf(line, sizeof(line), "trace %u print @%lu 0ms %ub\n", entries[0].seq, (unsigned long) entries[0].startMs, (unsigned) entries[0].bytes);
+    CHECK(strstr(debug, line) != NULL);
+    CHECK(strstr(debug, "trace wait n:1 p50:20ms p99:20ms max:20ms err:0\n") != NULL);
+    CHECK(strstr(debug, "trace recv n:1 p50:12ms p99:12ms max:12ms err:0\n") != NULL);
+    CHECK(strstr(debug, "trace delay") == NULL);
+
+    NoteMemStats mem;
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+    return TEST_RESULT("trace");
+}
@@ -0,0 +1,112 @@
+// Copyright 2018 Blues Inc.  All rights reserved.
+// Use of this source code is governed by licenses granted by the
+// copyright holder including that found in the LICENSE file.
+
+// Tests of note-c's chunked upload of large blobs (n_upload.c) against a simulated Notecard that
+// reassembles the web.post fragments, and that can be made to fail them in the ways that a real
+// network does.
+
+#include "notecard.h"
+#include "test.h"
+
+#define BLOB_LEN        70000
+#define SMALL_LEN       4000
+#define READ_FAIL_AT    20000
+
+static uint8_t blob[BLOB_LEN];
+static uint8_t rebuilt[BLOB_LEN];
+static uint32_t posted = 0;
+static int failEvery = 0, failCount = 0;
+static bool failWithStatus = false;
+static uint32_t readFailAt = 0xffffffff;
+
+// Reassemble each fragment at its offset, unless this is a fragment to fail, either with a Notecard error
+// or with an HTTP status
+static char *handler(J *req) {
+    if (!JIsExactString(req, "req", "web.post"))
+        return notecardText("{}");
+    posted++;
+    if (failEvery != 0 && (++failCount % failEvery) == 0)
+        return notecardText(failWithStatus ? "{\"result\":503}" : "{\"err\":\"network busy {busy}\"}");
+    const char *payload = JGetString(req, "payload");
+    uint32_t offset = (uint32_t) JGetNumber(req, "offset");
+    uint32_t total = (uint32_t) JGetNumber(req, "total");
+    if (total != BLOB_LEN && total != SMALL_LEN)
+        return notecardText("{\"err\":\"bad total\"}");
+    int len = JB64DecodeExactLen(payload);
+    if (offset + len > BLOB_LEN)
+        return notecardText("{\"err\":\"past the end\"}");
+    JB64Decoder dec;
+    JB64DecodeStart(&dec);
+    JB64DecodeUpdate(&dec, &rebuilt[offset], len, payload, strlen(payload));
+    return notecardText("{\"result\":200}");
+}
+
+// A reader that fails at a given offset, as a flash read might
+static uint32_t readFailing(void *context, uint32_t offset, void *buf, uint32_t len) {
+    if (offset >= readFailAt)
+        return 0;
+    return NoteUploadReadMemory(context, offset, buf, len);
+}
+
+int main() {
+    notecardBegin(handler);
+    for (int i=0; i<BLOB_LEN; i++)
+        blob[i] = (uint8_t) (i*131 + 7);
+    NoteUpload upload;
+    NoteMemStats mem;
+
+    // A blob smaller than a fragment goes in one post
+    NoteUploadBegin(&upload, "route1", "cap.bin", SMALL_LEN, NoteUploadReadMemory, blob);
+    CHECK(NoteUploadRun(&upload));
+    CHECK(upload.offset == SMALL_LEN);
+    CHECK(memcmp(rebuilt, blob, SMALL_LEN) == 0);
+    CHECK(posted == (SMALL_LEN + NOTE_UPLOAD_CHUNK_LEN - 1) / NOTE_UPLOAD_CHUNK_LEN);
+
+    // A large blob arrives intact despite every fourth post failing, each failure costing one retry, and
+    // the RAM used is bounded by the fragment rather than the blob: its encoding, the printed request
+    // around it, and the reply
+    memset(rebuilt, 0, sizeof(rebuilt));
+    posted = 0;
+    failEvery = 4;
+    NoteResetMemStats();
+    NoteUploadBegin(&upload, "route1", NULL, BLOB_LEN, NoteUploadReadMemory, blob);
+    CHECK(NoteUploadRun(&upload));
+    NoteGetMemStats(&mem);
+    uint32_t fragments = (BLOB_LEN + NOTE_UPLOAD_CHUNK_LEN - 1) / NOTE_UPLOAD_CHUNK_LEN;
+    printf("upload: %u bytes in %u fragments took %u posts, peak heap %u bytes\n", BLOB_LEN, fragments, posted, (unsigned) mem.highWaterBytes);
+    CHECK(upload.offset == BLOB_LEN);
+    CHECK(memcmp(rebuilt, blob, BLOB_LEN) == 0);
+    CHECK(posted == fragments + (posted / 4));
+    CHECK(mem.highWaterBytes < 5 * NOTE_UPLOAD_CHUNK_LEN);
+
+    // A read that fails stops the upload where it got to
+    memset(rebuilt, 0, sizeof(rebuilt));
+    failEvery = 0;
+    readFailAt = READ_FAIL_AT;
+    NoteUploadBegin(&upload, "route1", NULL, BLOB_LEN, readFailing, blob);
+    CHECK(!NoteUploadRun(&upload));
+    CHECK(upload.offset > 0 && upload.offset <= READ_FAIL_AT);
+    CHECK(memcmp(rebuilt, blob, upload.offset) == 0);
+
+    // As does a post that keeps failing with an HTTP error, after its retries, without losing its place
+    uint32_t stoppedAt = upload.offset;
+    readFailAt = 0xffffffff;
+    failEvery = 1;
+    failWithStatus = true;
+    posted = 0;
+    CHECK(!NoteUploadRun(&upload));
+    CHECK(upload.offset == stoppedAt);
+    CHECK(posted == NOTE_UPLOAD_RETRIES);
+
+    // And once the failures clear, the upload resumes from there and completes
+    failEvery = 0;
+    CHECK(NoteUploadRun(&upload));
+    CHECK(NoteUploadComplete(&upload));
+    CHECK(memcmp(rebuilt, blob, BLOB_LEN) == 0);
+
+    NoteGetMemStats(&mem);
+    CHECK(mem.liveBytes == 0);
+
+    return TEST_RESULT("upload");
+}